@@ -0,0 +1,220 @@
+/***********************************************************************
+* ANSI screen renderer
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* ANSI screen renderer
+*
+* This file is linkable to a program.
+* The caller keeps its own display memory, converts it into an image
+* of ANSI_ROWS x ANSI_COLS cells and hands it over. The renderer sends
+* only the runs of cells that changed since the last call, using the
+* shortest cursor motion it knows, all into one buffer.
+*
+* The last cell of the last row is never written, the terminal would
+* scroll.
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ansiscreen.h"
+
+#define	GAP	4	// unchanged cells between changes are simply rewritten
+#define	CELLMAX	32	// buffer room needed for one cell incl. motion and attributes
+
+/***********************************************************************
+* append a string
+***********************************************************************/
+static char *put(char *p, const char *s) {
+	while (*s)
+		*p++ = *s++;
+	return p;
+}
+
+/***********************************************************************
+* move terminal cursor, shortest sequence wins
+***********************************************************************/
+static char *moveto(ANSISCREEN_T *s, char *p, int row, int col) {
+	char abs[32], rel[32];
+	int n, alen, rlen = sizeof rel;
+
+	if (s->row == row && s->col == col)
+		return p;
+	alen = sprintf(abs, "\033[%d;%dH", row+1, col+1);
+	if (s->row == row && s->col >= 0) {
+		n = s->col - col;
+		if (col == 0)
+			rlen = sprintf(rel, "\r");
+		else if (n > 0 && n <= GAP)
+			rlen = sprintf(rel, "%.*s", n, "\b\b\b\b\b\b\b\b");
+		else if (n > 0)
+			rlen = sprintf(rel, "\033[%dD", n);
+		else
+			rlen = sprintf(rel, "\033[%dC", -n);
+	} else if (s->row >= 0 && s->row + 1 == row && col == 0) {
+		rlen = sprintf(rel, "\r\n");
+	}
+	p = put(p, rlen < alen ? rel : abs);
+	s->row = row;
+	s->col = col;
+	return p;
+}
+
+/***********************************************************************
+* set terminal highlight
+***********************************************************************/
+static char *setattr(ANSISCREEN_T *s, const ANSISTYLE_T *st, char *p, int attr) {
+	if (s->attr != attr) {
+		p = put(p, attr ? st->attron : st->attroff);
+		s->attr = attr;
+	}
+	return p;
+}
+
+/***********************************************************************
+* write one cell at the cursor
+***********************************************************************/
+static char *putcell(ANSISCREEN_T *s, const ANSISTYLE_T *st, char *p, unsigned short cell) {
+	const char *g = NULL;
+
+	p = setattr(s, st, p, (cell & ANSI_ATTR) != 0);
+	if (st->glyph)
+		g = st->glyph(cell & ANSI_CHAR);
+	if (g)
+		p = put(p, g);
+	else
+		*p++ = cell & ANSI_CHAR;
+	// behind the last column the cursor position is terminal specific
+	if (++s->col >= ANSI_COLS)
+		s->row = s->col = -1;
+	return p;
+}
+
+/***********************************************************************
+* ANSI Screen Init
+* the terminal content is unknown, first render clears it
+***********************************************************************/
+void ansiscreen_init(ANSISCREEN_T *s) {
+	memset(s, 0, sizeof *s);
+	ansiscreen_invalidate(s);
+}
+
+/***********************************************************************
+* ANSI Screen Invalidate
+* next render clears and repaints all
+***********************************************************************/
+void ansiscreen_invalidate(ANSISCREEN_T *s) {
+	s->clear = 1;
+	s->scroll = 0;
+	s->attr = -1;
+	ansiscreen_forget_cursor(s);
+}
+
+/***********************************************************************
+* ANSI Screen Forget Cursor
+* something else has written to the terminal
+***********************************************************************/
+void ansiscreen_forget_cursor(ANSISCREEN_T *s) {
+	s->row = s->col = -1;
+}
+
+/***********************************************************************
+* ANSI Screen Scroll
+* the caller's image moved up one line, let the terminal do the same
+***********************************************************************/
+void ansiscreen_scroll(ANSISCREEN_T *s) {
+	if (++s->scroll >= ANSI_ROWS)
+		ansiscreen_invalidate(s);
+}
+
+/***********************************************************************
+* ANSI Screen Render
+* writes the sequences to make the terminal show img with the cursor
+* at row/col into buf
+* returns number of bytes, call again while that is not 0
+***********************************************************************/
+int ansiscreen_render(ANSISCREEN_T *s, const ANSISTYLE_T *st,
+	const unsigned short *img, int row, int col, char *buf, int len) {
+	char *p = buf, *end = buf + len - CELLMAX;
+	const unsigned short *im;
+	unsigned short *sh;
+	int r, c, e, k, gap, last, tail;
+
+	if (s->clear) {
+		p = setattr(s, st, p, 0);
+		p = put(p, "\033[H\033[2J");
+		for (k = 0; k < ANSI_ROWS*ANSI_COLS; k++)
+			s->shadow[k] = ' ';
+		s->row = s->col = 0;
+		s->clear = 0;
+	}
+
+	// scroll, new lines appear with normal attributes
+	while (s->scroll > 0) {
+		if (p >= end)
+			return p - buf;
+		p = moveto(s, p, ANSI_ROWS-1, 0);
+		p = setattr(s, st, p, 0);
+		*p++ = '\n';
+		memmove(s->shadow, s->shadow + ANSI_COLS, (ANSI_ROWS-1)*ANSI_COLS*sizeof s->shadow[0]);
+		for (k = (ANSI_ROWS-1)*ANSI_COLS; k < ANSI_ROWS*ANSI_COLS; k++)
+			s->shadow[k] = ' ';
+		s->scroll--;
+	}
+
+	for (r = 0; r < ANSI_ROWS; r++) {
+		im = img + r*ANSI_COLS;
+		sh = s->shadow + r*ANSI_COLS;
+		last = r == ANSI_ROWS-1 ? ANSI_COLS-1 : ANSI_COLS;
+		// blank part at the end of the line
+		tail = last;
+		while (tail > 0 && im[tail-1] == ' ')
+			tail--;
+		c = 0;
+		while (c < last) {
+			if (im[c] == sh[c]) {
+				c++;
+				continue;
+			}
+			if (p >= end)
+				return p - buf;
+			if (c >= tail) {
+				// only blanks follow, erase to end of line
+				p = moveto(s, p, r, c);
+				p = setattr(s, st, p, 0);
+				p = put(p, "\033[K");
+				for (k = c; k < last; k++)
+					sh[k] = ' ';
+				break;
+			}
+			// find end of this run, short unchanged gaps are included
+			for (e = c + 1, gap = 0; e + gap < last && gap <= GAP; ) {
+				if (im[e+gap] != sh[e+gap]) {
+					e += gap + 1;
+					gap = 0;
+				} else {
+					gap++;
+				}
+			}
+			p = moveto(s, p, r, c);
+			for (; c < e; c++) {
+				if (p >= end)
+					return p - buf;
+				p = putcell(s, st, p, im[c]);
+				sh[c] = im[c];
+			}
+		}
+	}
+
+	// finally the cursor
+	if (row >= 0 && row < ANSI_ROWS && col >= 0 && col < ANSI_COLS)
+		p = moveto(s, p, row, col);
+	return p - buf;
+}
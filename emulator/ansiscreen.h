@@ -0,0 +1,62 @@
+/***********************************************************************
+* ANSI screen renderer
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* ANSI screen renderer
+*
+* keeps a shadow copy of what the remote ANSI terminal displays and
+* only sends the cells that differ from the wanted image
+*
+* an image cell is the character in the low 8 bits plus attribute bits,
+* the character is translated by the glyph function of the style
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#ifndef	_ANSISCREEN_H_
+#define	_ANSISCREEN_H_
+
+#define	ANSI_ROWS	25
+#define	ANSI_COLS	80
+
+// image cell bits
+#define	ANSI_CHAR	0x00ff	// character
+#define	ANSI_ATTR	0x0100	// highlighted (style decides how)
+
+/***********************************************************************
+* how the image is shown
+***********************************************************************/
+typedef struct ansistyle {
+	const char	*attron;	// switch highlight on
+	const char	*attroff;	// switch highlight off
+	// display string of a character, NULL: the character itself
+	const char	*(*glyph)(int ch);
+} ANSISTYLE_T;
+
+/***********************************************************************
+* what the terminal shows
+***********************************************************************/
+typedef struct ansiscreen {
+	unsigned short	shadow[ANSI_ROWS*ANSI_COLS];
+	int		row, col;	// terminal cursor, -1 = unknown
+	int		attr;		// terminal highlight, -1 = unknown
+	int		clear;		// clear screen on next render
+	int		scroll;		// lines to scroll up on next render
+} ANSISCREEN_T;
+
+/***********************************************************************
+* the methods
+***********************************************************************/
+extern void ansiscreen_init(ANSISCREEN_T *s);
+extern void ansiscreen_invalidate(ANSISCREEN_T *s);
+extern void ansiscreen_forget_cursor(ANSISCREEN_T *s);
+extern void ansiscreen_scroll(ANSISCREEN_T *s);
+extern int ansiscreen_render(ANSISCREEN_T *s, const ANSISTYLE_T *st,
+	const unsigned short *img, int row, int col, char *buf, int len);
+
+#endif	/*_ANSISCREEN_H_*/
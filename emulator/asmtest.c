@@ -0,0 +1,573 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* assembler and regression runner for the testing/ sources (*.asm)
+*
+* Assembles each source file into memory with the instruction table,
+* runs it on the processor core alone and checks the .VFY register
+* expectations. There are no devices, no I/O units and no timer, main
+* memory and central control are private to this program.
+*
+* usage: asmtest [-n <count>] [-l <limit>] [-v] <file.asm> ...
+*   -n	assemble and run each file this often, for the timing
+*   -l	instructions a .RUN may take before it counts as hung
+*   -v	list every .RUN and .VFY
+*
+* Source lines:
+*	<mnemonic> [<operand>]	[# comment]
+* Operands are numbers (leading 0 for octal), for LITC/OPDC/DESC also
+* R+n, F+n, F-n and C+n, for .WORD also "text" of up to 8 characters.
+* A branch with an operand gets a LITC of the operand in front.
+*
+* Pseudo instructions:
+*	.ORG <addr>		continue assembling at addr, the next
+*				.RUN starts there
+*	.WORD <value>		one word
+*	.SYLL <value>		one syllable
+*	.SET <reg> <value>	set a processor register
+*	.RUN			run until the processor halts, executes
+*				a ZPI (in any state) or takes an
+*				interrupt in normal state, there is no
+*				MCP to handle it
+*	.VFY <reg> <value>	check a processor register
+*	.END			end of the source
+*
+* Exit code 0 if all files pass, 1 if one fails, 2 for usage errors.
+* A program that does I/O is skipped, there are no devices. A file
+* without any .VFY is reported as NONE, it ran but proves nothing.
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "common.h"
+#include "telemetry.h"
+#include "machine.h"
+
+#define	LINELEN		200
+#define	RUNLIMIT	1000000		// default instructions per .RUN
+#define	ZPI		02411
+
+/***********************************************************************
+* the machine, without shared memory
+***********************************************************************/
+__thread MACHINE *machine;
+__thread volatile WORD48 *MAIN;
+__thread CPU *P[2];
+__thread volatile CENTRAL_CONTROL *CC;
+__thread IOCU *IO[4];
+__thread TELEMETRY_T *TM;
+static MACHINE m;
+
+int dotrcmem;
+int dotrcins;
+
+/***********************************************************************
+* state of the current file
+***********************************************************************/
+static const char *filename;
+static int lineno;
+static ADDR15 loc;		// assembly location, word
+static unsigned syll;		// and syllable 0..3
+static ADDR15 runaddr;		// start of the next .RUN
+static BIT runnew;		// .ORG since the last .RUN
+static BIT zpi_seen;		// the current instruction is a ZPI
+static BIT io_seen;		// the program tried an I/O
+static unsigned runs, checks, errors;
+static double runtime;		// seconds spent in .RUN
+static unsigned runinstr;	// instructions executed by .RUN
+
+static unsigned runlimit = RUNLIMIT;
+static int verbose;
+
+/***********************************************************************
+* processor callbacks and what the core needs from central control
+***********************************************************************/
+void sim_traceinstr(CPU *cpu) {
+	zpi_seen = cpu->rT == ZPI;
+}
+
+void initiateIO(CPU *cpu) {
+	io_seen = true;
+	cpu->bHLTF = true;
+}
+
+WORD48 interrogateIOChannel(CPU *cpu) {
+	return 1;
+}
+
+WORD48 interrogateUnitStatus(CPU *cpu) {
+	return 0;
+}
+
+WORD48 readTimer(CPU *cpu) {
+	return CC->TM;
+}
+
+void io_complete_taken(int cu) {
+}
+
+void replay_tick(void) {
+}
+
+/***********************************************************************
+* registers for .SET and .VFY
+***********************************************************************/
+typedef struct reg {
+	const char	*name;
+	unsigned	offset;
+	unsigned	size;
+	WORD48		mask;
+} REG_T;
+
+#define	REG(n, f, m)	{n, offsetof(CPU, f), sizeof(((CPU *)0)->f), m}
+
+static const REG_T regs[] = {
+	REG("A", rA, MASK_WORD48),
+	REG("B", rB, MASK_WORD48),
+	REG("C", rC, MASK_ADDR15),
+	REG("F", rF, MASK_ADDR15),
+	REG("GH", rGH, 077),
+	REG("I", rI, 0377),
+	REG("KV", rKV, 077),
+	REG("L", rL, 3),
+	REG("M", rM, MASK_ADDR15),
+	REG("N", rN, 017),
+	REG("P", rP, MASK_WORD48),
+	REG("R", rR, MASK_ADDR15),
+	REG("S", rS, MASK_ADDR15),
+	REG("T", rT, 07777),
+	REG("X", rX, MASK_WORD39),
+	REG("Y", rY, 077),
+	REG("Z", rZ, 077),
+	REG("AROF", bAROF, 1),
+	REG("BROF", bBROF, 1),
+	REG("CWMF", bCWMF, 1),
+	REG("HLTF", bHLTF, 1),
+	REG("MSFF", bMSFF, 1),
+	REG("NCSF", bNCSF, 1),
+	REG("PROF", bPROF, 1),
+	REG("SALF", bSALF, 1),
+	REG("TFFF", bTFFF, 1),
+	REG("TROF", bTROF, 1),
+	REG("VARF", bVARF, 1),
+	REG("isP1", isP1, 1),
+	{NULL, 0, 0, 0},
+};
+
+static const REG_T *find_reg(const char *name) {
+	const REG_T *r;
+
+	for (r = regs; r->name; r++)
+		if (strcasecmp(r->name, name) == 0)
+			return r;
+	return NULL;
+}
+
+static WORD48 get_reg(CPU *cpu, const REG_T *r) {
+	const char *p = (const char *)cpu + r->offset;
+
+	switch (r->size) {
+	case 1:	return *(const unsigned char *)p;
+	case 2:	return *(const unsigned short *)p;
+	case 4:	return *(const unsigned *)p;
+	default: return *(const WORD48 *)p;
+	}
+}
+
+static void set_reg(CPU *cpu, const REG_T *r, WORD48 v) {
+	char *p = (char *)cpu + r->offset;
+
+	v &= r->mask;
+	switch (r->size) {
+	case 1:	*(unsigned char *)p = v; break;
+	case 2:	*(unsigned short *)p = v; break;
+	case 4:	*(unsigned *)p = v; break;
+	default: *(WORD48 *)p = v; break;
+	}
+}
+
+/***********************************************************************
+* messages
+***********************************************************************/
+static void error(const char *msg, const char *arg) {
+	printf("%s:%d: %s %s\n", filename, lineno, msg, arg);
+	errors++;
+}
+
+/***********************************************************************
+* operands
+***********************************************************************/
+static BIT number(const char *s, WORD48 *v) {
+	char *end;
+
+	if (!isdigit(*s))
+		return false;
+	*v = strtoull(s, &end, 0);
+	return *end == 0;
+}
+
+// relative address of LITC/OPDC/DESC, see relsym() in machine.c
+static BIT relative(const char *s, WORD48 *v) {
+	WORD48 n;
+
+	if (number(s, v))
+		return true;
+	if (s[1] != '+' && s[1] != '-')
+		return false;
+	if (!number(s+2, &n))
+		return false;
+	switch (toupper(s[0]) << 8 | s[1]) {
+	case 'R' << 8 | '+':	*v = n & 0777; break;
+	case 'F' << 8 | '+':	*v = 01000 | (n & 0377); break;
+	case 'C' << 8 | '+':	*v = 01400 | (n & 0177); break;
+	case 'F' << 8 | '-':	*v = 01600 | (n & 0177); break;
+	default:		return false;
+	}
+	return true;
+}
+
+// up to 8 characters, blank filled
+static BIT text(const char *s, WORD48 *v) {
+	const char *end;
+	int i;
+
+	if (*s != '"' || (end = strchr(s+1, '"')) == NULL || end - s > 9)
+		return false;
+	*v = 0;
+	for (i = 1; i <= 8; i++)
+		*v = (*v << 6) | translatetable_ascii2bic[(s + i < end ? s[i] : ' ') & 0x7f];
+	return true;
+}
+
+/***********************************************************************
+* code emission
+***********************************************************************/
+static void emit_syll(WORD12 code) {
+	unsigned shift = (3 - syll) * 12;
+
+	MAIN[loc] = (MAIN[loc] & ~((WORD48)07777 << shift)) | ((WORD48)(code & 07777) << shift);
+	if (++syll == 4) {
+		syll = 0;
+		loc = (loc + 1) & MASKMEM;
+	}
+}
+
+static void emit_word(WORD48 w) {
+	if (syll) {
+		syll = 0;
+		loc = (loc + 1) & MASKMEM;
+	}
+	MAIN[loc] = w & MASK_WORD48;
+	loc = (loc + 1) & MASKMEM;
+}
+
+/***********************************************************************
+* .RUN
+***********************************************************************/
+static void do_run(CPU *cpu) {
+	struct timespec t0, t1;
+	unsigned n;
+	BIT irq = false;
+
+	if (runnew) {
+		cpu->rC = runaddr;
+		cpu->rL = 0;
+		cpu->bTROF = false;
+		cpu->bPROF = false;
+		runnew = false;
+	}
+	cpu->bHLTF = false;
+	zpi_seen = false;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (n = 0; n < runlimit && !cpu->bHLTF && !zpi_seen && !irq; n++) {
+		m.instr_count++;
+		irq = cpu->bNCSF;
+		sim_instr(cpu);
+		irq = irq && !cpu->bNCSF;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	runtime += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	runinstr += n;
+	runs++;
+	if (verbose)
+		printf("%s:%d: .RUN %u instructions, stopped at %05o:%o%s\n",
+			filename, lineno, n, cpu->rC, cpu->rL,
+			irq ? " by an interrupt" : "");
+	if (!cpu->bHLTF && !zpi_seen && !irq)
+		error(".RUN did not halt within", "the instruction limit");
+}
+
+/***********************************************************************
+* .SET and .VFY
+***********************************************************************/
+static void do_regval(CPU *cpu, OPTYPE op, const char *name, const char *value) {
+	const REG_T *r = find_reg(name);
+	WORD48 v, got;
+	char buf[80];
+
+	if (r == NULL) {
+		error("unknown register", name);
+		return;
+	}
+	if (!number(value, &v)) {
+		error("bad value", value);
+		return;
+	}
+	if (op == OP_SET) {
+		set_reg(cpu, r, v);
+		return;
+	}
+	checks++;
+	got = get_reg(cpu, r);
+	if (verbose)
+		printf("%s:%d: .VFY %s %llo\n", filename, lineno, r->name, got);
+	if (got != (v & r->mask)) {
+		snprintf(buf, sizeof buf, "%s expected %llo, is %llo", r->name, v & r->mask, got);
+		error(".VFY", buf);
+	}
+}
+
+/***********************************************************************
+* one source line, returns false at .END
+***********************************************************************/
+static BIT assemble(CPU *cpu, char *line) {
+	const INSTRUCTION *ip;
+	char *p, *word[3];
+	int nword = 0;
+	WORD48 v;
+
+	// cut the comment, but not inside "text"
+	for (p = line; *p && *p != '#'; p++)
+		if (*p == '"' && strchr(p+1, '"'))
+			p = strchr(p+1, '"');
+	*p = 0;
+	// words separated by blanks and tabs, "text" is one word
+	for (p = line; nword < 3; ) {
+		while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+			p++;
+		if (*p == 0)
+			break;
+		word[nword++] = p;
+		if (*p == '"' && strchr(p+1, '"'))
+			p = strchr(p+1, '"') + 1;
+		while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+			p++;
+		if (*p)
+			*p++ = 0;
+	}
+	if (nword == 0)
+		return true;
+
+	for (ip = instruction_table; ip->name; ip++)
+		if (strcasecmp(ip->name, word[0]) == 0)
+			break;
+	if (ip->name == NULL) {
+		error("unknown instruction", word[0]);
+		return true;
+	}
+
+	// operands
+	switch (ip->intype) {
+	case OP_NONE:
+		v = 0;
+		break;
+	case OP_EXPR:
+		if (nword < 2 || !(number(word[1], &v) || text(word[1], &v))) {
+			error("bad operand for", word[0]);
+			return true;
+		}
+		break;
+	case OP_RELA:
+		if (nword < 2 || !relative(word[1], &v)) {
+			error("bad operand for", word[0]);
+			return true;
+		}
+		break;
+	case OP_BRAS:
+	case OP_BRAW:
+		// an optional literal of the distance
+		if (nword >= 2) {
+			if (!number(word[1], &v)) {
+				error("bad operand for", word[0]);
+				return true;
+			}
+			emit_syll((v & 01777) << 2);	// LITC
+		}
+		break;
+	case OP_REGVAL:
+		if (nword < 3) {
+			error("register and value needed for", word[0]);
+			return true;
+		}
+		do_regval(cpu, ip->outtype, word[1], word[2]);
+		return true;
+	default:
+		error("unhandled operand type of", word[0]);
+		return true;
+	}
+
+	switch (ip->outtype) {
+	case OP_ORG:
+		loc = runaddr = v & MASKMEM;
+		syll = 0;
+		runnew = true;
+		break;
+	case OP_RUN:
+		do_run(cpu);
+		break;
+	case OP_END:
+		return false;
+	case OP_WORD:
+		emit_word(v);
+		break;
+	case OP_SYLL:
+		emit_syll(v);
+		break;
+	case OP_ASIS:
+	case OP_BRAS:
+	case OP_BRAW:
+		emit_syll(ip->code);
+		break;
+	case OP_TOP4:
+		emit_syll(ip->code | (v << 8));
+		break;
+	case OP_TOP6:
+		emit_syll(ip->code | (v << 6));
+		break;
+	case OP_TOP10:
+		emit_syll(ip->code | (v << 2));
+		break;
+	default:
+		error("unhandled instruction type of", word[0]);
+	}
+	return true;
+}
+
+/***********************************************************************
+* one source file on a cleared machine
+***********************************************************************/
+static int assemble_file(const char *name) {
+	FILE *fp;
+	char line[LINELEN];
+	CPU *cpu = P[0];
+
+	fp = fopen(name, "r");
+	if (fp == NULL) {
+		perror(name);
+		return -1;
+	}
+	filename = name;
+	lineno = 0;
+	loc = runaddr = 0;
+	syll = 0;
+	runnew = true;
+	io_seen = false;
+
+	memset((void *)MAIN, 0, MAXMEM * sizeof(WORD48));
+	memset((void *)CC, 0, sizeof *CC);
+	CC->P2BF = true;
+	CC->HP2F = true;
+	memset(cpu, 0, sizeof *cpu);
+	strcpy((char *)cpu->id, "P1");
+	cpu->acc.id = cpu->id;
+	cpu->isP1 = true;
+
+	while (fgets(line, sizeof line, fp)) {
+		lineno++;
+		if (!assemble(cpu, line) || io_seen)
+			break;
+	}
+	fclose(fp);
+	return 0;
+}
+
+/***********************************************************************
+* the MAIN program
+***********************************************************************/
+int main(int argc, char *argv[]) {
+	unsigned count = 1, i, e, failed = 0, skipped = 0, unchecked = 0;
+	int opt, f;
+
+	while ((opt = getopt(argc, argv, "n:l:v")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtoul(optarg, NULL, 10);
+			break;
+		case 'l':
+			runlimit = strtoul(optarg, NULL, 10);
+			break;
+		case 'v':
+			verbose++;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n <count>] [-l <limit>] [-v] <file.asm> ...\n", argv[0]);
+			exit(2);
+		}
+	}
+	if (optind >= argc || count == 0) {
+		fprintf(stderr, "Usage: %s [-n <count>] [-l <limit>] [-v] <file.asm> ...\n", argv[0]);
+		exit(2);
+	}
+
+	MAIN = (WORD48 *)calloc(MAXMEM, sizeof(WORD48));
+	CC = (CENTRAL_CONTROL *)calloc(1, sizeof(CENTRAL_CONTROL));
+	P[0] = (CPU *)calloc(1, sizeof(CPU));
+	P[1] = (CPU *)calloc(1, sizeof(CPU));
+	for (i = 0; i < 4; i++)
+		IO[i] = (IOCU *)calloc(1, sizeof(IOCU));
+	TM = (TELEMETRY_T *)calloc(1, sizeof(TELEMETRY_T));
+	m.main = MAIN;
+	m.cpu[0] = P[0];
+	m.cpu[1] = P[1];
+	m.cc = CC;
+	for (i = 0; i < 4; i++)
+		m.iocu[i] = IO[i];
+	m.tm = TM;
+	m.tracefp = stdout;
+	machine_bind(&m);
+
+	for (f = optind; f < argc; f++) {
+		runs = checks = errors = runinstr = 0;
+		runtime = 0;
+		for (i = 0; i < count; i++) {
+			e = errors;
+			if (assemble_file(argv[f]) < 0)
+				errors++;
+			// report the errors of the first pass only
+			if (i > 0)
+				errors = e;
+			if (io_seen)
+				break;
+		}
+		if (io_seen) {
+			printf("SKIP %-24s does I/O\n", argv[f]);
+			skipped++;
+			continue;
+		}
+		printf("%s %-24s %u runs, %u checks, %u instructions, %.2f MIPS\n",
+			errors ? "FAIL" : checks ? "PASS" : "NONE", argv[f], runs / count,
+			checks / count, runinstr / count,
+			runtime > 0 ? runinstr / runtime / 1e6 : 0.0);
+		if (errors)
+			failed++;
+		else if (checks == 0)
+			unchecked++;
+	}
+	printf("%d files, %u failed, %u without checks, %u skipped\n",
+		argc - optind, failed, unchecked, skipped);
+	return failed ? 1 : 0;
+}
@@ -111,7 +111,7 @@
 #include <math.h>
 #include <time.h>
 #include <stdio.h>
-extern FILE *tracefp;
+#include "machine.h"
 
 const t_uint64 bit_mask[64] = {
         00000000000000001LL,
@@ -3503,18 +3503,18 @@ control:
                 case VARIANT(WMOP_LLL): /* Link List Look-up */
                         AB_valid(cpu);
 			if (dotrcins)
-				fprintf(tracefp, "*\tLLL A=%016llo B=%016llo\n", A, B);
+				fprintf(machine->tracefp, "*\tLLL A=%016llo B=%016llo\n", A, B);
                         A = MANT ^ A;
                         do {
                             M = CF(B);
                             memory_cycle(cpu, 5); /* B=[M] */
 				if (dotrcins)
-					fprintf(tracefp, "*\t    A=%016llo B=%016llo\n", A, B);
+					fprintf(machine->tracefp, "*\t    A=%016llo B=%016llo\n", A, B);
                             temp = (B & MANT) + (A & MANT);
                         } while ((temp & EXPO) == 0);
                         A = FLAG | PRESENT | toC(M);
 			if (dotrcins)
-				fprintf(tracefp, "*\t    A=%016llo END\n", A);
+				fprintf(machine->tracefp, "*\t    A=%016llo END\n", A);
                         break;
 
                 case VARIANT(WMOP_CMN): /* Enter Character Mode In Line */
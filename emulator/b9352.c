@@ -49,6 +49,8 @@
 *   Write output into non-spatial memory and copy to ANSI terminal
 * 2018-03-27  R.Meyer
 *   Evolution from b9353.c now using spatial memory
+* 2026-10-19  agent
+*   only changes are sent to the ANSI terminal, in one write
 ***********************************************************************/
 
 #include <stdio.h>
@@ -68,12 +70,15 @@
 #include <signal.h>
 #include <arpa/inet.h>
 
+#include "ansiscreen.h"
+
 /***********************************************************************
 * defines for screen resolution and storage
 ***********************************************************************/
 #define	COLS	80	// number of characters per row
 #define	ROWS	25	// number of rows
 #define	BUFLEN	200	// length of TCP input/output buffers
+#define	SCRLEN	2048	// length of ANSI output buffer
 
 /***********************************************************************
 * ASCII control codes
@@ -135,6 +140,9 @@ static int sock = -1;
 static char screen[ROWS][COLS];	// spatial memory
 static int currow=0, curcol=0;	// current cursor position
 
+// what the ANSI terminal shows
+static ANSISCREEN_T ansi;
+
 // user input
 static pthread_t user_input_handler;
 static char inbuf[BUFLEN];
@@ -251,42 +259,57 @@ loop:
 	return NULL;	// compiler requires this!	
 }
 
+/***********************************************************************
+* How special characters are displayed
+***********************************************************************/
+static const char *glyph(int ch) {
+	switch (ch) {
+	case CR: return _PARA_;
+	case ETX: return _STAR_;
+	case RS: return _LE_;
+	case US: return _GE_;
+	default: return NULL;
+	}
+}
+
+static const ANSISTYLE_T style = {_SO_, _SI_, glyph};
+
 /***********************************************************************
 * Redisplay spatial memory on ANSI terminal
+* the protected area from RS to US is shown inverse,
+* a CR ends the visible part of a line
 ***********************************************************************/
 static void redisplay(void) {
+	unsigned short img[ROWS*COLS];
+	char buf[SCRLEN];
 	unsigned row, col;
+	unsigned short inverse = 0;
+	int len;
 	char ch;
-	// home cursor to start at top left
-	printf(_HOME_);
+
 	for (row = 0; row < ROWS; row++) {
-		// move cursor to begin of line
-		printf(_GOTO_, row+1, 1);
 		for (col = 0; col < COLS; col++) {
 			ch = screen[row][col];
-			if (row == ROWS-1 && col == COLS-1) {
-				// cannot use last char of last line
-				break;
-			}
+			if (ch == RS)
+				inverse = ANSI_ATTR;
+			img[row*COLS+col] = (unsigned char)ch | inverse;
+			if (ch == US)
+				inverse = 0;
 			if (ch == CR) {
-				// end of line
-				// just clear the rest of the line (or the whole line)
-				printf(_PARA_ _EREOL_);
-				break;
-			} else if (ch == ETX) {
-				printf(_STAR_);
-			} else if (ch == RS) {
-				printf(_SO_ _LE_);
-			} else if (ch == US) {
-				printf(_GE_ _SI_);
-			} else {
-				printf("%c", ch);
+				// end of line, the rest is blank
+				while (++col < COLS)
+					img[row*COLS+col] = ' ';
 			}
 		}
 	}
-	// move cursor to its position
-	printf(_GOTO_, currow+1, curcol+1);
+	// trace output has moved the cursor
 	fflush(stdout);
+	if (ctrace || ptrace)
+		ansiscreen_forget_cursor(&ansi);
+	while ((len = ansiscreen_render(&ansi, &style, img, currow, curcol, buf, sizeof buf)) > 0) {
+		if (write(1, buf, len) != len)
+			break;
+	}
 }
 
 /***********************************************************************
@@ -391,6 +414,7 @@ int main(int argc, char*argv[]) {
 	if (socket_open(server, port))
 		return 1;
 	pthread_create(&user_input_handler, 0, user_input_function, 0);
+	ansiscreen_init(&ansi);
 	erasescreen();
 loop:
 	len = socket_read(buf, sizeof buf);
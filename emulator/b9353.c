@@ -56,6 +56,8 @@
 *   Initial Version
 * 2018-03-26  R.Meyer
 *   Write output into non-spatial memory and copy to ANSI terminal
+* 2026-10-19  agent
+*   only changes are sent to the ANSI terminal, in one write
 ***********************************************************************/
 
 #include <stdio.h>
@@ -75,6 +77,8 @@
 #include <signal.h>
 #include <arpa/inet.h>
 
+#include "ansiscreen.h"
+
 /***********************************************************************
 * defines for screen resolution and storage
 ***********************************************************************/
@@ -82,6 +86,7 @@
 #define	ROWS	25	// number of rows
 #define	MEMSIZ	1018	// size of the non-spatial memory
 #define	BUFLEN	200	// length of TCP input/output buffers
+#define	SCRLEN	2048	// length of ANSI output buffer
 
 /***********************************************************************
 * ASCII control codes
@@ -144,6 +149,9 @@ static char screen[MEMSIZ];	// non-spatial memory
 static char *curp = screen;	// current cursor position
 static char *endp = screen;	// current end position
 
+// what the ANSI terminal shows
+static ANSISCREEN_T ansi;
+
 // user input
 static pthread_t user_input_handler;
 static char inbuf[BUFLEN];
@@ -312,56 +320,69 @@ static void setcursor(unsigned drow, unsigned dcol) {
 	}
 }
 
+/***********************************************************************
+* How special characters are displayed
+***********************************************************************/
+static const char *glyph(int ch) {
+	switch (ch) {
+	case CR: case LF: return _PARA_;
+	case ETX: return _STAR_;
+	case RS: return _LE_;
+	case US: return _GE_;
+	case 0: return _NOT_;	// end of memory
+	default: return NULL;
+	}
+}
+
+static const ANSISTYLE_T style = {_SO_, _SI_, glyph};
+
 /***********************************************************************
 * Redisplay non-spatial memory on ANSI terminal
+* the protected area from RS to US is shown inverse,
+* CR or LF end a line, the end of memory ends the screen
 ***********************************************************************/
 static void redisplay(void) {
-	unsigned row=1, col=1, cursorrow = 1, cursorcol = 1;
+	unsigned short img[ROWS*COLS];
+	char buf[SCRLEN];
+	unsigned row, col, cursorrow = 0, cursorcol = 0;
+	unsigned short inverse = 0;
 	char *p = screen;
-	char ch = 0;
-	// home cursor to start at top left
-	printf(_HOME_);
-	for (row = 1; row <= ROWS; row++) {
-		// move cursor to begin of line
-		printf(_GOTO_, row, 1);
-		for (col = 1; col <= COLS; col++) {
+	int len, k;
+	char ch;
+
+	for (k = 0; k < ROWS*COLS; k++)
+		img[k] = ' ';
+	for (row = 0; row < ROWS; row++) {
+		for (col = 0; col < COLS; col++) {
 			if (p == curp) {
 				// remember cursor position
 				cursorrow = row;
 				cursorcol = col;
 			}
-			if (p < endp) {
-				ch = *p++;
-			} else {
-				// end of non-spatial memory
-				// just clear the rest of the screen
-				printf(_NOT_ _EREOS_);
+			if (p >= endp) {
+				// end of non-spatial memory, rest of screen stays blank
+				img[row*COLS+col] = 0;
 				goto done;
 			}
-			if (row == ROWS && col == COLS) {
-				// cannot use last char of last line
-				break;
-			}
-			if (ch == CR || ch == LF) {
-				// end of line
-				// just clear the rest of the line (or the whole line)
-				printf(_PARA_ _EREOL_);
-				break;
-			} else if (ch == ETX) {
-				printf(_STAR_);
-			} else if (ch == RS) {
-				printf(_SO_ _LE_);
-			} else if (ch == US) {
-				printf(_GE_ _SI_);
-			} else {
-				printf("%c", ch);
-			}
+			ch = *p++;
+			if (ch == RS)
+				inverse = ANSI_ATTR;
+			img[row*COLS+col] = (unsigned char)ch | inverse;
+			if (ch == US)
+				inverse = 0;
+			if (ch == CR || ch == LF)
+				break;	// end of line
 		}
 	}
 done:
-	// move cursor to its position
-	printf(_GOTO_, cursorrow, cursorcol);
+	// trace output has moved the cursor
 	fflush(stdout);
+	if (ctrace || ptrace)
+		ansiscreen_forget_cursor(&ansi);
+	while ((len = ansiscreen_render(&ansi, &style, img, cursorrow, cursorcol, buf, sizeof buf)) > 0) {
+		if (write(1, buf, len) != len)
+			break;
+	}
 }
 
 /***********************************************************************
@@ -420,6 +441,7 @@ int main(int argc, char*argv[]) {
 	if (socket_open(server, port))
 		return 1;
 	pthread_create(&user_input_handler, 0, user_input_function, 0);
+	ansiscreen_init(&ansi);
 loop:
 	len = socket_read(buf, sizeof buf);
 	if (len == 0)
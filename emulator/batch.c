@@ -0,0 +1,306 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* headless batch mode
+*
+* see batch.h
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "io.h"
+#include "telemetry.h"
+#include "snapshot.h"
+#include "batch.h"
+#include "machine.h"
+
+#define	BATCH_TEXTLEN	80
+
+/***********************************************************************
+* operator script
+***********************************************************************/
+typedef struct step {
+	char	match[BATCH_TEXTLEN];	// empty: right after the previous
+	char	answer[BATCH_TEXTLEN];
+} STEP;
+
+/***********************************************************************
+* state
+***********************************************************************/
+struct batch_state {
+	BIT	mode;		// batch_execute runs the machine
+	volatile BIT eoj_seen;
+	char	eoj[BATCH_MAXEOJ][BATCH_TEXTLEN];
+	unsigned neoj;
+	unsigned long long instr_limit;	// 0 = none
+	unsigned time_limit;	// seconds, 0 = none
+	char	deck[BATCH_TEXTLEN];	// loaded into CRA once booted
+	char	savename[BATCH_TEXTLEN];	// snapshot at the end
+	STEP	script[BATCH_MAXSTEP];
+	unsigned nstep;
+	unsigned curstep;
+};
+#define	BA	(machine->batch)
+
+/***********************************************************************
+* type the answers of all following steps without a text
+***********************************************************************/
+static void type_pending(void) {
+	while (BA->curstep < BA->nstep && BA->script[BA->curstep].match[0] == 0) {
+		printf("batch: typing %s\n", BA->script[BA->curstep].answer);
+		spo_input(BA->script[BA->curstep].answer);
+		BA->curstep++;
+	}
+}
+
+/***********************************************************************
+* answer a line printed on the SPO, posted to the CPU thread
+***********************************************************************/
+static int batch_answer(const char *line) {
+	if (BA->curstep < BA->nstep && strstr(line, BA->script[BA->curstep].match)) {
+		printf("batch: typing %s\n", BA->script[BA->curstep].answer);
+		spo_input(BA->script[BA->curstep].answer);
+		BA->curstep++;
+		type_pending();
+	}
+	return 0;
+}
+
+/***********************************************************************
+* a line printed on the SPO
+***********************************************************************/
+void batch_spo(const char *line) {
+	unsigned i;
+
+	if (!BA->mode)
+		return;
+	for (i = 0; i < BA->neoj; i++) {
+		if (strstr(line, BA->eoj[i]))
+			BA->eoj_seen = true;
+	}
+	// the script is worked off between instructions
+	if (BA->nstep > 0)
+		cpu_post(batch_answer, line);
+}
+
+/***********************************************************************
+* BATCH commands
+***********************************************************************/
+static int batch_eoj(const char *v, void *) {
+	char *p;
+
+	if (v[0] == 0) {
+		printf("$EOJ needs a text\n");
+		return 2; // FATAL
+	}
+	if (BA->neoj >= BATCH_MAXEOJ) {
+		printf("$EOJ at most %d texts\n", BATCH_MAXEOJ);
+		return 2; // FATAL
+	}
+	// the option parser ends a value at a blank
+	strcpy(BA->eoj[BA->neoj], v);
+	for (p = BA->eoj[BA->neoj]; *p; p++)
+		if (*p == '_')
+			*p = ' ';
+	BA->neoj++;
+	return 0; // OK
+}
+
+static int batch_instr(const char *v, void *) {
+	char *end;
+
+	BA->instr_limit = strtoull(v, &end, 10);
+	if (*v == 0 || *end != 0) {
+		printf("$INSTR needs a number of instructions, 0 for none\n");
+		return 2; // FATAL
+	}
+	return 0; // OK
+}
+
+static int batch_time(const char *v, void *) {
+	char *end;
+
+	BA->time_limit = strtoul(v, &end, 10);
+	if (*v == 0 || *end != 0) {
+		printf("$TIME needs a number of seconds, 0 for none\n");
+		return 2; // FATAL
+	}
+	return 0; // OK
+}
+
+static int batch_script(const char *v, void *) {
+	FILE *fp;
+	char buf[2*BATCH_TEXTLEN+2], *p, *bar;
+	int line = 0;
+
+	fp = fopen(v, "r");
+	if (fp == NULL) {
+		perror(v);
+		return 2; // FATAL
+	}
+	BA->nstep = BA->curstep = 0;
+	while (fgets(buf, sizeof buf, fp)) {
+		line++;
+		// remove trailing control codes
+		p = buf + strlen(buf);
+		while (p >= buf && *p <= ' ')
+			*p-- = 0;
+		if (buf[0] == 0 || buf[0] == '#')
+			continue;
+		bar = strchr(buf, '|');
+		if (bar == NULL || strlen(buf) >= BATCH_TEXTLEN
+			|| strlen(bar+1) >= BATCH_TEXTLEN || BA->nstep >= BATCH_MAXSTEP) {
+			printf("%s:%d: bad script line\n", v, line);
+			fclose(fp);
+			return 2; // FATAL
+		}
+		*bar = 0;
+		strcpy(BA->script[BA->nstep].match, buf);
+		strcpy(BA->script[BA->nstep].answer, bar+1);
+		BA->nstep++;
+	}
+	fclose(fp);
+	return 0; // OK
+}
+
+// the option parser limits the length
+static int batch_deck(const char *v, void *) {
+	strcpy(BA->deck, v);
+	return 0; // OK
+}
+
+static int batch_save(const char *v, void *) {
+	strcpy(BA->savename, v);
+	return 0; // OK
+}
+
+static const command_t batch_commands[] = {
+	{"BATCH", NULL},
+	{"EOJ", batch_eoj},
+	{"INSTR", batch_instr},
+	{"TIME", batch_time},
+	{"SCRIPT", batch_script},
+	{"DECK", batch_deck},
+	{"SAVE", batch_save},
+	{NULL, NULL},
+};
+
+int batch_init(const char *option) {
+	return command_parser(batch_commands, option);
+}
+
+/***********************************************************************
+* state of a new machine, freed with it
+***********************************************************************/
+int batch_create(void) {
+	BA = (struct batch_state *)calloc(1, sizeof *BA);
+	if (BA == NULL) {
+		perror("batch");
+		return -1;
+	}
+	return 0;
+}
+
+void batch_term(void) {
+	free(BA);
+	BA = NULL;
+}
+
+/***********************************************************************
+* seconds since start
+***********************************************************************/
+static double elapsed(const struct timespec *t0) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - t0->tv_sec) + (t.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+/***********************************************************************
+* let the running I/O finish, then save the machine
+***********************************************************************/
+static int save_machine(void) {
+	unsigned n;
+
+	for (n = 0; n < BATCH_SLICE; n++) {
+		if (snapshot_io_idle())
+			return snapshot_save(BA->savename);
+		if (execute_slice(1) == 0)
+			usleep(10);	// halted, the I/O may still complete
+	}
+	printf("batch: I/O does not finish, no snapshot saved\n");
+	return -1;
+}
+
+/***********************************************************************
+* run until one of the end conditions
+***********************************************************************/
+int batch_execute(void) {
+	static const char *why[] = {"EOJ", "?", "?", "halt", "instruction limit", "time limit"};
+	CPU *cpu = P[0];
+	struct timespec t0;
+	unsigned long long done = 0, slice;
+	double sec;
+	int code;
+
+	BA->mode = true;
+	if (BA->deck[0]) {
+		char option[sizeof BA->deck + 10];
+
+		snprintf(option, sizeof option, "CRA FILE=%s", BA->deck);
+		if (handle_option(option))
+			return 2;
+	}
+	type_pending();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (;;) {
+		slice = BATCH_SLICE;
+		if (BA->instr_limit && BA->instr_limit - done < slice)
+			slice = BA->instr_limit - done;
+		done += execute_slice(slice);
+		if (term_request)
+			return -1;
+		if (BA->eoj_seen) {
+			code = BATCH_EOJ;
+			break;
+		}
+		if (cpu->bHLTF) {
+			code = BATCH_HALT;
+			break;
+		}
+		if (BA->instr_limit && done >= BA->instr_limit) {
+			code = BATCH_INSTR;
+			break;
+		}
+		if (BA->time_limit && elapsed(&t0) >= BA->time_limit) {
+			code = BATCH_TIME;
+			break;
+		}
+	}
+	sec = elapsed(&t0);
+
+	telemetry_publish();
+	if (code == BATCH_HALT)
+		dump_flight("halt");
+	printf("\n\n***** BATCH END: %s *****\n", why[code]);
+	printf("batch: %llu instructions in %.2f s, %.2f MIPS\n",
+		done, sec, sec > 0 ? done / sec / 1e6 : 0.0);
+	handle_option("IO STA");
+	if (BA->savename[0] && save_machine() < 0)
+		code = 2;
+	printf("batch: exit code %d\n", code);
+	return code;
+}
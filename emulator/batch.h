@@ -0,0 +1,80 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* headless batch mode
+*
+* With -b the emulator runs without an operator: the card deck comes
+* from the usual CRA FILE=<deck> option, the operator answers from a
+* script, and instead of asking "Continue?" at a halt the run ends.
+*
+* The run ends at the first of
+*   - an SPO line containing one of the EOJ texts
+*   - a CPU halt
+*   - the instruction limit
+*   - the wall time limit
+* and the process exits with a code telling which one it was. A summary
+* of instructions, MIPS and I/O counts is printed before.
+*
+* Options (ini file, command line or $ on the SPO):
+*   BATCH EOJ=<text>	end when the SPO prints text, '_' stands for a
+*			blank, up to BATCH_MAXEOJ texts
+*   BATCH INSTR=<n>	end after n instructions
+*   BATCH TIME=<s>	end after s seconds
+*   BATCH SCRIPT=<file>	operator answers
+*   BATCH DECK=<file>	load the deck into CRA once booted, after a
+*			snapshot (-r) was loaded
+*   BATCH SAVE=<file>	save a snapshot at the end, e.g. after the
+*			Halt/Load, to start many runs from (see jobrun)
+*
+* Script file, one answer per line, empty lines and # comments ignored:
+*   <text>|<answer>
+* The answer is typed when an SPO line contains text, the lines are
+* worked off in order. An empty text types the answer right after the
+* previous one, or at the start. Answers starting with $ are emulator
+* commands, as typed on the SPO.
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#ifndef	_BATCH_H_
+#define	_BATCH_H_
+
+#define	BATCH_MAXEOJ	8
+#define	BATCH_MAXSTEP	100
+#define	BATCH_SLICE	100000	// instructions between checks
+
+/***********************************************************************
+* exit codes, 2 stays with setup errors
+***********************************************************************/
+#define	BATCH_EOJ	0	// an EOJ text was printed
+#define	BATCH_HALT	3	// the CPU halted
+#define	BATCH_INSTR	4	// instruction limit reached
+#define	BATCH_TIME	5	// wall time limit reached
+
+/***********************************************************************
+* state of a new machine and BATCH options
+***********************************************************************/
+extern int batch_create(void);
+extern int batch_init(const char *option);
+extern void batch_term(void);
+
+/***********************************************************************
+* a line printed on the SPO, called by the I/O thread
+* the EOJ texts are checked at once, the script answers are typed by
+* the CPU thread between instructions
+***********************************************************************/
+extern void batch_spo(const char *line);
+
+/***********************************************************************
+* run the started machine until one of the end conditions
+* returns the exit code, or -1 when term_request ended it
+***********************************************************************/
+extern int batch_execute(void);
+
+#endif	/*_BATCH_H_*/
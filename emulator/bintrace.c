@@ -0,0 +1,307 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* binary instruction trace
+*
+* This file is linkable to a program.
+* see bintrace.h for the file layout
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "circbuffer.h"
+#include "bintrace.h"
+
+/***********************************************************************
+* state
+***********************************************************************/
+struct bintrace {
+	// writer
+	FILE	*fp;
+	RING_T	ring;
+	pthread_t writer;
+	volatile BIT closing;
+	BINTRACE_REC rec;	// record used without flight recorder
+	BINTRACE_REC *cur;	// record being filled by the CPU thread
+	unsigned stalls;	// CPU had to wait for the writer
+
+	// flight recorder
+	BINTRACE_REC *fr;	// the ring
+	unsigned frmask;	// entries - 1
+	unsigned frpos;		// entries recorded so far
+};
+
+/***********************************************************************
+* compress one record
+* returns number of bytes placed in buf
+***********************************************************************/
+int bintrace_encode(const BINTRACE_REC *prev, const BINTRACE_REC *rec, unsigned char *buf) {
+	const unsigned char *p = (const unsigned char *)prev;
+	const unsigned char *r = (const unsigned char *)rec;
+	unsigned char *mask = buf, *q = buf + BINTRACE_MASKLEN;
+	unsigned i, x;
+
+	memset(mask, 0, BINTRACE_MASKLEN);
+	for (i = 0; i < sizeof(BINTRACE_REC); i++) {
+		x = p[i] ^ r[i];
+		if (x) {
+			mask[i >> 3] |= 1 << (i & 7);
+			*q++ = x;
+		}
+	}
+	return q - buf;
+}
+
+/***********************************************************************
+* read and expand one record
+***********************************************************************/
+int bintrace_decode(FILE *fp, BINTRACE_REC *rec) {
+	unsigned char mask[BINTRACE_MASKLEN];
+	unsigned char *r = (unsigned char *)rec;
+	unsigned i;
+	int x;
+
+	if (fread(mask, 1, sizeof mask, fp) != sizeof mask)
+		return feof(fp) ? 0 : -1;
+	for (i = 0; i < sizeof(BINTRACE_REC); i++) {
+		if (mask[i >> 3] & (1 << (i & 7))) {
+			x = getc(fp);
+			if (x == EOF)
+				return -1;
+			r[i] ^= x;
+		}
+	}
+	return 1;
+}
+
+/***********************************************************************
+* writer thread, empties the ring into the file
+***********************************************************************/
+static void *bintrace_writer(void *p) {
+	BINTRACE_T *bt = (BINTRACE_T *)p;
+	BINTRACE_REC prev, cur;
+	unsigned char buf[BINTRACE_MASKLEN + sizeof(BINTRACE_REC)];
+	int len;
+	BIT last;
+
+	memset(&prev, 0, sizeof prev);
+	while (1) {
+		// look at closing first, records may arrive until then
+		last = bt->closing;
+		if (ring_used(&bt->ring) < sizeof cur) {
+			if (last)
+				break;
+			fflush(bt->fp);
+			usleep(10000);
+			continue;
+		}
+		ring_read_n(&bt->ring, &cur, sizeof cur);
+		len = bintrace_encode(&prev, &cur, buf);
+		if (fwrite(buf, 1, len, bt->fp) != (size_t)len) {
+			perror("bintrace");
+			break;
+		}
+		prev = cur;
+	}
+	return NULL;
+}
+
+/***********************************************************************
+* write file header and symbols
+***********************************************************************/
+static void bintrace_header(FILE *fp, const BINTRACE_SYM *sym, unsigned nsym) {
+	BINTRACE_HDR hdr;
+
+	hdr.magic = BINTRACE_MAGIC;
+	hdr.version = BINTRACE_VERSION;
+	hdr.recsize = sizeof(BINTRACE_REC);
+	hdr.nsym = nsym;
+	fwrite(&hdr, sizeof hdr, 1, fp);
+	fwrite(sym, sizeof *sym, nsym, fp);
+}
+
+/***********************************************************************
+* a new handle, neither trace nor flight recorder
+***********************************************************************/
+BINTRACE_T *bintrace_create(void) {
+	BINTRACE_T *bt = (BINTRACE_T *)calloc(1, sizeof *bt);
+
+	if (bt == NULL) {
+		perror("bintrace");
+		return NULL;
+	}
+	bt->cur = &bt->rec;
+	return bt;
+}
+
+/***********************************************************************
+* open the trace file and start the writer
+***********************************************************************/
+int bintrace_open(BINTRACE_T *bt, const char *filename, const BINTRACE_SYM *sym, unsigned nsym) {
+	bt->fp = fopen(filename, "wb");
+	if (bt->fp == NULL) {
+		perror(filename);
+		return -1;
+	}
+	setvbuf(bt->fp, NULL, _IOFBF, 65536);
+	bintrace_header(bt->fp, sym, nsym);
+	if (ring_create(&bt->ring, BINTRACE_RINGSIZE) < 0) {
+		perror("bintrace ring");
+		fclose(bt->fp);
+		bt->fp = NULL;
+		return -1;
+	}
+	bt->closing = false;
+	pthread_create(&bt->writer, 0, bintrace_writer, bt);
+	return 0;
+}
+
+/***********************************************************************
+* the syllable has been fetched into T
+***********************************************************************/
+void bintrace_fetch(BINTRACE_T *bt, CPU *cpu, unsigned long long count) {
+	BINTRACE_REC *cur = bt->cur;
+
+	cur->count = count;
+	// C:L point behind the syllable
+	if (cpu->rL == 0) {
+		cur->c = (cpu->rC - 1) & MASKMEM;
+		cur->l = 3;
+	} else {
+		cur->c = cpu->rC;
+		cur->l = cpu->rL - 1;
+	}
+	cur->ft = cpu->rT;
+	cur->fflags = (cpu->bCWMF ? BT_CWMF : 0) |
+		(cpu->bSALF ? BT_SALF : 0) |
+		(cpu->bQ12F ? BT_Q12F : 0);
+}
+
+/***********************************************************************
+* the instruction has been executed, complete the record, queue it
+* and advance the flight recorder
+***********************************************************************/
+void bintrace_regs(BINTRACE_T *bt, CPU *cpu) {
+	BINTRACE_REC *cur = bt->cur;
+
+	cur->a = cpu->rA;
+	cur->b = cpu->rB;
+	cur->x = cpu->rX;
+	cur->t = cpu->rT;
+	cur->m = cpu->rM;
+	cur->f = cpu->rF;
+	cur->s = cpu->rS;
+	cur->r = cpu->rR;
+	cur->gh = cpu->rGH;
+	cur->kv = cpu->rKV;
+	cur->y = cpu->rY;
+	cur->z = cpu->rZ;
+	cur->n = cpu->rN;
+	cur->flags = (cpu->bAROF ? BT_AROF : 0) |
+		(cpu->bBROF ? BT_BROF : 0) |
+		(cpu->bCWMF ? BT_CWMF : 0) |
+		(cpu->bNCSF ? BT_NCSF : 0) |
+		(cpu->bSALF ? BT_SALF : 0) |
+		(cpu->bQ12F ? BT_Q12F : 0);
+	if (bt->fp) {
+		// a trace must be complete, wait for the writer
+		while (ring_space(&bt->ring) < sizeof *cur) {
+			bt->stalls++;
+			usleep(100);
+		}
+		ring_write_n(&bt->ring, cur, sizeof *cur);
+	}
+	if (bt->fr)
+		bt->cur = &bt->fr[++bt->frpos & bt->frmask];
+}
+
+/***********************************************************************
+* drain the ring and close the file
+***********************************************************************/
+void bintrace_close(BINTRACE_T *bt) {
+	if (bt->fp == NULL)
+		return;
+	bt->closing = true;
+	pthread_join(bt->writer, NULL);
+	fclose(bt->fp);
+	bt->fp = NULL;
+	ring_destroy(&bt->ring);
+	if (bt->stalls)
+		printf("bintrace: CPU waited %u times for the writer\n", bt->stalls);
+}
+
+/***********************************************************************
+* close the trace and free the handle
+***********************************************************************/
+void bintrace_destroy(BINTRACE_T *bt) {
+	if (bt == NULL)
+		return;
+	bintrace_close(bt);
+	free(bt->fr);
+	free(bt);
+}
+
+/***********************************************************************
+* (re)allocate the flight recorder
+***********************************************************************/
+int flight_init(BINTRACE_T *bt, unsigned len) {
+	unsigned n = 1;
+
+	free(bt->fr);
+	bt->fr = NULL;
+	bt->cur = &bt->rec;
+	bt->frpos = 0;
+	if (len == 0)
+		return 0;
+	while (n < len)
+		n <<= 1;
+	bt->fr = (BINTRACE_REC *)calloc(n, sizeof *bt->fr);
+	if (bt->fr == NULL) {
+		perror("flight recorder");
+		return -1;
+	}
+	bt->frmask = n - 1;
+	bt->cur = &bt->fr[0];
+	return 0;
+}
+
+/***********************************************************************
+* write the flight recorder, oldest instruction first
+* must be called by the CPU thread between two instructions
+***********************************************************************/
+int flight_dump(BINTRACE_T *bt, const char *filename, const BINTRACE_SYM *sym, unsigned nsym) {
+	BINTRACE_REC prev;
+	unsigned char buf[BINTRACE_MASKLEN + sizeof(BINTRACE_REC)];
+	unsigned i, first;
+	FILE *ffp;
+
+	if (bt->fr == NULL)
+		return -1;
+	ffp = fopen(filename, "wb");
+	if (ffp == NULL) {
+		perror(filename);
+		return -1;
+	}
+	bintrace_header(ffp, sym, nsym);
+	memset(&prev, 0, sizeof prev);
+	first = bt->frpos > bt->frmask ? bt->frpos - bt->frmask - 1 : 0;
+	for (i = first; i != bt->frpos; i++) {
+		fwrite(buf, 1, bintrace_encode(&prev, &bt->fr[i & bt->frmask], buf), ffp);
+		prev = bt->fr[i & bt->frmask];
+	}
+	fclose(ffp);
+	return bt->frpos - first;
+}
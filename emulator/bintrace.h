@@ -0,0 +1,113 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* binary instruction trace
+*
+* The CPU thread fills one fixed size record per instruction and puts
+* it into a ring buffer. A writer thread takes the records out,
+* compresses them and writes them to the trace file. trcdecode turns
+* the file into the text format of the -e trace.
+*
+* The same records also go into the flight recorder, a ring of the
+* last instructions kept in memory. It is written in the trace file
+* format when asked for.
+*
+* File layout:
+*   BINTRACE_HDR
+*   nsym times BINTRACE_SYM, the NAME entries at trace start
+*   compressed records
+*
+* Compression: each record is XORed with the previous one, then a
+* mask of BINTRACE_MASKLEN bytes tells which of the bytes are not
+* zero, only those follow the mask.
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#ifndef	_BINTRACE_H_
+#define	_BINTRACE_H_
+
+#define	BINTRACE_MAGIC		0x52543542	// "B5TR"
+#define	BINTRACE_VERSION	2
+#define	BINTRACE_RINGSIZE	(1<<20)		// bytes between CPU and writer
+#define	FLIGHT_LEN		16384		// default instructions in flight recorder
+#define	FLIGHT_FILE		"flight"	// flight.bin, flight-<n>.bin for instance n
+
+/***********************************************************************
+* file header
+***********************************************************************/
+typedef struct bintrace_hdr {
+	unsigned	magic;
+	unsigned	version;
+	unsigned	recsize;	// sizeof(BINTRACE_REC)
+	unsigned	nsym;		// number of symbols following
+} BINTRACE_HDR;
+
+typedef struct bintrace_sym {
+	unsigned short	index;		// index into PRT
+	unsigned short	addr;		// code address, 0 = none
+	char		name[28];
+} BINTRACE_SYM;
+
+/***********************************************************************
+* one instruction
+* the fetch part is taken when the syllable is in T,
+* the rest after the instruction has been executed
+***********************************************************************/
+// flag bits
+#define	BT_AROF		0x01
+#define	BT_BROF		0x02
+#define	BT_CWMF		0x04
+#define	BT_NCSF		0x08
+#define	BT_SALF		0x10
+#define	BT_Q12F		0x20	// MSFF in word mode, TFFF in char mode
+
+typedef struct bintrace_rec {
+	unsigned long long a, b, x;
+	unsigned long long count;	// instruction count
+	// fetch part
+	unsigned short	c;		// C:L of the syllable
+	unsigned short	ft;		// the syllable
+	unsigned char	l;
+	unsigned char	fflags;		// flags at fetch
+	// registers after execution
+	unsigned short	t, m, f, s, r;
+	unsigned char	gh, kv, y, z, n;
+	unsigned char	flags;
+	unsigned char	spare[2];
+} BINTRACE_REC;
+
+#define	BINTRACE_MASKLEN	((sizeof(BINTRACE_REC) + 7) / 8)
+
+/***********************************************************************
+* writing, called by the CPU thread
+***********************************************************************/
+typedef struct bintrace BINTRACE_T;
+
+extern BINTRACE_T *bintrace_create(void);
+extern int bintrace_open(BINTRACE_T *bt, const char *filename, const BINTRACE_SYM *sym, unsigned nsym);
+extern void bintrace_fetch(BINTRACE_T *bt, CPU *cpu, unsigned long long count);
+extern void bintrace_regs(BINTRACE_T *bt, CPU *cpu);
+extern void bintrace_close(BINTRACE_T *bt);
+extern void bintrace_destroy(BINTRACE_T *bt);
+
+/***********************************************************************
+* flight recorder, len is rounded up to a power of two, 0 = off
+***********************************************************************/
+extern int flight_init(BINTRACE_T *bt, unsigned len);
+extern int flight_dump(BINTRACE_T *bt, const char *filename, const BINTRACE_SYM *sym, unsigned nsym);
+
+/***********************************************************************
+* compression, rec holds the previous record on entry of decode
+* decode returns 1 for a record, 0 at end of file, -1 on error
+***********************************************************************/
+extern int bintrace_encode(const BINTRACE_REC *prev, const BINTRACE_REC *rec, unsigned char *buf);
+extern int bintrace_decode(FILE *fp, BINTRACE_REC *rec);
+
+#endif	/*_BINTRACE_H_*/
@@ -9,6 +9,9 @@
 ************************************************************************
 * 2017-09-08  R.Meyer
 *   Started
+* 2026-10-19  agent
+*   input via lock free ring buffers, reader thread and DCC do not
+*   race on the buffer index anymore
 ***********************************************************************/
 
 #include <stdio.h>
@@ -24,13 +27,14 @@
 #include <time.h>
 #include "common.h"
 #include "io.h"
+#include "circbuffer.h"
 
 #include <linux/can.h>
 #include <linux/can/raw.h>
 #include <linux/can/error.h> 
 #include "canlib.h"
 
-#define CANSTRINGLENGTH 200
+#define CANBUFSIZE 256	// power of 2
 
 /***********************************************************************
 * CANbus data
@@ -42,9 +46,9 @@ static struct sigevent sev;
 static struct itimerspec its;
 
 typedef struct can {
-	// input buffer
-	char	buf[CANSTRINGLENGTH];
-	int	bufidx;
+	// input buffer, written by reader thread only
+	RING_T	in;
+	unsigned char buf[CANBUFSIZE];
 	// peer ready
 	int	ready;
 	struct timeval last_ready;
@@ -102,13 +106,9 @@ loop:
 		} else if (cob == MSGID_TPDO4(0)) {
 			// TPDO4: received data
 			can[id].space = frame.data[0] & 0x7f;
-			// process chars into buffer
-			for (int j=1; j<frame.can_dlc; j++) {
-				char ch = frame.data[j];
-				if (can[id].bufidx < CANSTRINGLENGTH-1) {
-					can[id].buf[can[id].bufidx++] = ch;
-				}
-			}
+			// process chars into buffer, excess is lost
+			if (frame.can_dlc > 1)
+				ring_write_n(&can[id].in, frame.data + 1, frame.can_dlc - 1);
 		}
 	} else {
 		// error?
@@ -178,20 +178,9 @@ int can_read(unsigned id, char *buf, int maxlen)
 {
 	// possible at all?
 	if (canfd >= 0 && can[id].ready > 0) {
-		int cnt = can[id].bufidx;
-		if (cnt < 0 || cnt >= CANSTRINGLENGTH) {
-			printf("can_read: invalid buffer index %d - resetting\n", cnt);
-			can[id].bufidx = 0;
+		if (maxlen < 1)
 			return 0;
-		}
-		if (cnt > maxlen)
-			cnt = maxlen;
-		if (cnt < 1)
-			return cnt;
-		memmove(buf, can[id].buf, cnt);
-		can[id].bufidx -= cnt;
-		memmove(can[id].buf, can[id].buf + cnt, can[id].bufidx);
-		return cnt;
+		return ring_read_n(&can[id].in, buf, maxlen);
 	}
 	return -1;
 }
@@ -204,7 +193,7 @@ void can_init(const char *busname)
 	int i;
 	for (i=0; i<128; i++) {
 		can[i].ready = 0;
-		can[i].bufidx = 0;
+		ring_init(&can[i].in, can[i].buf, sizeof can[i].buf);
 		can[i].last_ready.tv_sec = 0;
 		can[i].last_ready.tv_usec = 0;
 	}
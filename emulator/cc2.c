@@ -13,6 +13,9 @@
 *   some refactoring in the functions, added documentation
 * 2018-02-27  R.Meyer
 *   factored out I/O handling to io.c
+* 2026-10-19  agent
+*   telemetry snapshots, I/O interrupt latency, virtual clock, timer
+*   ticks through the replay log, state is that of the MACHINE
 ***********************************************************************/
 
 #include <stdio.h>
@@ -29,6 +32,9 @@
 #include <sys/ipc.h>
 #include <sys/msg.h>
 #include "common.h"
+#include "telemetry.h"
+#include "replay.h"
+#include "machine.h"
 
 /*
  * optional trace files
@@ -179,8 +185,8 @@ void signalInterrupt(const char *id, const char *cause) {
 
 	if (traceirq == NULL)
 		return;
-	fprintf(traceirq, "%08u %s signalInterrupt %s P1.I=%02x P2.I=%02x\n",
-		instr_count, id, cause, P[0]->rI, P[1]->rI);
+	fprintf(traceirq, "%08llu %s signalInterrupt %s P1.I=%02x P2.I=%02x\n",
+		machine->instr_count, id, cause, P[0]->rI, P[1]->rI);
 }
 
 /***********************************************************************
@@ -212,18 +218,22 @@ void clearInterrupt(ADDR15 iar) {
                 case 027: // I/O 1 finished
                         CC->CCI08F = false;
                         CC->AD1F = false; // make unit non-busy
+                        io_complete_taken(1);
                         break;
                 case 030: // I/O 2 finished
                         CC->CCI09F = false;
                         CC->AD2F = false; // make unit non-busy
+                        io_complete_taken(2);
                         break;
                 case 031: // I/O 3 finished
                         CC->CCI10F = false;
                         CC->AD3F = false; // make unit non-busy
+                        io_complete_taken(3);
                         break;
                 case 032: // I/O 4 finished
                         CC->CCI11F = false;
                         CC->AD4F = false; // make unit non-busy
+                        io_complete_taken(4);
                         break;
                 case 033: // P2 busy
                         CC->CCI12F = false;
@@ -284,10 +294,9 @@ void clearInterrupt(ADDR15 iar) {
 };
 
 /***********************************************************************
-* handle 60Hz timer
-* warning: this can be called from another thread or even interrupt context
+* advance the interval timer by one tick
 ***********************************************************************/
-void timer60hz(union sigval sv) {
+void timer_tick(void) {
 	WORD6 temp = CC->TM;
 	temp = (temp+1) & 077;
 	CC->TM = temp;
@@ -299,6 +308,44 @@ void timer60hz(union sigval sv) {
 	signalInterrupt("CC", "TIMER");
 }
 
+/***********************************************************************
+* handle 60Hz timer
+* warning: this is called from the timer thread of the machine
+***********************************************************************/
+void timer60hz(void) {
+	MACHINE *m = machine;
+
+	// virtual, recorded and replayed ticks are done by the CPU thread
+	if (m->vclock == 0) {
+		if (m->replay_mode == REPLAY_OFF)
+			timer_tick();
+		else
+			replay_tick();
+	}
+	// time for a telemetry snapshot?
+	if (TM->rate > 0 && ++m->telemetry_ticks >= 60 / TM->rate) {
+		m->telemetry_ticks = 0;
+		m->telemetry_due = true;
+	}
+}
+
+/***********************************************************************
+* publish a telemetry snapshot
+* called by the CPU thread between instructions, so processor and
+* central control are consistent
+***********************************************************************/
+void telemetry_publish(void) {
+	machine->telemetry_due = false;
+	seqlock_write_begin(&TM->seq);
+	TM->data.instr_count = machine->instr_count;
+	memcpy(TM->data.P, P[0], sizeof TM->data.P[0]);
+	memcpy(TM->data.P+1, P[1], sizeof TM->data.P[1]);
+	memcpy(&TM->data.CC, (const void *)CC, sizeof TM->data.CC);
+	for (int i = 0; i < 4; i++)
+		memcpy(TM->data.IO+i, IO[i], sizeof TM->data.IO[i]);
+	seqlock_write_end(&TM->seq);
+}
+
 /***********************************************************************
 * Called by P1 to initiate P2. Assumes that an INCW has been stored at
 * memory location @10. If P2 is busy or not present, sets the P2 busy
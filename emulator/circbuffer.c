@@ -9,6 +9,7 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include "circbuffer.h"
 
 void circ_clear(CIRCBUFFER_T *cb) {
@@ -62,4 +63,107 @@ int circ_read(CIRCBUFFER_T *cb) {
 	return v;
 }
 
+/*
+ * ring buffer, lock free for one producer and one consumer
+ */
+
+int ring_create(RING_T *r, unsigned size) {
+	unsigned n = 1;
+
+	// round up to a power of two
+	while (n < size)
+		n <<= 1;
+	r->buf = (unsigned char *)malloc(n);
+	if (r->buf == 0)
+		return -1;
+	r->mask = n - 1;
+	r->rp = r->wp = 0;
+	return 0;
+}
+
+void ring_init(RING_T *r, void *buf, unsigned size) {
+	// size must be a power of two
+	r->buf = (unsigned char *)buf;
+	r->mask = size - 1;
+	r->rp = r->wp = 0;
+}
+
+void ring_destroy(RING_T *r) {
+	free(r->buf);
+	r->buf = NULL;
+	r->mask = 0;
+	r->rp = r->wp = 0;
+}
+
+void ring_clear(RING_T *r) {
+	// only when neither side is active
+	r->rp = r->wp = 0;
+}
+
+unsigned ring_used(RING_T *r) {
+	return __atomic_load_n(&r->wp, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->rp, __ATOMIC_ACQUIRE);
+}
+
+unsigned ring_space(RING_T *r) {
+	return r->mask + 1 - ring_used(r);
+}
+
+/* producer: copy up to len bytes in, returns number copied */
+unsigned ring_write_n(RING_T *r, const void *buf, unsigned len) {
+	unsigned wp = r->wp;
+	unsigned space = r->mask + 1 - (wp - __atomic_load_n(&r->rp, __ATOMIC_ACQUIRE));
+	unsigned off = wp & r->mask;
+	unsigned first;
+
+	if (len > space)
+		len = space;
+	first = r->mask + 1 - off;
+	if (first > len)
+		first = len;
+	memcpy(r->buf + off, buf, first);
+	memcpy(r->buf, (const unsigned char *)buf + first, len - first);
+	__atomic_store_n(&r->wp, wp + len, __ATOMIC_RELEASE);
+	return len;
+}
+
+/* consumer: copy up to len bytes out without removing them */
+unsigned ring_peek(RING_T *r, void *buf, unsigned len) {
+	unsigned rp = r->rp;
+	unsigned used = __atomic_load_n(&r->wp, __ATOMIC_ACQUIRE) - rp;
+	unsigned off = rp & r->mask;
+	unsigned first;
+
+	if (len > used)
+		len = used;
+	first = r->mask + 1 - off;
+	if (first > len)
+		first = len;
+	memcpy(buf, r->buf + off, first);
+	memcpy((unsigned char *)buf + first, r->buf, len - first);
+	return len;
+}
+
+/* consumer: remove len bytes (at most what is used) */
+void ring_skip(RING_T *r, unsigned len) {
+	__atomic_store_n(&r->rp, r->rp + len, __ATOMIC_RELEASE);
+}
+
+/* consumer: copy up to len bytes out, returns number copied */
+unsigned ring_read_n(RING_T *r, void *buf, unsigned len) {
+	len = ring_peek(r, buf, len);
+	ring_skip(r, len);
+	return len;
+}
+
+/* consumer: contiguous readable part, use ring_skip when done */
+unsigned ring_span(RING_T *r, unsigned char **p) {
+	unsigned rp = r->rp;
+	unsigned used = __atomic_load_n(&r->wp, __ATOMIC_ACQUIRE) - rp;
+	unsigned off = rp & r->mask;
+
+	*p = r->buf + off;
+	if (used > r->mask + 1 - off)
+		used = r->mask + 1 - off;
+	return used;
+}
 
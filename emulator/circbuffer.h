@@ -28,4 +28,28 @@ extern int circ_used(CIRCBUFFER_T *cb);
 extern int circ_write(CIRCBUFFER_T *cb, unsigned char v);
 extern int circ_read(CIRCBUFFER_T *cb);
 
+/*
+ * ring buffer for one producer and one consumer thread
+ * the size is a power of two, rp and wp are free running counters,
+ * the producer only stores wp, the consumer only stores rp
+ */
+typedef struct ring {
+	unsigned char	*buf;	// pointer to buffer area
+	unsigned	mask;	// size - 1
+	unsigned	rp;	// read counter
+	unsigned	wp;	// write counter
+} RING_T;
+
+extern int ring_create(RING_T *r, unsigned size);
+extern void ring_init(RING_T *r, void *buf, unsigned size);
+extern void ring_destroy(RING_T *r);
+extern void ring_clear(RING_T *r);
+extern unsigned ring_used(RING_T *r);
+extern unsigned ring_space(RING_T *r);
+extern unsigned ring_write_n(RING_T *r, const void *buf, unsigned len);
+extern unsigned ring_read_n(RING_T *r, void *buf, unsigned len);
+extern unsigned ring_peek(RING_T *r, void *buf, unsigned len);
+extern unsigned ring_span(RING_T *r, unsigned char **p);
+extern void ring_skip(RING_T *r, unsigned len);
+
 #endif
@@ -19,6 +19,9 @@
 *   overhaul of file names
 * 2018-03-01  R.Meyer
 *   factored out iocu.h
+* 2026-10-19  agent
+*   shares per instance, MAIN, P, CC and IO are those of the
+*   MACHINE of the thread
 ***********************************************************************/
 
 #ifndef COMMON_H
@@ -109,6 +112,8 @@ typedef struct central_control {
         BIT             AD2F;   // I/O control 2 admitted
         BIT             AD3F;   // I/O control 3 admitted
         BIT             AD4F;   // I/O control 4 admitted
+// units ready mask as returned by TUS, maintained by the devices
+        WORD48          RDY;
 // flags from processor 2
         BIT             HP2F;   // HALT CPU #2 flag
         BIT             P2BF;   // CPU #2 busy flag
@@ -243,6 +248,7 @@ typedef struct iocu {
 	WORD7		wb;		// magnetic tape write buffer (not used)
 	// statistics
 	unsigned	calls;
+	unsigned	words;		// words transferred by this operation
 } IOCU;
 
 /***********************************************************************
@@ -278,10 +284,19 @@ typedef struct irq {
 #define SHM_IOC3        (('I'<<24)|('O'<<16)|('C'<<8)|'3')  // shared data of I/O control unit 3
 #define SHM_IOC4        (('I'<<24)|('O'<<16)|('C'<<8)|'4')  // shared data of I/O control unit 4
 #define SHM_DCC         (('D'<<24)|('C'<<16)|('C'<<8)|'_')  // shared data of Data Communication Controller
+#define SHM_TELE        (('T'<<24)|('E'<<16)|('L'<<8)|'E')  // telemetry snapshot for the processor panel
+#define SHM_DCCT        (('D'<<24)|('C'<<16)|('C'<<8)|'T')  // telemetry snapshot for the datacom panel
 #define MSG_CPUA        (('C'<<24)|('P'<<16)|('U'<<8)|'A')  // messages to cpu A
 #define MSG_CPUB        (('C'<<24)|('P'<<16)|('U'<<8)|'B')  // messages to cpu B
 #define MSG_IOCU        (('I'<<24)|('O'<<16)|('C'<<8)|'U')  // messages to I/O control unit(s)
 
+/*
+ * instance n of the emulator adds n to the top byte of the names,
+ * instance 0 uses them as they are
+ */
+#define MAXINSTANCE     100
+#define IPCKEY(name, instance)  ((int)((unsigned)(name) + ((unsigned)(instance) << 24)))
+
 /*
  * macros for memory handling
  */
@@ -303,12 +318,16 @@ typedef struct irq {
 /***********************************************************************
 * global (IPC) memory areas
 ***********************************************************************/
-extern volatile WORD48 *MAIN;
-extern CPU	*P[2];
-extern volatile CENTRAL_CONTROL *CC;
-extern IOCU	*IO[4];
-extern int	msg_cpu[2];	// messages to P1 and P2
-extern int	msg_iocu;	// messages to IOCU(s)
+/*
+ * the machine the thread works for, see machine.h
+ * the pointers below are those of this machine
+ */
+typedef struct machine MACHINE;
+extern __thread MACHINE *machine;
+extern __thread volatile WORD48 *MAIN;
+extern __thread CPU	*P[2];
+extern __thread volatile CENTRAL_CONTROL *CC;
+extern __thread IOCU	*IO[4];
 extern const UNIT unit[32][2];
 
 /*
@@ -534,7 +553,9 @@ extern void b5500_pdp_text1(CPU *);
 extern void b5500_pdp_text2(CPU *);
 extern void b5500_ccdp_text2(volatile CENTRAL_CONTROL *);
 extern void b5500_iodp_text2(IOCU *);
-extern void b5500_init_shares(void);
+extern int b5500_init_shares(MACHINE *m, unsigned instance, BIT create);
+extern void b5500_remove_shares(MACHINE *m);
+extern void b5500_detach_shares(MACHINE *m);
 
 /* A & B adjustments, stack operations */
 extern BIT incrementS(CPU *);
@@ -587,7 +608,10 @@ extern WORD48 interrogateIOChannel(CPU *);
 extern void storeForInterrupt(CPU *, BIT forced, BIT forTest, const char *);
 extern void clearInterrupt(ADDR15);
 extern void initiateIO(CPU *);
+extern void io_complete_taken(int cu);
 extern void signalInterrupt(const char *id, const char *cause);
+extern void timer_tick(void);
+extern void timer60hz(void);
 
 /* single precision */
 extern int singlePrecisionCompare(CPU *);
@@ -647,6 +671,11 @@ typedef struct command {
 
 extern int command_parser(const command_t *table, const char *op);
 extern int handle_option(const char *option);
+extern unsigned long long execute_slice(unsigned long long count);
+extern void cpu_post(int (*func)(const char *arg), const char *arg);
+extern void cpu_post_poll(void);
+extern volatile BIT term_request;
+extern void dump_flight(const char *why);
 
 /* translate tables */
 extern const WORD6 translatetable_ascii2bic[128];
@@ -718,6 +747,5 @@ extern int dotrcins;    // trace instruction and IRQs
 extern int dotrcmat;    // trace math operations
 extern int emode;       // emode math
 extern const INSTRUCTION instruction_table[];
-extern unsigned instr_count;
 
 #endif /* COMMON_H */
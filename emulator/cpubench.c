@@ -0,0 +1,477 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* per operator micro benchmark of the processor core
+*
+* Builds a small program for each operator, a loop of the operator
+* with just enough around it to keep the stack balanced, and drives
+* sim_instr() on it directly. Like asmtest there are no devices, main
+* memory and central control are private to this program. The loops
+* run in control state, so no interrupt is ever taken.
+*
+* usage: cpubench [-n <count>] [-r <repeat>] [-o <file>] [-v] [<name> ...]
+*   -n	instructions per timed run, default 5000000
+*   -r	timed runs per operator, the fastest counts, default 3
+*   -o	JSON result file, default cpubench.json
+*   -v	list the loops with their instruction mix
+*   names select operators, all by default
+*
+* For each operator the table shows the instructions of the loop per
+* operator executed, the time per operator (including the instructions
+* around it), the time per instruction and MIPS. The JSON file has the
+* same plus the aggregate MIPS over all loops, to compare the builds
+* before and after a change to b5500_cpu.c.
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "common.h"
+#include "telemetry.h"
+#include "machine.h"
+
+#define	COUNT		5000000		// default instructions per run
+#define	REPEAT		3		// default runs per operator
+#define	WARMUP		10000		// instructions before timing
+#define	UNITS		32		// operator units per word mode loop
+#define	CHARLOOP	60		// syllables per character mode loop
+
+/***********************************************************************
+* memory layout, R is 0 so R+n is n
+***********************************************************************/
+#define	DATA		0100		// OPDC/DESC operand
+#define	LLLKEY		0101		// key for LLL
+#define	LLLHEAD		0102		// link to the list
+#define	LLLLIST		0110		// list of 8 entries and an end
+#define	PDXIT		0140		// program descriptor, XIT procedure
+#define	PDRTN		0141		// program descriptor, RTN procedure
+#define	SRCDESC		0204		// source array descriptor
+#define	DSTDESC		0205		// destination array descriptor
+#define	SRCARRAY	01000
+#define	DSTARRAY	01020
+#define	CODE		02000		// the loop
+#define	PROCXIT		03000
+#define	PROCRTN		03010
+#define	STACK		04000
+
+/***********************************************************************
+* the machine, without shared memory
+***********************************************************************/
+__thread MACHINE *machine;
+__thread volatile WORD48 *MAIN;
+__thread CPU *P[2];
+__thread volatile CENTRAL_CONTROL *CC;
+__thread IOCU *IO[4];
+__thread TELEMETRY_T *TM;
+static MACHINE m;
+
+int dotrcmem;
+int dotrcins;
+
+/***********************************************************************
+* the operators
+***********************************************************************/
+typedef struct bench {
+	const char	*name;		// as selected on the command line
+	const char	*opclass;
+	const char	*target;	// the operator counted
+	const char	*prologue;	// word mode, once before the loop
+	const char	*unit;		// repeated in the loop
+	BIT		cwmf;		// unit is character mode
+} BENCH;
+
+// enter character mode with R, COUNT, source and destination as in
+// testing/charmode_test.asm
+#define	STREAM	"LITC 0123;MKS;LITC 0;LITC 0204;LOD;LITC 0205;LOD;CMN"
+
+static const BENCH benches[] = {
+	{"LITC", "literal/operand", "LITC", "", "LITC 5;DEL"},
+	{"OPDC", "literal/operand", "OPDC", "", "OPDC 0100;DEL"},
+	{"DESC", "literal/operand", "DESC", "", "DESC 0100;DEL"},
+	{"ADD", "single precision", "ADD", "LITC 0", "LITC 1;ADD"},
+	{"SUB", "single precision", "SUB", "LITC 0", "LITC 1;SUB"},
+	{"MUL", "single precision", "MUL", "LITC 3", "LITC 1;MUL"},
+	{"DIV", "single precision", "DIV", "LITC 3", "LITC 1;DIV"},
+	{"IDV", "single precision", "IDV", "LITC 3", "LITC 1;IDV"},
+	{"DLA", "double precision", "DLA", "LITC 0;LITC 0", "LITC 1;LITC 1;DLA"},
+	{"DLS", "double precision", "DLS", "LITC 0;LITC 0", "LITC 1;LITC 1;DLS"},
+	{"DLM", "double precision", "DLM", "LITC 3;LITC 3", "LITC 1;LITC 1;DLM"},
+	{"DLD", "double precision", "DLD", "LITC 3;LITC 3", "LITC 1;LITC 1;DLD"},
+	{"XIT", "call", "MKS", "", "MKS;DESC 0140"},
+	{"RTN", "call", "RTN", "", "MKS;DESC 0141;DEL"},
+	{"LLL", "link list", "LLL", "", "OPDC 0102;OPDC 0101;LLL;DEL;DEL"},
+	{"TRS", "char transfer", "TRS", STREAM, "RSA 2;RDA 1;TRS 8", true},
+	{"TRW", "char transfer", "TRW", STREAM, "RSA 2;RDA 1;TRW 2", true},
+	{"TRN", "char transfer", "TRN", STREAM, "RSA 2;RDA 1;TRN 8", true},
+	{"TRZ", "char transfer", "TRZ", STREAM, "RSA 2;RDA 1;TRZ 8", true},
+	{"TEQ", "char compare", "TEQ", STREAM, "RSA 2;TEQ 1", true},
+	{"CEQ", "char compare", "CEQ", STREAM, "RSA 2;RDA 1;CEQ 8", true},
+	{"CGR", "char compare", "CGR", STREAM, "RSA 2;RDA 1;CGR 8", true},
+	{"OCV", "char convert", "OCV", STREAM, "SES 5;RDA 1;OCV 8", true},
+	{"ICV", "char convert", "ICV", STREAM, "RSA 2;SED 5;ICV 8", true},
+	{NULL},
+};
+
+/***********************************************************************
+* results
+***********************************************************************/
+typedef struct result {
+	const BENCH	*bench;
+	unsigned	hits;		// target operators executed
+	double		seconds;	// fastest run
+	WORD8		irq;		// I register after the runs
+	BIT		failed;
+} RESULT;
+
+static RESULT results[sizeof benches / sizeof benches[0]];
+static unsigned nresult;
+
+static unsigned count = COUNT;
+static unsigned repeat = REPEAT;
+static int verbose;
+
+/***********************************************************************
+* processor callbacks and what the core needs from central control
+***********************************************************************/
+static WORD12 target_code;	// the syllable counted
+static BIT target_cwmf;
+static unsigned hits;
+
+void sim_traceinstr(CPU *cpu) {
+	if (cpu->rT == target_code && cpu->bCWMF == target_cwmf)
+		hits++;
+}
+
+void initiateIO(CPU *cpu) {
+	cpu->bHLTF = true;
+}
+
+WORD48 interrogateIOChannel(CPU *cpu) {
+	return 1;
+}
+
+WORD48 interrogateUnitStatus(CPU *cpu) {
+	return 0;
+}
+
+WORD48 readTimer(CPU *cpu) {
+	return CC->TM;
+}
+
+void io_complete_taken(int cu) {
+}
+
+void replay_tick(void) {
+}
+
+/***********************************************************************
+* code emission
+***********************************************************************/
+static ADDR15 loc;		// word
+static unsigned syll;		// and syllable 0..3
+
+static void emit_syll(WORD12 code) {
+	unsigned shift = (3 - syll) * 12;
+
+	MAIN[loc] = (MAIN[loc] & ~((WORD48)07777 << shift)) | ((WORD48)(code & 07777) << shift);
+	if (++syll == 4) {
+		syll = 0;
+		loc = (loc + 1) & MASKMEM;
+	}
+}
+
+// one "<mnemonic> [<number>]"
+static WORD12 encode(const char *item, BIT cwmf) {
+	const INSTRUCTION *ip;
+	char name[8];
+	unsigned v = 0;
+
+	if (sscanf(item, "%7s %i", name, &v) < 1) {
+		fprintf(stderr, "bad benchmark item '%s'\n", item);
+		exit(2);
+	}
+	for (ip = instruction_table; ip->name; ip++)
+		if (ip->cwmf == cwmf && strcmp(ip->name, name) == 0)
+			break;
+	switch (ip->outtype) {
+	case OP_ASIS:
+	case OP_BRAS:
+	case OP_BRAW:	return ip->code;
+	case OP_TOP4:	return ip->code | (v << 8);
+	case OP_TOP6:	return ip->code | (v << 6);
+	case OP_TOP10:	return ip->code | (v << 2);
+	default:
+		fprintf(stderr, "cannot encode benchmark item '%s'\n", item);
+		exit(2);
+	}
+}
+
+// items separated by ';', returns the number of syllables
+static unsigned emit_list(const char *list, BIT cwmf, const char *target) {
+	char buf[100], *item;
+	unsigned n = 0;
+	WORD12 code;
+
+	strcpy(buf, list);
+	for (item = strtok(buf, ";"); item; item = strtok(NULL, ";")) {
+		code = encode(item, cwmf);
+		if (target && strncmp(item, target, strlen(target)) == 0)
+			target_code = code;
+		emit_syll(code);
+		n++;
+	}
+	return n;
+}
+
+/***********************************************************************
+* data, procedures and arrays used by the loops
+***********************************************************************/
+static void layout(void) {
+	static const char *text[] = {"12345678", "NOW IS T", "HE TIME ", "FOR ALL "};
+	unsigned i, j;
+
+	MAIN[DATA] = 01234567;
+	// 8 entries of increasing value, the 9th ends the look-up
+	MAIN[LLLKEY] = (8LL << 15) | 077777;
+	MAIN[LLLHEAD] = LLLLIST;
+	for (i = 0; i < 9; i++)
+		MAIN[LLLLIST + i] = ((WORD48)(i + 1) << 15) | (LLLLIST + i + 1);
+	// program descriptors
+	MAIN[PDXIT] = 07500000000000000LL | PROCXIT;
+	MAIN[PDRTN] = 07500000000000000LL | PROCRTN;
+	loc = PROCXIT, syll = 0;
+	emit_list("XIT", false, NULL);
+	loc = PROCRTN, syll = 0;
+	emit_list("LITC 7;RTN", false, NULL);
+	// array descriptors for 16 words
+	MAIN[SRCDESC] = 05000200000000000LL | SRCARRAY;
+	MAIN[DSTDESC] = 05000200000000000LL | DSTARRAY;
+	for (i = 0; i < 16; i++) {
+		MAIN[SRCARRAY + i] = 0;
+		for (j = 0; j < 8; j++)
+			MAIN[SRCARRAY + i] = (MAIN[SRCARRAY + i] << 6)
+				| translatetable_ascii2bic[(unsigned char)text[i & 3][j]];
+	}
+}
+
+/***********************************************************************
+* a cleared machine with the loop of one operator at CODE
+***********************************************************************/
+static void build(CPU *cpu, const BENCH *b) {
+	ADDR15 start, wb;
+	unsigned units, n, first;
+
+	memset((void *)MAIN, 0, MAXMEM * sizeof(WORD48));
+	memset((void *)CC, 0, sizeof *CC);
+	CC->P2BF = true;
+	CC->HP2F = true;
+	memset(cpu, 0, sizeof *cpu);
+	strcpy((char *)cpu->id, "P1");
+	cpu->acc.id = cpu->id;
+	cpu->isP1 = true;
+	cpu->rC = CODE;
+	cpu->rS = cpu->rF = STACK;
+	layout();
+
+	loc = CODE, syll = 0;
+	if (b->prologue[0])
+		emit_list(b->prologue, false, NULL);
+	target_cwmf = b->cwmf;
+	if (b->cwmf) {
+		// JRV reaches back 63 syllables at most
+		first = loc << 2 | syll;
+		n = emit_list(b->unit, true, b->target);
+		for (units = 1; (units + 1) * n < CHARLOOP; units++)
+			emit_list(b->unit, true, NULL);
+		n = (loc << 2 | syll) + 1 - first;
+		emit_syll(encode("JRV", true) | (n << 6));
+	} else {
+		// the loop starts at a word
+		while (syll)
+			emit_list("NOP", false, NULL);
+		start = loc;
+		for (units = 0; units < UNITS; units++)
+			emit_list(b->unit, false, b->target);
+		// LBU branches back from the word holding it
+		wb = syll == 3 ? loc + 1 : loc;
+		emit_syll(((wb - start) & 01777) << 2);	// LITC
+		emit_list("LBU", false, NULL);
+	}
+	if (verbose)
+		printf("%-5s %2u x %s%s\n", b->name, units, b->unit,
+			b->cwmf ? ";JRV" : ";LITC;LBU");
+}
+
+/***********************************************************************
+* run one operator
+***********************************************************************/
+static void run(CPU *cpu, const BENCH *b, RESULT *r) {
+	struct timespec t0, t1;
+	unsigned i, n;
+	double sec;
+
+	build(cpu, b);
+	r->bench = b;
+	r->seconds = 0;
+	for (n = 0; n < WARMUP && !cpu->bHLTF; n++)
+		sim_instr(cpu);
+	for (i = 0; i < repeat && !cpu->bHLTF; i++) {
+		hits = 0;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (n = 0; n < count; n++)
+			sim_instr(cpu);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+		if (i == 0 || sec < r->seconds)
+			r->seconds = sec;
+		r->hits = hits;
+	}
+	r->irq = cpu->rI;
+	r->failed = cpu->bHLTF || r->hits == 0 || r->seconds <= 0;
+}
+
+/***********************************************************************
+* output
+***********************************************************************/
+static void print_table(void) {
+	const RESULT *r;
+	double total = 0;
+	unsigned i, ok = 0;
+
+	printf("%-5s %-17s %9s %9s %9s %9s\n",
+		"op", "class", "instr/op", "ns/op", "ns/instr", "MIPS");
+	for (i = 0; i < nresult; i++) {
+		r = results + i;
+		if (r->failed) {
+			printf("%-5s %-17s FAILED, the loop does not run (I=%02x)\n",
+				r->bench->name, r->bench->opclass, r->irq);
+			continue;
+		}
+		printf("%-5s %-17s %9.2f %9.2f %9.2f %9.2f\n",
+			r->bench->name, r->bench->opclass,
+			(double)count / r->hits, r->seconds * 1e9 / r->hits,
+			r->seconds * 1e9 / count, count / r->seconds / 1e6);
+		total += r->seconds;
+		ok++;
+	}
+	if (total > 0)
+		printf("aggregate %.2f MIPS\n", ok * (double)count / total / 1e6);
+}
+
+static int write_json(const char *name) {
+	const RESULT *r;
+	double total = 0;
+	unsigned i, ok = 0;
+	FILE *fp;
+
+	fp = fopen(name, "w");
+	if (fp == NULL) {
+		perror(name);
+		return -1;
+	}
+	fprintf(fp, "{\n\t\"instructions\": %u,\n\t\"repeat\": %u,\n\t\"operators\": [\n",
+		count, repeat);
+	for (i = 0; i < nresult; i++) {
+		r = results + i;
+		fprintf(fp, "\t\t{\"op\": \"%s\", \"class\": \"%s\", \"loop\": \"%s\", ",
+			r->bench->name, r->bench->opclass, r->bench->unit);
+		if (r->failed) {
+			fprintf(fp, "\"failed\": true}");
+		} else {
+			fprintf(fp, "\"instr_per_op\": %.3f, \"ns_per_op\": %.3f, "
+				"\"ns_per_instr\": %.3f, \"mips\": %.3f}",
+				(double)count / r->hits, r->seconds * 1e9 / r->hits,
+				r->seconds * 1e9 / count, count / r->seconds / 1e6);
+			total += r->seconds;
+			ok++;
+		}
+		fprintf(fp, "%s\n", i + 1 < nresult ? "," : "");
+	}
+	fprintf(fp, "\t],\n\t\"aggregate_mips\": %.3f\n}\n",
+		total > 0 ? ok * (double)count / total / 1e6 : 0.0);
+	fclose(fp);
+	return 0;
+}
+
+/***********************************************************************
+* the MAIN program
+***********************************************************************/
+int main(int argc, char *argv[]) {
+	const char *jsonname = "cpubench.json";
+	const BENCH *b;
+	unsigned i, failed = 0;
+	int opt, f;
+
+	while ((opt = getopt(argc, argv, "n:r:o:v")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			repeat = strtoul(optarg, NULL, 10);
+			break;
+		case 'o':
+			jsonname = optarg;
+			break;
+		case 'v':
+			verbose++;
+			break;
+		default:
+			count = 0;
+		}
+	}
+	if (count == 0 || repeat == 0) {
+		fprintf(stderr, "Usage: %s [-n <count>] [-r <repeat>] [-o <file>] [-v] [<name> ...]\n", argv[0]);
+		exit(2);
+	}
+
+	MAIN = (WORD48 *)calloc(MAXMEM, sizeof(WORD48));
+	CC = (CENTRAL_CONTROL *)calloc(1, sizeof(CENTRAL_CONTROL));
+	P[0] = (CPU *)calloc(1, sizeof(CPU));
+	P[1] = (CPU *)calloc(1, sizeof(CPU));
+	for (i = 0; i < 4; i++)
+		IO[i] = (IOCU *)calloc(1, sizeof(IOCU));
+	TM = (TELEMETRY_T *)calloc(1, sizeof(TELEMETRY_T));
+	m.main = MAIN;
+	m.cpu[0] = P[0];
+	m.cpu[1] = P[1];
+	m.cc = CC;
+	for (i = 0; i < 4; i++)
+		m.iocu[i] = IO[i];
+	m.tm = TM;
+	m.tracefp = stdout;
+	machine_bind(&m);
+
+	for (b = benches; b->name; b++) {
+		if (optind < argc) {
+			for (f = optind; f < argc; f++)
+				if (strcasecmp(argv[f], b->name) == 0)
+					break;
+			if (f >= argc)
+				continue;
+		}
+		run(P[0], b, results + nresult);
+		if (results[nresult].failed)
+			failed++;
+		nresult++;
+	}
+	if (nresult == 0) {
+		fprintf(stderr, "no such operator\n");
+		exit(2);
+	}
+	print_table();
+	if (write_json(jsonname) < 0)
+		exit(2);
+	return failed ? 1 : 0;
+}
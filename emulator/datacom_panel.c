@@ -15,6 +15,9 @@
 *   overhaul of file names
 * 2020-03-09  R.Meyer
 *   added iTELEX functionality
+* 2026-10-19  agent
+*   only connected lines, read from the DCC telemetry region,
+*   -n <instance> selects the emulator
 ***********************************************************************/
 
 #include <stdio.h>
@@ -33,6 +36,7 @@
 #include "telnetd.h"
 #include "itelexd.h"
 #include "dcc.h"
+#include "telemetry.h"
 
 /***********************************************************************
 * string constants
@@ -49,65 +53,84 @@ static const char *bufstate_name[] = {
 	"NRDY", "IDLE", "IBSY", "RRDY", "OBSY", "WRDY"};
 
 /***********************************************************************
-* the terminals
+* the lines, as published by the DCC
 ***********************************************************************/
-int shm_dcc;	// DCC shared structures
-static TERMINAL_T *terminal;
+int shm_dcct;	// DCC telemetry
+static DCC_TELEMETRY_T *dcct;
+static DCC_TELEMETRY_T snap;
 
 int main(int argc, char	*argv[])
 {
-	int i;
-	TERMINAL_T *t;
+	unsigned i, seen = 0, instance = 0;
+	DCC_LINE_T *l;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			instance = strtoul(optarg, NULL, 10);
+			if (instance < MAXINSTANCE)
+				break;
+			// fall through
+		default:
+			fprintf(stderr, "Usage: %s [-n <instance>]\n", argv[0]);
+			exit(2);
+		}
+	}
 
 	// establish shared memory
-	shm_dcc = shmget(SHM_DCC, sizeof(TERMINAL_T)*NUMTERM, IPC_CREAT|0644);
-	if (shm_dcc < 0) {
-		perror("shmget DCC");
+	shm_dcct = shmget(IPCKEY(SHM_DCCT, instance), sizeof(DCC_TELEMETRY_T), IPC_CREAT|0644);
+	if (shm_dcct < 0) {
+		perror("shmget DCCT");
 		exit(2);
 	}
-	terminal = (TERMINAL_T *)shmat(shm_dcc, NULL, 0);
-	if ((int)terminal == -1) {
-		perror("shmat DCC");
+	dcct = (DCC_TELEMETRY_T *)shmat(shm_dcct, NULL, 0);
+	if ((int)dcct == -1) {
+		perror("shmat DCCT");
 		exit(2);
 	}
 
 	printf("\033[2J");
 	while (1) {
+		// redraw only when the DCC published a new table
+		if (seqlock_read(&dcct->seq, &snap, dcct, sizeof snap) < 0 || snap.seq == seen) {
+			usleep(100000);
+			continue;
+		}
+		seen = snap.seq;
 		printf("\033[H");
-		for (i=0; i<NUMTERM-1; i++) {
-			t = &terminal[i];
+		for (i=0; i<snap.count && i<NUMTERM; i++) {
+			l = &snap.line[i];
 			printf("%-5.5s %-4.4s I=%u A=%u F=%u %-4.4s %-4.4s %-4.4s %-4.4s",
-				t->name,
-				bufstate_name[t->bufstate],
-				t->interrupt, t->abnormal, t->fullbuffer,
-				pc_name[t->pc], pcs_name[t->pcs],
-				ld_name[t->ld], em_name[t->em]);
-			switch (t->pc) {
+				l->name,
+				bufstate_name[l->bufstate],
+				l->interrupt, l->abnormal, l->fullbuffer,
+				pc_name[l->pc], pcs_name[l->pcs],
+				ld_name[l->ld], em_name[l->em]);
+			switch (l->pc) {
 			case pc_none:
 				break;
 			case pc_serial:
-				printf(" %d", t->serial_handle);
-				break;
 			case pc_canopen:
-				printf(" %d", t->canid);
+				printf(" %d", l->handle);
 				break;
 			case pc_telnet:
 				printf(" %d %s %ux%u %s",
-					t->tsession.socket,
-					t->tsession.type,
-					t->tsession.cols, t->tsession.rows,
-					t->peer_info);
+					l->handle, l->type,
+					l->cols, l->rows,
+					l->peer_info);
 				break;
 			case pc_itelex:
 				printf(" %d %s",
-					t->isession.socket,
-					t->peer_info);
+					l->handle,
+					l->peer_info);
 				break;
 			}
 			printf("\033[K\n");
 		}
+		printf("\033[J");
 		fflush(stdout);
-		sleep(1);
+		usleep(100000);
 	}
 	return 0;
 }
@@ -9,16 +9,25 @@
 ************************************************************************
 * 2018-02-14  R.Meyer
 *   Frame from dev_spo.c
+* 2026-10-19  agent
+*   IO/DCC queues, buffer pool for all 15 terminal units, TELNET ring,
+*   ANSI shadow, line telemetry, pc_telnet_term and pc_itelex_term
 ***********************************************************************/
 
 #ifndef	_DCC_H_
 #define	_DCC_H_
 
-#define NUMTERM 32
+#include "ansiscreen.h"
+
+#define	NUMTU 15	// terminal units 1..15
+#define	NUMBUF 16	// buffers 0..15 per terminal unit
+#define	NUMTERM (NUMTU*NUMBUF)
 #define	NUMSERV_T 2
 #define	NUMSERV_I 2
 
 #define TRACE_DCC 0
+#define	DCC_TICK 20	// milliseconds between polls of not event driven connections
+#define	DCC_QLEN 512	// power of two, at least twice NUMTERM
 #define PEER_INFO_LEN 80
 
 // Special Codes 
@@ -57,16 +66,17 @@
 #define	US	0x1f	// "shift in" - protected area end
 #define	RUBOUT	0x7f	// rubout - punch all holes on tape
 
-// tnr/bnr to index and back
-#define	IDX(tnr,bnr)	(((tun)-1)*16+(bnr))
-#define	TUN(index)	((index)/16+1)
-#define	BNR(index)	((index)%16)
+// tun/bnr to index and back
+#define	IDX(tun,bnr)	(((tun)-1)*NUMBUF+(bnr))
+#define	TUN(index)	((index)/NUMBUF+1)
+#define	BNR(index)	((index)%NUMBUF)
 
 // buffer sizes
 #define	SYSBUFSIZE	112
 #define	INBUFSIZE	200
 #define	OUTBUFSIZE	200
 #define	KEYBUFSIZE	100
+#define	TN_OUTBUFSIZE	8192	// power of 2, holds a full screen update
 
 /***********************************************************************
 * the sysbuf states
@@ -146,8 +156,25 @@ enum pcs {
 	pcs_connected,		// connected and also connected to system
 	pcs_failed};		// connection failed and will be closed
 
+/***********************************************************************
+* the buffers only needed while a terminal is connected
+***********************************************************************/
+typedef struct terminal_buffers {
+	struct terminal_buffers *next;	// next in free pool
+	char inbuf[SYSBUFSIZE];
+	char outbuf[SYSBUFSIZE];
+	char keybuf[KEYBUFSIZE];
+	char scrbuf[ROWS*COLS];
+	unsigned char tnout[TN_OUTBUFSIZE];	// TELNET output ring
+	unsigned char itin[IT_BUFLEN];	// iTELEX packet assembly ring
+	unsigned char itrx[IT_BUFLEN];	// iTELEX received ASCII ring
+	ANSISCREEN_T scr;		// what the ANSI terminal shows
+} TERMINAL_BUFFERS_T;
+
 /***********************************************************************
 * the complete terminal state
+* the buffers are taken from a pool on connect and returned
+* on disconnect
 ***********************************************************************/
 typedef struct terminal {
 	char name[10];			// printable name
@@ -168,15 +195,17 @@ typedef struct terminal {
 	int sysidx;			// number of chars in sysbuf
 	enum bufstate bufstate;		// current state of sysbuf
 	BIT fullbuffer;
+// buffers from pool
+	TERMINAL_BUFFERS_T *bufs;
 // input buffer
-	char inbuf[SYSBUFSIZE];		// buffer simulating line from terminal
+	char *inbuf;			// buffer simulating line from terminal
 	int inidx;
 // output buffer
-	char outbuf[SYSBUFSIZE];	// buffer simulating line to terminal
+	char *outbuf;			// buffer simulating line to terminal
 	int outidx;
 	BIT disc;			// pending disconnect request
 // keyboard edit buffer
-	char keybuf[KEYBUFSIZE];	// buffer for keyboard editing
+	char *keybuf;			// buffer for keyboard editing
 	int keyidx;			// number of chars in keybuf
 	BIT escaped;
 // line discipline/emulation
@@ -196,7 +225,7 @@ typedef struct terminal {
 	int eotcount;
 	int timer;
 // screen buffer
-	char scrbuf[ROWS*COLS];		// screen buffer
+	char *scrbuf;			// screen buffer
 	int scridx, scridy;		// index into screen (cursor position, zero based)
 	BIT lfpending;
 	BIT paused;
@@ -204,8 +233,43 @@ typedef struct terminal {
 	BIT insertmode;
 // tracing file
 	FILE *trace;
+// DCC thread
+	BIT blocked;			// input events disabled
+	BIT queued;			// in the service queue
 } TERMINAL_T;
 
+/***********************************************************************
+* queue of terminal indexes between threads
+***********************************************************************/
+typedef struct dcc_queue {
+	unsigned rp, wp;		// read and write counters
+	unsigned short idx[DCC_QLEN];
+} DCC_QUEUE_T;
+
+/***********************************************************************
+* telemetry for the datacom panel
+* the connected lines, copied by the DCC thread (see telemetry.h)
+***********************************************************************/
+typedef struct dcc_line {
+	char name[10];
+	enum pc pc;
+	enum pcs pcs;
+	enum ld ld;
+	enum em em;
+	enum bufstate bufstate;
+	BIT interrupt, abnormal, fullbuffer;
+	int handle;			// socket, tty handle or CAN id
+	unsigned cols, rows;		// TELNET window
+	char type[TN_TYPE_BUFLEN];	// TELNET terminal type
+	char peer_info[PEER_INFO_LEN];
+} DCC_LINE_T;
+
+typedef struct dcc_telemetry {
+	unsigned seq;			// seqlock
+	unsigned count;			// entries used in line
+	DCC_LINE_T line[NUMTERM];
+} DCC_TELEMETRY_T;
+
 /***********************************************************************
 * trace flags
 ***********************************************************************/
@@ -217,15 +281,18 @@ extern BIT ctrace;
 * physical connection by TELNET
 ***********************************************************************/
 extern void pc_telnet_init(void);
+extern void pc_telnet_term(void);
 extern void pc_telnet_poll(BIT telnet);
 extern void pc_telnet_poll_terminal(TERMINAL_T *t);
 extern int pc_telnet_read(TERMINAL_T *t, char *buf, int len);
 extern int pc_telnet_write(TERMINAL_T *t, char *buf, int len);
+extern void pc_telnet_flush(TERMINAL_T *t);
 
 /***********************************************************************
 * physical connection by iTELEX
 ***********************************************************************/
 extern void pc_itelex_init(void);
+extern void pc_itelex_term(void);
 extern void pc_itelex_poll(BIT telnet);
 extern void pc_itelex_poll_terminal(TERMINAL_T *t);
 extern int pc_itelex_read(TERMINAL_T *t, char *buf, int len);
@@ -275,14 +342,18 @@ extern void dcc_input_ready(TERMINAL_T *t);
 ***********************************************************************/
 extern TERMINAL_T *dcc_find_free_terminal(enum ld ld);
 extern void dcc_init_terminal(TERMINAL_T *t);
+extern void dcc_release_terminal(TERMINAL_T *t);
 extern void dcc_report_connect(TERMINAL_T *t);
 extern void dcc_report_disconnect(TERMINAL_T *t);
+extern void dcc_watch(int fd, TERMINAL_T *t);
+extern void dcc_request_service(TERMINAL_T *t);
 
 /***********************************************************************
 * B9352 emulation input/output
 ***********************************************************************/
 extern int b9352_input(TERMINAL_T *t, char ch);
 extern int b9352_output(TERMINAL_T *t, char ch);
+extern void b9352_refresh(TERMINAL_T *t);
 
 #endif	//_DCC_H_
 
@@ -20,6 +20,9 @@
 *   and all emulation (EM) functionality to spearate files
 * 2020-03-09  R.Meyer
 *   added iTELEX functionality
+* 2026-10-19  agent
+*   the screen memory is rendered with a shadow copy of the terminal,
+*   only changes are sent, once per block
 ***********************************************************************/
 
 #include <stdio.h>
@@ -63,15 +66,16 @@
 #define	_GOTO_	"\033[%u;%uH"	// set cursor to row and column
 
 /***********************************************************************
-* Special UTF-8 characters
+* Special characters
+* in plain mode CR, ETX, RS and US are shown highlighted
 ***********************************************************************/
-#define	_CRSYM_		_SO_ "~" _SI_ _EREOL_
-#define	_ETXSYM_	_SO_ "|" _SI_ _EREOL_
-#define	_RSSYM_		_SO_ "<" _SI_
-#define	_USSYM_		_SO_ ">" _SI_
+#define	_CRSYM_		"~"
+#define	_ETXSYM_	"|"
+#define	_RSSYM_		"<"
+#define	_USSYM_		">"
 
-#define	_CRSYM8_	"○" _EREOL_
-#define	_ETXSYM8_	"◊" _EREOL_
+#define	_CRSYM8_	"○"
+#define	_ETXSYM8_	"◊"
 #define	_RSSYM8_	"◄"
 #define	_USSYM8_	"►"
 
@@ -83,66 +87,66 @@
 
 #define	FILLCHAR	' '
 
+#if ROWS != ANSI_ROWS || COLS != ANSI_COLS
+#error screen memory and ANSI renderer differ in size
+#endif
+
 /***********************************************************************
-* Redisplay memory on ANSI terminal
+* how screen memory characters are displayed
 ***********************************************************************/
-#define BUFLEN 40	// make sure it can hold the escape sequences!
-static void redisplay(TERMINAL_T *t, int row1, int row2) {
-	char buf[BUFLEN];
-	char *p = buf;
-
-	for (int row = row1; row <= row2; row++) {
-		// move cursor to begin of line
-		p = buf + sprintf(buf, _GOTO_, row+1, 1);
-		char *q = t->scrbuf + row * COLS;
-		for (int col = 0; col < COLS; col++) {
-			char ch = *q++;
-			if (row == ROWS-1 && col == COLS-1) {
-				// cannot use last char of last line
-				continue;
-			}
+static const char *glyph(int ch) {
+	switch (ch) {
+	case CR: return _CRSYM_;
+	case ETX: return _ETXSYM_;
+	case RS: return _RSSYM_;
+	case US: return _USSYM_;
+	default: return NULL;
+	}
+}
 
-			switch (ch) {
-			case CR:
-				if (t->utf8mode) p += sprintf(p, _CRSYM8_); else p += sprintf(p, _CRSYM_);
-				break;
-			case ETX:
-				if (t->utf8mode) p += sprintf(p, _ETXSYM8_); else p += sprintf(p, _ETXSYM_);
-				break;
-			case RS:
-				if (t->utf8mode) p += sprintf(p, _RSSYM8_); else p += sprintf(p, _RSSYM_);
-				break;
-			case US:
-				if (t->utf8mode) p += sprintf(p, _USSYM8_); else p += sprintf(p, _USSYM_);
-				break;
-			case '{':
-				if (t->utf8mode) p += sprintf(p, _LE8_); else *p++ = ch;
-				break;
-			case '}':
-				if (t->utf8mode) p += sprintf(p, _GE8_); else *p++ = ch;
-				break;
-			case '!':
-				if (t->utf8mode) p += sprintf(p, _NOT8_); else *p++ = ch;
-				break;
-			case '|':
-				if (t->utf8mode) p += sprintf(p, _MULT8_); else *p++ = ch;
-				break;
-			case '~':
-				if (t->utf8mode) p += sprintf(p, _LEFTARROW8_); else *p++ = ch;
-				break;
-			default:
-				*p++ = ch;
-			}
+static const char *glyph8(int ch) {
+	switch (ch) {
+	case CR: return _CRSYM8_;
+	case ETX: return _ETXSYM8_;
+	case RS: return _RSSYM8_;
+	case US: return _USSYM8_;
+	case '{': return _LE8_;
+	case '}': return _GE8_;
+	case '!': return _NOT8_;
+	case '|': return _MULT8_;
+	case '~': return _LEFTARROW8_;
+	default: return NULL;
+	}
+}
 
-			if (p > buf) {
-				telnet_session_write(&t->tsession, buf, p-buf);
-				p = buf;
-			}
+static const ANSISTYLE_T style = {_SO_, _SI_, glyph};
+static const ANSISTYLE_T style8 = {_SO_, _SI_, glyph8};
+
+/***********************************************************************
+* Show changes of memory on ANSI terminal
+***********************************************************************/
+#define BUFLEN 1024
+void b9352_refresh(TERMINAL_T *t) {
+	unsigned short img[ROWS*COLS];
+	char buf[BUFLEN];
+	int i, len;
+
+	if (t->em != em_ansi || t->pc != pc_telnet || t->bufs == NULL)
+		return;
+	for (i = 0; i < ROWS*COLS; i++) {
+		img[i] = (unsigned char)t->scrbuf[i];
+		if (!t->utf8mode && (t->scrbuf[i] == CR || t->scrbuf[i] == ETX ||
+		    t->scrbuf[i] == RS || t->scrbuf[i] == US))
+			img[i] |= ANSI_ATTR;
+	}
+	while ((len = ansiscreen_render(&t->bufs->scr, t->utf8mode ? &style8 : &style,
+			img, t->scridy, t->scridx, buf, sizeof buf)) > 0) {
+		if (telnet_session_write(&t->tsession, buf, len) != len) {
+			// the shadow already holds what was lost, so repaint all next time
+			ansiscreen_invalidate(&t->bufs->scr);
+			break;
 		}
 	}
-	// move cursor to its last position
-	p += sprintf(p, _GOTO_, t->scridy+1, t->scridx+1);
-	telnet_session_write(&t->tsession, buf, p-buf);
 }
 
 /***********************************************************************
@@ -164,8 +168,8 @@ static void cursorwrap(TERMINAL_T *t) {
 		memmove(t->scrbuf, t->scrbuf + COLS, t->scridy*COLS);
 		// clear last line
 		memset(t->scrbuf + t->scridy*COLS, FILLCHAR, COLS);
-		// re-paint full screen
-		redisplay(t, 0, t->scridy);
+		// let the terminal scroll as well
+		ansiscreen_scroll(&t->bufs->scr);
 	}
 	while (t->scridy < 0) {
 		t->scridy += ROWS;
@@ -175,37 +179,20 @@ static void cursorwrap(TERMINAL_T *t) {
 	}
 }
 
-/***********************************************************************
-* position cursor on ANSI screen
-***********************************************************************/
-static void cursormove(TERMINAL_T *t) {
-	char buf[20];
-	int len;
-	len = sprintf(buf, _GOTO_, t->scridy+1, t->scridx+1);
-	len = telnet_session_write(&t->tsession, buf, len);
-}
-
 /***********************************************************************
 * erase to end of line
 ***********************************************************************/
 static void erasetoeol(TERMINAL_T *t) {
-	char buf[20];
-	int len;
 	memset(t->scrbuf + t->scridy*COLS + t->scridx, FILLCHAR, COLS - t->scridx);
-	len = sprintf(buf, _EREOL_);
-	len = telnet_session_write(&t->tsession, buf, len);
 }
 
 /***********************************************************************
 * erase screen and home
 ***********************************************************************/
 static void erasescreen(TERMINAL_T *t) {
-	char buf[20];
-	int len;
 	t->scridx = t->scridy = 0;
 	memset(t->scrbuf, FILLCHAR, ROWS*COLS);
-	len = sprintf(buf, _HOME_ _CLS_);
-	len = telnet_session_write(&t->tsession, buf, len);
+	ansiscreen_invalidate(&t->bufs->scr);
 }
 
 /***********************************************************************
@@ -216,7 +203,6 @@ static void char_insert(TERMINAL_T *t) {
 		t->scrbuf + t->scridy*COLS + t->scridx,
 		COLS-t->scridx-1);
 	t->scrbuf[t->scridy*COLS + t->scridx] = FILLCHAR;
-	redisplay(t, t->scridy, t->scridy);
 }
 
 /***********************************************************************
@@ -227,49 +213,12 @@ static void char_delete(TERMINAL_T *t) {
 		t->scrbuf + t->scridy*COLS + t->scridx + 1,
 		COLS-t->scridx-1);
 	t->scrbuf[t->scridy*COLS + COLS - 1] = FILLCHAR;
-	redisplay(t, t->scridy, t->scridy);
 }
 
 /***********************************************************************
 * store char and move cursor with wrap
 ***********************************************************************/
 static void store(TERMINAL_T *t, char ch) {
-	char buf[20];
-	char *p = buf;
-
-	switch (ch) {
-	case CR:
-		if (t->utf8mode) p += sprintf(p, _CRSYM8_); else p += sprintf(p, _CRSYM_);
-		break;
-	case ETX:
-		if (t->utf8mode) p += sprintf(p, _ETXSYM8_); else p += sprintf(p, _ETXSYM_);
-		break;
-	case RS:
-		if (t->utf8mode) p += sprintf(p, _RSSYM8_); else p += sprintf(p, _RSSYM_);
-		break;
-	case US:
-		if (t->utf8mode) p += sprintf(p, _USSYM8_); else p += sprintf(p, _USSYM_);
-		break;
-	case '{':
-		if (t->utf8mode) p += sprintf(p, _LE8_); else *p++ = ch;
-		break;
-	case '}':
-		if (t->utf8mode) p += sprintf(p, _GE8_); else *p++ = ch;
-		break;
-	case '!':
-		if (t->utf8mode) p += sprintf(p, _NOT8_); else *p++ = ch;
-		break;
-	case '|':
-		if (t->utf8mode) p += sprintf(p, _MULT8_); else *p++ = ch;
-		break;
-	case '~':
-		if (t->utf8mode) p += sprintf(p, _LEFTARROW8_); else *p++ = ch;
-		break;
-	default:
-		*p++ = ch;
-	}
-
-	telnet_session_write(&t->tsession, buf, p - buf);
 	t->scrbuf[t->scridy*COLS+t->scridx] = ch;
 	t->scridx++;
 	cursorwrap(t);
@@ -294,7 +243,6 @@ int b9352_output(TERMINAL_T *t, char ch) {
 		case BS: // BS = one position left
 			t->scridx--;
 			cursorwrap(t);
-			cursormove(t);
 			break;
 		case DC4: // DC4 = home position, no clear
 			if (true) {
@@ -302,28 +250,23 @@ int b9352_output(TERMINAL_T *t, char ch) {
 				t->paused = true;
 				*op++ = BEL;
 				t->scridx = 0;
-				cursormove(t);
 			} else {
 				t->scridx = t->scridy = 0;
-				cursormove(t);
 			}
 			break;
 		case DC3: // DC3 = one position up
 			t->scridy--;
 			cursorwrap(t);
-			cursormove(t);
 			break;
 		case LF: // LF = one position down
 			t->scridy++;
 			cursorwrap(t);
-			cursormove(t);
 			break;
 		case CR: // CR = move cursor to start of next line
 			store(t, CR);
 			t->scridx = 0;
 			t->scridy++;
 			cursorwrap(t);
-			cursormove(t);
 			break;
 		case FF: // FF = clear screen and cursor home
 			if (true) {
@@ -333,10 +276,8 @@ int b9352_output(TERMINAL_T *t, char ch) {
 				cursorwrap(t);
 				t->scridy++;
 				cursorwrap(t);
-				cursormove(t);
 			} else {
 				t->scridx = t->scridy = 0;
-				cursormove(t);
 				erasescreen(t);
 			}
 			break;
@@ -387,22 +328,18 @@ static void interpret_esc(TERMINAL_T *t) {
 		case 'A': // CURSOR UP
 			t->scridy--;
 			cursorwrap(t);
-			cursormove(t);
 			return;
 		case 'B': // CURSOR DOWN
 			t->scridy++;
 			cursorwrap(t);
-			cursormove(t);
 			return;
 		case 'C': // CURSOR RIGHT
 			t->scridx++;
 			cursorwrap(t);
-			cursormove(t);
 			return;
 		case 'D': // CURSOR LEFT
 			t->scridx--;
 			cursorwrap(t);
-			cursormove(t);
 			return;
 		case 'P': // PAUSE
 			return;
@@ -419,11 +356,11 @@ static void interpret_esc(TERMINAL_T *t) {
 					char_delete(t);
 					return;
 				case 11: F1: // F1
-					redisplay(t, 0, ROWS-1);
+					ansiscreen_invalidate(&t->bufs->scr);
 					return;
 				case 12: F2: // F2
 					t->utf8mode = !t->utf8mode;
-					redisplay(t, 0, ROWS-1);
+					ansiscreen_invalidate(&t->bufs->scr);
 					return;
 				case 13: F3: // F3
 					break;
@@ -496,7 +433,6 @@ int b9352_input(TERMINAL_T *t, char ch) {
 			t->scridx = cursor - linestart;
 		}
 #endif
-		cursormove(t);
 
 		// leave this loop
 		return true;
@@ -17,6 +17,8 @@
 *   and all emulation (EM) functionality to spearate files
 * 2020-03-09  R.Meyer
 *   added iTELEX functionality
+* 2026-10-19  agent
+*   ANSI screen is refreshed once per block instead of per character
 ***********************************************************************/
 
 #include <stdio.h>
@@ -90,7 +92,7 @@ static BIT convert6to8(TERMINAL_T *t) {
 	// make sysbuf available again
 	t->sysidx = 0;
 	t->bufstate = t->fullbuffer ? writeready : idle;
-	t->interrupt = true;
+	dcc_request_service(t);
 
 	return disc;
 }
@@ -153,7 +155,7 @@ static void convert8to6(TERMINAL_T *t) {
 	// buffer is ready to be ready by the system
 	t->abnormal = false;
 	t->bufstate = readready;
-	t->interrupt = true;
+	dcc_request_service(t);
 }
 
 /***********************************************************************
@@ -312,6 +314,9 @@ finish:
 	if (etrace)
 		printf("\n");
 
+	// show the changes on the terminal
+	b9352_refresh(t);
+
 	// reason to disconnect?
 	if (disc || error) {
 		if (disc && dtrace) {
@@ -365,7 +370,7 @@ int ld_poll_contention(TERMINAL_T *t) {
 				t->keyidx = 0;
 				t->abnormal = false;
 				t->bufstate = readready;
-				t->interrupt = true;
+				dcc_request_service(t);
 			}
 		}
 		return idx;	
@@ -381,7 +386,7 @@ int ld_poll_contention(TERMINAL_T *t) {
 		t->sysidx = 1;
 		t->abnormal = false;
 		t->bufstate = readready;
-		t->interrupt = true;
+		dcc_request_service(t);
 		t->lds = lds_sentenq;
 		return 0;
 	}
@@ -398,6 +403,7 @@ int ld_poll_contention(TERMINAL_T *t) {
 		if (b9352_input(t, ch))
 			break;
 	}
+	b9352_refresh(t);
 	return idx;	
 }
 
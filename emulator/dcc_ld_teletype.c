@@ -17,6 +17,8 @@
 *   and all emulation (EM) functionality to separate files
 * 2020-03-09  R.Meyer
 *   added iTELEX functionality
+* 2026-10-19  agent
+*   service requests are queued
 ***********************************************************************/
 
 #include <stdio.h>
@@ -85,7 +87,7 @@ static void release_sysbuf(TERMINAL_T *t) {
 	// make sysbuf available again
 	t->sysidx = 0;
 	t->bufstate = t->fullbuffer ? writeready : idle;
-	t->interrupt = true;
+	dcc_request_service(t);
 }
 
 /***********************************************************************
@@ -113,7 +115,7 @@ static void convert8to6(TERMINAL_T *t) {
 	// buffer is ready to be read by the system
 	t->abnormal = false;
 	t->bufstate = readready;
-	t->interrupt = true;
+	dcc_request_service(t);
 }
 
 /***********************************************************************
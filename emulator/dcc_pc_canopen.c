@@ -17,6 +17,8 @@
 *   and all emulation (EM) functionality to spearate files
 * 2020-03-09  R.Meyer
 *   added iTELEX functionality
+* 2026-10-19  agent
+*   buffers are released on disconnect
 ***********************************************************************/
 
 #include <stdio.h>
@@ -89,6 +91,7 @@ void pc_canopen_poll_terminal(TERMINAL_T *t) {
 		}
 		dcc_report_disconnect(t);
 		t->pcs = pcs_disconnected;
+		dcc_release_terminal(t);
 		break;
 	}
 }
@@ -12,6 +12,9 @@
 ************************************************************************
 * 2020-03-09  R.Meyer
 *   copied and modified from dcc_pc_telnet.c
+* 2026-10-19  agent
+*   acknowledge by timer, waiting output sent on acknowledge,
+*   servers are part of the MACHINE
 ***********************************************************************/
 
 #include <stdio.h>
@@ -35,11 +38,15 @@
 #include "telnetd.h"
 #include "itelexd.h"
 #include "dcc.h"
+#include "machine.h"
 
 /***********************************************************************
-* the iTELEX servers
+* the iTELEX servers of the machine
 ***********************************************************************/
-static ITELEX_SERVER_T server[NUMSERV_I];
+struct itelex_state {
+	ITELEX_SERVER_T server[NUMSERV_I];
+};
+#define	ITS	(machine->itelex)
 // server[0]: Port 8024 - LINE type terminals (TELETYPE)
 static unsigned portno[NUMSERV_I] = {8024, 8025};
 static enum ld ldno[NUMSERV_I] = {ld_teletype, ld_teletype};
@@ -73,6 +80,7 @@ static void new_connection(int newsocket, struct sockaddr_in *addr, enum ld ld,
 		itelex_session_clear(&t->isession);
 		t->isession.baudot = baudot;
 		itelex_session_open(&t->isession, newsocket);
+		dcc_watch(newsocket, t);
 		t->pc = pc_itelex;
 		t->ld = ld; t->em = em; t->lds = lds_idle;
 		t->pcs = pcs_pending;
@@ -101,7 +109,7 @@ void pc_itelex_poll_terminal(TERMINAL_T *t) {
 		// connection is pending
 		// poll receive to make negotiation run
 		// (we are not interested in any data yet)
-		cnt = itelex_session_read(&t->isession, t->inbuf, sizeof t->inbuf);
+		cnt = itelex_session_read(&t->isession, t->inbuf, SYSBUFSIZE);
 		if (cnt < 0) {
 			// socket closed by peer
 			t->outidx += sprintf(t->outbuf+t->outidx, " CLOSED\r\n");
@@ -142,12 +150,20 @@ void pc_itelex_poll_terminal(TERMINAL_T *t) {
 		if (cnt < 0) {
 			// socket closed by peer
 			t->pcs = pcs_failed;
+			break;
 		}
+		// acknowledge what we received
+		itelex_session_timer(&t->isession);
+		// output waiting for the peer to acknowledge?
+		if (t->bufstate == outputbusy && t->ld == ld_teletype &&
+		    itelex_session_window(&t->isession) > 0)
+			ld_write_teletype(t);
 		break;
 	case pcs_aborted:
 		itelex_session_close(&t->isession);
 		t->pcs = pcs_disconnected;
 		t->pc = pc_none;
+		dcc_release_terminal(t);
 		break;
 
 	case pcs_failed:
@@ -160,6 +176,7 @@ void pc_itelex_poll_terminal(TERMINAL_T *t) {
 		dcc_report_disconnect(t);
 		t->pcs = pcs_disconnected;
 		t->pc = pc_none;
+		dcc_release_terminal(t);
 		break;
 	}
 }
@@ -170,8 +187,26 @@ void pc_itelex_poll_terminal(TERMINAL_T *t) {
 void pc_itelex_init(void) {
 	int index;
 
+	ITS = (struct itelex_state *)calloc(1, sizeof *ITS);
+	if (ITS == NULL) {
+		perror("itelex");
+		exit(2);
+	}
+	for (index=0; index<NUMSERV_I; index++)
+		itelex_server_clear(ITS->server+index);
+}
+
+/***********************************************************************
+* PC ITELEX: TERM
+***********************************************************************/
+void pc_itelex_term(void) {
+	int index;
+
 	for (index=0; index<NUMSERV_I; index++)
-		itelex_server_clear(server+index);
+		if (ITS->server[index].socket > 2)
+			itelex_server_stop(ITS->server+index);
+	free(ITS);
+	ITS = NULL;
 }
 
 /***********************************************************************
@@ -184,17 +219,21 @@ void pc_itelex_poll(BIT itelex) {
 
 	// start/stop servers
 	for (index=0; index<NUMSERV_I; index++) {
-		if (itelex && server[index].socket <= 2) {
-			itelex_server_start(server+index, portno[index]);
-		} else if (!itelex && server[index].socket > 2) {
-			itelex_server_stop(server+index);
+		if (itelex && ITS->server[index].socket <= 2) {
+			if (itelex_server_start(ITS->server+index, portno[index]) > 2)
+				dcc_watch(ITS->server[index].socket, NULL);
+		} else if (!itelex && ITS->server[index].socket > 2) {
+			itelex_server_stop(ITS->server+index);
 		}
 	}
 
+	// finish closing connections
+	itelex_linger_poll();
+
 	// poll servers for new connections
 	for (index=0; index<NUMSERV_I; index++) {
-		if (server[index].socket > 2) {
-			newsocket = itelex_server_poll(server+index, &addr);
+		if (ITS->server[index].socket > 2) {
+			newsocket = itelex_server_poll(ITS->server+index, &addr);
 			if (newsocket > 0)
 				new_connection(newsocket, &addr,
 					ldno[index], emno[index], is_baudot[index]);
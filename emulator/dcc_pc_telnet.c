@@ -21,6 +21,9 @@
 *   do not insist on TELNET negotiation for TELETYPE lines
 * 2020-03-09  R.Meyer
 *   added iTELEX functionality
+* 2026-10-19  agent
+*   output queued in a ring and flushed by the DCC thread,
+*   servers are part of the MACHINE
 ***********************************************************************/
 
 #include <stdio.h>
@@ -44,11 +47,15 @@
 #include "telnetd.h"
 #include "itelexd.h"
 #include "dcc.h"
+#include "machine.h"
 
 /***********************************************************************
-* the TELNET servers
+* the TELNET servers of the machine
 ***********************************************************************/
-static TELNET_SERVER_T server[NUMSERV_T];
+struct telnet_state {
+	TELNET_SERVER_T server[NUMSERV_T];
+};
+#define	TNS	(machine->telnet)
 // server[0]: Port 23 - BLOCK type terminals (B9352 with external ANSI emulation)
 // server[1]: Port 8023 - LINE type terminals (TELETYPE)
 static unsigned portno[NUMSERV_T] = {23, 8023};
@@ -80,7 +87,9 @@ static void new_connection(int newsocket, struct sockaddr_in *addr, enum ld ld,
 			t->name, t->peer_info, newsocket);
 		dcc_init_terminal(t);
 		telnet_session_clear(&t->tsession);
+		ring_init(&t->tsession.out, t->bufs->tnout, sizeof t->bufs->tnout);
 		telnet_session_open(&t->tsession, newsocket);
+		dcc_watch(newsocket, t);
 		t->pc = pc_telnet;
 		t->ld = ld; t->em = em; t->lds = lds_idle;
 		t->pcs = pcs_pending;
@@ -109,7 +118,7 @@ void pc_telnet_poll_terminal(TERMINAL_T *t) {
 		// connection is pending
 		// poll receive to make negotiation run
 		// (we are not interested in any data yet)
-		cnt = telnet_session_read(&t->tsession, t->inbuf, sizeof t->inbuf);
+		cnt = telnet_session_read(&t->tsession, t->inbuf, SYSBUFSIZE);
 		if (cnt < 0) {
 			// socket closed by peer
 			t->outidx += sprintf(t->outbuf+t->outidx, " CLOSED\r\n");
@@ -158,6 +167,7 @@ void pc_telnet_poll_terminal(TERMINAL_T *t) {
 		telnet_session_close(&t->tsession);
 		t->pcs = pcs_disconnected;
 		t->pc = pc_none;
+		dcc_release_terminal(t);
 		break;
 
 	case pcs_failed:
@@ -170,6 +180,7 @@ void pc_telnet_poll_terminal(TERMINAL_T *t) {
 		dcc_report_disconnect(t);
 		t->pcs = pcs_disconnected;
 		t->pc = pc_none;
+		dcc_release_terminal(t);
 		break;
 	}
 }
@@ -180,8 +191,26 @@ void pc_telnet_poll_terminal(TERMINAL_T *t) {
 void pc_telnet_init(void) {
 	int index;
 
+	TNS = (struct telnet_state *)calloc(1, sizeof *TNS);
+	if (TNS == NULL) {
+		perror("telnet");
+		exit(2);
+	}
 	for (index=0; index<NUMSERV_T; index++)
-		telnet_server_clear(server+index);
+		telnet_server_clear(TNS->server+index);
+}
+
+/***********************************************************************
+* PC TELNET: TERM
+***********************************************************************/
+void pc_telnet_term(void) {
+	int index;
+
+	for (index=0; index<NUMSERV_T; index++)
+		if (TNS->server[index].socket > 2)
+			telnet_server_stop(TNS->server+index);
+	free(TNS);
+	TNS = NULL;
 }
 
 /***********************************************************************
@@ -194,17 +223,18 @@ void pc_telnet_poll(BIT telnet) {
 
 	// start/stop servers
 	for (index=0; index<NUMSERV_T; index++) {
-		if (telnet && server[index].socket <= 2) {
-			telnet_server_start(server+index, portno[index]);
-		} else if (!telnet && server[index].socket > 2) {
-			telnet_server_stop(server+index);
+		if (telnet && TNS->server[index].socket <= 2) {
+			if (telnet_server_start(TNS->server+index, portno[index]) > 2)
+				dcc_watch(TNS->server[index].socket, NULL);
+		} else if (!telnet && TNS->server[index].socket > 2) {
+			telnet_server_stop(TNS->server+index);
 		}
 	}
 
 	// poll servers for new connections
 	for (index=0; index<NUMSERV_T; index++) {
-		if (server[index].socket > 2) {
-			newsocket = telnet_server_poll(server+index, &addr);
+		if (TNS->server[index].socket > 2) {
+			newsocket = telnet_server_poll(TNS->server+index, &addr);
 			if (newsocket > 0)
 				new_connection(newsocket, &addr, ldno[index], emno[index]);
 		}
@@ -227,11 +257,24 @@ int pc_telnet_write(TERMINAL_T *t, char *buf, int len) {
 	// try to write
 	cnt = telnet_session_write(&t->tsession, buf, len);
 	// reason to disconnect?
-	if (cnt != len) {
+	// a short write is no failure: the output ring is full for now,
+	// the caller keeps the rest and the ring drains on the next flush
+	if (cnt < 0) {
 		telnet_session_close(&t->tsession);
 		t->pcs = pcs_failed;
 	}
 	return cnt;
 }
 
+/***********************************************************************
+* PC TELNET: FLUSH
+* send what is waiting in the output ring
+***********************************************************************/
+void pc_telnet_flush(TERMINAL_T *t) {
+	if (t->pcs != pcs_connected && t->pcs != pcs_pending)
+		return;
+	if (telnet_session_flush(&t->tsession) < 0)
+		t->pcs = pcs_failed;
+}
+
 
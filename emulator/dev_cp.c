@@ -9,6 +9,8 @@
 ************************************************************************
 * 2018-05-04  R.Meyer
 *   Copied from dev_cr.c
+* 2026-10-19  agent
+*   state is part of the MACHINE
 ***********************************************************************/
 
 #include <stdio.h>
@@ -22,6 +24,7 @@
 #include <fcntl.h>
 #include "common.h"
 #include "io.h"
+#include "machine.h"
 
 #define PUNCHES 1
 #define NAMELEN 100
@@ -30,73 +33,85 @@
 /***********************************************************************
 * for each supported card reader
 ***********************************************************************/
-static struct cp {
+struct cp {
 	char	filename[NAMELEN];
 	FILE	*fp;
 	BIT	ready;
-} cp[PUNCHES];
+};
 
 /***********************************************************************
-* optional open file to write debugging traces into
+* state
 ***********************************************************************/
-static FILE *trace = NULL;
-static struct cp *cpx = NULL;
+struct cp_state {
+	struct cp cp[PUNCHES];
+	FILE	*trace;		// optional open file to write debugging traces into
+	struct cp *cpx;
+};
+#define	CPS	(machine->cp)
 
 /***********************************************************************
 * set to cpa
 ***********************************************************************/
-static int set_cp(const char *v, void *data) {cpx = cp+(int)data; return 0; }
+static int set_cp(const char *v, void *data) {CPS->cpx = CPS->cp+(int)data; return 0; }
 
 /***********************************************************************
 * specify or close the trace file
 ***********************************************************************/
 static int set_cptrace(const char *v, void *) {
 	// if open, close existing trace file
-	if (trace) {
-		fclose(trace);
-		trace = NULL;
+	if (CPS->trace) {
+		fclose(CPS->trace);
+		CPS->trace = NULL;
 	}
 	// if a name is given, open new trace
 	if (strlen(v) > 0) {
-		trace = fopen(v, "w");
-		if (!trace)
+		CPS->trace = fopen(v, "w");
+		if (!CPS->trace)
 			return 2; // FATAL
 	}
 	return 0; // OK
 }
 
+/***********************************************************************
+* report the ready status of the drive after a change
+***********************************************************************/
+static int cp_changed(int res) {
+	io_ready_changed(cp_ready, CPS->cpx - CPS->cp);
+	return res;
+}
+
 /***********************************************************************
 * specify or close the file for emulation
 ***********************************************************************/
 static int set_cpfile(const char *v, void *) {
-	if (!cpx) {
+	if (!CPS->cpx) {
 		printf("cp not specified\n");
 		return 2; // FATAL
 	}
-	strncpy(cpx->filename, v, NAMELEN);
-	cpx->filename[NAMELEN-1] = 0;
+	strncpy(CPS->cpx->filename, v, NAMELEN);
+	CPS->cpx->filename[NAMELEN-1] = 0;
 
 	// if we are ready, close current file
-	if (cpx->ready) {
-		fclose(cpx->fp);
-		cpx->fp = NULL;
-		cpx->ready = false;
+	if (CPS->cpx->ready) {
+		fclose(CPS->cpx->fp);
+		CPS->cpx->fp = NULL;
+		CPS->cpx->ready = false;
 	}
 
 	// now open the new file, if any name was given
 	// if none given, the drive just stays unready
-	if (cpx->filename[0]) {
-		cpx->fp = fopen(cpx->filename, "w"); // card punch is always write only
-		if (cpx->fp) {
-			cpx->ready = true;
-			return 0; // OK
+	if (CPS->cpx->filename[0]) {
+		CPS->cpx->fp = fopen(CPS->cpx->filename, "w"); // card punch is always write only
+		if (CPS->cpx->fp) {
+			CPS->cpx->ready = true;
+			return cp_changed(0); // OK
 		} else {
 			// cannot open
-			perror(cpx->filename);
-			return 2; // FATAL
+			perror(CPS->cpx->filename);
+			return cp_changed(2); // FATAL
 		}
 	}
-	return 0; // OK
+	return cp_changed(0); // OK
 }
 
 /***********************************************************************
@@ -113,8 +128,41 @@ static const command_t cp_commands[] = {
 * Initialize command from argv scanner or special SPO input
 ***********************************************************************/
 int cp_init(const char *option) {
-	cpx = NULL; // require specification of a drive
-	return command_parser(cp_commands, option);
+	int res;
+
+	CPS->cpx = NULL; // require specification of a drive
+	res = command_parser(cp_commands, option);
+	return res;
+}
+
+/***********************************************************************
+* state of a new machine
+***********************************************************************/
+int cp_create(void) {
+	CPS = (struct cp_state *)calloc(1, sizeof *CPS);
+	if (CPS == NULL) {
+		perror("cp");
+		return -1;
+	}
+	return 0;
+}
+
+/***********************************************************************
+* close the files
+***********************************************************************/
+void cp_term(void) {
+	struct cp *c;
+
+	if (CPS == NULL)
+		return;
+	for (c = CPS->cp; c < CPS->cp+PUNCHES; c++) {
+		if (c->fp)
+			fclose(c->fp);
+	}
+	if (CPS->trace)
+		fclose(CPS->trace);
+	free(CPS);
+	CPS = NULL;
 }
 
 /***********************************************************************
@@ -122,7 +170,7 @@ int cp_init(const char *option) {
 ***********************************************************************/
 BIT cp_ready(unsigned index) {
 	if (index < PUNCHES)
-		return cp[index].ready;
+		return CPS->cp[index].ready;
 	return false;
 }
 
@@ -131,16 +179,16 @@ BIT cp_ready(unsigned index) {
 ***********************************************************************/
 void cp_write(IOCU *u) {
         BIT mi;
-	struct cp *cpx;
+	struct cp *c;
 	int w, i;
 
         mi = u->d_control & CD_30_MI ? true : false;
 
         u->d_result = 0; // no errors so far
 
-	cpx = cp + unit[u->d_unit][1].index;
+	c = CPS->cp + unit[u->d_unit][1].index;
 
-        if (!cpx->ready) {
+        if (!c->ready) {
                 u->d_result = RD_18_NRDY;
                 goto retresult;
         }
@@ -151,12 +199,12 @@ void cp_write(IOCU *u) {
                         main_read_inc(u);
                         for (i=0; i<8; i++) {
                                 get_ob(u);
-                                fputc(translatetable_bic2ascii[u->ob], cpx->fp);
+                                fputc(translatetable_bic2ascii[u->ob], c->fp);
 			}
                 }
-		fputc('\r', cpx->fp);
-		fputc('\n', cpx->fp);
-		fflush(cpx->fp);
+		fputc('\r', c->fp);
+		fputc('\n', c->fp);
+		fflush(c->fp);
         }
 
 retresult:
@@ -12,98 +12,441 @@
 * 2018-03-16  R.Meyer
 *   Changed old ACCESSOR method to main_*_inc functions
 *   and use u->ib
+* 2026-10-19  agent
+*   hopper queue of memory mapped decks, optional spool directory,
+*   snapshots, state is part of the MACHINE
 ***********************************************************************/
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <stddef.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
 #include "common.h"
 #include "io.h"
+#include "snapshot.h"
+#include "machine.h"
 
 #define READERS 2
 #define NAMELEN 100
-#define	CBUFLEN	164
+#define	HOPPER	64
+
+/***********************************************************************
+* a pre-parsed card, pointing into the mapped deck
+***********************************************************************/
+struct card {
+	const char *text;	// first column
+	int	len;		// without trailing blanks and control codes
+};
 
 /***********************************************************************
 * for each supported card reader
 ***********************************************************************/
-static struct cr {
-	char	filename[NAMELEN];
-	FILE	*fp;
+struct cr {
+	char	filename[NAMELEN];	// current deck
 	BIT	ready;
-	char	cbuf[CBUFLEN];
-	char	*cbufp;
-} cr[READERS];
+	BIT	spooled;		// current deck came from the spool directory
+	char	*map;			// current deck mapped into memory
+	size_t	maplen;
+	struct card *cards;		// cards of current deck
+	int	ncards;
+	int	next;			// next card to read
+	char	hopper[HOPPER][NAMELEN];	// queued decks
+	BIT	hspooled[HOPPER];
+	unsigned hrp, hwp;		// hopper read and write counters
+	char	spooldir[NAMELEN];	// watched spool directory
+	int	ifd;			// inotify handle or -1
+	BIT	rescan;			// spooled decks wait for room in the hopper
+};
+
+/***********************************************************************
+* state
+***********************************************************************/
+struct cr_state {
+	struct cr cr[READERS];
+	pthread_mutex_t mutex;		// protects the hopper against SPO commands while the IO thread reads
+	BIT	initialized;
+	pthread_t spool_handler;
+	int	wakefd;			// wakes the spool thread to end it
+	volatile BIT stop;
+	FILE	*trace;			// optional open file to write debugging traces into
+	struct cr *crx;
+};
+#define	CRS	(machine->cr)
+
+/***********************************************************************
+* release the current deck
+* a deck from the spool directory is renamed to <name>.done
+***********************************************************************/
+static void cr_unload(struct cr *c) {
+	char done[NAMELEN+8];
+
+	if (c->map)
+		munmap(c->map, c->maplen);
+	free(c->cards);
+	if (c->spooled) {
+		sprintf(done, "%s.done", c->filename);
+		if (rename(c->filename, done) < 0)
+			perror(c->filename);
+	}
+	c->map = NULL;
+	c->maplen = 0;
+	c->cards = NULL;
+	c->ncards = 0;
+	c->next = 0;
+	c->spooled = false;
+	c->ready = false;
+}
+
+/***********************************************************************
+* map a deck and split it into cards
+* returns 0: OK, 2: cannot be opened or is empty
+***********************************************************************/
+static int cr_load(struct cr *c, const char *name, BIT spooled) {
+	struct stat st;
+	char *p, *end, *eol;
+	int fd, n;
+
+	cr_unload(c);
+	strncpy(c->filename, name, NAMELEN);
+	c->filename[NAMELEN-1] = 0;
+
+	fd = open(c->filename, O_RDONLY); // cards are always read only
+	if (fd < 0) {
+		perror(c->filename);
+		return 2; // FATAL
+	}
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		printf("%s: empty deck\n", c->filename);
+		close(fd);
+		return 2; // FATAL
+	}
+	c->maplen = st.st_size;
+	c->map = (char*)mmap(NULL, c->maplen, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (c->map == MAP_FAILED) {
+		perror(c->filename);
+		c->map = NULL;
+		return 2; // FATAL
+	}
+
+	// count lines to size the card table
+	end = c->map + c->maplen;
+	n = 1;
+	for (p = c->map; p < end; p++)
+		if (*p == '\n')
+			n++;
+	c->cards = (struct card*)malloc(n * sizeof(struct card));
+
+	// one card per line, remove trailing control codes and blanks
+	for (p = c->map; p < end; p = eol + 1) {
+		eol = (char*)memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+		n = eol - p;
+		while (n > 0 && p[n-1] <= ' ')
+			n--;
+		c->cards[c->ncards].text = p;
+		c->cards[c->ncards].len = n;
+		c->ncards++;
+	}
+	c->spooled = spooled;
+	c->ready = true;
+	return 0; // OK
+}
+
+/***********************************************************************
+* add a deck to the hopper, must hold CRS->mutex
+***********************************************************************/
+static int cr_queue(struct cr *c, const char *name, BIT spooled) {
+	if (c->hwp - c->hrp >= HOPPER) {
+		printf("%s: hopper full\n", name);
+		return 1; // WARNING
+	}
+	strncpy(c->hopper[c->hwp % HOPPER], name, NAMELEN);
+	c->hopper[c->hwp % HOPPER][NAMELEN-1] = 0;
+	c->hspooled[c->hwp % HOPPER] = spooled;
+	c->hwp++;
+	return 0; // OK
+}
 
 /***********************************************************************
-* optional open file to write debugging traces into
+* spool directory entries to pick up
 ***********************************************************************/
-static FILE *trace = NULL;
-static struct cr *crx = NULL;
+static int cr_spoolname(const char *name) {
+	int len = strlen(name);
+	return name[0] != '.' && !(len > 5 && strcmp(name+len-5, ".done") == 0);
+}
+
+static int cr_spoolfilter(const struct dirent *d) {
+	return d->d_type != DT_DIR && cr_spoolname(d->d_name);
+}
+
+/***********************************************************************
+* is the deck loaded or in the hopper, must hold CRS->mutex
+***********************************************************************/
+static BIT cr_queued(struct cr *c, const char *path) {
+	unsigned i;
+
+	if (c->ready && strcmp(c->filename, path) == 0)
+		return true;
+	for (i = c->hrp; i != c->hwp; i++)
+		if (strcmp(c->hopper[i % HOPPER], path) == 0)
+			return true;
+	return false;
+}
+
+/***********************************************************************
+* queue a file found in the spool directory, must hold CRS->mutex
+* with the hopper full the file stays in the directory for a rescan
+***********************************************************************/
+static void cr_queue_spooled(struct cr *c, const char *name) {
+	char path[NAMELEN];
+
+	if (snprintf(path, sizeof path, "%s/%s", c->spooldir, name) >= (int)sizeof path) {
+		printf("%s: name too long\n", name);
+		return;
+	}
+	if (cr_queued(c, path))
+		return;
+	if (c->hwp - c->hrp >= HOPPER) {
+		c->rescan = true;
+		return;
+	}
+	cr_queue(c, path, true);
+}
+
+/***********************************************************************
+* queue the decks present in the spool directory in name order
+* must hold CRS->mutex
+***********************************************************************/
+static void cr_spool_scan(struct cr *c) {
+	struct dirent **list;
+	int i, n;
+
+	c->rescan = false;
+	n = scandir(c->spooldir, &list, cr_spoolfilter, alphasort);
+	for (i = 0; i < n; i++) {
+		cr_queue_spooled(c, list[i]->d_name);
+		free(list[i]);
+	}
+	if (n >= 0)
+		free(list);
+}
+
+/***********************************************************************
+* queue decks that were completely written to the spool directory
+***********************************************************************/
+static void cr_spool_poll(struct cr *c) {
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	int len;
+	char *p;
+
+	if (c->ifd < 0)
+		return;
+	while ((len = read(c->ifd, buf, sizeof buf)) > 0) {
+		for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event *)p;
+			if (ev->len > 0 && cr_spoolname(ev->name))
+				cr_queue_spooled(c, ev->name);
+		}
+	}
+}
+
+/***********************************************************************
+* load the next deck from the hopper, must hold CRS->mutex
+***********************************************************************/
+static BIT cr_next_deck(struct cr *c) {
+	unsigned i;
+	BIT loaded;
+
+	cr_spool_poll(c);
+	while (c->hwp != c->hrp) {
+		i = c->hrp++ % HOPPER;
+		loaded = cr_load(c, c->hopper[i], c->hspooled[i]) == 0;
+		// the slot is free now for a deck waiting in the spool directory
+		if (c->rescan && c->ifd >= 0)
+			cr_spool_scan(c);
+		if (loaded)
+			return true;
+	}
+	return false;
+}
+
+/***********************************************************************
+* spool directory thread
+* queues new decks and makes an idle reader ready
+***********************************************************************/
+static void *spool_function(void *p) {
+	struct pollfd pfd[READERS+1];
+	int i;
+
+	machine_bind((MACHINE *)p);
+loop:
+	if (CRS->stop)
+		return NULL;
+	pthread_mutex_lock(&CRS->mutex);
+	for (i = 0; i < READERS; i++) {
+		pfd[i].fd = CRS->cr[i].ifd;	// poll ignores negative handles
+		pfd[i].events = POLLIN;
+	}
+	pthread_mutex_unlock(&CRS->mutex);
+	pfd[READERS].fd = CRS->wakefd;
+	pfd[READERS].events = POLLIN;
+
+	// wake up now and then to see changed spool directories
+	if (poll(pfd, READERS+1, 1000) <= 0)
+		goto loop;
+
+	for (i = 0; i < READERS; i++) {
+		if (pfd[i].revents & POLLIN) {
+			pthread_mutex_lock(&CRS->mutex);
+			cr_spool_poll(CRS->cr+i);
+			if (!CRS->cr[i].ready)
+				cr_next_deck(CRS->cr+i);
+			pthread_mutex_unlock(&CRS->mutex);
+			io_ready_changed(cr_ready, i);
+		}
+	}
+	goto loop;
+}
 
 /***********************************************************************
 * set to cra/crb
 ***********************************************************************/
-static int set_cr(const char *v, void *data) {crx = cr+(int)data; return 0; }
+static int set_cr(const char *v, void *data) {CRS->crx = CRS->cr+(int)data; return 0; }
 
 /***********************************************************************
 * specify or close the trace file
 ***********************************************************************/
 static int set_crtrace(const char *v, void *) {
 	// if open, close existing trace file
-	if (trace) {
-		fclose(trace);
-		trace = NULL;
+	if (CRS->trace) {
+		fclose(CRS->trace);
+		CRS->trace = NULL;
 	}
 	// if a name is given, open new trace
 	if (strlen(v) > 0) {
-		trace = fopen(v, "w");
-		if (!trace)
+		CRS->trace = fopen(v, "w");
+		if (!CRS->trace)
 			return 2; // FATAL
 	}
 	return 0; // OK
 }
 
+/***********************************************************************
+* report the ready status of the drive after a change
+***********************************************************************/
+static int cr_changed(int res) {
+	io_ready_changed(cr_ready, CRS->crx - CRS->cr);
+	return res;
+}
+
 /***********************************************************************
 * specify or close the file for emulation
+* replaces the current deck, the hopper is kept
 ***********************************************************************/
 static int set_crfile(const char *v, void *) {
-	if (!crx) {
+	int res = 0;
+
+	if (!CRS->crx) {
 		printf("cr not specified\n");
 		return 2; // FATAL
 	}
-	strncpy(crx->filename, v, NAMELEN);
-	crx->filename[NAMELEN-1] = 0;
 
-	// if we are ready, close current file
-	if (crx->ready) {
-		fclose(crx->fp);
-		crx->fp = NULL;
-		crx->ready = false;
+	pthread_mutex_lock(&CRS->mutex);
+	// now load the new file, if any name was given
+	// if none given, the drive just stays unready
+	if (v[0])
+		res = cr_load(CRS->crx, v, false);
+	else
+		cr_unload(CRS->crx);
+	pthread_mutex_unlock(&CRS->mutex);
+	return cr_changed(res);
+}
+
+/***********************************************************************
+* add a deck to the hopper
+***********************************************************************/
+static int set_crqueue(const char *v, void *) {
+	int res;
+
+	if (!CRS->crx) {
+		printf("cr not specified\n");
+		return 2; // FATAL
 	}
 
-	// now open the new file, if any name was given
-	// if none given, the drive just stays unready
-	if (crx->filename[0]) {
-		crx->fp = fopen(crx->filename, "r"); // cards are always read only
-		if (crx->fp) {
-			crx->ready = true;
-			return 0; // OK
-		} else {
-			// cannot open
-			perror(crx->filename);
-			return 2; // FATAL
-		}
+	pthread_mutex_lock(&CRS->mutex);
+	res = cr_queue(CRS->crx, v, false);
+	if (!CRS->crx->ready)
+		cr_next_deck(CRS->crx);
+	pthread_mutex_unlock(&CRS->mutex);
+	return cr_changed(res);
+}
+
+/***********************************************************************
+* remove all decks from the hopper
+***********************************************************************/
+static int set_crempty(const char *v, void *) {
+	if (!CRS->crx) {
+		printf("cr not specified\n");
+		return 2; // FATAL
 	}
+
+	pthread_mutex_lock(&CRS->mutex);
+	CRS->crx->hrp = CRS->crx->hwp;
+	pthread_mutex_unlock(&CRS->mutex);
 	return 0; // OK
 }
 
+/***********************************************************************
+* specify or stop watching the spool directory
+* decks already present are queued in name order
+***********************************************************************/
+static int set_crspool(const char *v, void *) {
+	if (!CRS->crx) {
+		printf("cr not specified\n");
+		return 2; // FATAL
+	}
+
+	pthread_mutex_lock(&CRS->mutex);
+	if (CRS->crx->ifd >= 0)
+		close(CRS->crx->ifd);
+	CRS->crx->ifd = -1;
+	CRS->crx->rescan = false;
+	strncpy(CRS->crx->spooldir, v, NAMELEN);
+	CRS->crx->spooldir[NAMELEN-1] = 0;
+
+	if (CRS->crx->spooldir[0]) {
+		CRS->crx->ifd = inotify_init1(IN_NONBLOCK);
+		if (CRS->crx->ifd < 0 || inotify_add_watch(CRS->crx->ifd, CRS->crx->spooldir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+			perror(CRS->crx->spooldir);
+			if (CRS->crx->ifd >= 0)
+				close(CRS->crx->ifd);
+			CRS->crx->ifd = -1;
+			pthread_mutex_unlock(&CRS->mutex);
+			return cr_changed(2); // FATAL
+		}
+		cr_spool_scan(CRS->crx);
+		if (!CRS->crx->ready)
+			cr_next_deck(CRS->crx);
+	}
+	pthread_mutex_unlock(&CRS->mutex);
+	return cr_changed(0); // OK
+}
+
 /***********************************************************************
 * command table
 ***********************************************************************/
@@ -112,6 +455,9 @@ static const command_t cr_commands[] = {
 	{"crb", 	set_cr, (void *) 1},
 	{"trace",	set_crtrace},
 	{"file",	set_crfile},
+	{"queue",	set_crqueue},
+	{"empty",	set_crempty},
+	{"spool",	set_crspool},
 	{NULL,		NULL},
 };
 
@@ -119,8 +465,71 @@ static const command_t cr_commands[] = {
 * Initialize command from argv scanner or special SPO input
 ***********************************************************************/
 int cr_init(const char *option) {
-	crx = NULL; // require specification of a drive
-	return command_parser(cr_commands, option);
+	int res;
+
+	if (!CRS->initialized) {
+		// spool directory thread
+		pthread_create(&CRS->spool_handler, 0, spool_function, machine);
+		CRS->initialized = true;
+	}
+	CRS->crx = NULL; // require specification of a drive
+	res = command_parser(cr_commands, option);
+	return res;
+}
+
+/***********************************************************************
+* state of a new machine
+***********************************************************************/
+int cr_create(void) {
+	int i;
+
+	CRS = (struct cr_state *)calloc(1, sizeof *CRS);
+	if (CRS == NULL) {
+		perror("cr");
+		return -1;
+	}
+	for (i = 0; i < READERS; i++)
+		CRS->cr[i].ifd = -1;
+	pthread_mutex_init(&CRS->mutex, NULL);
+	CRS->wakefd = eventfd(0, EFD_NONBLOCK);
+	if (CRS->wakefd < 0) {
+		perror("cr eventfd");
+		free(CRS);
+		CRS = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/***********************************************************************
+* end the spool thread, release decks and directories
+***********************************************************************/
+void cr_term(void) {
+	uint64_t one = 1;
+	int i;
+
+	if (CRS == NULL)
+		return;
+	if (CRS->initialized) {
+		CRS->stop = true;
+		if (write(CRS->wakefd, &one, sizeof one) < 0)
+			perror("cr eventfd");
+		pthread_join(CRS->spool_handler, NULL);
+	}
+	// a spooled deck not read to the end stays in the directory
+	for (i = 0; i < READERS; i++) {
+		if (CRS->cr[i].map)
+			munmap(CRS->cr[i].map, CRS->cr[i].maplen);
+		free(CRS->cr[i].cards);
+		if (CRS->cr[i].ifd >= 0)
+			close(CRS->cr[i].ifd);
+	}
+	if (CRS->trace)
+		fclose(CRS->trace);
+	close(CRS->wakefd);
+	pthread_mutex_destroy(&CRS->mutex);
+	free(CRS);
+	CRS = NULL;
 }
 
 /***********************************************************************
@@ -128,7 +537,7 @@ int cr_init(const char *option) {
 ***********************************************************************/
 BIT cr_ready(unsigned index) {
 	if (index < READERS)
-		return cr[index].ready;
+		return CRS->cr[index].ready;
 	return false;
 }
 
@@ -137,7 +546,9 @@ BIT cr_ready(unsigned index) {
 ***********************************************************************/
 void cr_read(IOCU *u) {
         BIT mi;
-	struct cr *crx;
+	struct cr *c;
+	const struct card *cd;
+	const char *cp, *ce;
 	int i;
 
         int chars;
@@ -151,47 +562,51 @@ void cr_read(IOCU *u) {
 
         u->d_result = 0; // no errors so far
 
-	crx = cr + unit[u->d_unit][1].index;
+	c = CRS->cr + unit[u->d_unit][1].index;
 
-        if (!crx->ready) {
-notready:
+	pthread_mutex_lock(&CRS->mutex);
+        if (!c->ready) {
+		pthread_mutex_unlock(&CRS->mutex);
                 u->d_result = RD_18_NRDY;
                 goto retresult;
         }
 
-	// read one ACSII line from file
-        if (fgets(crx->cbuf, sizeof crx->cbuf, crx->fp) == NULL) {
-                crx->ready = false;
-		fclose(crx->fp);
-		crx->fp = NULL;
-		goto notready;
-        }
-
-        // remove trailing control codes
-        crx->cbufp = crx->cbuf + strlen(crx->cbuf);
-        while (crx->cbufp >= crx->cbuf && *crx->cbufp <= ' ')
-                *crx->cbufp-- = 0;
-        crx->cbufp = crx->cbuf;
+	// deck exhausted: continue with the next deck in the hopper
+	if (c->next >= c->ncards) {
+		cr_unload(c);
+		if (!cr_next_deck(c)) {
+			pthread_mutex_unlock(&CRS->mutex);
+			// hopper is empty, TUS must see it
+			io_ready_changed(cr_ready, c - CRS->cr);
+			u->d_result = RD_18_NRDY;
+			goto retresult;
+		}
+	}
+	// the deck stays mapped while the card is read, a FILE= command or
+	// a spool directory may replace it
+	cd = c->cards + c->next++;
 
 	// warn if a binary line is not exactly 160 chars
-        if ((u->d_control & CD_27_BINARY) && strlen(crx->cbuf) != (unsigned)chars) {
-                printf("*\tWARNING: binary card incorrect length(%u). abort\n", strlen(crx->cbuf));
+        if ((u->d_control & CD_27_BINARY) && cd->len != chars) {
+                printf("*\tWARNING: binary card incorrect length(%u). abort\n", cd->len);
         }
 
 	// a "?" is an illegal char when at column 0 and in alpha mode
-        if (crx->cbuf[0] == '?' && !(u->d_control & CD_27_BINARY))
+        if (cd->len > 0 && cd->text[0] == '?' && !(u->d_control & CD_27_BINARY))
                 u->d_result |= RD_19_PAR; // set illegal char bit in result
 
-	// now fill the buffer with the just read card
-	// note that "cbufp" will stay on the first non-printable character
+	// now fill the buffer with the card
+	// note that "cp" will stay on the first non-printable character
 	// and this will cause the rest of the buffer to be filled with blanks
+	cp = cd->text;
+	ce = cd->text + cd->len;
         while (chars > 0) {
 		u->w = 0LL;
 		// 8 chars fit into a word
 		for (i=0; i<8; i++) {
-		        if (*crx->cbufp >= ' ') {
-		                u->ib = translatetable_ascii2bic[*crx->cbufp & 0x7f];
-		                crx->cbufp++;
+		        if (cp < ce && *cp >= ' ') {
+		                u->ib = translatetable_ascii2bic[*cp & 0x7f];
+		                cp++;
 		        } else {
 		                u->ib = 060; // BIC code for Blank
 		        }
@@ -203,9 +618,55 @@ notready:
 		if (!mi) // if not inhibited
 			main_write_inc(u);
         }
+	pthread_mutex_unlock(&CRS->mutex);
 
 retresult:
 	u->d_wc = 0;
 }
 
 
+/***********************************************************************
+* snapshot: current deck, next card and hopper
+* the deck is loaded again by its file name
+***********************************************************************/
+void cr_snapshot(SNAP_T *s) {
+	struct cr *c, sc;
+
+	pthread_mutex_lock(&CRS->mutex);
+	for (c = CRS->cr; c < CRS->cr+READERS; c++) {
+		if (s->save) {
+			memcpy(sc.filename, c->filename, NAMELEN);
+			if (!c->map)
+				sc.filename[0] = 0;
+			sc.spooled = c->spooled;
+			sc.next = c->next;
+			memcpy(sc.hopper, c->hopper, sizeof sc.hopper);
+			memcpy(sc.hspooled, c->hspooled, sizeof sc.hspooled);
+			sc.hrp = c->hrp;
+			sc.hwp = c->hwp;
+		}
+		snap_data(s, sc.filename, NAMELEN);
+		snap_data(s, &sc.spooled, sizeof sc.spooled);
+		snap_data(s, &sc.next, sizeof sc.next);
+		snap_data(s, sc.hopper, sizeof sc.hopper);
+		snap_data(s, sc.hspooled, sizeof sc.hspooled);
+		snap_data(s, &sc.hrp, sizeof sc.hrp);
+		snap_data(s, &sc.hwp, sizeof sc.hwp);
+		if (s->save || s->error)
+			continue;
+		memcpy(c->hopper, sc.hopper, sizeof c->hopper);
+		memcpy(c->hspooled, sc.hspooled, sizeof c->hspooled);
+		c->hrp = sc.hrp;
+		c->hwp = sc.hwp;
+		sc.filename[NAMELEN-1] = 0;
+		if (sc.filename[0] == 0) {
+			cr_unload(c);
+		} else if (cr_load(c, sc.filename, sc.spooled) == 0) {
+			c->next = sc.next;
+		} else {
+			printf("CR%c: deck %s not restored\n", 'A'+(int)(c-CRS->cr), sc.filename);
+		}
+		io_ready_changed(cr_ready, c - CRS->cr);
+	}
+	pthread_mutex_unlock(&CRS->mutex);
+}
@@ -38,6 +38,10 @@
 *   added data trace to file
 * 2020-03-09  R.Meyer
 *   added iTELEX functionality
+* 2026-10-19  agent
+*   DCC thread driven by epoll, lock free sysbuf and service queues,
+*   full terminal address space, line telemetry, replay of inquiries,
+*   state and shares per MACHINE
 ***********************************************************************/
 
 #include <stdio.h>
@@ -58,13 +62,22 @@
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <sys/msg.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
 
 #include "common.h"
 #include "io.h"
+#include "snapshot.h"
+#include "replay.h"
 #include "circbuffer.h"
 #include "telnetd.h"
 #include "itelexd.h"
 #include "dcc.h"
+#include "telemetry.h"
+#include "machine.h"
 
 /***********************************************************************
 * string constants
@@ -81,17 +94,34 @@ static const char *bufstate_name[] = {
 	"NRDY", "IDLE", "IBSY", "RRDY", "OBSY", "WRDY"};
 
 /***********************************************************************
-* the terminals
+* state with the terminals
 ***********************************************************************/
-int shm_dcc;	// DCC shared structures
-static TERMINAL_T *terminal;
+struct dcc_state {
+	int	shm_dcc;		// DCC shared structures
+	TERMINAL_T *terminal;
+	int	shm_dcct;		// DCC telemetry
+	DCC_TELEMETRY_T *dcct;
+	unsigned telemetry_ticks;
+	BIT	ready;
+	pthread_t dcc_handler;
+	volatile BIT stop;
+	int	epollfd;		// event loop of the DCC thread
+	int	wakefd;			// wakes the DCC thread
+	DCC_QUEUE_T sysbufq;		// sysbufs handed over by the IO thread
+	DCC_QUEUE_T serviceq;		// terminals requesting service
+	TERMINAL_BUFFERS_T *freebufs;	// pool of terminal buffers
+	BIT	telnet;
+	BIT	itelex;
+};
+#define	DCS	(machine->dcc)
 
-/***********************************************************************
-* misc variables
-***********************************************************************/
-static BIT ready;
-static BIT telnet = false;
-static BIT itelex = false;
+static void *dcc_function(void *p);
+static void dcc_notify(unsigned index);
+static int terminal_fd(TERMINAL_T *t);
+
+// event tags besides terminal index+1
+#define	EV_SERVER	0
+#define	EV_WAKE		0xffffffff
 
 char ftracedir[80];
 BIT etrace = false;
@@ -162,9 +192,9 @@ static int set_ftrace(const char *v, void *) {
 ***********************************************************************/
 static int set_telnet(const char *v, void *) {
 	if (strcasecmp(v, "ON") == 0) {
-		telnet = true;
+		DCS->telnet = true;
 	} else if (strcasecmp(v, "OFF") == 0) {
-		telnet = false;
+		DCS->telnet = false;
 	} else {
 		spo_print("$SPECIFY ON OR OFF\r\n");
 		return 2; // FATAL
@@ -177,9 +207,9 @@ static int set_telnet(const char *v, void *) {
 ***********************************************************************/
 static int set_itelex(const char *v, void *) {
 	if (strcasecmp(v, "ON") == 0) {
-		itelex = true;
+		DCS->itelex = true;
 	} else if (strcasecmp(v, "OFF") == 0) {
-		itelex = false;
+		DCS->itelex = false;
 	} else {
 		spo_print("$SPECIFY ON OR OFF\r\n");
 		return 2; // FATAL
@@ -203,7 +233,7 @@ static int get_status(const char *v, void *) {
 
 	// list all connected terminals
 	for (index = 0; index < NUMTERM; index++) {
-		t = &terminal[index];
+		t = &DCS->terminal[index];
 		// list all entries that are not in disconnected state
 		if (t->pcs > pcs_disconnected) {
 			p = buf;
@@ -249,13 +279,13 @@ static int get_status(const char *v, void *) {
 ***********************************************************************/
 static int set_can(const char *v, void *) {
 	if (isdigit(v[0])) {
-		terminal[15].canid = atoi(v);
-		if (terminal[15].canid < 1 || terminal[15].canid > 126) {
-			terminal[15].canid = 0;
+		DCS->terminal[15].canid = atoi(v);
+		if (DCS->terminal[15].canid < 1 || DCS->terminal[15].canid > 126) {
+			DCS->terminal[15].canid = 0;
 			goto help;
 		}
 	} else if (strcasecmp(v, "OFF") == 0) {
-		terminal[15].canid = 0;
+		DCS->terminal[15].canid = 0;
 	} else {
 help:		spo_print("$SPECIFY CANID(1..126) OR OFF\r\n");
 		return 2; // FATAL
@@ -282,51 +312,67 @@ static const command_t dcc_commands[] = {
 	{NULL, NULL},
 };
 
+/***********************************************************************
+* take buffers for a terminal from the pool
+* pool and buffers are only used by the DCC thread
+***********************************************************************/
+static void terminal_attach(TERMINAL_T *t) {
+	TERMINAL_BUFFERS_T *b;
+
+	if (t->bufs)
+		return;
+	b = DCS->freebufs;
+	if (b) {
+		DCS->freebufs = b->next;
+	} else {
+		b = (TERMINAL_BUFFERS_T *)malloc(sizeof *b);
+		if (b == NULL) {
+			perror("DCC buffers");
+			exit(2);
+		}
+	}
+	t->bufs = b;
+	t->inbuf = b->inbuf;
+	t->outbuf = b->outbuf;
+	t->keybuf = b->keybuf;
+	t->scrbuf = b->scrbuf;
+	t->isession.inbuf = b->itin;
+	t->isession.rxbuf = b->itrx;
+	t->inidx = 0; t->outidx = 0;
+}
+
+/***********************************************************************
+* return the buffers of a disconnected terminal to the pool
+***********************************************************************/
+void dcc_release_terminal(TERMINAL_T *t) {
+	TERMINAL_BUFFERS_T *b = t->bufs;
+
+	if (b == NULL)
+		return;
+	t->bufs = NULL;
+	t->inbuf = NULL; t->outbuf = NULL;
+	t->keybuf = NULL; t->scrbuf = NULL;
+	t->isession.inbuf = NULL; t->isession.rxbuf = NULL;
+	t->inidx = 0; t->outidx = 0; t->keyidx = 0;
+	b->next = DCS->freebufs;
+	DCS->freebufs = b;
+}
+
 /***********************************************************************
 * initialize terminal structure to safe defaults
 ***********************************************************************/
 void dcc_init_terminal(TERMINAL_T *t) {
-	memset(t->scrbuf, ' ', sizeof t->scrbuf);
+	terminal_attach(t);
+	memset(t->scrbuf, ' ', ROWS*COLS);
+	ansiscreen_init(&t->bufs->scr);
 	t->sysidx = 0; t->keyidx = 0; t->scridx = 0; t->scridy = 0;
 	t->lfpending = false; t->paused = false; t->utf8mode = false;
 	t->insertmode = true;
+	t->blocked = false;
 	t->inmode = false; t->outmode = false;
 	t->outlastwasmode = false; t->eotcount = 0;
 }
 
-/***********************************************************************
-* Find a terminal that needs service
-***********************************************************************/
-static BIT terminal_search(unsigned *ptun, unsigned *pbnr, BIT do_output) {
-	unsigned index;
-	TERMINAL_T *t;
-
-	for (index = 0; index < NUMTERM; index++) {
-		t = &terminal[index];
-
-		// trigger late output IRQ
-		if (do_output && t->bufstate == outputbusy) {
-			// now send/interpret the data
-			if (t->ld == ld_teletype)
-				ld_write_teletype(t);
-			else
-				ld_write_contention(t);
-		}
-
-		// is this requiring service now?
-		if (t->interrupt)  {
-			// something found
-			if (ptun) *ptun = TUN(index);
-			if (pbnr) *pbnr = BNR(index);
-			return true;
-		}
-	}
-	// nothing found
-	if (ptun) *ptun = 0;
-	if (pbnr) *pbnr = 0;
-	return false;
-}
-
 /***********************************************************************
 * Find a terminal that needs service
 ***********************************************************************/
@@ -336,9 +382,10 @@ TERMINAL_T *dcc_find_free_terminal(enum ld ld) {
 
 	// find a free terminal to handle this
 	for (index = 0; index < NUMTERM; index++) {
-		t = &terminal[index];
+		t = &DCS->terminal[index];
 		if (t->ld == ld && t->pcs == pcs_disconnected) {
 			// free terminal found
+			terminal_attach(t);
 			return t;
 		}
 	}
@@ -350,23 +397,35 @@ TERMINAL_T *dcc_find_free_terminal(enum ld ld) {
 * Initialize command from argv scanner or special SPO input
 ***********************************************************************/
 int dcc_init(const char *option) {
-	if (!ready) {
+	if (!DCS->ready) {
 		int index;
+		struct epoll_event ev;
 
 		// ignore all SIGPIPEs
 		signal(SIGPIPE, SIG_IGN);
 
 		// establish shared memory
-		shm_dcc = shmget(SHM_DCC, sizeof(TERMINAL_T)*NUMTERM, IPC_CREAT|0644);
-		if (shm_dcc < 0) {
+		DCS->shm_dcc = shmget(IPCKEY(SHM_DCC, machine->instance), sizeof(TERMINAL_T)*NUMTERM, IPC_CREAT|0644);
+		if (DCS->shm_dcc < 0) {
 			perror("shmget DCC");
 			exit(2);
 		}
-		terminal = (TERMINAL_T *)shmat(shm_dcc, NULL, 0);
-		if ((int)terminal == -1) {
+		DCS->terminal = (TERMINAL_T *)shmat(DCS->shm_dcc, NULL, 0);
+		if ((int)DCS->terminal == -1) {
 			perror("shmat DCC");
 			exit(2);
 		}
+		DCS->shm_dcct = shmget(IPCKEY(SHM_DCCT, machine->instance), sizeof(DCC_TELEMETRY_T), IPC_CREAT|0644);
+		if (DCS->shm_dcct < 0) {
+			perror("shmget DCCT");
+			exit(2);
+		}
+		DCS->dcct = (DCC_TELEMETRY_T *)shmat(DCS->shm_dcct, NULL, 0);
+		if ((int)DCS->dcct == -1) {
+			perror("shmat DCCT");
+			exit(2);
+		}
+		memset(DCS->dcct, 0, sizeof *DCS->dcct);
 
 		// init server etc data structures
 		pc_telnet_init();
@@ -376,26 +435,95 @@ int dcc_init(const char *option) {
 
 		// init terminal data structures
 		for (index=0; index<NUMTERM; index++) {
-			TERMINAL_T *t = terminal+index;
+			TERMINAL_T *t = DCS->terminal+index;
 			memset(t, 0, sizeof(TERMINAL_T));
 			sprintf(t->name, "%02u/%02u", TUN(index), BNR(index));
 			// TODO: this next part is kindy hacky, should be
 			// TODO: parametrized
 			// TODO: preferable read SYSDISK-MAKER.CARD...
-			if (index < 15) {
+			if (index < NUMBUF-1) {
 				t->ld = ld_teletype;
-			} else if (index == 15) {
+			} else if (index == NUMBUF-1) {
 				t->ld = ld_teletype;
 				t->pc = pc_canopen;
 			} else {
 				t->ld = ld_contention;
 			}
 		}
+
+		// event loop and its wake up
+		DCS->epollfd = epoll_create1(EPOLL_CLOEXEC);
+		DCS->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (DCS->epollfd < 0 || DCS->wakefd < 0) {
+			perror("DCC epoll");
+			exit(2);
+		}
+		ev.events = EPOLLIN;
+		ev.data.u32 = EV_WAKE;
+		epoll_ctl(DCS->epollfd, EPOLL_CTL_ADD, DCS->wakefd, &ev);
+
+		// DCC thread
+		pthread_create(&DCS->dcc_handler, 0, dcc_function, machine);
 	}
-	ready = true;
+	DCS->ready = true;
+	io_ready_changed(dcc_ready, 0);
 	return command_parser(dcc_commands, option);
 }
 
+/***********************************************************************
+* state of a new machine, the DCC itself starts on first use
+***********************************************************************/
+int dcc_create(void) {
+	DCS = (struct dcc_state *)calloc(1, sizeof *DCS);
+	if (DCS == NULL) {
+		perror("dcc");
+		return -1;
+	}
+	DCS->epollfd = -1;
+	DCS->wakefd = -1;
+	return 0;
+}
+
+/***********************************************************************
+* end the DCC thread, drop all connections and servers
+* the shared memory is removed with the other shares of the machine
+***********************************************************************/
+void dcc_term(void) {
+	TERMINAL_BUFFERS_T *b;
+	TERMINAL_T *t;
+	uint64_t one = 1;
+	int fd;
+
+	if (DCS == NULL)
+		return;
+	if (DCS->ready) {
+		DCS->stop = true;
+		if (write(DCS->wakefd, &one, sizeof one) != sizeof one)
+			perror("dcc_term");
+		pthread_join(DCS->dcc_handler, NULL);
+		pc_telnet_term();
+		pc_itelex_term();
+		for (t = DCS->terminal; t < DCS->terminal+NUMTERM; t++) {
+			fd = terminal_fd(t);
+			if (fd > 2)
+				close(fd);
+			if (t->trace)
+				fclose(t->trace);
+			free(t->bufs);
+		}
+		shmdt(DCS->terminal);
+		shmdt(DCS->dcct);
+		close(DCS->epollfd);
+		close(DCS->wakefd);
+	}
+	while ((b = DCS->freebufs) != NULL) {
+		DCS->freebufs = b->next;
+		free(b);
+	}
+	free(DCS);
+	DCS = NULL;
+}
+
 /***********************************************************************
 * report connect to system
 ***********************************************************************/
@@ -424,7 +552,7 @@ void dcc_report_connect(TERMINAL_T *t) {
 	}
 	// do not report again
 	if (!t->connected) {
-		t->interrupt = true;
+		dcc_request_service(t);
 	}
 	t->fullbuffer = false; t->bufstate = writeready;
 	t->abnormal = true; t->connected = true;
@@ -438,7 +566,7 @@ void dcc_report_connect(TERMINAL_T *t) {
 void dcc_report_disconnect(TERMINAL_T *t) {
 	// do not report again
 	if (t->connected) {
-		t->interrupt = true;
+		dcc_request_service(t);
 	}
 	t->fullbuffer = false; t->bufstate = notready;
 	t->abnormal = true; t->connected = false;
@@ -458,60 +586,324 @@ void dcc_report_disconnect(TERMINAL_T *t) {
 }
 
 /***********************************************************************
-* handle servers, connections and terminals
+* single producer, single consumer queue of terminal indexes
+* the IO thread hands sysbufs to the DCC thread through this
+***********************************************************************/
+static BIT queue_put(DCC_QUEUE_T *q, unsigned index) {
+	unsigned wp = q->wp;
+
+	if (wp - __atomic_load_n(&q->rp, __ATOMIC_ACQUIRE) >= DCC_QLEN)
+		return false; // full, the tick will catch up
+	q->idx[wp % DCC_QLEN] = index;
+	__atomic_store_n(&q->wp, wp + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+static int queue_get(DCC_QUEUE_T *q) {
+	unsigned rp = q->rp;
+	int index;
+
+	if (rp == __atomic_load_n(&q->wp, __ATOMIC_ACQUIRE))
+		return -1; // empty
+	index = q->idx[rp % DCC_QLEN];
+	__atomic_store_n(&q->rp, rp + 1, __ATOMIC_RELEASE);
+	return index;
+}
+
+static int queue_peek(DCC_QUEUE_T *q) {
+	unsigned rp = __atomic_load_n(&q->rp, __ATOMIC_ACQUIRE);
+
+	if (rp == __atomic_load_n(&q->wp, __ATOMIC_ACQUIRE))
+		return -1; // empty
+	return q->idx[rp % DCC_QLEN];
+}
+
+/***********************************************************************
+* terminal needs service by the system
+* called by the DCC thread, queues the terminal for interrogation
+***********************************************************************/
+void dcc_request_service(TERMINAL_T *t) {
+	t->interrupt = true;
+	// queue each terminal only once
+	if (!__atomic_exchange_n(&t->queued, true, __ATOMIC_SEQ_CST))
+		queue_put(&DCS->serviceq, t - DCS->terminal);
+	// signal Datacomm IRQ
+	if (t->enabled && !CC->CCI13F)
+		replay_irq(034);
+}
+
+/***********************************************************************
+* Find a terminal that needs service
+* called by the IO thread on interrogate, skips terminals whose
+* request has been satisfied by a specific interrogate or a read
+***********************************************************************/
+static BIT service_next(unsigned *ptun, unsigned *pbnr) {
+	int index;
+	TERMINAL_T *t;
+
+	while ((index = queue_get(&DCS->serviceq)) >= 0) {
+		t = &DCS->terminal[index];
+		// allow queueing again before looking at the request
+		__atomic_store_n(&t->queued, false, __ATOMIC_SEQ_CST);
+		if (t->interrupt) {
+			// something found
+			*ptun = TUN(index);
+			*pbnr = BNR(index);
+			return true;
+		}
+	}
+	// nothing found
+	*ptun = 0;
+	*pbnr = 0;
+	return false;
+}
+
+/***********************************************************************
+* the IO thread has changed the sysbuf of a terminal
+***********************************************************************/
+static void dcc_notify(unsigned index) {
+	uint64_t one = 1;
+
+	queue_put(&DCS->sysbufq, index);
+	if (write(DCS->wakefd, &one, sizeof one) != sizeof one)
+		perror("dcc_notify");
+}
+
+/***********************************************************************
+* the socket (or tty) handle of a terminal or -1
+***********************************************************************/
+static int terminal_fd(TERMINAL_T *t) {
+	switch (t->pc) {
+	case pc_telnet: return t->tsession.socket;
+	case pc_itelex: return t->isession.socket;
+	case pc_serial: return t->serial_handle;
+	default: return -1;
+	}
+}
+
+/***********************************************************************
+* add a handle to the DCC event loop
+* t is NULL for listening sockets
+***********************************************************************/
+void dcc_watch(int fd, TERMINAL_T *t) {
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN;
+	ev.data.u32 = t ? (t - DCS->terminal) + 1 : EV_SERVER;
+	if (epoll_ctl(DCS->epollfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		perror("dcc_watch");
+}
+
+/***********************************************************************
+* (re)enable or disable input events of a terminal
+***********************************************************************/
+static void terminal_arm(TERMINAL_T *t, BIT on) {
+	struct epoll_event ev;
+	int fd = terminal_fd(t);
+
+	if (fd < 0 || t->blocked == !on)
+		return;
+	ev.events = on ? EPOLLIN : 0;
+	ev.data.u32 = (t - DCS->terminal) + 1;
+	epoll_ctl(DCS->epollfd, EPOLL_CTL_MOD, fd, &ev);
+	t->blocked = !on;
+}
+
+/***********************************************************************
+* poll one terminal
+* a terminal that leaves pending input unread (because its sysbuf is
+* busy) gets its input events disabled until the sysbuf changes
+***********************************************************************/
+static void terminal_poll(TERMINAL_T *t) {
+	int fd, before = 0, after = 0;
+
+	fd = terminal_fd(t);
+	if (fd >= 0)
+		ioctl(fd, FIONREAD, &before);
+again:
+	switch (t->pc) {
+	case pc_telnet: pc_telnet_poll_terminal(t); break;
+	case pc_itelex: pc_itelex_poll_terminal(t); break;
+	case pc_serial: pc_serial_poll_terminal(t); break;
+	case pc_canopen: pc_canopen_poll_terminal(t); break;
+	default:
+		return;
+	}
+	if (t->pc == pc_telnet)
+		pc_telnet_flush(t);
+	// closing states are handled right away
+	if (t->pcs == pcs_aborted || t->pcs == pcs_failed)
+		goto again;
+
+	fd = terminal_fd(t);
+	if (fd >= 0) {
+		ioctl(fd, FIONREAD, &after);
+		terminal_arm(t, !(after > 0 && after == before));
+	}
+}
+
+/***********************************************************************
+* send/interpret data the system has put into the sysbuf
+***********************************************************************/
+static void terminal_output(TERMINAL_T *t) {
+	if (t->bufstate != outputbusy || t->bufs == NULL)
+		return;
+	if (t->ld == ld_teletype)
+		ld_write_teletype(t);
+	else
+		ld_write_contention(t);
+	if (t->pc == pc_telnet)
+		pc_telnet_flush(t);
+}
+
+/***********************************************************************
+* publish the connected lines for the datacom panel
+* at the telemetry rate of the processor panel
+***********************************************************************/
+static void dcc_telemetry(void) {
+	unsigned index, n = 0;
+	TERMINAL_T *t;
+	DCC_LINE_T *l;
+
+	if (TM->rate == 0 || ++DCS->telemetry_ticks < (1000 / DCC_TICK) / TM->rate)
+		return;
+	DCS->telemetry_ticks = 0;
+
+	seqlock_write_begin(&DCS->dcct->seq);
+	for (index = 0; index < NUMTERM; index++) {
+		t = &DCS->terminal[index];
+		if (t->pc == pc_none)
+			continue;
+		l = &DCS->dcct->line[n++];
+		memcpy(l->name, t->name, sizeof l->name);
+		l->pc = t->pc; l->pcs = t->pcs;
+		l->ld = t->ld; l->em = t->em;
+		l->bufstate = t->bufstate;
+		l->interrupt = t->interrupt;
+		l->abnormal = t->abnormal;
+		l->fullbuffer = t->fullbuffer;
+		l->cols = l->rows = 0;
+		l->type[0] = 0;
+		switch (t->pc) {
+		case pc_serial: l->handle = t->serial_handle; break;
+		case pc_canopen: l->handle = t->canid; break;
+		case pc_telnet:
+			l->handle = t->tsession.socket;
+			l->cols = t->tsession.cols;
+			l->rows = t->tsession.rows;
+			memcpy(l->type, t->tsession.type, sizeof l->type);
+			break;
+		case pc_itelex: l->handle = t->isession.socket; break;
+		default: l->handle = -1;
+		}
+		memcpy(l->peer_info, t->peer_info, sizeof l->peer_info);
+	}
+	DCS->dcct->count = n;
+	seqlock_write_end(&DCS->dcct->seq);
+}
+
+/***********************************************************************
+* handle servers and all connections
+* done on every tick for everything that is not event driven:
+* starting/stopping servers, CANopen, iTELEX timing, output that
+* could not be sent completely and terminals with disabled events
 ***********************************************************************/
-static void dcc_poll(void) {
+static void dcc_tick(void) {
 	unsigned index;
 	TERMINAL_T *t;
 
 	// poll servers etc.
-	pc_telnet_poll(telnet);
-	pc_itelex_poll(itelex);
+	pc_telnet_poll(DCS->telnet);
+	pc_itelex_poll(DCS->itelex);
 	pc_serial_poll();
 	pc_canopen_poll();
 
-	// poll existing connections
 	for (index = 0; index < NUMTERM; index++) {
-		t = &terminal[index];
-		switch (t->pc) {
-		case pc_telnet: pc_telnet_poll_terminal(t); break;
-		case pc_itelex: pc_itelex_poll_terminal(t); break;
-		case pc_serial: pc_serial_poll_terminal(t); break;
-		case pc_canopen: pc_canopen_poll_terminal(t); break;
-		default:
-			;
-		}
+		t = &DCS->terminal[index];
+		if (t->pc == pc_none)
+			continue;
+		terminal_output(t);
+		if (t->pc == pc_telnet && ring_used(&t->tsession.out) > 0)
+			pc_telnet_flush(t);
+		if (t->pc != pc_telnet || t->blocked || t->pcs != pcs_connected)
+			terminal_poll(t);
 	}
+
+	dcc_telemetry();
 }
 
 /***********************************************************************
-* query DCC ready status
+* DCC thread
+* waits for network events, sysbufs handed over by the IO thread or
+* the next tick, and signals terminals requesting service
 ***********************************************************************/
-BIT dcc_ready(unsigned index) {
-	unsigned tun, bnr;
+static void *dcc_function(void *p) {
+	struct epoll_event ev[16];
+	struct timespec now, next;
+	int i, n, index;
+	uint64_t cnt;
+	TERMINAL_T *t;
 
-	// initialize SPO if not ready
-	if (!ready)
-		dcc_init("");
+	machine_bind((MACHINE *)p);
+	clock_gettime(CLOCK_MONOTONIC, &next);
+loop:
+	n = epoll_wait(DCS->epollfd, ev, 16, DCC_TICK);
+	if (DCS->stop)
+		return NULL;
+	for (i = 0; i < n; i++) {
+		if (ev[i].data.u32 == EV_SERVER) {
+			// new connection(s)
+			pc_telnet_poll(DCS->telnet);
+			pc_itelex_poll(DCS->itelex);
+		} else if (ev[i].data.u32 == EV_WAKE) {
+			if (read(DCS->wakefd, &cnt, sizeof cnt) != sizeof cnt)
+				perror("dcc wake");
+		} else if (ev[i].data.u32 <= NUMTERM) {
+			terminal_poll(DCS->terminal + ev[i].data.u32 - 1);
+		}
+	}
 
-	// do ALL the polling first
-	dcc_poll();
+	// sysbufs changed by the system
+	while ((index = queue_get(&DCS->sysbufq)) >= 0) {
+		t = DCS->terminal + index;
+		terminal_output(t);
+		// a freed sysbuf may take pending input
+		terminal_arm(t, true);
+		terminal_poll(t);
+	}
 
-	// check for a signal ready sysbuf
-	if (terminal_search(&tun, &bnr, true)) {
-		// a terminal requesting service has been found - set Datacomm IRQ
-		unsigned index = IDX(tun, bnr);
-		TERMINAL_T *t = terminal+index;
-		if (t->enabled && !CC->CCI13F) {
-#if 0
-			printf("+IRQ  %02u/%02u -> SET CCI13F\n", tun, bnr);
-#endif
-			CC->CCI13F = true;
+	// time driven polling
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec && now.tv_nsec >= next.tv_nsec)) {
+		dcc_tick();
+		next = now;
+		next.tv_nsec += DCC_TICK * 1000000L;
+		if (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
 		}
 	}
 
+	// signal Datacomm IRQ again while terminals wait for service
+	index = queue_peek(&DCS->serviceq);
+	if (index >= 0) {
+		t = &DCS->terminal[index];
+		if (t->enabled && t->interrupt && !CC->CCI13F)
+			replay_irq(034);
+	}
+	goto loop;
+}
+
+/***********************************************************************
+* query DCC ready status
+***********************************************************************/
+BIT dcc_ready(unsigned index) {
+	// initialize DCC if not ready
+	if (!DCS->ready)
+		dcc_init("");
+
 	// finally return always ready
-	return ready;
+	return DCS->ready;
 }
 
 /***********************************************************************
@@ -530,7 +922,7 @@ static void dcc_read(IOCU *u) {
 		return;
 	}
 
-	TERMINAL_T *t = terminal+index;
+	TERMINAL_T *t = DCS->terminal+index;
 	char c;
 	int count;
 	int ptr;
@@ -612,6 +1004,9 @@ loop:
 	t->bufstate = idle;
 	t->abnormal = false;
 	t->interrupt = false;
+
+	// the line may have more input
+	dcc_notify(index);
 }
 
 /***********************************************************************
@@ -630,7 +1025,7 @@ static void dcc_write(IOCU *u) {
 		return;
 	}
 
-	TERMINAL_T *t = terminal+index;
+	TERMINAL_T *t = DCS->terminal+index;
 	char c;
 
 	// was written
@@ -713,7 +1108,8 @@ done:	if (dtrace) printf("'\n");
 	// data is now going to be sent...
 	t->bufstate = outputbusy;
 
-	// the sending is concluded in "terminal_search"
+	// the sending is done by the DCC thread
+	dcc_notify(index);
 }
 
 /***********************************************************************
@@ -726,8 +1122,8 @@ static void dcc_interrogate(IOCU *u) {
 
 	// tun == 0: general query - find a terminal that needs service
 	if (tun == 0) {
-		// search if any terminal needs service
-		terminal_search(&tun, &bnr, false);
+		// take the next terminal that needs service
+		service_next(&tun, &bnr);
 	}
 
 	// any found or specific query?
@@ -736,7 +1132,7 @@ static void dcc_interrogate(IOCU *u) {
 		unsigned index = IDX(tun, bnr);
 
 		if (index < NUMTERM) {
-			t = &terminal[index];
+			t = &DCS->terminal[index];
 			switch (t->bufstate) {
 			case readready:
 				u->d_result = RD_24_READ;
@@ -804,3 +1200,20 @@ void dcc_access(IOCU *u) {
 }
 
 
+
+/***********************************************************************
+* snapshot: network and serial sessions cannot be saved, all lines
+* come back disconnected
+***********************************************************************/
+void dcc_snapshot(SNAP_T *s) {
+	unsigned index, n = 0;
+
+	if (s->save) {
+		for (index = 0; index < NUMTERM; index++)
+			if (DCS->terminal[index].pcs == pcs_connected)
+				n++;
+		if (n)
+			printf("DCC: %u connected lines are not part of the snapshot\n", n);
+	}
+	snap_data(s, &n, sizeof n);
+}
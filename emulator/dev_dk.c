@@ -14,6 +14,8 @@
 *   read/write/open/lseek
 * 2018-03-16  R.Meyer
 *   Changed old ACCESSOR method to main_*_inc functions
+* 2026-10-19  agent
+*   disk contents go into snapshots, state is part of the MACHINE
 ***********************************************************************/
 
 #define COMPLAINABOUTNEVERWRITTEN 1
@@ -29,6 +31,8 @@
 #include <fcntl.h>
 #include "common.h"
 #include "io.h"
+#include "snapshot.h"
+#include "machine.h"
 
 /***********************************************************************
 * notes:
@@ -70,7 +74,7 @@
 /***********************************************************************
 * for each supported disk drive
 ***********************************************************************/
-static struct dk {
+struct dk {
 	char	filename[NAMELEN];
 	int	df;	// we do not use stdio here AND we assume we will never get 0 as the handle
 	BIT	ready;
@@ -79,36 +83,36 @@ static struct dk {
 	unsigned eus;
 	char	dbuf[DBUFLEN];
 	char	*dbufp;
-} dk[DFCU_PER_SYSTEM];
-
-/***********************************************************************
-* optional file to write debugging traces into
-***********************************************************************/
-static FILE *trace = NULL;
+};
 
 /***********************************************************************
-* currently selected unit or NULL in command interpreter
+* state
 ***********************************************************************/
-static struct dk *dkx = NULL;
+struct dk_state {
+	struct dk dk[DFCU_PER_SYSTEM];
+	FILE	*trace;		// optional file to write debugging traces into
+	struct dk *dkx;		// currently selected unit or NULL in command interpreter
+};
+#define	DKS	(machine->dk)
 
 /***********************************************************************
 * set to dka/dkb
 ***********************************************************************/
-static int set_dk(const char *v, void *data) {dkx = dk+(int)data; return 0; }
+static int set_dk(const char *v, void *data) {DKS->dkx = DKS->dk+(int)data; return 0; }
 
 /***********************************************************************
 * specify or close the trace file
 ***********************************************************************/
 static int set_dktrace(const char *v, void *) {
 	// if open, close existing trace file
-	if (trace) {
-		fclose(trace);
-		trace = NULL;
+	if (DKS->trace) {
+		fclose(DKS->trace);
+		DKS->trace = NULL;
 	}
 	// if a name is given, open new trace
 	if (strlen(v) > 0) {
-		trace = fopen(v, "w");
-		if (!trace)
+		DKS->trace = fopen(v, "w");
+		if (!DKS->trace)
 			return 2; // FATAL
 	}
 	return 0; // OK
@@ -118,14 +122,14 @@ static int set_dktrace(const char *v, void *) {
 * specify rwtrace on or off
 ***********************************************************************/
 static int set_dkrwtrace(const char *v, void *) {
-	if (!dkx) {
+	if (!DKS->dkx) {
 		printf("dk not specified\n");
 		return 2; // FATAL
 	}
 	if (strcmp(v, "on") == 0)
-		dkx->rwtrace = true;
+		DKS->dkx->rwtrace = true;
 	else if (strcmp(v, "off") == 0)
-		dkx->rwtrace = false;
+		DKS->dkx->rwtrace = false;
 	else {
 		printf("on or off required\n");
 		return 2; // FATAL
@@ -138,53 +142,61 @@ static int set_dkrwtrace(const char *v, void *) {
 ***********************************************************************/
 static int set_dkeus(const char *v, void *) {
 	char *p;
-	if (!dkx) {
+	if (!DKS->dkx) {
 		printf("dk not specified\n");
 		return 2; // FATAL
 	}
-	dkx->eus = strtoul(v, &p, 10);
-	if (*p || dkx->eus > 10) {
+	DKS->dkx->eus = strtoul(v, &p, 10);
+	if (*p || DKS->dkx->eus > 10) {
 		printf("non numeric or illegal data\n");
 		return 2; // FATAL
 	}
 	return 0; // OK
 }
 
+/***********************************************************************
+* report the ready status of the drive after a change
+***********************************************************************/
+static int dk_changed(int res) {
+	io_ready_changed(dk_ready, DKS->dkx - DKS->dk);
+	return res;
+}
+
 /***********************************************************************
 * specify or close the file for emulation
 ***********************************************************************/
 static int set_dkfile(const char *v, void *) {
-	if (!dkx) {
+	if (!DKS->dkx) {
 		printf("dk not specified\n");
 		return 2; // FATAL
 	}
-	strncpy(dkx->filename, v, NAMELEN);
-	dkx->filename[NAMELEN-1] = 0;
+	strncpy(DKS->dkx->filename, v, NAMELEN);
+	DKS->dkx->filename[NAMELEN-1] = 0;
 
 	// if we are ready, close current file
-	if (dkx->ready) {
-		close(dkx->df);
-		dkx->df = 0;
-		dkx->ready = false;
+	if (DKS->dkx->ready) {
+		close(DKS->dkx->df);
+		DKS->dkx->df = 0;
+		DKS->dkx->ready = false;
 	}
 
 	// reset flags
-	dkx->readcheck = false;
+	DKS->dkx->readcheck = false;
 
 	// now open the new file, if any name was given
 	// if none given, the drive just stays unready
-	if (dkx->filename[0]) {
-		dkx->df = open(dkx->filename, O_RDWR);
-		if (dkx->df > 0) {
-			dkx->ready = true;
-			return 0; // OK
+	if (DKS->dkx->filename[0]) {
+		DKS->dkx->df = open(DKS->dkx->filename, O_RDWR);
+		if (DKS->dkx->df > 0) {
+			DKS->dkx->ready = true;
+			return dk_changed(0); // OK
 		} else {
 			// cannot open
-			perror(dkx->filename);
-			return 2; // FATAL
+			perror(DKS->dkx->filename);
+			return dk_changed(2); // FATAL
 		}
 	}
-	return 0; // OK
+	return dk_changed(0); // OK
 }
 
 /***********************************************************************
@@ -204,8 +216,41 @@ static const command_t dk_commands[] = {
 * Initialize command from argv scanner or special SPO input
 ***********************************************************************/
 int dk_init(const char *option) {
-	dkx = NULL; // require specification of a drive
-	return command_parser(dk_commands, option);
+	int res;
+
+	DKS->dkx = NULL; // require specification of a drive
+	res = command_parser(dk_commands, option);
+	return res;
+}
+
+/***********************************************************************
+* state of a new machine
+***********************************************************************/
+int dk_create(void) {
+	DKS = (struct dk_state *)calloc(1, sizeof *DKS);
+	if (DKS == NULL) {
+		perror("dk");
+		return -1;
+	}
+	return 0;
+}
+
+/***********************************************************************
+* close the files
+***********************************************************************/
+void dk_term(void) {
+	struct dk *d;
+
+	if (DKS == NULL)
+		return;
+	for (d = DKS->dk; d < DKS->dk+DFCU_PER_SYSTEM; d++) {
+		if (d->ready)
+			close(d->df);
+	}
+	if (DKS->trace)
+		fclose(DKS->trace);
+	free(DKS);
+	DKS = NULL;
 }
 
 /***********************************************************************
@@ -213,7 +258,7 @@ int dk_init(const char *option) {
 ***********************************************************************/
 BIT dk_ready(unsigned index) {
 	if (index < DFCU_PER_SYSTEM)
-		return dk[index].ready;
+		return DKS->dk[index].ready;
 	return false;
 }
 
@@ -226,7 +271,7 @@ void dk_access(IOCU *u) {
 	unsigned eu = 0, diskfileaddr = 0;
 	off_t seekval;
 	ssize_t cnt;
-	struct dk *dkx;
+	struct dk *d;
 
 	count = u->d_wc;
 	segcnt = u->d_result & 077;
@@ -234,11 +279,11 @@ void dk_access(IOCU *u) {
 	words = (u->d_control & CD_25_USEWC) ? count : segcnt * 30;
 
 	// select local data structure
-	dkx = dk + unit[u->d_unit][0].index;
+	d = DKS->dk + unit[u->d_unit][0].index;
 
 	u->d_result = 0;
 
-	if (!dkx->ready) {
+	if (!d->ready) {
 		printf("*** DISK %s NOT READY ***\n", unit[u->d_unit][0].name);
 		u->d_result = RD_18_NRDY;
 		goto retresult;
@@ -258,11 +303,11 @@ void dk_access(IOCU *u) {
 	}
 
 	// legal access?
-	if (eu >= dkx->eus || diskfileaddr >= SEGS_PER_DFEU) {
+	if (eu >= d->eus || diskfileaddr >= SEGS_PER_DFEU) {
 		// not supported
-		if (trace)
-			fprintf(trace, " NOT SUPPORTED\n");
-		if (dkx->rwtrace)
+		if (DKS->trace)
+			fprintf(DKS->trace, " NOT SUPPORTED\n");
+		if (d->rwtrace)
 			putchar('?');
 		u->d_result = RD_21_END;
 		goto retresult;
@@ -270,28 +315,28 @@ void dk_access(IOCU *u) {
 
 	// special case when memory inhibit
 	if (u->d_control & CD_30_MI) {
-		dkx->readcheck = true;
-		if (trace)
-			fprintf(trace, " READ CHECK SEGMENTS=%02u\n", segcnt);
-		if (dkx->rwtrace)
+		d->readcheck = true;
+		if (DKS->trace)
+			fprintf(DKS->trace, " READ CHECK SEGMENTS=%02u\n", segcnt);
+		if (d->rwtrace)
 			putchar('c');
 		goto retresult;
 	}
 
 	// special case when words=0
 	if (words == 0) {
-		if (trace)
-			fprintf(trace, " INTERROGATE\n");
-		if (dkx->rwtrace)
+		if (DKS->trace)
+			fprintf(DKS->trace, " INTERROGATE\n");
+		if (d->rwtrace)
 			putchar('i');
 		goto retresult;
 	}
 
 	// regular read
 	if (u->d_control & CD_24_READ) {
-		if (trace)
-			fprintf(trace, " READ WORDS=%02u\n", words);
-		if (dkx->rwtrace)
+		if (DKS->trace)
+			fprintf(DKS->trace, " READ WORDS=%02u\n", words);
+		if (d->rwtrace)
 			putchar('r');
 
 		// read until word count exhausted
@@ -306,13 +351,13 @@ void dk_access(IOCU *u) {
 			// on read problems retry...
 			retry = 0;
 			readagain:
-			if (lseek(dkx->df, seekval, SEEK_SET) != seekval) {
+			if (lseek(d->df, seekval, SEEK_SET) != seekval) {
 				printf("*** DISKIO READ SEEK ERROR %d DFA=%u:%06u ***\n", errno, eu, diskfileaddr);
 				// report not ready
 				u->d_result = RD_18_NRDY;
 				goto retresult;
 			}
-			cnt = read(dkx->df, dkx->dbuf, 256);
+			cnt = read(d->df, d->dbuf, 256);
 			if (cnt == 0) {
 				// read past current end
 #if COMPLAINABOUTNEVERWRITTEN
@@ -330,56 +375,56 @@ void dk_access(IOCU *u) {
 				goto retresult;
 			}
 			// put and end of string
-			dkx->dbuf[256] = 0;
+			d->dbuf[256] = 0;
 
 			// if the signature is missing or wrong, this record has never been written
-			dkx->dbufp = dkx->dbuf + DATALEN;
-			if (sscanf(dkx->dbufp, "_%04x_%01u_%06u_\n", &xsum, &xeu, &xdiskfileaddr) != 3) {
+			d->dbufp = d->dbuf + DATALEN;
+			if (sscanf(d->dbufp, "_%04x_%01u_%06u_\n", &xsum, &xeu, &xdiskfileaddr) != 3) {
 #if COMPLAINABOUTNEVERWRITTEN
 				printf("*** DISKIO READ OF RECORD NEVER WRITTEN DFA=%u:%06u ***\n", eu, diskfileaddr);
-				//printf("Segment:'%s'\n", dkx->dbuf);
+				//printf("Segment:'%s'\n", d->dbuf);
 #endif
 		pasteof:
 				// return a '0' filled segment
-				memset(dkx->dbuf, '0', 256);
-				dkx->dbuf[255] = '\n';
+				memset(d->dbuf, '0', 256);
+				d->dbuf[255] = '\n';
 				check = false;
 			}
 			// set pointer back to segment data
-			dkx->dbufp = dkx->dbuf;
+			d->dbufp = d->dbuf;
 			sum = 0;
 
 			// always handle chunks of 30 words
 			for (i=0; i<3; i++) {
-				if (trace)
-					fprintf(trace, "\t%05o %u:%06u", u->d_addr, eu, diskfileaddr);
+				if (DKS->trace)
+					fprintf(DKS->trace, "\t%05o %u:%06u", u->d_addr, eu, diskfileaddr);
 				for (j=0; j<10; j++) {
-					if (trace)
-						fprintf(trace, " %-8.8s", dkx->dbufp);
+					if (DKS->trace)
+						fprintf(DKS->trace, " %-8.8s", d->dbufp);
 					// store until word count exhausted
 					if (words > 0) {
 						u->w = 0LL;
 						for (k=0; k<8; k++) {
-							u->ib = translatetable_ascii2bic[*dkx->dbufp & 0x7f];
+							u->ib = translatetable_ascii2bic[*d->dbufp & 0x7f];
 							put_ib(u);
-							sum += *dkx->dbufp;
-							dkx->dbufp++;
+							sum += *d->dbufp;
+							d->dbufp++;
 						}
 						main_write_inc(u);
 						words--;
 					} else {
 						for (k=0; k<8; k++) {
-							sum += *dkx->dbufp;
-							dkx->dbufp++;
+							sum += *d->dbufp;
+							d->dbufp++;
 						}
 					}
 				}
-				if (trace)
-					fprintf(trace, "\n");
+				if (DKS->trace)
+					fprintf(DKS->trace, "\n");
 			} // chunk of 30 words
 
 			// sanity check - should never fail
-			if (dkx->dbufp != dkx->dbuf+DATALEN) {
+			if (d->dbufp != d->dbuf+DATALEN) {
 				printf("*** DISKIO READ SANITY CHECK(1) FAILED ***\n");
 				exit(2);
 			}
@@ -404,27 +449,27 @@ void dk_access(IOCU *u) {
 
 	// what remains: regular write
 	{
-		if (trace)
-			fprintf(trace, " WRITE WORDS=%02u\n", words);
-		if (dkx->rwtrace)
+		if (DKS->trace)
+			fprintf(DKS->trace, " WRITE WORDS=%02u\n", words);
+		if (d->rwtrace)
 			putchar('w');
 
 		// keep writing records until word count is exhausted
 		while (words > 0) {
 			// prepare buffer pointer and checksum
 			unsigned sum = 0;
-			dkx->dbufp = dkx->dbuf;
+			d->dbufp = d->dbuf;
 			// always handle chunks of 30 words
 			for (i=0; i<3; i++) {
-				if (trace)
-					fprintf(trace, "\t%05o %u:%06u", u->d_addr, eu, diskfileaddr);
+				if (DKS->trace)
+					fprintf(DKS->trace, "\t%05o %u:%06u", u->d_addr, eu, diskfileaddr);
 				for (j=0; j<10; j++) {
 					if (words > 0) {
 						// if word count NOT exhausted, write next word
 						main_read_inc(u);
 						for (k=0; k<8; k++) {
 							unsigned ch = translatetable_bic2ascii[u->w & 077];
-							dkx->dbufp[7-k] = ch;
+							d->dbufp[7-k] = ch;
 							u->w >>= 6;
 							sum += ch;
 						}
@@ -432,31 +477,31 @@ void dk_access(IOCU *u) {
 					} else {
 						// if word count exhausted, write zeros
 						for (k=0; k<8; k++) {
-							dkx->dbufp[7-k] = '0';
+							d->dbufp[7-k] = '0';
 							sum += '0';
 						}
 					}
-					dkx->dbufp += 8;
-					if (trace)
-						fprintf(trace, " %-8.8s", dkx->dbufp-8);
+					d->dbufp += 8;
+					if (DKS->trace)
+						fprintf(DKS->trace, " %-8.8s", d->dbufp-8);
 				}
-				if (trace)
-					fprintf(trace, "\n");
+				if (DKS->trace)
+					fprintf(DKS->trace, "\n");
 			} // chunk of 30 words
 
 			// sanity check - should never fail
-			if (dkx->dbufp != dkx->dbuf+DATALEN) {
+			if (d->dbufp != d->dbuf+DATALEN) {
 				printf("*** DISKIO WRITE SANITY CHECK(1) FAILED ***\n");
 				exit(2);
 			}
 
 			// write header
-			dkx->dbufp = dkx->dbuf + DATALEN;
-			dkx->dbufp += sprintf(dkx->dbufp, "_%04x_%01u_%06u_\n",
+			d->dbufp = d->dbuf + DATALEN;
+			d->dbufp += sprintf(d->dbufp, "_%04x_%01u_%06u_\n",
 				sum, eu, diskfileaddr);
 
 			// sanity check - should never fail
-			if (dkx->dbufp != dkx->dbuf+256) {
+			if (d->dbufp != d->dbuf+256) {
 				printf("*** DISKIO WRITE SANITY CHECK(2) FAILED ***\n");
 				exit(2);
 			}
@@ -465,13 +510,13 @@ void dk_access(IOCU *u) {
 			seekval = (eu*SEGS_PER_DFEU+diskfileaddr)*256;
 			retry = 0;
 			writeagain:
-			if (lseek(dkx->df, seekval, SEEK_SET) != seekval) {
+			if (lseek(d->df, seekval, SEEK_SET) != seekval) {
 				printf("*** DISKIO WRITE SEEK ERROR %d DFA=%u:%06u ***\n", errno, eu, diskfileaddr);
 				// report not ready
 				u->d_result = RD_18_NRDY;
 				goto retresult;
 			}
-			if (write(dkx->df, dkx->dbuf, 256) != 256) {
+			if (write(d->df, d->dbuf, 256) != 256) {
 				printf("*** DISKIO WRITE ERROR %d DFA=%u:%06u RETRYING... ***\n", errno, eu, diskfileaddr);
 				++retry;
 				if (retry < 10)
@@ -493,9 +538,9 @@ retresult:
 	else
 		u->d_wc = 0;
 
-	if (trace)
-		fflush(trace);
-	if (dkx->rwtrace)
+	if (DKS->trace)
+		fflush(DKS->trace);
+	if (d->rwtrace)
 		fflush(stdout);
 
 #if 0
@@ -510,3 +555,56 @@ retresult:
 }
 
 
+
+/***********************************************************************
+* snapshot: the disk files, as the MCP state on disk belongs to the
+* memory image
+* contents are only restored into a drive with the same file name
+***********************************************************************/
+void dk_snapshot(SNAP_T *s) {
+	struct dk *d;
+	char filename[NAMELEN];
+	char buf[65536];
+	long long size, done;
+	struct stat st;
+	int n;
+	BIT restore;
+
+	for (d = DKS->dk; d < DKS->dk+DFCU_PER_SYSTEM; d++) {
+		size = 0;
+		if (s->save) {
+			memcpy(filename, d->filename, NAMELEN);
+			if (d->ready && fstat(d->df, &st) == 0)
+				size = st.st_size;
+			else
+				filename[0] = 0;
+		}
+		snap_data(s, filename, NAMELEN);
+		snap_data(s, &size, sizeof size);
+		if (s->error)
+			return;
+		restore = !s->save && d->ready && strcmp(filename, d->filename) == 0;
+		if (!s->save && filename[0] && !restore)
+			printf("DK%c: %s not loaded, contents not restored\n", 'A'+(int)(d-DKS->dk), filename);
+		if (restore && ftruncate(d->df, size) < 0) {
+			perror(d->filename);
+			s->error = true;
+			return;
+		}
+		for (done = 0; done < size; done += n) {
+			n = size - done > (long long)sizeof buf ? sizeof buf : size - done;
+			if (s->save && pread(d->df, buf, n, done) != n) {
+				perror(d->filename);
+				s->error = true;
+			}
+			snap_data(s, buf, n);
+			if (s->error)
+				return;
+			if (restore && pwrite(d->df, buf, n, done) != n) {
+				perror(d->filename);
+				s->error = true;
+				return;
+			}
+		}
+	}
+}
@@ -9,6 +9,8 @@
 ************************************************************************
 * 2018-05-04  R.Meyer
 *   Copied from dev_cp.c
+* 2026-10-19  agent
+*   drum contents go into snapshots, state is part of the MACHINE
 ***********************************************************************/
 
 #include <stdio.h>
@@ -22,6 +24,8 @@
 #include <fcntl.h>
 #include "common.h"
 #include "io.h"
+#include "snapshot.h"
+#include "machine.h"
 
 #define DRUMS 2
 #define NAMELEN 100
@@ -29,58 +33,70 @@
 /***********************************************************************
 * for each supported magnetic drum
 ***********************************************************************/
-static struct dr {
+struct dr {
 	BIT	ready;
 	WORD48	drum[32768];
-} dr[DRUMS];
+};
 
 /***********************************************************************
-* optional open file to write debugging traces into
+* state
 ***********************************************************************/
-static FILE *trace = NULL;
-static struct dr *drx = NULL;
+struct dr_state {
+	struct dr dr[DRUMS];
+	FILE	*trace;		// optional open file to write debugging traces into
+	struct dr *drx;
+};
+#define	DRS	(machine->dr)
 
 /***********************************************************************
 * set to dra
 ***********************************************************************/
-static int set_dr(const char *v, void *data) {drx = dr+(int)data; return 0; }
+static int set_dr(const char *v, void *data) {DRS->drx = DRS->dr+(int)data; return 0; }
 
 /***********************************************************************
 * specify or close the trace file
 ***********************************************************************/
 static int set_drtrace(const char *v, void *) {
 	// if open, close existing trace file
-	if (trace) {
-		fclose(trace);
-		trace = NULL;
+	if (DRS->trace) {
+		fclose(DRS->trace);
+		DRS->trace = NULL;
 	}
 	// if a name is given, open new trace
 	if (strlen(v) > 0) {
-		trace = fopen(v, "w");
-		if (!trace)
+		DRS->trace = fopen(v, "w");
+		if (!DRS->trace)
 			return 2; // FATAL
 	}
 	return 0; // OK
 }
 
+/***********************************************************************
+* report the ready status of the drive after a change
+***********************************************************************/
+static int dr_changed(int res) {
+	io_ready_changed(dr_ready, DRS->drx - DRS->dr);
+	return res;
+}
+
 /***********************************************************************
 * specify ready or not
 ***********************************************************************/
 static int set_drready(const char *v, void *) {
-	if (!drx) {
+	if (!DRS->drx) {
 		spo_print("$DR NOT SPECIFIED\r\n");
 		return 2; // FATAL
 	}
 
 	if (strcasecmp(v, "ON") == 0) {
-		drx->ready = true;
+		DRS->drx->ready = true;
 	} else if (strcasecmp(v, "OFF") == 0) {
-		drx->ready = false;
+		DRS->drx->ready = false;
 	} else {
 		spo_print("$SPECIFY ON OR OFF\r\n");
-		return 2; // FATAL
+		return dr_changed(2); // FATAL
 	}
-	return 0; // OK
+	return dr_changed(0); // OK
 }
 
 /***********************************************************************
@@ -98,8 +114,35 @@ static const command_t dr_commands[] = {
 * Initialize command from argv scanner or special SPO input
 ***********************************************************************/
 int dr_init(const char *option) {
-	drx = NULL; // require specification of a drive
-	return command_parser(dr_commands, option);
+	int res;
+
+	DRS->drx = NULL; // require specification of a drive
+	res = command_parser(dr_commands, option);
+	return res;
+}
+
+/***********************************************************************
+* state of a new machine
+***********************************************************************/
+int dr_create(void) {
+	DRS = (struct dr_state *)calloc(1, sizeof *DRS);
+	if (DRS == NULL) {
+		perror("dr");
+		return -1;
+	}
+	return 0;
+}
+
+/***********************************************************************
+* release the drums
+***********************************************************************/
+void dr_term(void) {
+	if (DRS == NULL)
+		return;
+	if (DRS->trace)
+		fclose(DRS->trace);
+	free(DRS);
+	DRS = NULL;
 }
 
 /***********************************************************************
@@ -107,7 +150,7 @@ int dr_init(const char *option) {
 ***********************************************************************/
 BIT dr_ready(unsigned index) {
 	if (index < DRUMS)
-		return dr[index].ready;
+		return DRS->dr[index].ready;
 	return false;
 }
 
@@ -117,39 +160,39 @@ BIT dr_ready(unsigned index) {
 void dr_access(IOCU *u) {
         BIT read;
 	ADDR15 addr;
-	struct dr *drx;
+	struct dr *d;
 
         read = u->w & MASK_IODDRUMOP ? true : false;
 	addr = (u->w & MASK_IODDRUMAD) >> SHFT_IODDRUMAD;
 
         u->d_result = 0; // no errors so far
 
-	drx = dr + unit[u->d_unit][0].index;
+	d = DRS->dr + unit[u->d_unit][0].index;
 
-        if (!drx->ready) {
+        if (!d->ready) {
                 u->d_result = RD_18_NRDY;
                 goto retresult;
         }
 
-	if (trace)
-		fprintf(trace, unit[u->d_unit][0].name); 
+	if (DRS->trace)
+		fprintf(DRS->trace, unit[u->d_unit][0].name); 
 
 	if (read) {
-		if (trace)
-			fprintf(trace, " READ %u WORDS FROM %05o TO %05o\n",
+		if (DRS->trace)
+			fprintf(DRS->trace, " READ %u WORDS FROM %05o TO %05o\n",
 				u->d_wc, addr, u->d_addr);
 		while (u->d_wc > 0) {
-			u->w = drx->drum[addr++];
+			u->w = d->drum[addr++];
 			main_write_inc(u);
 			u->d_wc--;
 		}
 	} else {
-		if (trace)
-			fprintf(trace, " WRITE %u WORDS FROM %05o TO %05o\n",
+		if (DRS->trace)
+			fprintf(DRS->trace, " WRITE %u WORDS FROM %05o TO %05o\n",
 				u->d_wc, u->d_addr, addr);
 		while (u->d_wc > 0) {
 			main_read_inc(u);
-			drx->drum[addr++] = u->w;
+			d->drum[addr++] = u->w;
 			u->d_wc--;
 		}
 	}
@@ -159,3 +202,13 @@ retresult:
 }
 
 
+
+/***********************************************************************
+* snapshot: drum contents
+***********************************************************************/
+void dr_snapshot(SNAP_T *s) {
+	struct dr *d;
+
+	for (d = DRS->dr; d < DRS->dr+DRUMS; d++)
+		snap_data(s, d->drum, sizeof d->drum);
+}
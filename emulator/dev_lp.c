@@ -14,6 +14,9 @@
 *   and use u->ob
 * 2018-03-28  R.Meyer
 *   Added HPLJ type
+* 2026-10-19  agent
+*   pages written by a thread, optional file per job, snapshots,
+*   replay, state is part of the MACHINE
 ***********************************************************************/
 
 #include <stdio.h>
@@ -25,8 +28,13 @@
 #include <ctype.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
 #include "common.h"
 #include "io.h"
+#include "snapshot.h"
+#include "replay.h"
+#include "machine.h"
 
 /***********************************************************************
 * typical labels (all are on a skip to 1 line):
@@ -42,53 +50,272 @@
 
 #define PRINTERS 2
 #define NAMELEN 100
+#define	NPAGES	8
+#define	PAGELEN	16384
+#define	LABELLEN 132
 
 //			RESET	DIN-A4		PORTRAIT	ROMAN-8		LINEPRINTFONT	16.66CPI	VERY BOLD
 #define INIT_HPLJ	"\033E"	"\033&l26A"	"\033&l0O"	"\033(8U"	"\033(s0T"	"\033(s16.66H"	"\033(s7B"
 #define	LINES_HPLJ	60
 
+/***********************************************************************
+* output collected for the writer thread
+***********************************************************************/
+struct lppage {
+	char	newfile[NAMELEN+40];	// if set, switch to this file first
+	int	len;
+	char	data[PAGELEN];
+};
+
+/***********************************************************************
+* job separation state
+***********************************************************************/
+enum js {js_none=0, js_banner, js_body, js_trailer};
+
 /***********************************************************************
 * for each supported printer
 ***********************************************************************/
 enum pt	{pt_file=0, pt_lc10, pt_text, pt_hplj};
-static struct lp {
+struct lp {
 	char	filename[NAMELEN];
-	FILE	*fp;
+	FILE	*fp;			// owned by the writer thread
 	enum pt	type;
 	int	pagelen;
 	int 	lineno;
 	BIT	initsent;
 	BIT	ready;
 	BIT	pageused;
-} lp[PRINTERS];
+	struct lppage *page;		// ring of NPAGES, protected by LPS->mutex
+	unsigned prp, pwp;		// next page to write, page being filled
+	char	jobdir[NAMELEN];	// if set, one file per job in there
+	unsigned jobno;
+	enum js	js;
+	char	joblabel[LABELLEN];	// banner of the current job
+};
+
+/***********************************************************************
+* state with the writer thread and its synchronization
+***********************************************************************/
+struct lp_state {
+	struct lp lp[PRINTERS];
+	BIT	initialized;
+	pthread_t handler;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	BIT	stop;			// protected by mutex
+	struct lp *lpx;
+};
+#define	LPS	(machine->lp)
+
+/***********************************************************************
+* page being filled
+***********************************************************************/
+#define	PAGE(l)	((l)->page + (l)->pwp % NPAGES)
+
+/***********************************************************************
+* hand the page being filled to the writer, must hold LPS->mutex
+***********************************************************************/
+static void lp_handover(struct lp *l) {
+	if (PAGE(l)->len == 0 && PAGE(l)->newfile[0] == 0)
+		return;
+	while (l->pwp + 1 - l->prp >= NPAGES)
+		pthread_cond_wait(&LPS->cond, &LPS->mutex);
+	l->pwp++;
+	PAGE(l)->len = 0;
+	PAGE(l)->newfile[0] = 0;
+	pthread_cond_broadcast(&LPS->cond);
+}
+
+/***********************************************************************
+* writer thread
+* writes and flushes whole pages, partial pages after one idle second
+***********************************************************************/
+static void *lp_function(void *p) {
+	struct lp *l;
+	struct lppage *pg;
+	struct timespec ts;
+
+	machine_bind((MACHINE *)p);
+	pthread_mutex_lock(&LPS->mutex);
+loop:
+	if (LPS->stop) {
+		pthread_mutex_unlock(&LPS->mutex);
+		return NULL;
+	}
+	for (l = LPS->lp; l < LPS->lp+PRINTERS; l++)
+		if (l->prp != l->pwp)
+			goto found;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += 1;
+	if (pthread_cond_timedwait(&LPS->cond, &LPS->mutex, &ts) == ETIMEDOUT) {
+		for (l = LPS->lp; l < LPS->lp+PRINTERS; l++)
+			if (l->page && l->prp == l->pwp)
+				lp_handover(l);
+	}
+	goto loop;
+found:
+	pg = l->page + l->prp % NPAGES;
+	pthread_mutex_unlock(&LPS->mutex);
+
+	// the page is not touched by lp_write until prp advances
+	if (pg->newfile[0]) {
+		if (l->fp)
+			fclose(l->fp);
+		l->fp = fopen(pg->newfile, "w");
+		if (!l->fp)
+			perror(pg->newfile);
+	}
+	if (l->fp && pg->len > 0) {
+		fwrite(pg->data, 1, pg->len, l->fp);
+		fflush(l->fp);
+	}
+
+	pthread_mutex_lock(&LPS->mutex);
+	l->prp++;
+	pthread_cond_broadcast(&LPS->cond);
+	goto loop;
+}
 
-static struct lp *lpx = NULL;
+/***********************************************************************
+* wait until the writer has written everything and close the file
+***********************************************************************/
+static void lp_close(struct lp *l) {
+	pthread_mutex_lock(&LPS->mutex);
+	if (l->page) {
+		lp_handover(l);
+		while (l->prp != l->pwp)
+			pthread_cond_wait(&LPS->cond, &LPS->mutex);
+	}
+	pthread_mutex_unlock(&LPS->mutex);
+	if (l->fp)
+		fclose(l->fp);
+	l->fp = NULL;
+	l->ready = false;
+}
+
+/***********************************************************************
+* prepare printer for output
+***********************************************************************/
+static void lp_open(struct lp *l) {
+	if (!l->page)
+		l->page = (struct lppage*)calloc(NPAGES, sizeof(struct lppage));
+	l->ready = true;
+	l->lineno = 1;
+	l->pageused = false;
+	l->initsent = false;
+	l->js = js_none;
+}
+
+/***********************************************************************
+* append to the page being filled, must hold LPS->mutex
+* a full page goes to the writer, the rest continues on the next one
+***********************************************************************/
+static void lp_out(struct lp *l, const char *s, int len) {
+	int n;
+
+	while (len > 0) {
+		if (PAGE(l)->len == PAGELEN)
+			lp_handover(l);
+		n = PAGELEN - PAGE(l)->len;
+		if (n > len)
+			n = len;
+		memcpy(PAGE(l)->data + PAGE(l)->len, s, n);
+		PAGE(l)->len += n;
+		s += n;
+		len -= n;
+	}
+}
+
+static void lp_puts(struct lp *l, const char *s) {
+	lp_out(l, s, strlen(s));
+}
+
+/***********************************************************************
+* start a new job file, must hold LPS->mutex
+* the name is made of a sequence number and MFID/FID of the banner
+***********************************************************************/
+static void lp_newjob(struct lp *l, const char *label) {
+	char name[20], *np;
+	int i;
+
+	lp_handover(l);
+	np = name;
+	if (label) {
+		// MFID (unless zeros) and FID, see table above
+		if (strncmp(label+9, "0000000", 7) != 0) {
+			for (i = 9; i < 16; i++)
+				if (isalnum(label[i]))
+					*np++ = label[i];
+			*np++ = '-';
+		}
+		for (i = 17; i < 24; i++)
+			if (isalnum(label[i]))
+				*np++ = label[i];
+	}
+	*np = 0;
+	l->jobno++;
+	snprintf(PAGE(l)->newfile, sizeof PAGE(l)->newfile, "%s/job%04u%s%s.txt",
+		l->jobdir, l->jobno, name[0] ? "-" : "", name);
+	l->lineno = 1;
+	l->pageused = false;
+	l->initsent = false;
+}
+
+/***********************************************************************
+* follow the MCP banners to separate jobs, must hold LPS->mutex
+* a banner identical to that of the current job after some output
+* is the trailer, any other banner starts a new job
+***********************************************************************/
+static void lp_job(struct lp *l, WORD4 skip, const char *line, int len) {
+	BIT label = line && skip == 1 && len >= 24 && strncmp(line, " LABEL ", 7) == 0;
+
+	if (label) {
+		if (len > LABELLEN)
+			len = LABELLEN;
+		if (l->js != js_none && strncmp(l->joblabel, line, len) == 0) {
+			if (l->js == js_body)
+				l->js = js_trailer;
+			return;
+		}
+		memset(l->joblabel, 0, LABELLEN);
+		memcpy(l->joblabel, line, len);
+		lp_newjob(l, line);
+		l->js = js_banner;
+	} else if (l->js == js_none) {
+		// output without a banner
+		memset(l->joblabel, 0, LABELLEN);
+		lp_newjob(l, NULL);
+		l->js = js_body;
+	} else if (l->js == js_banner && line) {
+		l->js = js_body;
+	}
+}
 
 /***********************************************************************
 * set to lpa/lpb
 ***********************************************************************/
-static int set_lp(const char *v, void *data) {lpx = lp+(int)data; return 0; }
+static int set_lp(const char *v, void *data) {LPS->lpx = LPS->lp+(int)data; return 0; }
 
 /***********************************************************************
 * specify printer type
 ***********************************************************************/
 static int set_lptype(const char *v, void *) {
-	if (!lpx) {
+	if (!LPS->lpx) {
 		printf("lp not specified\n");
 		return 2; // FATAL
 	}
 	if (strcmp(v, "file") == 0) {
-		lpx->type = pt_file;
-		lpx->pagelen = 60;
+		LPS->lpx->type = pt_file;
+		LPS->lpx->pagelen = 60;
 	} else if (strcmp(v, "lc10") == 0) {
-		lpx->type = pt_lc10;
-		lpx->pagelen = 66;
+		LPS->lpx->type = pt_lc10;
+		LPS->lpx->pagelen = 66;
 	} else if (strcmp(v, "text") == 0) {
-		lpx->type = pt_text;
-		lpx->pagelen = 0;
+		LPS->lpx->type = pt_text;
+		LPS->lpx->pagelen = 0;
 	} else if (strcmp(v, "hplj") == 0) {
-		lpx->type = pt_hplj;
-		lpx->pagelen = LINES_HPLJ;
+		LPS->lpx->type = pt_hplj;
+		LPS->lpx->pagelen = LINES_HPLJ;
 	} else {
 		printf("unknown type\n");
 		return 2; // FATAL
@@ -96,41 +323,72 @@ static int set_lptype(const char *v, void *) {
 	return 0; // OK
 }
 
+/***********************************************************************
+* report the ready status of the drive after a change
+***********************************************************************/
+static int lp_changed(int res) {
+	io_ready_changed(lp_ready, LPS->lpx - LPS->lp);
+	return res;
+}
+
 /***********************************************************************
 * specify or close the file for emulation
 ***********************************************************************/
 static int set_lpfile(const char *v, void *) {
-	if (!lpx) {
+	if (!LPS->lpx) {
 		printf("lp not specified\n");
 		return 2; // FATAL
 	}
-	strncpy(lpx->filename, v, NAMELEN);
-	lpx->filename[NAMELEN-1] = 0;
-
-	// if we are ready, close current file
-	if (lpx->ready) {
-		fclose(lpx->fp);
-		lpx->fp = NULL;
-		lpx->ready = false;
-	}
+	strncpy(LPS->lpx->filename, v, NAMELEN);
+	LPS->lpx->filename[NAMELEN-1] = 0;
+
+	// write out everything pending, close current file
+	lp_close(LPS->lpx);
+	LPS->lpx->jobdir[0] = 0;
 
 	// now open the new file, if any name was given
 	// if none given, the drive just stays unready
-	if (lpx->filename[0]) {
-		lpx->fp = fopen(lpx->filename, "w"); // printers are always write only
-		if (lpx->fp) {
-			lpx->ready = true;
-			lpx->lineno = 1;
-			lpx->pageused = false;
-			lpx->initsent = false;
-			return 0; // OK
+	if (LPS->lpx->filename[0]) {
+		LPS->lpx->fp = fopen(LPS->lpx->filename, "w"); // printers are always write only
+		if (LPS->lpx->fp) {
+			lp_open(LPS->lpx);
+			return lp_changed(0); // OK
 		} else {
 			// cannot open
-			perror(lpx->filename);
-			return 2; // FATAL
+			perror(LPS->lpx->filename);
+			return lp_changed(2); // FATAL
 		}
 	}
-	return 0; // OK
+	return lp_changed(0); // OK
+}
+
+/***********************************************************************
+* specify or stop the directory for one file per job
+***********************************************************************/
+static int set_lpjobs(const char *v, void *) {
+	struct stat st;
+
+	if (!LPS->lpx) {
+		printf("lp not specified\n");
+		return 2; // FATAL
+	}
+
+	// write out everything pending, close current file
+	lp_close(LPS->lpx);
+	LPS->lpx->filename[0] = 0;
+	strncpy(LPS->lpx->jobdir, v, NAMELEN);
+	LPS->lpx->jobdir[NAMELEN-1] = 0;
+
+	// if none given, the printer just stays unready
+	if (LPS->lpx->jobdir[0]) {
+		if (stat(LPS->lpx->jobdir, &st) < 0 || !S_ISDIR(st.st_mode)) {
+			printf("%s: not a directory\n", LPS->lpx->jobdir);
+			LPS->lpx->jobdir[0] = 0;
+			return lp_changed(2); // FATAL
+		}
+		lp_open(LPS->lpx);
+	}
+	return lp_changed(0); // OK
 }
 
 /***********************************************************************
@@ -141,6 +399,7 @@ static const command_t lp_commands[] = {
 	{"lpb", 	set_lp, (void *) 1},
 	{"type",	set_lptype},
 	{"file",	set_lpfile},
+	{"jobs",	set_lpjobs},
 	{NULL,		NULL},
 };
 
@@ -148,8 +407,55 @@ static const command_t lp_commands[] = {
 * Initialize command from argv scanner or special SPO input
 ***********************************************************************/
 int lp_init(const char *option) {
-	lpx = NULL; // require specification of a drive
-	return command_parser(lp_commands, option);
+	int res;
+
+	if (!LPS->initialized) {
+		// writer thread
+		pthread_create(&LPS->handler, 0, lp_function, machine);
+		LPS->initialized = true;
+	}
+	LPS->lpx = NULL; // require specification of a drive
+	res = command_parser(lp_commands, option);
+	return res;
+}
+
+/***********************************************************************
+* state of a new machine
+***********************************************************************/
+int lp_create(void) {
+	LPS = (struct lp_state *)calloc(1, sizeof *LPS);
+	if (LPS == NULL) {
+		perror("lp");
+		return -1;
+	}
+	pthread_mutex_init(&LPS->mutex, NULL);
+	pthread_cond_init(&LPS->cond, NULL);
+	return 0;
+}
+
+/***********************************************************************
+* write out and close all printers, end the writer thread
+***********************************************************************/
+void lp_term(void) {
+	struct lp *l;
+
+	if (LPS == NULL)
+		return;
+	if (LPS->initialized) {
+		for (l = LPS->lp; l < LPS->lp+PRINTERS; l++)
+			lp_close(l);
+		pthread_mutex_lock(&LPS->mutex);
+		LPS->stop = true;
+		pthread_cond_broadcast(&LPS->cond);
+		pthread_mutex_unlock(&LPS->mutex);
+		pthread_join(LPS->handler, NULL);
+	}
+	for (l = LPS->lp; l < LPS->lp+PRINTERS; l++)
+		free(l->page);
+	pthread_mutex_destroy(&LPS->mutex);
+	pthread_cond_destroy(&LPS->cond);
+	free(LPS);
+	LPS = NULL;
 }
 
 /***********************************************************************
@@ -157,7 +463,7 @@ int lp_init(const char *option) {
 ***********************************************************************/
 BIT lp_ready(unsigned index) {
 	if (index < PRINTERS)
-		return lp[index].ready;
+		return LPS->lp[index].ready;
 	return false;
 }
 
@@ -169,8 +475,9 @@ void lp_write(IOCU *u) {
         BIT mi;
         WORD2 space;
         WORD4 skip;
-	struct lp *lpx;
-        int i;
+	struct lp *l;
+        int i, len;
+	char line[8*1024];
 
         mi = (u->d_control & CD_30_MI) ? true : false;
         space = (u->d_result & 060) >> 4;
@@ -179,18 +486,41 @@ void lp_write(IOCU *u) {
                 count = u->d_wc;
         else
                 count = 0;
-	lpx = lp + unit[u->d_unit][0].index;
+	l = LPS->lp + unit[u->d_unit][0].index;
 
 	u->d_result = 0;
 
-        if (!lpx->ready) {
+        if (!l->ready) {
                 u->d_result = RD_18_NRDY;
                 goto retresult;
         }
 
-	if (!lpx->initsent) {
+	// fetch the line
+	len = 0;
+        if (!mi) {
+                while (count > 0) {
+                        main_read_inc(u);
+                        for (i=0; i<8; i++) {
+                                get_ob(u);
+                                line[len++] = translatetable_bic2ascii[u->ob];
+			}
+                        count--;
+                }
+        }
+
+	pthread_mutex_lock(&LPS->mutex);
+
+	// a skip to channel 1 ends the page
+	if (skip == 1)
+		lp_handover(l);
+
+	// new file per job?
+	if (l->jobdir[0])
+		lp_job(l, skip, mi ? NULL : line, len);
+
+	if (!l->initsent) {
 		// send printer specific init commands
-		switch (lpx->type) {
+		switch (l->type) {
 		case pt_text:
 			break;
 		case pt_file:
@@ -198,101 +528,115 @@ void lp_write(IOCU *u) {
 		case pt_lc10:
 			break;
 		case pt_hplj:
-			fprintf(lpx->fp, INIT_HPLJ);
+			lp_puts(l, INIT_HPLJ);
 			break;
                 }
-		lpx->initsent = true;
+		l->initsent = true;
 	}
 		
 
         if (skip) {
                 // skip to stop
-		switch (lpx->type) {
-		case pt_text:
-			fprintf(lpx->fp, "****************************** SKIP %d ******************************\n", skip);
-			break;
+		switch (l->type) {
+		case pt_text: {
+			char sk[80];
+			sprintf(sk, "****************************** SKIP %d ******************************\n", skip);
+			lp_puts(l, sk);
+			} break;
 		case pt_file:
-			fprintf(lpx->fp, "%c", '@'+skip);
+			line[len] = '@'+skip;
+			lp_out(l, line+len, 1);
 			break;
 		case pt_lc10:
-			if (skip == 1 && lpx->lineno != 1)
-				fprintf(lpx->fp, "\014");
+			if (skip == 1 && l->lineno != 1)
+				lp_puts(l, "\014");
 			break;
 		case pt_hplj:
-			if (skip == 1 && lpx->pageused)
-				fprintf(lpx->fp, "\014");
+			if (skip == 1 && l->pageused)
+				lp_puts(l, "\014");
 			break;
 		}
-		lpx->lineno = 1;
-		lpx->pageused = 0;
+		l->lineno = 1;
+		l->pageused = 0;
         } else {
                 // space
-		switch (lpx->type) {
+		switch (l->type) {
 		case pt_text:
 		        switch (space) {
-		        case 1: case 3: fprintf(lpx->fp, "\n"); lpx->lineno += 2; break;
-		        case 2: lpx->lineno++; break;
+		        case 1: case 3: lp_puts(l, "\n"); l->lineno += 2; break;
+		        case 2: l->lineno++; break;
 			}
 			break;
 		case pt_file:
 		        switch (space) {
-		        case 0: fprintf(lpx->fp, "0"); break;
-		        case 1: case 3: fprintf(lpx->fp, "2"); lpx->lineno += 2; break;
-		        case 2: fprintf(lpx->fp, "1"); lpx->lineno++; break;
+		        case 0: lp_puts(l, "0"); break;
+		        case 1: case 3: lp_puts(l, "2"); l->lineno += 2; break;
+		        case 2: lp_puts(l, "1"); l->lineno++; break;
 			}
 			break;
 		case pt_lc10:
 		        switch (space) {
-		        case 0: fprintf(lpx->fp, "\033P\017"); break;
-		        case 1: case 3: fprintf(lpx->fp, "\n\n\033P\017"); lpx->lineno += 2; break;
-		        case 2: fprintf(lpx->fp, "\n\033P\017"); lpx->lineno++; break;
+		        case 0: lp_puts(l, "\033P\017"); break;
+		        case 1: case 3: lp_puts(l, "\n\n\033P\017"); l->lineno += 2; break;
+		        case 2: lp_puts(l, "\n\033P\017"); l->lineno++; break;
 			}
 			break;
 		case pt_hplj:
 		        switch (space) {
-		        case 1: case 3: fprintf(lpx->fp, "\n\n"); lpx->lineno += 2; break;
-		        case 2: fprintf(lpx->fp, "\n"); lpx->lineno++; break;
+		        case 1: case 3: lp_puts(l, "\n\n"); l->lineno += 2; break;
+		        case 2: lp_puts(l, "\n"); l->lineno++; break;
 			}
 			break;
                 }
         }
         if (!mi) {
                 // print
-                while (count > 0) {
-                        main_read_inc(u);
-                        for (i=0; i<8; i++) {
-                                get_ob(u);
-                                fputc(translatetable_bic2ascii[u->ob], lpx->fp);
-			}
-                        count--;
-                }
-		lpx->pageused = true;
+		lp_out(l, line, len);
+		l->pageused = true;
         }
-	switch (lpx->type) {
+	switch (l->type) {
 	case pt_text:
 	case pt_file:
-	        fprintf(lpx->fp, "\n");
+	        lp_puts(l, "\n");
 		break;
 	case pt_lc10:
-	        fprintf(lpx->fp, "\r");
+	        lp_puts(l, "\r");
 		break;
 	case pt_hplj:
-	        fprintf(lpx->fp, "\r");
+	        lp_puts(l, "\r");
 		break;
 	}
-	fflush(lpx->fp);
 
 	// end of page reached?
-	if (lpx->pagelen > 0 && lpx->lineno >= lpx->pagelen) {
+	if (l->pagelen > 0 && l->lineno >= l->pagelen) {
 		u->d_result |= RD_21_END;
+		lp_handover(l);
 	}
 
+	pthread_mutex_unlock(&LPS->mutex);
+
 retresult:
         // set printer finished IRQ
         switch (unit[u->d_unit][0].index) {
-	case 0: CC->CCI06F = true; break;
-	case 1: CC->CCI07F = true; break;
+	case 0: replay_irq(025); break;
+	case 1: replay_irq(026); break;
 	}
 }
 
+/***********************************************************************
+* snapshot: line and job separation state
+***********************************************************************/
+void lp_snapshot(SNAP_T *s) {
+	struct lp *l;
+	int js;
 
+	for (l = LPS->lp; l < LPS->lp+PRINTERS; l++) {
+		js = l->js;
+		snap_data(s, &l->lineno, sizeof l->lineno);
+		snap_data(s, &l->pageused, sizeof l->pageused);
+		snap_data(s, &l->jobno, sizeof l->jobno);
+		snap_data(s, &js, sizeof js);
+		snap_data(s, l->joblabel, sizeof l->joblabel);
+		l->js = (enum js)js;
+	}
+}
@@ -13,6 +13,9 @@
 *   Changed old ACCESSOR method to main_*_inc functions
 * 2018-05-05  R.Meyer
 *   Converted to Input/Output Buffer and Added Write Capability
+* 2026-10-19  agent
+*   write-behind buffering with a writer thread, fsync on rewind and
+*   unload, snapshots, state is part of the MACHINE
 ***********************************************************************/
 
 #include <stdio.h>
@@ -24,17 +27,21 @@
 #include <ctype.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include "common.h"
 #include "io.h"
+#include "snapshot.h"
+#include "machine.h"
 
 #define TAPES 16
 #define NAMELEN 100
 #define	TBUFLEN	8192
+#define	WBUFLEN	65536
 
 /***********************************************************************
 * for each supported tape drive
 ***********************************************************************/
-static struct mt {
+struct mt {
 	char	filename[NAMELEN];	// external filename
 	FILE	*fp;			// file handle
 	int	reclen;			// length of record in tbuf
@@ -43,14 +50,29 @@ static struct mt {
 	BIT	eof;			// unit has encountered an eof
 	BIT	writering;		// unit has write ring
 	char	tbuf[TBUFLEN];		// tape buffer
-} mt[TAPES];
+	// write-behind, protected by MTS->wb_mutex
+	char	*wbuf[2];		// fill and drain buffers
+	int	wlen[2];		// bytes in each buffer
+	long	wpos[2];		// file position of each buffer start
+	int	wfill;			// index of the buffer being filled
+	BIT	wbusy;			// the other buffer is owned by the writer
+	BIT	werror;			// a background write has failed
+};
 
 /***********************************************************************
-* optional open file to write debugging traces into
+* state with the write-behind thread and its synchronization
 ***********************************************************************/
-static FILE *trace = NULL;
-
-static struct mt *mtx = NULL;
+struct mt_state {
+	struct mt mt[TAPES];
+	BIT	ready;
+	pthread_t wb_handler;
+	pthread_mutex_t wb_mutex;
+	pthread_cond_t wb_cond;
+	BIT	stop;			// protected by wb_mutex
+	FILE	*trace;			// optional open file to write debugging traces into
+	struct mt *mtx;
+};
+#define	MTS	(machine->mt)
 
 /***********************************************************************
 * https://www.geeksforgeeks.org/compute-parity-number-using-xor-table-look/
@@ -60,122 +82,250 @@ static struct mt *mtx = NULL;
 #define P6(n) P4(n),P4(n^1),P4(n^1),P4(n)
 static unsigned char parity[256] = {P6(0),P6(1),P6(1),P6(0)};
 
+/***********************************************************************
+* write-behind thread
+* writes all buffers handed over by mt_handover() to their files
+***********************************************************************/
+static void *wb_function(void *p) {
+	struct mt *m;
+	char *buf;
+	int len;
+	long pos;
+	BIT ok;
+
+	machine_bind((MACHINE *)p);
+	pthread_mutex_lock(&MTS->wb_mutex);
+loop:
+	if (MTS->stop) {
+		pthread_mutex_unlock(&MTS->wb_mutex);
+		return NULL;
+	}
+	// look for a drive with a buffer to drain
+	for (m = MTS->mt; m < MTS->mt+TAPES; m++)
+		if (m->wbusy)
+			goto found;
+	pthread_cond_wait(&MTS->wb_cond, &MTS->wb_mutex);
+	goto loop;
+found:
+	buf = m->wbuf[m->wfill^1];
+	len = m->wlen[m->wfill^1];
+	pos = m->wpos[m->wfill^1];
+	pthread_mutex_unlock(&MTS->wb_mutex);
+
+	// the file is not touched by anyone else while wbusy is set
+	ok = fseek(m->fp, pos, SEEK_SET) == 0
+		&& (int)fwrite(buf, 1, len, m->fp) == len
+		&& fflush(m->fp) == 0;
+	if (!ok)
+		perror(m->filename);
+
+	pthread_mutex_lock(&MTS->wb_mutex);
+	if (!ok)
+		m->werror = true;
+	m->wlen[m->wfill^1] = 0;
+	m->wbusy = false;
+	pthread_cond_broadcast(&MTS->wb_cond);
+	goto loop;
+}
+
+/***********************************************************************
+* hand the fill buffer over to the writer, must hold MTS->wb_mutex
+***********************************************************************/
+static void mt_handover(struct mt *m) {
+	while (m->wbusy)
+		pthread_cond_wait(&MTS->wb_cond, &MTS->wb_mutex);
+	if (m->wlen[m->wfill] > 0) {
+		m->wbusy = true;
+		m->wfill ^= 1;
+		pthread_cond_broadcast(&MTS->wb_cond);
+	}
+}
+
+/***********************************************************************
+* queue a record for writing at file position pos
+* returns false if an earlier background write has failed
+***********************************************************************/
+static BIT mt_queue(struct mt *m, const char *data, int len, long pos) {
+	BIT ok;
+	int f;
+
+	pthread_mutex_lock(&MTS->wb_mutex);
+	if (!m->wbuf[0]) {
+		m->wbuf[0] = (char*)malloc(WBUFLEN);
+		m->wbuf[1] = (char*)malloc(WBUFLEN);
+	}
+	f = m->wfill;
+	// pending data not contiguous or no room: start a new buffer
+	if (m->wlen[f] > 0 && (pos != m->wpos[f] + m->wlen[f] || m->wlen[f] + len > WBUFLEN)) {
+		mt_handover(m);
+		f = m->wfill;
+	}
+	if (m->wlen[f] == 0)
+		m->wpos[f] = pos;
+	memcpy(m->wbuf[f] + m->wlen[f], data, len);
+	m->wlen[f] += len;
+	// a full buffer goes to the writer right away
+	if (m->wlen[f] >= WBUFLEN - TBUFLEN)
+		mt_handover(m);
+	ok = !m->werror;
+	m->werror = false;
+	pthread_mutex_unlock(&MTS->wb_mutex);
+	return ok;
+}
+
+/***********************************************************************
+* wait until all pending writes of a drive are in the file
+* must be called before any other access to the file
+***********************************************************************/
+static void mt_drain(struct mt *m) {
+	pthread_mutex_lock(&MTS->wb_mutex);
+	mt_handover(m);
+	while (m->wbusy)
+		pthread_cond_wait(&MTS->wb_cond, &MTS->wb_mutex);
+	pthread_mutex_unlock(&MTS->wb_mutex);
+}
+
+/***********************************************************************
+* drain and commit a drive to stable storage
+***********************************************************************/
+static void mt_sync(struct mt *m) {
+	if (!m->fp)
+		return;
+	mt_drain(m);
+	fflush(m->fp);
+	if (fsync(fileno(m->fp)) < 0)
+		perror(m->filename);
+}
+
+/***********************************************************************
+* close file of a drive (unload)
+***********************************************************************/
+static void mt_unload(struct mt *m) {
+	if (m->fp) {
+		mt_sync(m);
+		fclose(m->fp);
+	}
+	m->fp = NULL;
+}
+
 /***********************************************************************
 * set to mta..mtt
 ***********************************************************************/
-static int set_mt(const char *v, void *data) {mtx = mt+(int)data; return 0; }
+static int set_mt(const char *v, void *data) {MTS->mtx = MTS->mt+(int)data; return 0; }
 
 /***********************************************************************
 * specify or close the trace file
 ***********************************************************************/
 static int set_mttrace(const char *v, void *) {
 	// if open, close existing trace file
-	if (trace) {
-		fclose(trace);
-		trace = NULL;
+	if (MTS->trace) {
+		fclose(MTS->trace);
+		MTS->trace = NULL;
 	}
 	// if a name is given, open new trace
 	if (strlen(v) > 0) {
-		trace = fopen(v, "w");
-		if (!trace)
+		MTS->trace = fopen(v, "w");
+		if (!MTS->trace)
 			return 2; // FATAL
 	}
 	return 0; // OK
 }
 
+/***********************************************************************
+* report the ready status of the drive after a change
+***********************************************************************/
+static int mt_changed(int res) {
+	io_ready_changed(mt_ready, MTS->mtx - MTS->mt);
+	return res;
+}
+
 /***********************************************************************
 * specify or close the file for emulation (read/write)
 ***********************************************************************/
 static int set_mtfile(const char *v, void *) {
-	if (!mtx) {
+	if (!MTS->mtx) {
 		printf("mt not specified\n");
 		return 2; // FATAL
 	}
 
 	// if open, close current file
-	if (mtx->fp) {
-		fclose(mtx->fp);
-	}
+	mt_unload(MTS->mtx);
 
-	mtx->fp = NULL;
-	mtx->reclen = 0;
-	mtx->pos = 0;
-	mtx->ready = false;
-	mtx->eof = true;
-	mtx->writering = false;
+	MTS->mtx->reclen = 0;
+	MTS->mtx->pos = 0;
+	MTS->mtx->ready = false;
+	MTS->mtx->eof = true;
+	MTS->mtx->writering = false;
 
-	strncpy(mtx->filename, v, NAMELEN);
-	mtx->filename[NAMELEN-1] = 0;
+	strncpy(MTS->mtx->filename, v, NAMELEN);
+	MTS->mtx->filename[NAMELEN-1] = 0;
 
 	// now open the new file, if any name was given
 	// if none given, the drive just stays unready
-	if (mtx->filename[0]) {
-		mtx->fp = fopen(mtx->filename, "r+");	// read/write
-		if (mtx->fp) {
-			mtx->ready = true;
-			mtx->eof = false;
-			return 0; // OK
+	if (MTS->mtx->filename[0]) {
+		MTS->mtx->fp = fopen(MTS->mtx->filename, "r+");	// read/write
+		if (MTS->mtx->fp) {
+			MTS->mtx->ready = true;
+			MTS->mtx->eof = false;
+			return mt_changed(0); // OK
 		} else {
 			// cannot open
-			perror(mtx->filename);
-			return 2; // FATAL
+			perror(MTS->mtx->filename);
+			return mt_changed(2); // FATAL
 		}
 	}
-	return 0; // OK
+	return mt_changed(0); // OK
 }
 
 /***********************************************************************
 * specify or close the file for emulation (create and read/write)
 ***********************************************************************/
 static int set_mtnewfile(const char *v, void *) {
-	if (!mtx) {
+	if (!MTS->mtx) {
 		printf("mt not specified\n");
 		return 2; // FATAL
 	}
 
 	// if open, close current file
-	if (mtx->fp) {
-		fclose(mtx->fp);
-	}
+	mt_unload(MTS->mtx);
 
-	mtx->fp = NULL;
-	mtx->reclen = 0;
-	mtx->pos = 0;
-	mtx->ready = false;
-	mtx->eof = true;
-	mtx->writering = false;
+	MTS->mtx->reclen = 0;
+	MTS->mtx->pos = 0;
+	MTS->mtx->ready = false;
+	MTS->mtx->eof = true;
+	MTS->mtx->writering = false;
 
-	strncpy(mtx->filename, v, NAMELEN);
-	mtx->filename[NAMELEN-1] = 0;
+	strncpy(MTS->mtx->filename, v, NAMELEN);
+	MTS->mtx->filename[NAMELEN-1] = 0;
 
 	// now open the new file, if any name was given
 	// if none given, the drive just stays unready
-	if (mtx->filename[0]) {
-		mtx->fp = fopen(mtx->filename, "w+");	// create or truncate, then read/write
-		if (mtx->fp) {
-			mtx->ready = true;
-			mtx->eof = false;
-			mtx->writering = true;		// implicitly writeable
-			return 0; // OK
+	if (MTS->mtx->filename[0]) {
+		MTS->mtx->fp = fopen(MTS->mtx->filename, "w+");	// create or truncate, then read/write
+		if (MTS->mtx->fp) {
+			MTS->mtx->ready = true;
+			MTS->mtx->eof = false;
+			MTS->mtx->writering = true;		// implicitly writeable
+			return mt_changed(0); // OK
 		} else {
 			// cannot open
-			perror(mtx->filename);
-			return 2; // FATAL
+			perror(MTS->mtx->filename);
+			return mt_changed(2); // FATAL
 		}
 	}
-	return 0; // OK
+	return mt_changed(0); // OK
 }
 
 /***********************************************************************
 * set the writering flag
 ***********************************************************************/
 static int set_mtwritering(const char *v, void *) {
-	if (!mtx) {
+	if (!MTS->mtx) {
 		printf("mt not specified\n");
 		return 2; // FATAL
 	}
 
-	mtx->writering = true;
+	MTS->mtx->writering = true;
 
 	return 0; // OK
 }
@@ -211,8 +361,55 @@ static const command_t mt_commands[] = {
 * Initialize command from argv scanner or special SPO input
 ***********************************************************************/
 int mt_init(const char *option) {
-	mtx = NULL; // require specification of a drive
-	return command_parser(mt_commands, option);
+	int res;
+
+	if (!MTS->ready) {
+		// write-behind thread
+		pthread_create(&MTS->wb_handler, 0, wb_function, machine);
+		MTS->ready = true;
+	}
+	MTS->mtx = NULL; // require specification of a drive
+	res = command_parser(mt_commands, option);
+	return res;
+}
+
+/***********************************************************************
+* state of a new machine
+***********************************************************************/
+int mt_create(void) {
+	MTS = (struct mt_state *)calloc(1, sizeof *MTS);
+	if (MTS == NULL) {
+		perror("mt");
+		return -1;
+	}
+	pthread_mutex_init(&MTS->wb_mutex, NULL);
+	pthread_cond_init(&MTS->wb_cond, NULL);
+	return 0;
+}
+
+/***********************************************************************
+* flush and close all drives, end the write-behind thread
+***********************************************************************/
+void mt_term(void) {
+	struct mt *m;
+
+	if (MTS == NULL)
+		return;
+	for (m = MTS->mt; m < MTS->mt+TAPES; m++)
+		mt_unload(m);
+	if (MTS->ready) {
+		pthread_mutex_lock(&MTS->wb_mutex);
+		MTS->stop = true;
+		pthread_cond_broadcast(&MTS->wb_cond);
+		pthread_mutex_unlock(&MTS->wb_mutex);
+		pthread_join(MTS->wb_handler, NULL);
+	}
+	if (MTS->trace)
+		fclose(MTS->trace);
+	pthread_mutex_destroy(&MTS->wb_mutex);
+	pthread_cond_destroy(&MTS->wb_cond);
+	free(MTS);
+	MTS = NULL;
 }
 
 /***********************************************************************
@@ -220,7 +417,7 @@ int mt_init(const char *option) {
 ***********************************************************************/
 BIT mt_ready(unsigned index) {
 	if (index < TAPES)
-		return mt[index].ready;
+		return MTS->mt[index].ready;
 	return false;
 }
 
@@ -235,32 +432,32 @@ BIT mt_ready(unsigned index) {
 * start condition: pos must point the record begin
 * end condition: pos points to next record begin
 ***********************************************************************/
-static int mt_read_record(struct mt *mt, BIT binary) {
+static int mt_read_record(struct mt *t, BIT binary) {
 	int lp;
 	int data;
 	BIT parflag = false;
 
-	mt->reclen = 0;
+	t->reclen = 0;
 
-	fseek(mt->fp, mt->pos, SEEK_SET);
+	fseek(t->fp, t->pos, SEEK_SET);
 	lp = 0;
 
 	while (1) {
-		data = fgetc(mt->fp);
+		data = fgetc(t->fp);
 		if (data < 0) {
-			mt->eof = true;
+			t->eof = true;
 			return 2;
 		}
 		// the first char of each record must have bit 7 set
-		if (mt->reclen == 0 && (data & 0x80) == 0) {
+		if (t->reclen == 0 && (data & 0x80) == 0) {
 			// error here
 			return 5;
 		}
 		// at non-first char it denotes record end
-		if (mt->reclen > 0 && (data & 0x80) != 0) {
+		if (t->reclen > 0 && (data & 0x80) != 0) {
 			// record complete
 			// is it a tape mark?
-			if (mt->reclen == 1 && mt->tbuf[0] == 0x0f)
+			if (t->reclen == 1 && t->tbuf[0] == 0x0f)
 				return 4;
 			if (parflag)
 				return 6;
@@ -278,23 +475,23 @@ static int mt_read_record(struct mt *mt, BIT binary) {
 				parflag = true;
 		}
 		// trace output
-		if (trace) {
+		if (MTS->trace) {
 			if (lp >= 80) {
-				fprintf(trace,"'\n\t'");
+				fprintf(MTS->trace,"'\n\t'");
 				lp = 0;
 			}
-			fprintf(trace, "%c", translatetable_bic2ascii[data & 077]);
+			fprintf(MTS->trace, "%c", translatetable_bic2ascii[data & 077]);
 			lp++;
 		}
 		// store char in buffer
-		if (mt->reclen >= TBUFLEN) {
+		if (t->reclen >= TBUFLEN) {
 			// record exceeds buffer size
 			return 3;
 		}
 		// now really store it
-		mt->tbuf[mt->reclen] = data & 0x7f;
-		mt->reclen++;
-		mt->pos++;
+		t->tbuf[t->reclen] = data & 0x7f;
+		t->reclen++;
+		t->pos++;
 	}
 	// we never come here, but the compiler demands it:
 	return 0;
@@ -310,25 +507,25 @@ static int mt_read_record(struct mt *mt, BIT binary) {
 * start condition: pos must point the the record end+1
 * end condition: pos points to the record begin
 ***********************************************************************/
-static int mt_read_record_reverse(struct mt *mt, BIT binary) {
+static int mt_read_record_reverse(struct mt *t, BIT binary) {
 	int lp;
 	int data;
 	BIT parflag = false;
 
-	mt->reclen = 0;
+	t->reclen = 0;
 
 	lp = 0;
 
 	while (1) {
-		mt->pos--;
-		if (mt->pos < 0) {
-			mt->pos = 0;
+		t->pos--;
+		if (t->pos < 0) {
+			t->pos = 0;
 			return 1;
 		}
-		fseek(mt->fp, mt->pos, SEEK_SET);
-		data = fgetc(mt->fp);
+		fseek(t->fp, t->pos, SEEK_SET);
+		data = fgetc(t->fp);
 		if (data < 0) {
-			mt->eof = true;
+			t->eof = true;
 			return 1;
 		}
 		// check parity
@@ -342,27 +539,27 @@ static int mt_read_record_reverse(struct mt *mt, BIT binary) {
 				parflag = true;
 		}
 		// store char in buffer
-		if (mt->reclen >= TBUFLEN) {
+		if (t->reclen >= TBUFLEN) {
 			// record exceeds buffer size
 			return 3;
 		}
 		// trace output
-		if (trace) {
+		if (MTS->trace) {
 			if (lp >= 80) {
-				fprintf(trace,"'\n\t'");
+				fprintf(MTS->trace,"'\n\t'");
 				lp = 0;
 			}
-			fprintf(trace, "%c", translatetable_bic2ascii[data & 077]);
+			fprintf(MTS->trace, "%c", translatetable_bic2ascii[data & 077]);
 			lp++;
 		}
 		// now really store it
-		mt->tbuf[mt->reclen] = data & 0x7f;
-		mt->reclen++;
+		t->tbuf[t->reclen] = data & 0x7f;
+		t->reclen++;
 		// bit 7 set denotes (reverse) record begin
 		if ((data & 0x80) != 0) {
 			// record complete
 			// is it a tape mark?
-			if (mt->reclen == 0)
+			if (t->reclen == 0)
 				return 4;
 			if (parflag)
 				return 6;
@@ -383,7 +580,7 @@ void mt_access(IOCU *u) {
 
         int i;
 	int cc;		// character counter
-	struct mt *mtx;
+	struct mt *t;
 
 	// all the flags that distinguish the operations
         mi = (u->d_control & CD_30_MI) ? true : false;
@@ -395,25 +592,25 @@ void mt_access(IOCU *u) {
         // number of words to do
         words = usewc ? u->d_wc : 1023;
 
-	mtx = mt + unit[u->d_unit][0].index;
+	t = MTS->mt + unit[u->d_unit][0].index;
 
         u->d_result = 0;
 
-        if (!mtx->ready) {
+        if (!t->ready) {
                 u->d_result = RD_18_NRDY;
                 return;
         }
 
-	if (trace) {
-		fprintf(trace, unit[u->d_unit][0].name); 
-		if (read) fprintf(trace, " READ");
-			else fprintf(trace, " WRITE");
-		if (usewc) fprintf(trace, " WC=%d", words);
-			else fprintf(trace, " GM");
-		if (reverse) fprintf(trace, " REVERSE");
-		if (binary) fprintf(trace, " BINARY");
-			else fprintf(trace, " ALPHA");
-		if (mi) fprintf(trace, " MI");
+	if (MTS->trace) {
+		fprintf(MTS->trace, unit[u->d_unit][0].name); 
+		if (read) fprintf(MTS->trace, " READ");
+			else fprintf(MTS->trace, " WRITE");
+		if (usewc) fprintf(MTS->trace, " WC=%d", words);
+			else fprintf(MTS->trace, " GM");
+		if (reverse) fprintf(MTS->trace, " REVERSE");
+		if (binary) fprintf(MTS->trace, " BINARY");
+			else fprintf(MTS->trace, " ALPHA");
+		if (mi) fprintf(MTS->trace, " MI");
 	}
 
 	/***************************************************************
@@ -421,42 +618,44 @@ void mt_access(IOCU *u) {
 	***************************************************************/
 	if (read) {
 		BIT had_parity = false;
-	        if (trace) fprintf(trace, " ADDR=%05o\n\t'", u->d_addr);
+	        if (MTS->trace) fprintf(MTS->trace, " ADDR=%05o\n\t'", u->d_addr);
+		// records still in the write-behind buffer must be visible
+		mt_drain(t);
 		// read a record into local buffer
 		if (reverse)
-			i = mt_read_record_reverse(mtx, binary);
+			i = mt_read_record_reverse(t, binary);
 		else
-			i = mt_read_record(mtx, binary);
+			i = mt_read_record(t, binary);
 
 		// analyze result
 		switch (i) {
 		case 1:	// BOT
-			mtx->eof = true;
-			if (trace)
-				fprintf(trace, "' BOT\n");
+			t->eof = true;
+			if (MTS->trace)
+				fprintf(MTS->trace, "' BOT\n");
 			u->d_wc = WD_35_BOT;
 			u->d_result = RD_19_PAR;
 			return;
 		case 2:	// EOT
-			mtx->eof = true;
-			if (trace)
-				fprintf(trace, "' EOT\n");
+			t->eof = true;
+			if (MTS->trace)
+				fprintf(MTS->trace, "' EOT\n");
 			u->d_wc = WD_34_EOT;
 			u->d_result = RD_19_PAR;
 			return;
 		case 3:	// record too long
-			if (trace)
-				fprintf(trace, "' RECORD TOO LONG\n");
+			if (MTS->trace)
+				fprintf(MTS->trace, "' RECORD TOO LONG\n");
 			u->d_result = RD_20_ERR;
 			return;
 		case 4:	// tape mark
-			if (trace)
-				fprintf(trace, "' TAPE MARK\n");
+			if (MTS->trace)
+				fprintf(MTS->trace, "' TAPE MARK\n");
 			u->d_result = RD_21_END;
 			return;
 		case 5:	// format error
-			if (trace)
-				fprintf(trace, "' .BCD FORMAT ERROR\n");
+			if (MTS->trace)
+				fprintf(MTS->trace, "' .BCD FORMAT ERROR\n");
 			u->d_result = RD_20_ERR;
 			return;
 		case 6:	// parity error
@@ -470,8 +669,8 @@ void mt_access(IOCU *u) {
 	                }
 			if (reverse) {
 				cc = 7;
-				for (i=mtx->reclen-1; i>=0; i--) {
-					u->ib = mtx->tbuf[i] & 077;
+				for (i=t->reclen-1; i>=0; i--) {
+					u->ib = t->tbuf[i] & 077;
 					put_ib_reverse(u);
 					cc--;
 			                if (cc < 0) {
@@ -485,10 +684,10 @@ void mt_access(IOCU *u) {
 			} else {
 				// for group mark ending, add a group mark to the buffer
 				if (!binary && !usewc)
-					mtx->tbuf[mtx->reclen++] = 037;
+					t->tbuf[t->reclen++] = 037;
 				cc = 0;
-				for (i=0; i<mtx->reclen; i++) {
-					u->ib = mtx->tbuf[i] & 077;
+				for (i=0; i<t->reclen; i++) {
+					u->ib = t->tbuf[i] & 077;
 					put_ib(u);
 					cc++;
 			                if (cc > 7) {
@@ -501,8 +700,8 @@ void mt_access(IOCU *u) {
 				}
 			}
 			// record end reached
-			if (trace)
-				fprintf(trace, "'\n");
+			if (MTS->trace)
+				fprintf(MTS->trace, "'\n");
 			// store possible partial filled word
 			if (reverse) {
 				if (words > 0 && cc < 7) {
@@ -523,19 +722,19 @@ void mt_access(IOCU *u) {
 			}
 			// report a parity error
 			if (had_parity) {
-				if (trace)
-					fprintf(trace, "\tPARITY ERROR\n");
+				if (MTS->trace)
+					fprintf(MTS->trace, "\tPARITY ERROR\n");
 				u->d_result = RD_20_ERR;
 			}
 			// return result
 			if (usewc) {
 				u->d_wc = words;
-				if (trace)
-					fprintf(trace, "\tWORDS REMAINING=%u\n", words);
+				if (MTS->trace)
+					fprintf(MTS->trace, "\tWORDS REMAINING=%u\n", words);
 			} else {
 				u->d_wc = cc;
-				if (trace)
-					fprintf(trace, "\tLAST CHAR=%u\n", cc);
+				if (MTS->trace)
+					fprintf(MTS->trace, "\tLAST CHAR=%u\n", cc);
 			}
 		default:
 			return;
@@ -551,32 +750,34 @@ void mt_access(IOCU *u) {
 		* Special WRITE: REWIND
 		***************************************************************/
 		if (reverse) {
-		        if (trace) fprintf(trace, "-> REWIND\n");
+		        if (MTS->trace) fprintf(MTS->trace, "-> REWIND\n");
 			// we should also have MI=1, BINARY=0, USEWC=0
 			if (!mi || binary || usewc)
 				printf("* WARNING: TAPE REWIND WITH UNEXPECTED OPTIONS IOCW=%016llo\n", u->w);
-		        mtx->pos = 0;
-		        mtx->eof = false;
+			// queued records go to the file and to disk first
+			mt_sync(t);
+		        t->pos = 0;
+		        t->eof = false;
 		        return;
 		}
 
 		/***************************************************************
 		* Regular WRITE
 		***************************************************************/
-                if (trace) fprintf(trace, " ADDR=%05o\n\t'", u->d_addr);
+                if (MTS->trace) fprintf(MTS->trace, " ADDR=%05o\n\t'", u->d_addr);
 		// we should also have BINARY equal to USEWC
 		if (binary != usewc)
 			printf("* WARNING: TAPE WRITE WITH UNEXPECTED OPTIONS IOCW=%016llo\n", u->w);
-		if (!mtx->writering) {
+		if (!t->writering) {
 		        // return no ring status
-		        if (trace)
-		                fprintf(trace, "' NO WRITE RING\n");
+		        if (MTS->trace)
+		                fprintf(MTS->trace, "' NO WRITE RING\n");
 		        u->d_result = RD_20_ERR | RD_22_MAE;
 		        return;
 		}
 
 		// read data from memory into local buffer
-		mtx->reclen = 0;
+		t->reclen = 0;
 		while (words > 0) {
 			main_read_inc(u);
 			words--;
@@ -596,22 +797,22 @@ void mt_access(IOCU *u) {
 					if (parity[u->ob])
 						u->ob |= 0x40;
 				}
-				mtx->tbuf[mtx->reclen++] = u->ob;
+				t->tbuf[t->reclen++] = u->ob;
 			}
                 }
 
 end_of_write:	// now write data to tape
 
 		// trace output
-		if (trace) {
+		if (MTS->trace) {
 			int lp = 0;
 			int j;
-			for (j=0; j<mtx->reclen; j++) {
+			for (j=0; j<t->reclen; j++) {
 				if (lp >= 80) {
-					fprintf(trace,"'\n\t'");
+					fprintf(MTS->trace,"'\n\t'");
 					lp = 0;
 				}
-				fprintf(trace, "%c", translatetable_bic2ascii[mtx->tbuf[j] & 077]);
+				fprintf(MTS->trace, "%c", translatetable_bic2ascii[t->tbuf[j] & 077]);
 				lp++;
 			}
 		}
@@ -619,24 +820,27 @@ end_of_write:	// now write data to tape
 		// in alpha mode, we have to do some checks first:
 		if (!binary) {
 			// remove "unique marks" at begin of buffer
-			for (i=0; i<mtx->reclen && mtx->tbuf[i] == 014; i++)
+			for (i=0; i<t->reclen && t->tbuf[i] == 014; i++)
 				;
-			if (trace)
-				fprintf(trace,"'\n\t(%d unique marks ignored)\n", i);
+			if (MTS->trace)
+				fprintf(MTS->trace,"'\n\t(%d unique marks ignored)\n", i);
 		} else {
 			i = 0;
-			if (trace)
-				fprintf(trace,"'\n");
+			if (MTS->trace)
+				fprintf(MTS->trace,"'\n");
 		}
 
 		// set bit 7 of first char in buffer
-		mtx->tbuf[i] |= 0x80;
+		t->tbuf[i] |= 0x80;
 
 		// anything left to write ?
-		if (mtx->reclen > i) {
-			fseek(mt->fp, mt->pos, SEEK_SET);
-			fwrite(mtx->tbuf + i, 1, mtx->reclen - i, mt->fp);
-			mtx->pos += mtx->reclen - i;
+		if (t->reclen > i) {
+			if (!mt_queue(t, t->tbuf + i, t->reclen - i, t->pos)) {
+				if (MTS->trace)
+					fprintf(MTS->trace, "\tWRITE ERROR\n");
+				u->d_result = RD_20_ERR;
+			}
+			t->pos += t->reclen - i;
 		}
 
 		// return good result and WC=0
@@ -646,3 +850,37 @@ end_of_write:	// now write data to tape
 }
 
 
+
+/***********************************************************************
+* snapshot: tape positions
+* a position is only restored if the drive has the same file loaded
+***********************************************************************/
+void mt_snapshot(SNAP_T *s) {
+	struct mt *m;
+	char filename[NAMELEN];
+	int pos;
+	BIT eof;
+
+	for (m = MTS->mt; m < MTS->mt+TAPES; m++) {
+		if (s->save) {
+			if (m->fp)
+				mt_drain(m);
+			memcpy(filename, m->filename, NAMELEN);
+			pos = m->pos;
+			eof = m->eof;
+		}
+		snap_data(s, filename, NAMELEN);
+		snap_data(s, &pos, sizeof pos);
+		snap_data(s, &eof, sizeof eof);
+		if (s->save || s->error || filename[0] == 0)
+			continue;
+		if (m->fp && strcmp(filename, m->filename) == 0) {
+			m->pos = pos;
+			m->eof = eof;
+			m->reclen = 0;
+		} else {
+			printf("MT%c: %s not loaded, position not restored\n",
+				unit[2*(m-MTS->mt)+1][0].name[2], filename);
+		}
+	}
+}
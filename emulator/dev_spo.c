@@ -9,6 +9,9 @@
 ************************************************************************
 * 2017-10-02  R.Meyer
 *   Factored out from emulator.c
+* 2026-10-19  agent
+*   input thread and lock free ring, replay, batch mode input and
+*   output, state is part of the MACHINE
 ***********************************************************************/
 
 #include <stdio.h>
@@ -21,8 +24,13 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <time.h>
+#include <pthread.h>
 #include "common.h"
 #include "io.h"
+#include "replay.h"
+#include "batch.h"
+#include "circbuffer.h"
+#include "machine.h"
 
 /***********************************************************************
 * analysy of possible buffer overrun situations
@@ -42,6 +50,7 @@
 
 #define NAMELEN 100
 #define	BUFLEN 80
+#define	QUEUELEN 1024	// power of 2
 #define TIMESTAMP 1
 #define	AUTOEXEC 1
 
@@ -50,33 +59,53 @@
 /***********************************************************************
 * the SPO
 ***********************************************************************/
-static BIT	ready;
-static char	spoinbuf[BUFLEN];
-static char	spooutbuf[BUFLEN];
-static time_t	stamp;
 #if AUTOEXEC
-static unsigned autoexec = false;
 static const char *auto_cmd = "CRA FILE=CARDS/DCMCP-PATCH-COMPILE.CARD";
 static const char *auto_trigger1 = "ESPOL/DISK= ";
 static const char *auto_trigger2 = " EOJ";
 #endif
+
+struct spo_state {
+	BIT	ready;
+	BIT	reader;			// the input thread reads stdin
+	char	spoinbuf[BUFLEN];	// line being read by the thread
+	RING_T	spoq;			// operator lines waiting for the MCP, each ending with CR
+	unsigned char spoqbuf[QUEUELEN];
+	pthread_mutex_t line_mutex;
+	pthread_cond_t line_cond;
+	pthread_mutex_t queue_mutex;	// lines come from the thread and the batch script
+	char	*promptbuf;		// emulator waits for a line here
+	int	promptlen;
+	BIT	eof;			// stdin ended, no more lines
+	pthread_t spo_handler;
+	char	spooutbuf[BUFLEN];
+	time_t	stamp;
+#if AUTOEXEC
+	unsigned autoexec;
+#endif
 #ifdef USECAN
-static unsigned canspo = 0;	// 0 for OFF, CANid for ON
+	unsigned canspo;		// 0 for OFF, CANid for ON
 #endif
 #ifdef TIMESTAMP
-static unsigned timestamp = false;
+	unsigned timestamp;
 #endif
+};
+#define	SPO	(machine->spo)
 
 /***********************************************************************
 * output function
 ***********************************************************************/
 void spo_print(const char *buf) {
-	fputs(buf, stdout);
+	// other machines share stdout with the console
+	if (machine->console)
+		fputs(buf, stdout);
+	else
+		printf("%u: %s", machine->instance, buf);
 
 #ifdef USECAN
 	// send message to "real SPO"
-	if (canspo)
-		can_send_string(canspo, buf);
+	if (SPO->canspo)
+		can_send_string(SPO->canspo, buf);
 #endif
 }
 
@@ -100,9 +129,9 @@ static int set_spoload(const char *v, void *) {
 ***********************************************************************/
 static int set_autoexec(const char *v, void *) {
 	if (strcasecmp(v, "ON") == 0) {
-		autoexec = true;
+		SPO->autoexec = true;
 	} else if (strcasecmp(v, "OFF") == 0) {
-		autoexec = false;
+		SPO->autoexec = false;
 	} else {
 		spo_print("$SPECIFY ON OR OFF\r\n");
 		return 2; // FATAL
@@ -116,18 +145,18 @@ static int set_autoexec(const char *v, void *) {
 ***********************************************************************/
 static int set_canspo(const char *v, void *) {
 	if (isdigit(v[0])) {
-		canspo = atoi(v);
-		if (canspo < 1 || canspo > 126) {
-			canspo = 0;
+		SPO->canspo = atoi(v);
+		if (SPO->canspo < 1 || SPO->canspo > 126) {
+			SPO->canspo = 0;
 			goto help;
 		}
 		// wait for SPO to become ready
-		while (!can_ready(canspo)) {
+		while (!can_ready(SPO->canspo)) {
 			spo_print("$WAITING FOR SPO READY\r\n");
 			sleep(1);
 		}
 	} else if (strcasecmp(v, "OFF") == 0) {
-		canspo = 0;
+		SPO->canspo = 0;
 	} else {
 help:		spo_print("$SPECIFY CANID(1..126) OR OFF\r\n");
 		return 2; // FATAL
@@ -142,9 +171,9 @@ help:		spo_print("$SPECIFY CANID(1..126) OR OFF\r\n");
 ***********************************************************************/
 static int set_timestamp(const char *v, void *) {
 	if (strcasecmp(v, "ON") == 0) {
-		timestamp = true;
+		SPO->timestamp = true;
 	} else if (strcasecmp(v, "OFF") == 0) {
-		timestamp = false;
+		SPO->timestamp = false;
 	} else {
 		spo_print("$SPECIFY ON OR OFF\r\n");
 		return 2; // FATAL
@@ -172,76 +201,212 @@ static const command_t spo_commands[] = {
 };
 
 /***********************************************************************
-* Initialize command from argv scanner or special SPO input
+* an emulator command typed on the SPO, carried out by the CPU thread
 ***********************************************************************/
-int spo_init(const char *option) {
-	ready = true;
-	return command_parser(spo_commands, option);
+static int spo_option(const char *option) {
+	char msg[BUFLEN];
+	int res;
+
+	res = handle_option(option);
+	if (res == 0)
+		sprintf(msg, "$OK\r\n");
+	else
+		sprintf(msg, "$ERROR %d\r\n", res);
+	spo_print(msg);
+	// remember when this input was
+	time(&SPO->stamp);
+	return res;
 }
 
 /***********************************************************************
-* query SPO ready status
+* a line typed by the operator (or by the batch script)
 *
-* this function has a few "side effects":
-* on first call, the SPO is initialized
-* on every call, the operating system is polled for input (select)
-* if input is present, it is read into a buffer
-* if the buffer contains the "#" escape, the line is handled in the
-* emulator, otherwise the "INPUT REQUEST" interupt is caused
+* if the line starts with the "$" escape, it is handled in the emulator,
+* otherwise it is queued and the "INPUT REQUEST" interupt is caused
 ***********************************************************************/
-BIT spo_ready(unsigned index) {
-        struct timeval tv = {0, 0};
-	char *spoinp = NULL;
-
-	// initialize SPO if not ready
-	if (!ready)
-		spo_init("");
+void spo_input(const char *spoinp) {
+	char line[BUFLEN+1];
+	unsigned len;
+
+	// divert input starting with '$' to our scanner
+	if (*spoinp == '$') {
+		cpu_post(spo_option, spoinp+1);
+		return;
+	}
 
-	// check for user input ready
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(0, &fds);
-        if (select(1, &fds, NULL, NULL, &tv)) {
-		spoinp = fgets(spoinbuf, sizeof spoinbuf, stdin); // no buffer overrun possible
+	// add EOL to the end, queue only complete lines
+	pthread_mutex_lock(&SPO->queue_mutex);
+	len = snprintf(line, sizeof line, "%s\r", spoinp);
+	if (len >= sizeof line)
+		len = sizeof line - 1;
+	if (ring_space(&SPO->spoq) < len) {
+		pthread_mutex_unlock(&SPO->queue_mutex);
+		spo_print("$INPUT LOST\r\n");
+		return;
 	}
+	ring_write_n(&SPO->spoq, line, len);
+	// signal input request, unless one is already pending
+	// (the fence pairs with the one in spo_read)
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (ring_used(&SPO->spoq) == len)
+		replay_irq(024);
+	pthread_mutex_unlock(&SPO->queue_mutex);
+}
+
+/***********************************************************************
+* SPO input thread
+*
+* reads operator input line by line
+***********************************************************************/
+static void *spo_function(void *p) {
+	char *spoinp;
+
+	machine_bind((MACHINE *)p);
+	// spo_term cancels the thread while it waits for input
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+loop:
+	spoinp = NULL;
 #ifdef USECAN
-	else {
-		// check whether a complete line has been received from the CANbus SPO
-		spoinp = can_receive_string(canspo, spoinbuf, sizeof spoinbuf);
+	{
+		// wait a little for user input, then check the CANbus SPO
+		struct timeval tv = {0, 20000};
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(0, &fds);
+		if (select(1, &fds, NULL, NULL, &tv)) {
+			spoinp = fgets(SPO->spoinbuf, sizeof SPO->spoinbuf, stdin); // no buffer overrun possible
+			if (spoinp == NULL)
+				goto eof; // end of input
+		} else {
+			// check whether a complete line has been received from the CANbus SPO
+			spoinp = can_receive_string(SPO->canspo, SPO->spoinbuf, sizeof SPO->spoinbuf);
+		}
 	}
+	if (spoinp == NULL)
+		goto loop;
+#else
+	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+	spoinp = fgets(SPO->spoinbuf, sizeof SPO->spoinbuf, stdin); // no buffer overrun possible
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	if (spoinp == NULL)
+		goto eof; // end of input
 #endif
 
-	// any input ?
-	if (spoinp != NULL) {
-		// remove trailing control codes
-		spoinp = spoinbuf + strlen(spoinbuf);
-		while (spoinp >= spoinbuf && *spoinp <= ' ')
-			*spoinp-- = 0;
-		spoinp = spoinbuf;
-		// divert input starting with '$' to our scanner
-		if (*spoinp == '$') {
-			int res = handle_option(spoinp+1);
-			if (res == 0)
-				sprintf(spoinbuf, "$OK\r\n");
-			else
-				sprintf(spoinbuf, "$ERROR %d\r\n", res);
-			spo_print(spoinbuf);
-			// mark the input buffer empty again
-			spoinbuf[0] = 0;
-			// remember when this input was
-			time(&stamp);
+	// remove trailing control codes
+	spoinp = SPO->spoinbuf + strlen(SPO->spoinbuf);
+	while (spoinp >= SPO->spoinbuf && *spoinp <= ' ')
+		*spoinp-- = 0;
+	spoinp = SPO->spoinbuf;
+	// the emulator itself asked for input?
+	pthread_mutex_lock(&SPO->line_mutex);
+	if (SPO->promptbuf) {
+		snprintf(SPO->promptbuf, SPO->promptlen, "%s\n", SPO->spoinbuf);
+		SPO->promptbuf = NULL;
+		pthread_cond_broadcast(&SPO->line_cond);
+		pthread_mutex_unlock(&SPO->line_mutex);
+		goto loop;
+	}
+	pthread_mutex_unlock(&SPO->line_mutex);
+	spo_input(SPO->spoinbuf);
+	// the input line is read later, once the IRQ is handled by the MCP
+	goto loop;
 
-		} else {
-			// add EOL to the end
-			strcat(spoinbuf, "\r");
-			// signal input request
-			CC->CCI05F = true;
-			// the input line is read later, once the IRQ is handled by the MCP
+eof:
+	// a waiting or later prompt gets no line
+	pthread_mutex_lock(&SPO->line_mutex);
+	SPO->eof = true;
+	pthread_cond_broadcast(&SPO->line_cond);
+	pthread_mutex_unlock(&SPO->line_mutex);
+	return NULL;
+}
+
+/***********************************************************************
+* Initialize command from argv scanner or special SPO input
+***********************************************************************/
+int spo_init(const char *option) {
+	if (!SPO->ready) {
+		// input handler thread, other machines get lines from spo_input
+		if (machine->console) {
+			pthread_create(&SPO->spo_handler, 0, spo_function, machine);
+			SPO->reader = true;
 		}
+		SPO->ready = true;
+		io_ready_changed(spo_ready, 0);
 	}
+	return command_parser(spo_commands, option);
+}
+
+/***********************************************************************
+* state of a new machine
+***********************************************************************/
+int spo_create(void) {
+	SPO = (struct spo_state *)calloc(1, sizeof *SPO);
+	if (SPO == NULL) {
+		perror("spo");
+		return -1;
+	}
+	ring_init(&SPO->spoq, SPO->spoqbuf, sizeof SPO->spoqbuf);
+	pthread_mutex_init(&SPO->line_mutex, NULL);
+	pthread_cond_init(&SPO->line_cond, NULL);
+	pthread_mutex_init(&SPO->queue_mutex, NULL);
+	return 0;
+}
+
+/***********************************************************************
+* end the input thread and free the state
+***********************************************************************/
+void spo_term(void) {
+	if (SPO == NULL)
+		return;
+	if (SPO->reader) {
+		pthread_cancel(SPO->spo_handler);
+		pthread_join(SPO->spo_handler, NULL);
+	}
+	pthread_mutex_destroy(&SPO->queue_mutex);
+	pthread_cond_destroy(&SPO->line_cond);
+	pthread_mutex_destroy(&SPO->line_mutex);
+	free(SPO);
+	SPO = NULL;
+}
+
+/***********************************************************************
+* read a line for the emulator itself (not the MCP)
+* returns NULL at the end of input, as fgets does, or after a
+* terminating signal
+***********************************************************************/
+char *spo_prompt(char *buf, int len) {
+	struct timespec ts;
+
+	if (!SPO->reader)
+		return fgets(buf, len, stdin);
+	pthread_mutex_lock(&SPO->line_mutex);
+	SPO->promptbuf = buf;
+	SPO->promptlen = len;
+	while (SPO->promptbuf && !SPO->eof && !term_request) {
+		// wake up every second to see a signal
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += 1;
+		pthread_cond_timedwait(&SPO->line_cond, &SPO->line_mutex, &ts);
+	}
+	if (SPO->promptbuf) {
+		SPO->promptbuf = NULL;
+		buf = NULL;
+	}
+	pthread_mutex_unlock(&SPO->line_mutex);
+	return buf;
+}
+
+/***********************************************************************
+* query SPO ready status
+* on first call, the SPO is initialized
+***********************************************************************/
+BIT spo_ready(unsigned index) {
+	// initialize SPO if not ready
+	if (!SPO->ready)
+		spo_init("");
 
 	// finally return always ready
-	return ready;
+	return SPO->ready;
 }
 
 /***********************************************************************
@@ -249,16 +414,16 @@ BIT spo_ready(unsigned index) {
 ***********************************************************************/
 void spo_write(IOCU *u) {
 	int i;
-	char *spooutp = spooutbuf;
+	char *spooutp = SPO->spooutbuf;
 #if TIMESTAMP
 	time_t now;
 	struct tm tm;
 
 	time(&now);
 	// subtract stamp
-	now -= stamp;
+	now -= SPO->stamp;
 	gmtime_r(&now, &tm);
-	if (timestamp)
+	if (SPO->timestamp)
 		spooutp += sprintf(spooutp, "%02d:%02u:%02u", tm.tm_hour, tm.tm_min, tm.tm_sec);
 #endif
 
@@ -271,7 +436,7 @@ loop:
 		if (u->ob == 037)
 			goto done;
 		// prevent buffer overrun
-		if (spooutp < spooutbuf + sizeof spooutbuf - 1)
+		if (spooutp < SPO->spooutbuf + sizeof SPO->spooutbuf - 1)
 			*spooutp++ = translatetable_bic2ascii[u->ob];
 	}
 	goto loop;
@@ -281,15 +446,16 @@ done:
 	*spooutp++ = '\r'; *spooutp++ = '\n'; *spooutp++ = 0;
 
 	// print
-	spo_print(spooutbuf);
+	spo_print(SPO->spooutbuf);
+	batch_spo(SPO->spooutbuf);
 
 #if AUTOEXEC
 	// check for end of job and reload card deck if so
-	if (autoexec > 0 && strstr(spooutbuf, auto_trigger1) && strstr(spooutbuf, auto_trigger2)) {
-		sprintf(spooutbuf, "$ ***** AUTOEXEC #%d *****\r\n", autoexec++);
-		spo_print(spooutbuf);
-		time(&stamp);
-		handle_option(auto_cmd);
+	if (SPO->autoexec > 0 && strstr(SPO->spooutbuf, auto_trigger1) && strstr(SPO->spooutbuf, auto_trigger2)) {
+		sprintf(SPO->spooutbuf, "$ ***** AUTOEXEC #%d *****\r\n", SPO->autoexec++);
+		spo_print(SPO->spooutbuf);
+		time(&SPO->stamp);
+		cpu_post(handle_option, auto_cmd);
 	}
 #endif
 
@@ -303,9 +469,19 @@ done:
 ***********************************************************************/
 void spo_read(IOCU *u) {
 	int i;
-	char *spoinp = spoinbuf;
+	char *spoinp;
+	char line[BUFLEN+2];
+	unsigned len;
 	BIT gmset = false;
 
+	// an empty line if nothing is queued
+	len = ring_peek(&SPO->spoq, line, sizeof line - 1);
+	line[len] = 0;
+	spoinp = strchr(line, '\r');
+	if (spoinp)
+		len = spoinp - line + 1;
+	spoinp = line;
+
 	// convert until EOL or any other control char found
 	// there should also be a limitation of the number of words
 	// unclear how much the MCP allocated, one place its 60 words(?)
@@ -331,8 +507,11 @@ void spo_read(IOCU *u) {
 		main_write_inc(u);
 	}
 
-	// mark the input buffer empty again
-	spoinbuf[0] = 0;
+	// remove the line from the queue, the next one requests input again
+	ring_skip(&SPO->spoq, len);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (ring_used(&SPO->spoq) > 0)
+		replay_irq(024);
 
 	// trivial all good result
 	u->d_wc = 0;
@@ -343,21 +522,21 @@ void spo_read(IOCU *u) {
 * write a debug line to SPO
 ***********************************************************************/
 void spo_debug_write(const char *msg) {
-	char *spooutp = spooutbuf;
+	char *spooutp = SPO->spooutbuf;
 #if TIMESTAMP
 	time_t now;
 	struct tm tm;
 	time(&now);
 	// subtract stamp
-	now -= stamp;
+	now -= SPO->stamp;
 	gmtime_r(&now, &tm);
-	if (timestamp)
+	if (SPO->timestamp)
 		spooutp += sprintf(spooutp, "%02d:%02u:%02u ", tm.tm_hour, tm.tm_min, tm.tm_sec);
 #endif
 	spooutp += sprintf(spooutp, "%s\r\n", msg);
 
 	// print it
-	spo_print(spooutbuf);
+	spo_print(SPO->spooutbuf);
 }
 
 
@@ -17,134 +17,209 @@
 *   added proper casts to return values	of shmat
 * 2017-09-30  R.Meyer
 *   overhaul of file names
+* 2026-10-19  agent
+*   telemetry region, keys per instance, exclusive create, the
+*   shares belong to a MACHINE
 ***********************************************************************/
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include <errno.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <sys/msg.h>
 #include "common.h"
+#include "telemetry.h"
+#include "machine.h"
 
 /*
- * storage declared here
- *
- * we might have different, implementation dependent ways
- * to get storage
+ * the machine of the thread, see machine.h
  */
-static
-int	shm_main,	// main memory
-	shm_cpu[2],	// P1 and P2 registers
-	shm_cc,		// central control registers
-	shm_ioc[4];	// I/O control units
+__thread		MACHINE		*machine;
+__thread volatile	WORD48		*MAIN;
+__thread		CPU		*P[2];
+__thread volatile	CENTRAL_CONTROL	*CC;
+__thread		IOCU		*IO[4];
+__thread		TELEMETRY_T	*TM;
 
-int	msg_cpu[2], // messages	to P1 and P2
-	msg_iocu;   // messages	to IOCU(s)
-
-volatile	WORD48		*MAIN;
-		CPU		*P[2];
-volatile	CENTRAL_CONTROL	*CC;
-		IOCU		*IO[4];
-
-void b5500_init_shares(void)
+/*
+ * remove the shares of an instance by their keys
+ * used for shares left behind by an emulator that was killed
+ */
+static void remove_instance(unsigned instance)
 {
-	shm_main = shmget(SHM_MAIN, MAXMEM*sizeof(WORD48), IPC_CREAT|0644);
-	if (shm_main < 0) {
-		perror("shmget MAIN");
-		exit(2);
-	}
-	shm_cpu[0] = shmget(SHM_CPUA, sizeof(CPU), IPC_CREAT|0644);
-	if (shm_cpu[0] < 0) {
-		perror("shmget P1");
-		exit(2);
-	}
-	shm_cpu[1] = shmget(SHM_CPUB, sizeof(CPU), IPC_CREAT|0644);
-	if (shm_cpu[1] < 0) {
-		perror("shmget P2");
-		exit(2);
-	}
-	shm_cc = shmget(SHM_CC,	sizeof(CENTRAL_CONTROL), IPC_CREAT|0644);
-	if (shm_cc < 0)	{
-		perror("shmget CC");
-		exit(2);
-	}
-	shm_ioc[0] = shmget(SHM_IOC1, sizeof(IOCU), IPC_CREAT|0644);
-	if (shm_ioc[0] < 0) {
-		perror("shmget IOC1");
-		exit(2);
-	}
-	shm_ioc[1] = shmget(SHM_IOC2, sizeof(IOCU), IPC_CREAT|0644);
-	if (shm_ioc[1] < 0) {
-		perror("shmget IOC2");
-		exit(2);
+	static const int shm_keys[] = {SHM_MAIN, SHM_CPUA, SHM_CPUB, SHM_CC,
+		SHM_IOC1, SHM_IOC2, SHM_IOC3, SHM_IOC4, SHM_TELE, SHM_DCC, SHM_DCCT};
+	static const int msg_keys[] = {MSG_CPUA, MSG_CPUB, MSG_IOCU};
+	unsigned i;
+	int id;
+
+	for (i = 0; i < sizeof shm_keys / sizeof shm_keys[0]; i++) {
+		id = shmget(IPCKEY(shm_keys[i], instance), 0, 0);
+		if (id >= 0)
+			shmctl(id, IPC_RMID, NULL);
 	}
-	shm_ioc[2] = shmget(SHM_IOC3, sizeof(IOCU), IPC_CREAT|0644);
-	if (shm_ioc[2] < 0) {
-		perror("shmget IOC3");
-		exit(2);
+	for (i = 0; i < sizeof msg_keys / sizeof msg_keys[0]; i++) {
+		id = msgget(IPCKEY(msg_keys[i], instance), 0);
+		if (id >= 0)
+			msgctl(id, IPC_RMID, NULL);
 	}
-	shm_ioc[3] = shmget(SHM_IOC4, sizeof(IOCU), IPC_CREAT|0644);
-	if (shm_ioc[3] < 0) {
-		perror("shmget IOC4");
-		exit(2);
+}
+
+/*
+ * create (the emulator) or attach to (the panels) the shares of an instance
+ * MAIN decides who owns the instance: if it exists and is attached by
+ * any process, another emulator or a panel uses the instance
+ * returns 0 or -1 when not all shares could be had
+ */
+int b5500_init_shares(MACHINE *m, unsigned instance, BIT create)
+{
+	static const struct {
+		int	key;
+		int	size;
+		const char *name;
+	} shm[] = {
+		{SHM_CPUA, sizeof(CPU), "P1"},
+		{SHM_CPUB, sizeof(CPU), "P2"},
+		{SHM_CC, sizeof(CENTRAL_CONTROL), "CC"},
+		{SHM_IOC1, sizeof(IOCU), "IOC1"},
+		{SHM_IOC2, sizeof(IOCU), "IOC2"},
+		{SHM_IOC3, sizeof(IOCU), "IOC3"},
+		{SHM_IOC4, sizeof(IOCU), "IOC4"},
+		{SHM_TELE, sizeof(TELEMETRY_T), "TELE"},
+	};
+	int *id[] = {&m->shm_cpu[0], &m->shm_cpu[1], &m->shm_cc,
+		&m->shm_ioc[0], &m->shm_ioc[1], &m->shm_ioc[2], &m->shm_ioc[3],
+		&m->shm_tele};
+	void *addr[sizeof shm / sizeof shm[0]];
+	struct shmid_ds ds;
+	int flags = create ? IPC_CREAT|IPC_EXCL|0644 : 0;
+	unsigned i;
+
+	m->instance = instance;
+	m->shm_main = shmget(IPCKEY(SHM_MAIN, instance), MAXMEM*sizeof(WORD48), flags);
+	if (m->shm_main < 0 && create && errno == EEXIST) {
+		m->shm_main = shmget(IPCKEY(SHM_MAIN, instance), 0, 0);
+		if (m->shm_main >= 0 && shmctl(m->shm_main, IPC_STAT, &ds) == 0 && ds.shm_nattch > 0) {
+			fprintf(stderr, "instance %u is in use, select another one with -n\n", instance);
+			return -1;
+		}
+		// nobody attached, left behind by a killed emulator
+		remove_instance(instance);
+		m->shm_main = shmget(IPCKEY(SHM_MAIN, instance), MAXMEM*sizeof(WORD48), flags);
+	}
+	if (m->shm_main < 0) {
+		if (!create && errno == ENOENT)
+			fprintf(stderr, "no emulator runs as instance %u\n", instance);
+		else
+			perror("shmget MAIN");
+		return -1;
+	}
+	// from here on b5500_remove_shares cleans up
+	for (i = 0; i < sizeof shm / sizeof shm[0]; i++)
+		*id[i] = -1;
+	m->msg_cpu[0] = m->msg_cpu[1] = m->msg_iocu = -1;
+	for (i = 0; i < sizeof shm / sizeof shm[0]; i++) {
+		*id[i] = shmget(IPCKEY(shm[i].key, instance), shm[i].size, flags);
+		if (*id[i] < 0) {
+			fprintf(stderr, "shmget %s: %s\n", shm[i].name, strerror(errno));
+			goto fail;
+		}
 	}
 
-	msg_cpu[0] = msgget(MSG_CPUA, IPC_CREAT|0644);
-	if (msg_cpu[0] < 0) {
+	m->msg_cpu[0] = msgget(IPCKEY(MSG_CPUA, instance), flags);
+	if (m->msg_cpu[0] < 0) {
 		perror("msgget P1");
-		exit(2);
+		goto fail;
 	}
-	msg_cpu[1] = msgget(MSG_CPUB, IPC_CREAT|0644);
-	if (msg_cpu[1] < 0) {
+	m->msg_cpu[1] = msgget(IPCKEY(MSG_CPUB, instance), flags);
+	if (m->msg_cpu[1] < 0) {
 		perror("msgget P2");
-		exit(2);
+		goto fail;
 	}
-	msg_iocu = msgget(MSG_IOCU, IPC_CREAT|0644);
-	if (msg_iocu < 0)	{
+	m->msg_iocu = msgget(IPCKEY(MSG_IOCU, instance), flags);
+	if (m->msg_iocu < 0)	{
 		perror("msgget IOCU");
-		exit(2);
+		goto fail;
 	}
 
-	MAIN = (WORD48*)shmat(shm_main,	NULL, 0);
-	if ((int)MAIN == -1) {
+	m->main = (WORD48*)shmat(m->shm_main, NULL, 0);
+	if (m->main == (void *)-1) {
+		m->main = NULL;
 		perror("shmat MAIN");
-		exit(2);
-	}
-	P[0] = (CPU *)shmat(shm_cpu[0], NULL,	0);
-	if ((int)P[0]	== -1) {
-		perror("shmat P1");
-		exit(2);
-	}
-	P[1] = (CPU *)shmat(shm_cpu[1], NULL,	0);
-	if ((int)P[1]	== -1) {
-		perror("shmat P2");
-		exit(2);
-	}
-	CC = (CENTRAL_CONTROL*)shmat(shm_cc, NULL, 0);
-	if ((int)CC == -1) {
-		perror("shmat CC");
-		exit(2);
-	}
-	IO[0] = (IOCU *)shmat(shm_ioc[0], NULL,	0);
-	if ((int)IO[0]	== -1) {
-		perror("shmat IOC1");
-		exit(2);
-	}
-	IO[1] = (IOCU *)shmat(shm_ioc[1], NULL,	0);
-	if ((int)IO[1]	== -1) {
-		perror("shmat IOC2");
-		exit(2);
-	}
-	IO[2] = (IOCU *)shmat(shm_ioc[2], NULL,	0);
-	if ((int)IO[2]	== -1) {
-		perror("shmat IOC3");
-		exit(2);
-	}
-	IO[3] = (IOCU *)shmat(shm_ioc[3], NULL,	0);
-	if ((int)IO[3]	== -1) {
-		perror("shmat IOC4");
-		exit(2);
-	}
+		goto fail;
+	}
+	for (i = 0; i < sizeof shm / sizeof shm[0]; i++) {
+		addr[i] = shmat(*id[i], NULL, 0);
+		if (addr[i] == (void *)-1) {
+			fprintf(stderr, "shmat %s: %s\n", shm[i].name, strerror(errno));
+			while (i-- > 0)
+				shmdt(addr[i]);
+			shmdt((void *)m->main);
+			m->main = NULL;
+			goto fail;
+		}
+	}
+	m->cpu[0] = (CPU *)addr[0];
+	m->cpu[1] = (CPU *)addr[1];
+	m->cc = (CENTRAL_CONTROL *)addr[2];
+	for (i = 0; i < 4; i++)
+		m->iocu[i] = (IOCU *)addr[3+i];
+	m->tm = (TELEMETRY_T *)addr[7];
+	return 0;
+
+fail:
+	// the panels must not remove the shares of a running emulator
+	if (create)
+		b5500_remove_shares(m);
+	return -1;
+}
+
+/*
+ * detach the shares from the process
+ */
+void b5500_detach_shares(MACHINE *m)
+{
+	int i;
+
+	if (m->main == NULL)
+		return;
+	shmdt((void *)m->main);
+	for (i = 0; i < 2; i++)
+		shmdt(m->cpu[i]);
+	shmdt((void *)m->cc);
+	for (i = 0; i < 4; i++)
+		shmdt(m->iocu[i]);
+	shmdt(m->tm);
+	m->main = NULL;
+}
+
+/*
+ * remove all of the above and the DCC segments when the emulator ends
+ * segments stay until the last panel detaches
+ * only system calls, this may be called from a signal handler
+ */
+void b5500_remove_shares(MACHINE *m)
+{
+	int i, id;
+
+	shmctl(m->shm_main, IPC_RMID, NULL);
+	for (i = 0; i < 2; i++)
+		shmctl(m->shm_cpu[i], IPC_RMID, NULL);
+	shmctl(m->shm_cc, IPC_RMID, NULL);
+	for (i = 0; i < 4; i++)
+		shmctl(m->shm_ioc[i], IPC_RMID, NULL);
+	shmctl(m->shm_tele, IPC_RMID, NULL);
+	for (i = 0; i < 2; i++)
+		msgctl(m->msg_cpu[i], IPC_RMID, NULL);
+	msgctl(m->msg_iocu, IPC_RMID, NULL);
+
+	id = shmget(IPCKEY(SHM_DCC, m->instance), 0, 0);
+	if (id >= 0)
+		shmctl(id, IPC_RMID, NULL);
+	id = shmget(IPCKEY(SHM_DCCT, m->instance), 0, 0);
+	if (id >= 0)
+		shmctl(id, IPC_RMID, NULL);
 }
@@ -11,6 +11,9 @@
 *   Factored out from cc2.c
 * 2018-03-16  R.Meyer
 *   Added MAIN Memory access functions and IB/OB functions
+* 2026-10-19  agent
+*   TUS ready mask, telemetry rate, unit statistics, record and
+*   replay, I/O thread ends with its queue, state is part of the MACHINE
 ***********************************************************************/
 
 #include <stdio.h>
@@ -26,8 +29,13 @@
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/msg.h>
+#include <pthread.h>
+#include <time.h>
 #include "common.h"
 #include "io.h"
+#include "telemetry.h"
+#include "replay.h"
+#include "machine.h"
 
 /***********************************************************************
 * optional trace files
@@ -35,22 +43,68 @@
 //static FILE *traceio = NULL;
 
 /***********************************************************************
-* ready/initialized flag
+* message
 ***********************************************************************/
-static BIT ready;
+struct iomsgbuf {
+	long	iocu;	// 1..4
+	char	iocw[8];
+	unsigned queued;	// time of IIO in microseconds
+};
 
 /***********************************************************************
-* thread handle
+* statistics
+* times are microseconds from a 32 bit monotonic clock, differences
+* are valid up to some 70 minutes
+* histogram bucket k counts times below 2^k microseconds, the last
+* one all longer times
 ***********************************************************************/
-static pthread_t io_handler;
+#define	IO_HISTO	24
+#define	IO_ERRMASK	(RD_22_MAE|RD_20_ERR|RD_19_PAR|RD_18_NRDY|RD_17_PE|RD_16_BUSY)
+#define	IO_STATINT	10	// default seconds between stats file dumps
+
+typedef struct iohisto {
+	unsigned	n;		// samples
+	unsigned long long sum;		// sum of samples
+	unsigned	max;		// longest sample
+	unsigned	bucket[IO_HISTO];
+} IOHISTO;
+
+typedef struct iounitstat {
+	unsigned	ops;		// I/O operations
+	unsigned long long words;	// words transferred
+	unsigned	errors;		// results with error bits
+	IOHISTO		wait;		// IIO until an I/O unit takes it
+	IOHISTO		service;	// time spent in the device
+} IOUNITSTAT;
+
+typedef struct iocustat {
+	unsigned	ops;		// I/O operations
+	unsigned long long words;	// words transferred
+	IOHISTO		irq;		// I/O finished until the interrupt is taken
+	unsigned	done;		// time of last I/O finished, 0 = none pending
+} IOCUSTAT;
 
 /***********************************************************************
-* message
+* state
 ***********************************************************************/
-struct iomsgbuf {
-	long	iocu;	// 1..4
-	char	iocw[8];
+struct io_state {
+	BIT		ready;		// I/O thread started
+	pthread_t	io_handler;
+	pthread_mutex_t	ready_mutex;	// serializes updates of the ready mask
+
+	IOUNITSTAT	unitstat[32][2];
+	IOCUSTAT	custat[4];
+
+	// the stats file is written by a thread of its own
+	char		statfile[80];
+	unsigned	statint;
+	pthread_t	stat_handler;
+	pthread_mutex_t	stat_mutex;
+	pthread_cond_t	stat_cond;	// wakes it early
+	BIT		stat_running;	// it writes the file
+	BIT		stat_started;	// it needs to be joined
 };
+#define	IOS	(machine->io)
 
 /***********************************************************************
 * Main memory accesses for I/O units
@@ -63,20 +117,29 @@ void main_read(IOCU *u) {
 void main_read_inc(IOCU *u) {
 	u->w = MAIN[u->d_addr & MASKMEM] & MASK_WORD48;
 	u->d_addr = (u->d_addr+1) & MASKMEM;
+	u->words++;
 }
 
 void main_write(IOCU *u) {
 	MAIN[u->d_addr & MASKMEM] = u->w & MASK_WORD48;
+	if (machine->replay_capture)
+		replay_word(u->d_addr, u->w);
 }
 
 void main_write_inc(IOCU *u) {
 	MAIN[u->d_addr & MASKMEM] = u->w & MASK_WORD48;
+	if (machine->replay_capture)
+		replay_word(u->d_addr, u->w);
 	u->d_addr = (u->d_addr+1) & MASKMEM;
+	u->words++;
 }
 
 void main_write_dec(IOCU *u) {
 	MAIN[u->d_addr & MASKMEM] = u->w & MASK_WORD48;
+	if (machine->replay_capture)
+		replay_word(u->d_addr, u->w);
 	u->d_addr = (u->d_addr-1) & MASKMEM;
+	u->words++;
 }
 
 /***********************************************************************
@@ -153,17 +216,73 @@ const UNIT unit[32][2] = {
         /*31*/ {{"MTT", 47-32, 15, mt_ready, mt_access, NULL}, {"MTT", 47-32, 15, mt_ready, mt_access, NULL}},
 };
 
+/***********************************************************************
+* statistics helpers
+***********************************************************************/
+static unsigned io_usec(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	// never 0, that means "no time"
+	return (unsigned)(ts.tv_sec * 1000000LL + ts.tv_nsec / 1000) | 1;
+}
+
+static void histo_add(IOHISTO *h, unsigned us) {
+	unsigned k = 0;
+
+	while (k < IO_HISTO-1 && us >= (1u << k))
+		k++;
+	h->bucket[k]++;
+	h->n++;
+	h->sum += us;
+	if (us > h->max)
+		h->max = us;
+}
+
+static unsigned histo_avg(const IOHISTO *h) {
+	return h->n ? h->sum / h->n : 0;
+}
+
+// upper bound of the bucket holding the given percentile
+static unsigned histo_pct(const IOHISTO *h, unsigned pct) {
+	unsigned k, cnt = 0;
+
+	for (k = 0; k < IO_HISTO-1; k++) {
+		cnt += h->bucket[k];
+		if (cnt * 100ULL >= (unsigned long long)h->n * pct)
+			break;
+	}
+	return k < IO_HISTO-1 ? 1u << k : h->max;
+}
+
+/***********************************************************************
+* the CPU takes the I/O finished interrupt of unit cu (1..4)
+***********************************************************************/
+void io_complete_taken(int cu) {
+	IOCUSTAT *s = &IOS->custat[cu-1];
+	unsigned done = __atomic_load_n(&s->done, __ATOMIC_ACQUIRE);
+
+	if (done) {
+		histo_add(&s->irq, io_usec() - done);
+		s->done = 0;
+	}
+}
+
 /***********************************************************************
 * actual I/O is done here
 ***********************************************************************/
-static void perform_io(int cu, WORD48 iocw) {
+static void perform_io(int cu, WORD48 iocw, unsigned queued) {
 	IOCU *u = IO[cu-1];
+	unsigned start, end;
+	IOUNITSTAT *s;
 
 	// iocw is passed by W register
 	u->w = iocw;
 
 	// statistics
 	u->calls++;
+	u->words = 0;
+	start = io_usec();
 
 	// analyze and decompose IOCW
 	u->d_unit = (u->w & MASK_IODUNIT) >> SHFT_IODUNIT;
@@ -181,15 +300,33 @@ static void perform_io(int cu, WORD48 iocw) {
 
 	BIT reading = (u->d_control & CD_24_READ) ? true : false;
 
-	// check for entry in unit table
-	if (unit[u->d_unit][reading].ioaccess) {
+	// a replay takes the result and the stored words from the log
+	if (machine->replay_mode == REPLAY_PLAY && replay_play_io(u, cu, iocw)) {
+		reading = (u->d_control & CD_24_READ) ? true : false;
+	} else if (unit[u->d_unit][reading].ioaccess) {
 		// handle I/O
+		machine->replay_capture = machine->replay_mode == REPLAY_RECORD;
 		(*unit[u->d_unit][reading].ioaccess)(u);
+		machine->replay_capture = false;
 	} else {
 	        // prepare result with not ready set
 	        u->d_result = RD_18_NRDY;
 	}
 
+	// statistics
+	end = io_usec();
+	s = &IOS->unitstat[u->d_unit][reading];
+	s->ops++;
+	s->words += u->words;
+	if (u->d_result & IO_ERRMASK)
+		s->errors++;
+	histo_add(&s->wait, start - queued);
+	histo_add(&s->service, end - start);
+	IOS->custat[cu-1].ops++;
+	IOS->custat[cu-1].words += u->words;
+	// before the interrupt flag, the CPU looks at it then
+	__atomic_store_n(&IOS->custat[cu-1].done, end, __ATOMIC_RELEASE);
+
 	// compose W register
 	u->w = MASK_IORISMOD3;
 	u->w |= ((WORD48)u->d_unit) << SHFT_IODUNIT;
@@ -198,6 +335,9 @@ static void perform_io(int cu, WORD48 iocw) {
 	u->w |= ((WORD48)u->d_result) << SHFT_IODRESULT;
 	u->w |= ((WORD48)u->d_addr) << SHFT_IODADDR;
 
+	if (machine->replay_mode == REPLAY_RECORD)
+		replay_record_io(cu, iocw, u->w);
+
 #if 0
 	if (u->d_unit == 16) {
 		print_ior(stdout, u);
@@ -264,8 +404,15 @@ void initiateIO(CPU *cpu) {
 	w = MAIN[w & MASKMEM];
 
 	memcpy(msg.iocw, (char*)&w, sizeof msg.iocw);
+	msg.queued = io_usec();
+
+	// record and replay need the I/O to complete at this instruction
+	if (machine->replay_mode != REPLAY_OFF) {
+		perform_io(msg.iocu, w, msg.queued);
+		return;
+	}
 
-	while (msgsnd(msg_iocu, &msg, sizeof msg.iocw, IPC_NOWAIT) < 0) {
+	while (msgsnd(machine->msg_iocu, &msg, sizeof msg - offsetof(struct iomsgbuf, iocw), IPC_NOWAIT) < 0) {
 		perror("initiateIO");
 		if (errno == EINTR)
 			continue;
@@ -277,16 +424,58 @@ void initiateIO(CPU *cpu) {
 * check which units are ready
 ***********************************************************************/
 WORD48 interrogateUnitStatus(CPU *cpu) {
+	// the mask is kept up to date by the devices
+        return CC->RDY;
+}
+
+/***********************************************************************
+* a device reports a possible change of its ready status
+* all units using this ready function and index are updated
+* the status is read under the lock, so of two reports at the same
+* time the later one is not overwritten with an older status
+***********************************************************************/
+void io_ready_changed(BIT (*isready)(unsigned), unsigned index) {
+	int i, j;
+	WORD48 mask = 0LL;
+	BIT ready;
+
+	for (i=0; i<32; i++) for (j=0; j<2; j++)
+		if (unit[i][j].isready == isready && unit[i][j].index == index)
+			mask |= (1LL << unit[i][j].readybit);
+
+	pthread_mutex_lock(&IOS->ready_mutex);
+	ready = (*isready)(index);
+	// the CPU thread applies recorded changes, a replay logged ones
+	if (machine->replay_mode != REPLAY_OFF)
+		replay_ready(mask, ready);
+	else if (ready)
+		CC->RDY |= mask;
+	else
+		CC->RDY &= ~mask;
+	pthread_mutex_unlock(&IOS->ready_mutex);
+}
+
+/***********************************************************************
+* build the ready mask from scratch by asking all units
+* this also initializes units that are not yet configured (SPO, DCC),
+* which report their change from within, hence the recursive lock
+***********************************************************************/
+static void io_ready_scan(void) {
 	int i, j;
 	WORD48 unitsready = 0LL;
 
+	pthread_mutex_lock(&IOS->ready_mutex);
 	// go through all units
 	for (i=0; i<32; i++) for (j=0; j<2; j++)
 		if (unit[i][j].isready && (*unit[i][j].isready)(unit[i][j].index))
 			unitsready |= (1LL << unit[i][j].readybit);
 
-	// return the mask
-        return unitsready;
+	// logged, or replaced by the logged mask
+	if (machine->replay_mode != REPLAY_OFF)
+		replay_scan(&unitsready);
+
+	CC->RDY = unitsready;
+	pthread_mutex_unlock(&IOS->ready_mutex);
 }
 
 /***********************************************************************
@@ -316,12 +505,17 @@ WORD48 interrogateIOChannel(CPU *cpu) {
 * I/O handling thread
 ***********************************************************************/
 static void *io_function(void *p) {
-	size_t	len;
+	ssize_t	len;
 	struct iomsgbuf msg;
 	WORD48	iocw;
+
+	machine_bind((MACHINE *)p);
 loop:
-	len = msgrcv(msg_iocu, &msg, sizeof msg.iocw, 0, 0);
+	len = msgrcv(machine->msg_iocu, &msg, sizeof msg - offsetof(struct iomsgbuf, iocw), 0, 0);
 	if (len < 0) {
+		// the queue is removed when the emulator ends
+		if (errno == EIDRM || errno == EINVAL)
+			return NULL;
 		perror("IO THREAD");
 		if (errno == EINTR)
 			goto loop;
@@ -329,7 +523,7 @@ loop:
 	}
 	// now do the I/O
 	memcpy((char*)&iocw, msg.iocw, sizeof msg.iocw);
-	perform_io(msg.iocu, iocw);
+	perform_io(msg.iocu, iocw, msg.queued);
 	goto loop;	
 }
 
@@ -337,8 +531,162 @@ loop:
 * Status
 ***********************************************************************/
 static int io_status(const char *v, void *) {
+	int i, j;
+	IOCUSTAT *c;
+	IOUNITSTAT *s;
+
 	printf("$CALLS: %u %u %u %u\n",
 		IO[0]->calls, IO[1]->calls, IO[2]->calls, IO[3]->calls);
+	// times in microseconds: average/95th percentile/maximum
+	for (i=0; i<4; i++) {
+		c = &IOS->custat[i];
+		printf("$IOCU%d OPS=%u WORDS=%llu IRQ=%u/%u/%u\n", i+1,
+			c->ops, c->words,
+			histo_avg(&c->irq), histo_pct(&c->irq, 95), c->irq.max);
+	}
+	for (i=0; i<32; i++) for (j=0; j<2; j++) {
+		s = &IOS->unitstat[i][j];
+		if (s->ops == 0)
+			continue;
+		printf("$%-3.3s %c OPS=%u WORDS=%llu ERR=%u WAIT=%u/%u/%u SVC=%u/%u/%u\n",
+			unit[i][j].name ? unit[i][j].name : "???", j ? 'R' : 'W',
+			s->ops, s->words, s->errors,
+			histo_avg(&s->wait), histo_pct(&s->wait, 95), s->wait.max,
+			histo_avg(&s->service), histo_pct(&s->service, 95), s->service.max);
+	}
+	return 0; // OK
+}
+
+/***********************************************************************
+* Statistics reset
+***********************************************************************/
+static int io_reset(const char *v, void *) {
+	int i;
+
+	memset(IOS->unitstat, 0, sizeof IOS->unitstat);
+	for (i=0; i<4; i++) {
+		IOS->custat[i].ops = 0;
+		IOS->custat[i].words = 0;
+		memset(&IOS->custat[i].irq, 0, sizeof IOS->custat[i].irq);
+	}
+	return 0; // OK
+}
+
+/***********************************************************************
+* Statistics file
+* one line per IOCU and per used unit, blank separated key=value,
+* rewritten as a whole so readers never see a partial file
+***********************************************************************/
+static void histo_print(FILE *fp, const char *key, const IOHISTO *h) {
+	int k;
+
+	fprintf(fp, " %s_n=%u %s_sum=%llu %s_max=%u %s_hist=",
+		key, h->n, key, h->sum, key, h->max, key);
+	for (k=0; k<IO_HISTO; k++)
+		fprintf(fp, k ? ",%u" : "%u", h->bucket[k]);
+}
+
+static void io_stats_write(void) {
+	char tmp[sizeof IOS->statfile + 4];
+	FILE *fp;
+	int i, j;
+	IOCUSTAT *c;
+	IOUNITSTAT *s;
+
+	sprintf(tmp, "%s.tmp", IOS->statfile);
+	fp = fopen(tmp, "w");
+	if (fp == NULL) {
+		perror(tmp);
+		return;
+	}
+	fprintf(fp, "time=%ld\n", (long)time(NULL));
+	for (i=0; i<4; i++) {
+		c = &IOS->custat[i];
+		fprintf(fp, "iocu=%d ops=%u words=%llu", i+1, c->ops, c->words);
+		histo_print(fp, "irq", &c->irq);
+		fprintf(fp, "\n");
+	}
+	for (i=0; i<32; i++) for (j=0; j<2; j++) {
+		s = &IOS->unitstat[i][j];
+		if (s->ops == 0)
+			continue;
+		fprintf(fp, "unit=%s dir=%c ops=%u words=%llu errors=%u",
+			unit[i][j].name ? unit[i][j].name : "???", j ? 'R' : 'W',
+			s->ops, s->words, s->errors);
+		histo_print(fp, "wait", &s->wait);
+		histo_print(fp, "svc", &s->service);
+		fprintf(fp, "\n");
+	}
+	fclose(fp);
+	if (rename(tmp, IOS->statfile) < 0)
+		perror(IOS->statfile);
+}
+
+static void *io_stats_function(void *p) {
+	struct timespec ts;
+
+	machine_bind((MACHINE *)p);
+	pthread_mutex_lock(&IOS->stat_mutex);
+	while (IOS->statfile[0]) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += IOS->statint;
+		// woken early when the name changes or the machine ends
+		if (pthread_cond_timedwait(&IOS->stat_cond, &IOS->stat_mutex, &ts) == ETIMEDOUT
+			&& IOS->statfile[0])
+			io_stats_write();
+	}
+	IOS->stat_running = false;
+	pthread_mutex_unlock(&IOS->stat_mutex);
+	return NULL;
+}
+
+static int io_stats(const char *v, void *) {
+	BIT start;
+
+	if (strlen(v) + 4 >= sizeof IOS->statfile) {
+		printf("$STATS file name too long\n");
+		return 2; // FATAL
+	}
+	pthread_mutex_lock(&IOS->stat_mutex);
+	strcpy(IOS->statfile, v);
+	pthread_cond_signal(&IOS->stat_cond);
+	// empty name stops the dumps
+	start = IOS->statfile[0] && !IOS->stat_running;
+	if (start)
+		IOS->stat_running = true;
+	pthread_mutex_unlock(&IOS->stat_mutex);
+	if (start) {
+		// an earlier thread has ended
+		if (IOS->stat_started)
+			pthread_join(IOS->stat_handler, NULL);
+		pthread_create(&IOS->stat_handler, 0, io_stats_function, machine);
+		IOS->stat_started = true;
+	}
+	return 0; // OK
+}
+
+static int io_statint(const char *v, void *) {
+	unsigned sec = strtoul(v, NULL, 10);
+
+	if (sec == 0) {
+		printf("$STATINT must be at least 1 second\n");
+		return 2; // FATAL
+	}
+	IOS->statint = sec;
+	return 0; // OK
+}
+
+/***********************************************************************
+* Telemetry rate for the panels
+***********************************************************************/
+static int io_panel(const char *v, void *) {
+	unsigned rate = strtoul(v, NULL, 10);
+
+	if (rate > TELEMETRY_MAXRATE) {
+		printf("$PANEL rate must be 0..%d\n", TELEMETRY_MAXRATE);
+		return 2; // FATAL
+	}
+	TM->rate = rate;
 	return 0; // OK
 }
 
@@ -348,6 +696,10 @@ static int io_status(const char *v, void *) {
 static const command_t io_commands[] = {
 	{"IO", NULL},
 	{"STA", io_status},
+	{"RESET", io_reset},
+	{"STATS", io_stats},
+	{"STATINT", io_statint},
+	{"PANEL", io_panel},
 	{NULL, NULL},
 };
 
@@ -355,33 +707,86 @@ static const command_t io_commands[] = {
 * Initialize command from argv scanner or special SPO input
 ***********************************************************************/
 int io_init(const char *option) {
-	if (!ready) {
+	if (!IOS->ready) {
 		// io handler thread
-		pthread_create(&io_handler, 0, io_function, 0);
-		ready = true;
+		pthread_create(&IOS->io_handler, 0, io_function, machine);
+		IOS->ready = true;
 	}
 	return command_parser(io_commands, option);
 }
 
+/***********************************************************************
+* state of a new machine
+***********************************************************************/
+int io_create(void) {
+	pthread_mutexattr_t attr;
+
+	IOS = (struct io_state *)calloc(1, sizeof *IOS);
+	if (IOS == NULL) {
+		perror("io");
+		return -1;
+	}
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&IOS->ready_mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+	pthread_mutex_init(&IOS->stat_mutex, NULL);
+	pthread_cond_init(&IOS->stat_cond, NULL);
+	IOS->statint = IO_STATINT;
+	return 0;
+}
+
+/***********************************************************************
+* end the threads and free the state
+* the I/O thread ends once the message queue has been removed
+***********************************************************************/
+void io_term(void) {
+	if (IOS == NULL)
+		return;
+	if (IOS->ready)
+		pthread_join(IOS->io_handler, NULL);
+	pthread_mutex_lock(&IOS->stat_mutex);
+	IOS->statfile[0] = 0;
+	pthread_cond_signal(&IOS->stat_cond);
+	pthread_mutex_unlock(&IOS->stat_mutex);
+	if (IOS->stat_started)
+		pthread_join(IOS->stat_handler, NULL);
+	pthread_cond_destroy(&IOS->stat_cond);
+	pthread_mutex_destroy(&IOS->stat_mutex);
+	pthread_mutex_destroy(&IOS->ready_mutex);
+	free(IOS);
+	IOS = NULL;
+}
+
+/***********************************************************************
+* continue from a loaded snapshot instead of an Initial Program Load
+***********************************************************************/
+void io_restart(void) {
+	io_ready_scan();
+	memset(IOS->custat, 0, sizeof IOS->custat);
+}
+
 /***********************************************************************
 * Initial Program Load (either from CRA or DKA)
 ***********************************************************************/
 int io_ipl(ADDR15 addr) {
+	io_ready_scan();
         CC->CCI08F = false;
         addr = AA_STARTLOC; // start addr
         if (CC->CLS) {
                 // binary read first CRA card to <addr>
-		perform_io(1, 0240000540000000LL | addr);
+		perform_io(1, 0240000540000000LL | addr, io_usec());
         } else {
                 // load DKA disk segments 1..63 to <addr>
 		MAIN[addr-1] = 1LL;
-                perform_io(1, 0140000047700000LL | (addr-1));
+                perform_io(1, 0140000047700000LL | (addr-1), io_usec());
         }
 	while (!CC->CCI08F) {
 		printf ("I/O finish IRQ not present\n");
 		sleep(1);
 	}
         CC->CCI08F = false;
+	IOS->custat[0].done = 0;
 	return 1;
 }
 
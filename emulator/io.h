@@ -19,6 +19,9 @@
 *   overhaul of file names
 * 2018-03-01  R.Meyer
 *   factored out iocu.h
+* 2026-10-19  agent
+*   xx_create() sets up the state of a unit for the current MACHINE,
+*   xx_term() stops its threads and frees it
 ***********************************************************************/
 
 #ifndef IOCU_H
@@ -65,38 +68,51 @@ extern void get_ob(IOCU *u);
 extern void put_ib(IOCU *u);
 extern void put_ib_reverse(IOCU *u);
 
+/* machine snapshots, see snapshot.h */
+struct snap;
+
 /* Supervisory Console (SPO) */
 extern void spo_print(const char *buf);
+extern int spo_create(void);
 extern int spo_init(const char *info);
 extern void spo_term(void);
 extern BIT spo_ready(unsigned index);
 extern void spo_write(IOCU*);
 extern void spo_read(IOCU*);
 extern void spo_debug_write(const char *msg);
+extern char *spo_prompt(char *buf, int len);
+extern void spo_input(const char *line);
 
 /* Card Readers (CRx) */
+extern int cr_create(void);
 extern int cr_init(const char *info);
 extern void cr_term(void);
 extern BIT cr_ready(unsigned index);
 extern void cr_read(IOCU*);
+extern void cr_snapshot(struct snap *);
 
 /* Card Punches (CPx) */
+extern int cp_create(void);
 extern int cp_init(const char *info);
 extern void cp_term(void);
 extern BIT cp_ready(unsigned index);
 extern void cp_write(IOCU*);
 
 /* Line Printers (LPx) */
+extern int lp_create(void);
 extern int lp_init(const char *info);
 extern void lp_term(void);
 extern BIT lp_ready(unsigned index);
 extern void lp_write(IOCU*);
+extern void lp_snapshot(struct snap *);
 
 /* Magnetic Tapes (MTx) */
+extern int mt_create(void);
 extern int mt_init(const char *info);
 extern void mt_term(void);
 extern BIT mt_ready(unsigned index);
 extern void mt_access(IOCU*);
+extern void mt_snapshot(struct snap *);
 
 /* Magnetic Tapes V2 (MTx) */
 extern int mt2_init(const char *info);
@@ -105,26 +121,36 @@ extern BIT mt2_ready(unsigned index);
 extern void mt2_access(IOCU*);
 
 /* Magnetic Drums */
+extern int dr_create(void);
 extern int dr_init(const char *info);
 extern void dr_term(void);
 extern BIT dr_ready(unsigned index);
 extern void dr_access(IOCU*);
+extern void dr_snapshot(struct snap *);
 
 /* Disk Control Units (DKx) */
+extern int dk_create(void);
 extern int dk_init(const char *info);
 extern void dk_term(void);
 extern BIT dk_ready(unsigned index);
 extern void dk_access(IOCU*);
+extern void dk_snapshot(struct snap *);
 
 /* Data Communication (DC) */
+extern int dcc_create(void);
 extern int dcc_init(const char *info);
 extern void dcc_term(void);
 extern BIT dcc_ready(unsigned index);
 extern void dcc_access(IOCU*);
+extern void dcc_snapshot(struct snap *);
 
 /* IO Units (IO) */
+extern int io_create(void);
 extern int io_init(const char *info);
+extern void io_term(void);
 extern int io_ipl(ADDR15 addr);
+extern void io_restart(void);
+extern void io_ready_changed(BIT (*isready)(unsigned), unsigned index);
 
 /* debug formatting functions */
 extern void print_iocw(FILE *fp, IOCU*);
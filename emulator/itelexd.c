@@ -14,6 +14,9 @@
 ************************************************************************
 * 2020-03-09  R.Meyer
 *   copied and modified from telnetd.c
+* 2026-10-19  agent
+*   non blocking close, timer driven acknowledge, ring buffers,
+*   lingering sockets shared by all machines
 ***********************************************************************/
 
 #include <stdio.h>
@@ -31,6 +34,7 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <signal.h>
+#include <pthread.h>
 
 #include "itelexd.h"
 
@@ -95,6 +99,16 @@ const uint8_t ascii2ita2[128] = {
   0x3D,0x35,0x31,0x80,0x80,0x80,0x80,0x80, // 78-7F XYZ{|}~§ <-> XYZ		§=RUBOUT
 };
 
+/***********************************************************************
+* sockets waiting for the peer to close after our END
+* one list for the DCC threads of all machines in the process
+***********************************************************************/
+static struct {
+	int		socket;
+	long long	deadline;
+} linger[IT_NLINGER];
+static pthread_mutex_t linger_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /***********************************************************************
 * Version Data
 ***********************************************************************/
@@ -140,6 +154,16 @@ static void dumpbuf(const unsigned char *buf, int len, const char *msg) {
 }
 #endif
 
+/***********************************************************************
+* monotonic milliseconds
+***********************************************************************/
+static long long now_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
 /***********************************************************************
 * ITELEX Send Ack
 ***********************************************************************/
@@ -148,6 +172,8 @@ static void sendack(ITELEX_SESSION_T *t) {
 	buf[0] = IT_ACK;
 	buf[1] = 1;
 	buf[2] = t->rnr;
+	t->rack = t->rnr;
+	t->acktime = now_ms() + IT_ACKTIME;
 #if IT_VERBOSE
 	dumpbuf(buf, 3, "sendack");
 	printf("RNR=%d\n", t->rnr);
@@ -175,8 +201,11 @@ static void sendend(ITELEX_SESSION_T *t) {
 int itelex_session_open(ITELEX_SESSION_T *t, int sock) {
 	t->socket = sock;
 
-	t->bidx = 0;
-	t->snr = t->sack = t->rnr = 0;
+	ring_init(&t->in, t->inbuf, IT_BUFLEN);
+	ring_init(&t->rx, t->rxbuf, IT_BUFLEN);
+	t->snr = t->sack = t->rnr = t->rack = 0;
+	t->acktime = now_ms() + IT_ACKTIME;
+	t->ended = 0;
 	t->tbuzi = t->rbuzi = -1;
 
 	t->success_mask = 0;
@@ -205,23 +234,101 @@ int itelex_session_open(ITELEX_SESSION_T *t, int sock) {
 }
 
 /***********************************************************************
-* ITELEX Session Close
+* ITELEX Session Drop (connection is gone, close at once)
 ***********************************************************************/
-void itelex_session_close(ITELEX_SESSION_T *t) {
+static void session_drop(ITELEX_SESSION_T *t) {
 	int so = t->socket;
-	sendend(t);		// send iTELEX END packet
-	sleep(1);		// do we perhaps need this?
 	t->socket = -1;		// prevent recursion
 	if (so > 2)		// prevent accidential closing of std files
 		close(so);
 }
 
+/***********************************************************************
+* ITELEX Session Close
+* sends END and leaves the socket to the lingering close, so the peer
+* can read the END before the connection goes away
+***********************************************************************/
+void itelex_session_close(ITELEX_SESSION_T *t) {
+	int i;
+
+	if (t->socket <= 2 || t->ended) {
+		session_drop(t);
+		return;
+	}
+	sendend(t);		// send iTELEX END packet
+	shutdown(t->socket, SHUT_WR);
+	pthread_mutex_lock(&linger_mutex);
+	for (i = 0; i < IT_NLINGER; i++) {
+		if (linger[i].socket <= 2) {
+			linger[i].socket = t->socket;
+			linger[i].deadline = now_ms() + IT_LINGER;
+			t->socket = -1;
+			pthread_mutex_unlock(&linger_mutex);
+			return;
+		}
+	}
+	pthread_mutex_unlock(&linger_mutex);
+	// no room to linger
+	session_drop(t);
+}
+
+/***********************************************************************
+* ITELEX Lingering Close
+* discards anything the peer still sends, closes when the peer has
+* closed or the time is up
+***********************************************************************/
+void itelex_linger_poll(void) {
+	char buf[64];
+	long long now = now_ms();
+	int i, cnt;
+
+	pthread_mutex_lock(&linger_mutex);
+	for (i = 0; i < IT_NLINGER; i++) {
+		if (linger[i].socket <= 2)
+			continue;
+		do {
+			cnt = recv(linger[i].socket, buf, sizeof buf, MSG_DONTWAIT);
+		} while (cnt > 0);
+		if ((cnt < 0 && errno != EAGAIN) || cnt == 0 || now >= linger[i].deadline) {
+			close(linger[i].socket);
+			linger[i].socket = -1;
+		}
+	}
+	pthread_mutex_unlock(&linger_mutex);
+}
+
+/***********************************************************************
+* ITELEX Session Timer
+* acknowledges received characters
+***********************************************************************/
+void itelex_session_timer(ITELEX_SESSION_T *t) {
+	if (t->socket > 2 && t->baudot && t->rack != t->rnr && now_ms() >= t->acktime)
+		sendack(t);
+}
+
+/***********************************************************************
+* ITELEX Session Window
+* number of characters that may be sent before the peer must acknowledge
+***********************************************************************/
+int itelex_session_window(ITELEX_SESSION_T *t) {
+	uint8_t delta = t->snr - t->sack;
+
+	if (!t->baudot)
+		return IT_WINDOW;
+	return delta >= IT_WINDOW ? 0 : IT_WINDOW - delta;
+}
+
 /***********************************************************************
 * ITELEX Session Clear
 ***********************************************************************/
 void itelex_session_clear(ITELEX_SESSION_T *t) {
+	unsigned char *inbuf = t->inbuf, *rxbuf = t->rxbuf;
+
 	memset(t, 0, sizeof *t);
 	t->socket = -1;
+	// the ring storage stays attached to the terminal
+	t->inbuf = inbuf;
+	t->rxbuf = rxbuf;
 }
 
 /***********************************************************************
@@ -229,124 +336,118 @@ void itelex_session_clear(ITELEX_SESSION_T *t) {
 * Returns number of bytes read or -1 on non-recoverable error
 ***********************************************************************/
 int itelex_session_read(ITELEX_SESSION_T *t, char *buf, int len) {
-	//dumpbuf(t->buf, t->bidx, "@itelex_session_read - rest of buffer");
-	// step 1: try to fill buffer
-	int i = IT_BUFLEN-t->bidx;
-	int k;
-
-	// try to fill buffer with more read data
-	if (i > 0 && t->socket > 2) {	// prevent accidential use of std files
-		int cnt = read(t->socket, t->buf+t->bidx, i);
+	unsigned char pkt[IT_BUFLEN];
+	int i, k, n, plen;
+
+	// step 1: try to fill the receive ring
+	n = ring_space(&t->in);
+	if (n > 0 && t->socket > 2) {	// prevent accidential use of std files
+		int cnt = read(t->socket, pkt, n);
 		if (cnt < 0) {	// cnt < 0 : error occured
 			if (errno == EAGAIN)
 				goto step2;	// recoverable
-			itelex_session_close(t);
+			session_drop(t);
 			return -1;
 		}
 		if (cnt == 0) {	// cnt = 0 : connection was closed by peer
-			itelex_session_close(t);
+			session_drop(t);
 			errno = ECONNRESET;
 			return -1;
 		}
-		t->bidx += cnt;
+		ring_write_n(&t->in, pkt, cnt);
 #if IT_VERBOSE
-		dumpbuf(t->buf, t->bidx, "buffer after read(socket)");
+		dumpbuf(pkt, cnt, "after read(socket)");
 #endif
 	}
 step2:
-	// check for and analyse iTELEX packet
-	if (t->bidx > 0 && iscommand(t->buf[0])) {
-		// iTELEX command byte at buffer start
-		if (t->bidx > 1) {
-			// we have length
-			int plen = t->buf[1];
-			if (t->bidx >= plen + 2) {
-				// sufficient length - analyse command
+	// step 2: analyse iTELEX packets and ASCII data as long as there is room
+	while ((n = ring_peek(&t->in, pkt, sizeof pkt)) > 0) {
+		if (!iscommand(pkt[0])) {
+			// plain ASCII up to the next iTELEX packet
+			for (i = 1; i < n; i++)
+				if (iscommand(pkt[i]))
+					break;
+			i = ring_write_n(&t->rx, pkt, i);
+			if (i == 0)
+				break;
+			ring_skip(&t->in, i);
+			continue;
+		}
+		// iTELEX command byte at start, need complete packet
+		if (n < 2 || n < pkt[1] + 2)
+			break;
+		plen = pkt[1];
+		if (pkt[0] == IT_BAU && (int)ring_space(&t->rx) < plen)
+			break;
 #if IT_VERBOSE
-				dumpbuf(t->buf, plen+2, "iTELEX packet found");
+		dumpbuf(pkt, plen+2, "iTELEX packet found");
 #endif
-				switch(t->buf[0]) {
-				case IT_BAU:
-					// now convert to ASCII
-					for (i = 0, k = 0; i < plen; i++) {
-						uint8_t ch = iswap(t->buf[i+2]);
-						// handle special codes first
-						if (ch == ITA2_UNSHIFT) {
-							t->rbuzi = false;
-						} else if (ch == ITA2_SHIFT) {
-							t->rbuzi = true;
-						} else if (ch == ITA2_CR) {
-							t->buf[k++] = '\r';
-						} else if (ch == ITA2_SPACE) {
-							t->buf[k++] = ' ';
-						} else if (ch == ITA2_LF) {
-							t->buf[k++] = '\n';
-						} else if (ch == ITA2_NULL) {
-							t->buf[k++] = 0;
-						} else {
-							// look it up in table
-							// we must do a reverse loop, to find non capital letters instead of capital letters
-							for (int m=127; m>=0; m--) {
-								if (ascii2ita2[m] == (ch | (t->rbuzi ? TAB_SHIFT : TAB_UNSHIFT))) {
-									t->buf[k++] = m;
-									break;
-								}
-							}
-							// not in table --> no char received
-						 }
+		switch(pkt[0]) {
+		case IT_BAU:
+			// now convert to ASCII, in place, never more chars than codes
+			for (i = 0, k = 0; i < plen; i++) {
+				uint8_t ch = iswap(pkt[i+2]);
+				// handle special codes first
+				if (ch == ITA2_UNSHIFT) {
+					t->rbuzi = false;
+				} else if (ch == ITA2_SHIFT) {
+					t->rbuzi = true;
+				} else if (ch == ITA2_CR) {
+					pkt[k++] = '\r';
+				} else if (ch == ITA2_SPACE) {
+					pkt[k++] = ' ';
+				} else if (ch == ITA2_LF) {
+					pkt[k++] = '\n';
+				} else if (ch == ITA2_NULL) {
+					pkt[k++] = 0;
+				} else {
+					// look it up in table
+					// we must do a reverse loop, to find non capital letters instead of capital letters
+					for (int m=127; m>=0; m--) {
+						if (ascii2ita2[m] == (ch | (t->rbuzi ? TAB_SHIFT : TAB_UNSHIFT))) {
+							pkt[k++] = m;
+							break;
+						}
 					}
-					// now crunch buf
-					t->bidx -= (plen + 2 - k);
-					memcpy(t->buf + k, t->buf + (plen + 2), t->bidx);
+					// not in table --> no char received
+				 }
+			}
+			ring_write_n(&t->rx, pkt, k);
 #if IT_VERBOSE
-					dumpbuf(t->buf, t->bidx, "converted to ASCII");
+			dumpbuf(pkt, k, "converted to ASCII");
 #endif
-					// increment our receive byte counter
-					t->rnr += plen;
-					// let this be picked up next round
-					return 0;
-				case IT_ACK:
-					if (plen != 1)
-						break;
-					t->sack = t->buf[2];
+			// increment our receive byte counter
+			t->rnr += plen;
+			break;
+		case IT_ACK:
+			if (plen != 1)
+				break;
+			t->sack = pkt[2];
 #if IT_VERBOSE
-					printf("    SACK=%d SNR=%d RNR=%d\n", t->sack, t->snr, t->rnr);
+			printf("    SACK=%d SNR=%d RNR=%d\n", t->sack, t->snr, t->rnr);
 #endif
-					// send our own ack
-					sendack(t);
-					break;
-				default:
-					;
-				}
-				// remove command from buffer
-				t->bidx -= plen+2;
-				memcpy(t->buf, t->buf + (plen+2), t->bidx);
-			}
+			// send our own ack
+			sendack(t);
+			break;
+		case IT_END:
+			// peer hangs up
+			t->ended = 1;
+			errno = ECONNRESET;
+			return -1;
+		default:
+			;
 		}
+		// remove packet from ring
+		ring_skip(&t->in, plen+2);
 	}
 
-	// try to find string of ASCII data and return it
-	if (t->bidx > 0) {
-		for (i = 0; i < t->bidx; i++) {
-			// stop at any iTELEX Packet command
-			if (iscommand(t->buf[i]))
-				break;
-		}
-		if (i > len)
-			i = len;
-		if (i > 0) {
-			memcpy(buf, t->buf, i);
-			memcpy(t->buf, t->buf + i, t->bidx - i);
-			t->bidx -= i;
+	// step 3: return ASCII data
+	n = ring_read_n(&t->rx, buf, len);
 #if IT_VERBOSE
-			dumpbuf((const unsigned char *)buf, i, "returning ASCII");
+	if (n > 0)
+		dumpbuf((const unsigned char *)buf, n, "returning ASCII");
 #endif
-			return i;
-		}
-	}
-
-	// nothing found
-	return 0;
+	return n;
 }
 
 /***********************************************************************
@@ -367,11 +468,11 @@ int itelex_session_write(ITELEX_SESSION_T *t, const char *buf, int len) {
 #if IT_VERBOSE
 			printf("    SNR=%u SACK=%u delta=%u\n", t->snr, t->sack, delta);
 #endif
-			if (delta >= 50) {
+			if (delta >= IT_WINDOW) {
 #if IT_VERBOSE
-				printf("    delta >= 50 - not sending \n");
-				sleep(1);
+				printf("    delta >= %d - not sending \n", IT_WINDOW);
 #endif
+				// sent when the peer acknowledges
 				return 0;
 			}
 			buf2[0] = 2; // baudot data
@@ -414,7 +515,7 @@ int itelex_session_write(ITELEX_SESSION_T *t, const char *buf, int len) {
 						printf("itelex_session_write: EAGAIN\n");
 						return 0;	// recoverable
 					}
-					itelex_session_close(t);
+					session_drop(t);
 					return -1;
 				}
 			}
@@ -435,7 +536,7 @@ int itelex_session_write(ITELEX_SESSION_T *t, const char *buf, int len) {
 						printf("itelex_session_write: EAGAIN\n");
 						return 0;	// recoverable
 					}
-					itelex_session_close(t);
+					session_drop(t);
 					return -1;
 				}
 			}
@@ -21,11 +21,15 @@
 ************************************************************************
 * 2020-03-09  R.Meyer
 *   copied and modified from telnetd.h
+* 2026-10-19  agent
+*   non blocking close, timer driven acknowledge, ring buffers
 ***********************************************************************/
 
 #ifndef	_ITELEXD_H_
 #define	_ITELEXD_H_
 
+#include "circbuffer.h"
+
 #define TIMEOUT 1000
 
 // iTELEX codes
@@ -56,8 +60,15 @@
 #define ITA2_SPACE 0x04
 #define ITA2_NULL 0x00
 
-// work buffer length
-#define	IT_BUFLEN	260
+// work buffer length (power of 2, holds the longest packet of 2+255
+// bytes with room to spare)
+#define	IT_BUFLEN	512
+
+// flow control and timing
+#define	IT_WINDOW	50	// characters sent but not acknowledged
+#define	IT_ACKTIME	500	// milliseconds between acknowledges
+#define	IT_LINGER	1000	// milliseconds to wait for peer to close
+#define	IT_NLINGER	16	// sockets closing at the same time
 
 /***********************************************************************
 * the iTELEX stuff
@@ -68,9 +79,14 @@ typedef struct itelex_session {
 	unsigned	success_mask;
 	int		baudot;
 	// iTELEX packet assembly
-	int		bidx;		// buffer index (0 = start of buffer)
-	unsigned char	buf[IT_BUFLEN];	// buffer
+	RING_T		in;		// as received from socket
+	RING_T		rx;		// converted to ASCII
+	unsigned char	*inbuf;		// storage of the rings, IT_BUFLEN each,
+	unsigned char	*rxbuf;		// from the terminal buffer pool
 	unsigned char	snr, sack, rnr;	// character counts each direction
+	unsigned char	rack;		// rnr last acknowledged
+	long long	acktime;	// when to acknowledge next
+	int		ended;		// peer has sent END
 	int		tbuzi, rbuzi;	// letter/figure mode both directions
 	// negotiated terminal values
 } ITELEX_SESSION_T;
@@ -87,6 +103,9 @@ extern void itelex_session_close(ITELEX_SESSION_T *t);
 extern void itelex_session_clear(ITELEX_SESSION_T *t);
 extern int itelex_session_read(ITELEX_SESSION_T *t, char *buf, int len);
 extern int itelex_session_write(ITELEX_SESSION_T *t, const char *buf, int len);
+extern int itelex_session_window(ITELEX_SESSION_T *t);
+extern void itelex_session_timer(ITELEX_SESSION_T *t);
+extern void itelex_linger_poll(void);
 extern int itelex_server_start(ITELEX_SERVER_T *ts, unsigned port);
 extern void itelex_server_stop(ITELEX_SERVER_T *ts);
 extern int itelex_server_poll(ITELEX_SERVER_T *ts, struct sockaddr_in *addr);
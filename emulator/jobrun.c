@@ -0,0 +1,586 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* parallel job runner
+*
+* Boots the MCP once in batch mode and saves a snapshot of the machine
+* right after the Halt/Load. Then it runs every card deck found in a
+* directory as its own emulator started from that snapshot, as many at
+* a time as there are processors.
+*
+* Each run has a directory of its own below the work directory and a
+* shared memory instance of its own (-n):
+*	<work>/boot/		the boot, its SPO log and boot.snap
+*	<work>/<deck>/		one run: the SPO log spo.txt, its private
+*				copy of the disks, the printer output
+*	<work>/summary.txt	one line per deck with the exit code of
+*				the run and the files it wrote
+*
+* The emulators run in their own directories, so in the ini file:
+*	- decks and other input files have absolute names
+*	- disk files (DKA/DKB FILE=) have relative names, they are taken
+*	  from the current directory for the boot and copied from the
+*	  boot for every run
+*	- output files (printers, punch) have relative names
+*
+* Exit codes of the runs see batch.h.
+*
+* (The emulator keeps its state in shared memory and runs threads, so
+* a fork() of a booted emulator would share its memory and lose its
+* threads. A snapshot taken after the boot and loaded by each run costs
+* about the same and keeps the runs apart.)
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+/***********************************************************************
+* defines
+***********************************************************************/
+#define	MAXINSTANCE	100	// as in common.h
+#define	MAXDISK		2	// DKA and DKB
+#define	MAXARGS		20
+#define	NAMELEN		1024
+#define	LINELEN		200
+
+#define	SNAPNAME	"boot.snap"
+#define	SPONAME		"spo.txt"
+#define	DECKNAME	"deck.card"
+
+/***********************************************************************
+* options
+***********************************************************************/
+static char emulator[NAMELEN];
+static char ininame[NAMELEN];
+static const char *workdir = "jobs";
+static char bootdir[NAMELEN];
+static const char *bootopts = "";
+static const char *jobopts = "";
+static const char *snapshot;
+static const char *deckdir;
+static int njobs;
+static int instance = 1;
+
+/***********************************************************************
+* disk files named in the ini file
+***********************************************************************/
+static char disk[MAXDISK][NAMELEN];
+static int ndisk;
+
+/***********************************************************************
+* the runs
+***********************************************************************/
+typedef struct job {
+	char		name[NAMELEN];	// deck file name
+	char		dir[NAMELEN];	// its directory
+	pid_t		pid;		// 0 = not running
+	int		slot;		// 0..njobs-1, gives the instance
+	struct timespec	start;
+	int		status;		// exit code
+} JOB_T;
+
+static JOB_T *job;
+static int njob;
+static FILE *summary;
+
+/***********************************************************************
+* seconds since t0
+***********************************************************************/
+static double elapsed(const struct timespec *t0) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - t0->tv_sec) + (t.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+/***********************************************************************
+* dir/name into buf of NAMELEN
+***********************************************************************/
+static int join(char *buf, const char *dir, const char *name) {
+	if (snprintf(buf, NAMELEN, "%s/%s", dir, name) >= NAMELEN) {
+		fprintf(stderr, "jobrun: %s/%s is too long\n", dir, name);
+		return -1;
+	}
+	return 0;
+}
+
+/***********************************************************************
+* create a directory and its parents
+***********************************************************************/
+static int make_dirs(const char *path) {
+	char buf[NAMELEN], *p;
+
+	snprintf(buf, sizeof buf, "%s", path);
+	for (p = buf + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = 0;
+		if (mkdir(buf, 0777) < 0 && errno != EEXIST)
+			goto fail;
+		*p = '/';
+	}
+	if (mkdir(buf, 0777) < 0 && errno != EEXIST)
+		goto fail;
+	return 0;
+fail:
+	perror(buf);
+	return -1;
+}
+
+/***********************************************************************
+* copy a file, shares the blocks where the file system can do that
+***********************************************************************/
+static int copy_file(const char *from, const char *to) {
+	char buf[65536], dir[NAMELEN];
+	int in, out, n = 0;
+
+	snprintf(dir, sizeof dir, "%s", to);
+	if (make_dirs(dirname(dir)) < 0)
+		return -1;
+	in = open(from, O_RDONLY);
+	if (in < 0) {
+		perror(from);
+		return -1;
+	}
+	out = open(to, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+	if (out < 0) {
+		perror(to);
+		close(in);
+		return -1;
+	}
+#ifdef FICLONE
+	if (ioctl(out, FICLONE, in) == 0)
+		goto done;
+#endif
+	while ((n = read(in, buf, sizeof buf)) > 0) {
+		if (write(out, buf, n) != n) {
+			n = -1;
+			break;
+		}
+	}
+	if (n < 0)
+		perror(to);
+#ifdef FICLONE
+done:
+#endif
+	close(in);
+	if (close(out) < 0)
+		n = -1;
+	return n < 0 ? -1 : 0;
+}
+
+/***********************************************************************
+* find the disk files in the ini file
+***********************************************************************/
+static int read_ini(void) {
+	FILE *fp;
+	char buf[LINELEN], *p, *q;
+
+	fp = fopen(ininame, "r");
+	if (fp == NULL) {
+		perror(ininame);
+		return -1;
+	}
+	while (fgets(buf, sizeof buf, fp)) {
+		p = buf;
+		while (*p == ' ')
+			p++;
+		if (strncasecmp(p, "dk", 2) != 0)
+			continue;
+		// the FILE= word
+		for (; *p; p++) {
+			if ((p == buf || p[-1] == ' ') && strncasecmp(p, "file=", 5) == 0)
+				break;
+		}
+		if (*p == 0)
+			continue;
+		p += 5;
+		for (q = p; *q > ' '; q++)
+			;
+		*q = 0;
+		if (*p == 0)
+			continue;
+		if (*p == '/') {
+			printf("jobrun: %s is shared by all runs\n", p);
+			continue;
+		}
+		if (ndisk >= MAXDISK) {
+			printf("jobrun: more than %d disk files\n", MAXDISK);
+			fclose(fp);
+			return -1;
+		}
+		snprintf(disk[ndisk++], NAMELEN, "%s", p);
+	}
+	fclose(fp);
+	return 0;
+}
+
+/***********************************************************************
+* start one emulator in directory dir
+* its output goes to spo.txt there
+***********************************************************************/
+static pid_t start_emulator(const char *dir, int inst, const char *opts,
+	const char *restore, const char *last) {
+	const char *argv[MAXARGS];
+	char ibuf[12], obuf[LINELEN];
+	int argc = 0, fd;
+	pid_t pid;
+
+	snprintf(ibuf, sizeof ibuf, "%d", inst);
+	argv[argc++] = emulator;
+	argv[argc++] = "-b";
+	argv[argc++] = "-n";
+	argv[argc++] = ibuf;
+	argv[argc++] = "-i";
+	argv[argc++] = ininame;
+	if (restore) {
+		argv[argc++] = "-r";
+		argv[argc++] = restore;
+	}
+	if (opts[0]) {
+		snprintf(obuf, sizeof obuf, "BATCH %s", opts);
+		argv[argc++] = obuf;
+	}
+	argv[argc++] = last;
+	argv[argc] = NULL;
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+	if (pid > 0)
+		return pid;
+
+	// child
+	if (chdir(dir) < 0) {
+		perror(dir);
+		_exit(2);
+	}
+	fd = open(SPONAME, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+	if (fd < 0) {
+		perror(SPONAME);
+		_exit(2);
+	}
+	dup2(fd, 1);
+	dup2(fd, 2);
+	close(fd);
+	fd = open("/dev/null", O_RDONLY);
+	dup2(fd, 0);
+	close(fd);
+	execv(emulator, (char **)argv);
+	perror(emulator);
+	_exit(2);
+}
+
+/***********************************************************************
+* wait for an emulator, returns its exit code as the shell shows it
+***********************************************************************/
+static int wait_emulator(pid_t *pid) {
+	int status;
+
+	*pid = wait(&status);
+	if (*pid < 0)
+		return -1;
+	if (WIFEXITED(status))
+		return WEXITSTATUS(status);
+	if (WIFSIGNALED(status))
+		return 128 + WTERMSIG(status);
+	return -1;
+}
+
+/***********************************************************************
+* boot once and save the snapshot
+***********************************************************************/
+static int boot(char *snapname) {
+	char to[NAMELEN];
+	struct timespec t0;
+	struct stat st;
+	pid_t pid;
+	int i, code;
+
+	if (make_dirs(bootdir) < 0)
+		return -1;
+	for (i = 0; i < ndisk; i++) {
+		if (join(to, bootdir, disk[i]) < 0 || copy_file(disk[i], to) < 0)
+			return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	printf("jobrun: booting in %s\n", bootdir);
+	if (start_emulator(bootdir, instance, bootopts, NULL, "BATCH SAVE=" SNAPNAME) < 0)
+		return -1;
+	code = wait_emulator(&pid);
+	if (join(to, bootdir, SNAPNAME) < 0)
+		return -1;
+	if (code == 2 || code < 0 || stat(to, &st) < 0) {
+		printf("jobrun: boot failed with exit code %d, see %s/" SPONAME "\n", code, bootdir);
+		return -1;
+	}
+	if (realpath(to, snapname) == NULL) {
+		perror(to);
+		return -1;
+	}
+	printf("jobrun: booted in %.2f s, exit code %d\n", elapsed(&t0), code);
+	return 0;
+}
+
+/***********************************************************************
+* prepare the directory of a run and start it
+***********************************************************************/
+static int start_job(JOB_T *j, const char *snapname) {
+	char from[NAMELEN], to[NAMELEN], deck[NAMELEN];
+	int i;
+
+	if (join(j->dir, workdir, j->name) < 0 || make_dirs(j->dir) < 0)
+		return -1;
+	// private disks, as the boot left them
+	for (i = 0; i < ndisk; i++) {
+		if (join(from, bootdir, disk[i]) < 0 || join(to, j->dir, disk[i]) < 0
+			|| copy_file(from, to) < 0)
+			return -1;
+	}
+	// the deck under a short name, the option length is limited
+	if (join(from, deckdir, j->name) < 0 || join(to, j->dir, DECKNAME) < 0)
+		return -1;
+	if (realpath(from, deck) == NULL) {
+		perror(from);
+		return -1;
+	}
+	unlink(to);
+	if (symlink(deck, to) < 0) {
+		perror(to);
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &j->start);
+	j->pid = start_emulator(j->dir, instance + 1 + j->slot, jobopts,
+		snapname, "BATCH DECK=" DECKNAME);
+	if (j->pid < 0) {
+		j->pid = 0;
+		return -1;
+	}
+	return 0;
+}
+
+/***********************************************************************
+* a run has ended, list what it wrote
+***********************************************************************/
+static void end_job(JOB_T *j, int code) {
+	struct dirent **list;
+	int n, i, k, d, known;
+
+	j->pid = 0;
+	j->status = code;
+	fprintf(summary, "deck=%s status=%d seconds=%.2f dir=%s output=",
+		j->name, code, elapsed(&j->start), j->dir);
+	n = scandir(j->dir, &list, NULL, alphasort);
+	for (i = 0, k = 0; i < n; i++) {
+		known = list[i]->d_name[0] == '.'
+			|| strcmp(list[i]->d_name, SPONAME) == 0
+			|| strcmp(list[i]->d_name, DECKNAME) == 0;
+		for (d = 0; d < ndisk; d++)
+			if (strcmp(list[i]->d_name, disk[d]) == 0)
+				known = true;
+		if (!known)
+			fprintf(summary, k++ ? ",%s" : "%s", list[i]->d_name);
+		free(list[i]);
+	}
+	if (n >= 0)
+		free(list);
+	fprintf(summary, "\n");
+	fflush(summary);
+	printf("jobrun: %s ended with exit code %d\n", j->name, code);
+}
+
+/***********************************************************************
+* only regular files are decks
+***********************************************************************/
+static int deck_filter(const struct dirent *d) {
+	char path[NAMELEN];
+	struct stat st;
+
+	if (d->d_name[0] == '.')
+		return 0;
+	return join(path, deckdir, d->d_name) == 0 && stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+/***********************************************************************
+* the MAIN program
+***********************************************************************/
+int main(int argc, char *argv[]) {
+	char snapname[NAMELEN], path[NAMELEN];
+	struct dirent **list;
+	struct timespec t0;
+	int opt, i, next, running, code, failed = 0;
+	int *busy;
+	pid_t pid;
+
+	njobs = sysconf(_SC_NPROCESSORS_ONLN);
+	snprintf(path, sizeof path, "%s", argv[0]);
+	join(emulator, dirname(path), "emulator2.exe");
+
+	while ((opt = getopt(argc, argv, "i:e:w:j:n:B:J:r:")) != -1) {
+		switch (opt) {
+		case 'i':
+			if (realpath(optarg, ininame) == NULL) {
+				perror(optarg);
+				exit(2);
+			}
+			break;
+		case 'e':
+			snprintf(emulator, sizeof emulator, "%s", optarg);
+			break;
+		case 'w':
+			workdir = optarg;
+			break;
+		case 'j':
+			njobs = atoi(optarg);
+			break;
+		case 'n':
+			instance = atoi(optarg);
+			break;
+		case 'B':
+			bootopts = optarg;
+			break;
+		case 'J':
+			jobopts = optarg;
+			break;
+		case 'r':
+			snapshot = optarg;
+			break;
+		default: /* '?' */
+			fprintf(stderr,
+				"Usage: %s [options] -i <ini file> <deck directory>\n"
+				"\t-e\t<file>\t\temulator (emulator2.exe next to %s)\n"
+				"\t-w\t<dir>\t\twork directory (jobs)\n"
+				"\t-j\t<count>\t\truns at a time (number of processors)\n"
+				"\t-n\t<instance>\tinstance of the boot, the runs use the following (1)\n"
+				"\t-B\t<options>\tBATCH options of the boot, e.g. \"EOJ=H/L TIME=300\"\n"
+				"\t-J\t<options>\tBATCH options of each run, e.g. \"EOJ=_EOJ TIME=600\"\n"
+				"\t-r\t<file>\t\tstart from this snapshot, no boot\n"
+				, argv[0], argv[0]);
+			exit(2);
+		}
+	}
+	if (ininame[0] == 0 || optind >= argc) {
+		fprintf(stderr, "%s: ini file or deck directory missing\n", argv[0]);
+		exit(2);
+	}
+	if (njobs < 1 || instance < 0 || instance + njobs >= MAXINSTANCE) {
+		fprintf(stderr, "%s: instances %d..%d must be below %d\n",
+			argv[0], instance, instance + njobs, MAXINSTANCE);
+		exit(2);
+	}
+	if (realpath(emulator, path) == NULL) {
+		perror(emulator);
+		exit(2);
+	}
+	strcpy(emulator, path);
+	deckdir = argv[optind];
+
+	// the decks
+	njob = scandir(deckdir, &list, deck_filter, alphasort);
+	if (njob < 0) {
+		perror(deckdir);
+		exit(2);
+	}
+	if (njob == 0) {
+		fprintf(stderr, "%s: no decks in %s\n", argv[0], deckdir);
+		exit(2);
+	}
+	job = (JOB_T *)calloc(njob, sizeof *job);
+	busy = (int *)calloc(njobs, sizeof *busy);
+	for (i = 0; i < njob; i++) {
+		snprintf(job[i].name, sizeof job[i].name, "%s", list[i]->d_name);
+		free(list[i]);
+	}
+	free(list);
+
+	if (read_ini() < 0 || join(bootdir, workdir, "boot") < 0 || make_dirs(workdir) < 0)
+		exit(2);
+	if (snapshot) {
+		if (realpath(snapshot, snapname) == NULL) {
+			perror(snapshot);
+			exit(2);
+		}
+		// the runs copy their disks from there
+		for (i = 0; i < ndisk; i++) {
+			if (join(path, bootdir, disk[i]) < 0 || copy_file(disk[i], path) < 0)
+				exit(2);
+		}
+	} else if (boot(snapname) < 0) {
+		exit(2);
+	}
+
+	if (join(path, workdir, "summary.txt") < 0)
+		exit(2);
+	summary = fopen(path, "w");
+	if (summary == NULL) {
+		perror(path);
+		exit(2);
+	}
+
+	// keep njobs runs going
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	next = running = 0;
+	while (next < njob || running > 0) {
+		if (next < njob && running < njobs) {
+			for (i = 0; busy[i]; i++)
+				;
+			job[next].slot = i;
+			if (start_job(&job[next], snapname) < 0) {
+				end_job(&job[next], 2);
+			} else {
+				printf("jobrun: %s started as instance %d\n",
+					job[next].name, instance + 1 + i);
+				busy[i] = true;
+				running++;
+			}
+			next++;
+			continue;
+		}
+		code = wait_emulator(&pid);
+		if (pid < 0) {
+			perror("wait");
+			break;
+		}
+		for (i = 0; i < njob; i++) {
+			if (job[i].pid == pid) {
+				busy[job[i].slot] = false;
+				running--;
+				end_job(&job[i], code);
+				break;
+			}
+		}
+	}
+	fclose(summary);
+
+	for (i = 0; i < njob; i++)
+		if (job[i].status != 0)
+			failed++;
+	printf("jobrun: %d runs in %.2f s, %d did not end with EOJ, see %s/summary.txt\n",
+		njob, elapsed(&t0), failed, workdir);
+	return failed ? 1 : 0;
+}
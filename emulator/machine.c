@@ -0,0 +1,941 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* machine context
+*
+* see machine.h
+*
+* The CPU side of a machine: instruction execution driver, traces,
+* commands posted to the CPU thread, 60 Hz timer thread, and the
+* create/configure/start/run/destroy API.
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "common.h"
+#include "io.h"
+#include "telemetry.h"
+#include "bintrace.h"
+#include "snapshot.h"
+#include "replay.h"
+#include "batch.h"
+#include "machine.h"
+
+#define IAR_WATCHDOG 100000	/* instructions with IRQ pending until we stop */
+#define	NPOST	16		/* commands waiting for the CPU thread */
+#define	POSTLEN	264		/* longest command */
+
+/* debug flags: the same for all machines of the process */
+int dotrcmem     = false;       /* trace memory accesses */
+int dotrcins     = false;       /* trace instruction execution */
+
+// never set
+int dotrcmat     = false;       /* trace math operations */
+int emode        = false;       /* emode math */
+
+/* end all machines at the next instruction, see term_signal */
+volatile BIT term_request;
+
+/***********************************************************************
+* a command posted to the CPU thread
+***********************************************************************/
+struct post {
+	int	(*func)(const char *arg);
+	char	arg[POSTLEN];
+};
+
+/***********************************************************************
+* read the current timer value
+***********************************************************************/
+WORD48 readTimer(CPU *cpu) {
+        WORD48 result = 0;
+
+        if (CC->CCI03F)
+                result =  CC->TM | 0100;
+        else
+                result =  CC->TM;
+        return result;
+}
+
+/***********************************************************************
+* convert a relative address into a string
+* the buffer is per thread
+***********************************************************************/
+const char *relsym(unsigned offset, BIT cEnabled) {
+        static __thread char buf[32];
+	CPU *cpu = P[0];
+	char (*name)[29] = machine->name;
+
+        if (cpu->bSALF) {
+                // subroutine level - check upper 3 bits of the 10 bit offset
+                switch ((offset >> 7) & 7) {
+                case 0:
+                case 1:
+                case 2:
+                case 3:
+                        // pattern 0xx xxxxxxx - R+ relative
+                        // reach 0..511
+                        offset &= 0x1ff;
+prtuse:
+                        if (offset < MAXNAME && name[offset][0] != 0) {
+                                // do we have a memory address?
+                                if (MAIN[(cpu->rR) + offset] & MASK_FLAG)
+                                        sprintf(buf, "%s=%05llo", name[offset], MAIN[(cpu->rR) + offset] & MASK_ADDR);
+                                else
+                                        sprintf(buf, "%s", name[offset]);
+                                return buf;
+                        }
+                        sprintf(buf, "PRT[%03o]", offset);
+                        return buf;
+                case 4:
+                case 5:
+                        // pattern 10x xxxxxxx - F+ or (R+7)+ relative
+                        // reach 0..255
+                        offset &= 0xff;
+                        if (cpu->bMSFF) {
+                                // during function parameter loading its (R+7)+
+                                sprintf(buf, "PARAMETERLOADING %u", offset);
+                                return buf;
+                        } else {
+                                // inside function its F+
+                                sprintf(buf, "LOCAL %u", offset);
+                                return buf;
+                        }
+                case 6:
+                        // pattern 110 xxxxxxx - C+ relative on read, R+ on write
+                        // reach 0..127
+                        offset &= 0x7f;
+                        if (cEnabled) {
+                                sprintf(buf, "CODE+%u", offset);
+                                return buf;
+                        } else {
+                                goto prtuse;
+                        }
+                case 7:
+                        // pattern 111 xxxxxxx - F- or (R+7)- relative
+                        // reach 0..127 (negative direction)
+                        offset &= 0x7f;
+                        if (cpu->bMSFF) {
+                                sprintf(buf, "PARAMETER %u", offset);
+                                return buf;
+                        } else {
+                                sprintf(buf, "PARAMETER %u", offset);
+                                return buf;
+                        }
+                } // switch
+        } else {
+                // program level - all 10 bits are offset
+                offset &= 0x3ff;
+                goto prtuse;
+        }
+        return "should not happen";
+}
+
+/***********************************************************************
+* find and print the best matching label for a given code address
+***********************************************************************/
+void codesym(ADDR15 c, WORD2 l) {
+	MACHINE *m = machine;
+        unsigned bestmatch = 0;
+        unsigned index;
+        ADDR15 addr, bestaddr = 0;
+        // search for symbol
+        for (index = 0; index<MAXNAME; index++) {
+                if (m->name[index][0] != 0) {
+                        // do we have a memory address?
+                        if (MAIN[index] & MASK_FLAG)
+                                addr = MAIN[index] & MASK_ADDR;
+                        else
+                                addr = 0;
+                        if (addr <= c && bestaddr < addr) {
+                                bestmatch = index;
+                                bestaddr = addr;
+                        }
+                }
+        }
+        if (bestmatch > 0)
+                fprintf(m->tracefp, "%08llu %s+%04o (%05o:%o) ",
+			m->instr_count, m->name[bestmatch],
+			((c - bestaddr) << 2) + l, c, l);
+        else
+                fprintf(m->tracefp, "%08llu (%05o:%o) ",
+			m->instr_count, c, l);
+}
+
+/***********************************************************************
+* disassemble one instruction
+***********************************************************************/
+void printinstr(WORD12 code, BIT cwmf)
+{
+	FILE *tracefp = machine->tracefp;
+        const INSTRUCTION *ip;
+        // search instruction table
+        ip = instruction_table;
+        while (ip->name != 0) {
+                switch (ip->outtype) {
+                case OP_ASIS:
+                case OP_BRAS:
+                case OP_BRAW:
+                        if (ip->cwmf == cwmf && ip->code == code) {
+                                fprintf(tracefp, "%-4.4s        %04o",
+					ip->name, code);
+                                return;
+                        }
+                        break;
+                case OP_TOP4:
+                        if (ip->cwmf == cwmf && ip->code == (code & 0x0ff)) {
+                                fprintf(tracefp, "%-4.4s  %4u  %04o",
+					ip->name, code >> 8, code);
+                                return;
+                        }
+                        break;
+                case OP_TOP6:
+                        if (ip->cwmf == cwmf && ip->code == (code & 0x03f)) {
+                                fprintf(tracefp, "%-4.4s  %02o    %04o",
+					ip->name, code >> 6, code);
+                                return;
+                        }
+                        break;
+                case OP_TOP10:
+                        if (ip->cwmf == cwmf && ip->code == (code & 0x003)) {
+                                fprintf(tracefp, "%-4.4s  %04o  %04o  (%s)",
+					ip->name, code >> 2, code,
+					relsym(code >> 2, true));
+                                return;
+                        }
+                        break;
+                default:
+                        ;
+                }
+                ip++;
+        }
+        fprintf(tracefp, "unknown instruction %04o", code);
+}
+
+/***********************************************************************
+* convert a machine word into 8 two digit octal value and into
+* 8 character ASCII string: "OO OO OO OO OO OO OO OO AAAAAAAA"
+* the buffer is per thread
+***********************************************************************/
+char *word2string(WORD48 w)
+{
+        static __thread char buf[33];
+        int i;
+        for (i=7; i>=0; i--) {
+                buf[3*i  ] = '0'+((w>>3) & 7);
+                buf[3*i+1] = '0'+((w   ) & 7);
+                buf[3*i+2] = ' ';
+                buf[24+i] = translatetable_bic2ascii[w&077];
+                w>>=6;
+        }
+        buf[32]=0;
+        return buf;
+}
+
+/***********************************************************************
+* convert a Loop Control Word into a string
+* the buffer is per thread
+***********************************************************************/
+char *lcw2string(WORD48 w)
+{
+        static __thread char buf[33];
+        if (w & MASK_CREG) {
+                sprintf(buf, "Loop(%05llo:%llo Rpt=%03llo Prev=%05llo)",
+                        (w & MASK_CREG) >> SHFT_CREG,
+                        (w & MASK_LREG) >> SHFT_LREG,
+                        (w & MASK_LCWrpt) >> SHFT_LCWrpt,
+                        (w & MASK_FREG) >> SHFT_FREG);
+                buf[32]=0;
+        } else {
+                buf[0]=0;
+        }
+        return buf;
+}
+
+/***********************************************************************
+* file name of the machine: base.ext for instance 0, else base-n.ext
+***********************************************************************/
+void machine_file(char *buf, unsigned len, const char *base, const char *ext) {
+	if (machine->instance == 0)
+		snprintf(buf, len, "%s.%s", base, ext);
+	else
+		snprintf(buf, len, "%s-%u.%s", base, machine->instance, ext);
+}
+
+/***********************************************************************
+* do a complete core momory dump in readable text form
+***********************************************************************/
+void memdump(CPU *cpu) {
+        WORD48 w;
+        ADDR15 memaddr = 0;
+        char buf[132];
+        char *bufp;
+	char filename[40];
+	FILE *mfp;
+
+	machine_file(filename, sizeof filename, "coredump", "txt");
+	mfp = fopen(filename, "w");
+        if (mfp == NULL) {
+                perror(filename);
+                return;
+        }
+
+	if (cpu) {
+		fprintf(mfp, "\tA=%016llo(%u) GH=%02o Y=%02o M=%05o F=%05o N=%d NCSF=%u T=%04o\n",
+			cpu->rA, cpu->bAROF,
+			cpu->rGH,
+			(WORD6)cpu->rY, cpu->rM,
+			cpu->rF,
+			cpu->rN, cpu->bNCSF, cpu->rT);
+		fprintf(mfp, "\tB=%016llo(%u) KV=%02o Z=%02o S=%05o R=%05o MSFF=%u SALF=%u\n",
+			cpu->rB, cpu->bBROF,
+			cpu->rKV,
+			cpu->rZ, cpu->rS,
+			cpu->rR,
+			cpu->bMSFF, cpu->bSALF);
+	}
+
+        do {
+                int i, j;
+                bufp = buf;
+                bufp += sprintf(bufp, "%05o ", memaddr);
+                for (i=0; i<4; i++) {
+                        w = MAIN[memaddr+i];
+                        for (j=0; j<8; j++) {
+                                bufp += sprintf(bufp, "%02llo", (w>>42)&077);
+                                w<<=6;
+                        }
+                        *bufp++ = ' ';
+                }
+                for (i=0; i<4; i++) {
+                        w = MAIN[memaddr+i];
+                        for (j=0; j<8; j++) {
+                                *bufp++ = translatetable_bic2ascii[(w>>42)&077];
+                                w<<=6;
+                        }
+                        *bufp++ = ' ';
+                }
+                *bufp++ = '\n';
+                *bufp++ = 0;
+                fputs(buf, mfp);
+                memaddr = (memaddr + 4) & 077777;
+        } while (memaddr != 0);
+        fclose (mfp);
+}
+
+/***********************************************************************
+* Starts the processor
+***********************************************************************/
+void start(CPU *cpu)
+{
+	prepMessage(cpu); printf("start\n");
+	cpu->bHLTF = false;
+}
+
+/***********************************************************************
+* Stops running the processor
+***********************************************************************/
+void stop(CPU *cpu)
+{
+	prepMessage(cpu); printf("stop\n");
+	cpu->rT = 0;
+	cpu->bTROF = false;	// idle the processor
+	cpu->bPROF = false;
+	cpu->bHLTF = true;
+}
+
+/***********************************************************************
+* Presets the processor registers for a start at C=runAddr
+***********************************************************************/
+void preset(CPU *cpu, ADDR15 runAddr)
+{
+	prepMessage(cpu); printf("preset to %05o\n", runAddr);
+        cpu->rC = runAddr;
+        cpu->rL = 0;
+        cpu->rT = 0;
+        cpu->bPROF = false;	// cause memory read
+        cpu->bTROF = false;	// cause instrction fetch
+        cpu->rR = 0;
+        cpu->rS = 0;
+	cpu->bHLTF = true;
+}
+
+/***********************************************************************
+* Instruction execution driver for the B5500 processor.
+* This routine assumes the C:L registers are set up.
+* if TROF is set an instruction must be in T
+* and C:L must point to the next instruction.
+* if PROF is set, the current program word must be in P.
+***********************************************************************/
+void run(CPU *cpu)
+{
+	// execute one instruction
+	sim_instr(cpu);
+
+#if 0
+	// check for any registers gone wild
+#define CHECK(R,M,T) if((cpu->rR) & ~(M))printf("*\tCHECK "T" = %llo\n", (WORD48)(cpu->rR))
+	CHECK(A, MASK_WORD48, "A");
+	CHECK(B, MASK_WORD48, "B");
+	CHECK(C, MASK_ADDR15, "C");
+	CHECK(F, MASK_ADDR15, "F");
+	CHECK(M, MASK_ADDR15, "M");
+	CHECK(P, MASK_WORD48, "P");
+	CHECK(R, MASK_ADDR15, "R");
+	CHECK(S, MASK_ADDR15, "S");
+#endif
+
+	// check for IAR not serviced for nnn instructions
+	if (CC->IAR) {
+		machine->iar_count++;
+		if (machine->iar_count == IAR_WATCHDOG) {
+			// do a memory dump and stop, the flight recorder
+			// with the way here is written on halt
+			prepMessage(cpu); printf("IAR %02o not serviced\n", CC->IAR);
+			memdump(cpu);
+			stop(cpu);
+		}
+	} else {
+		machine->iar_count = 0;
+	}
+}
+
+/***********************************************************************
+* called back from emulator code when an instruction has been fetched
+* into T
+***********************************************************************/
+void sim_traceinstr(CPU *cpu) {
+	MACHINE *m = machine;
+
+	if (m->dobintrace || m->doflight)
+		bintrace_fetch(m->bintrace, cpu, m->instr_count);
+	if (dotrcins) {
+		ADDR15 c;
+		WORD2 l;
+		c = cpu->rC;
+		l = cpu->rL;
+		if (l == 0) {
+			l = 3;
+			c--;
+		} else {
+			l--;
+		}
+		// start a new line and print a symbolic name (if available)
+		// and the raw C:L values
+		fprintf(m->tracefp, "\n");
+		codesym(c, l);
+		// print the instruction itself
+		printinstr(cpu->rT, cpu->bCWMF);
+		// end the line
+		fprintf(m->tracefp, "\n");
+	}
+}
+
+/***********************************************************************
+* print all useful registers
+* word mode and char mode are different printouts
+***********************************************************************/
+void sim_printregs(CPU *cpu) {
+	FILE *tracefp = machine->tracefp;
+
+	if (cpu->bCWMF) {
+		fprintf(tracefp, "\tSI(M:GH)=%05o:%02o A=%s (%u) Y=%02o\n",
+			cpu->rM, cpu->rGH,
+			word2string(cpu->rA), cpu->bAROF,
+			(WORD6)cpu->rY);
+		fprintf(tracefp, "\tDI(S:KV)=%05o:%02o B=%s (%u) Z=%02o\n",
+			cpu->rS, cpu->rKV,
+			word2string(cpu->rB), cpu->bBROF,
+			cpu->rZ);
+		fprintf(tracefp, "\tR=%05o N=%d F=%05o TFFF=%u SALF=%u NCSF=%u T=%04o\n",
+			cpu->rR, cpu->rN, cpu->rF,
+			cpu->bTFFF, cpu->bSALF, cpu->bNCSF, cpu->rT);
+		fprintf(tracefp, "\tX=__%014llo %s\n", cpu->rX, lcw2string(cpu->rX));
+	} else {
+		fprintf(tracefp, "\tA=%016llo(%u) GH=%02o Y=%02o M=%05o F=%05o N=%d NCSF=%u T=%04o\n",
+			cpu->rA, cpu->bAROF,
+			cpu->rGH,
+			(WORD6)cpu->rY, cpu->rM,
+			cpu->rF,
+			cpu->rN, cpu->bNCSF, cpu->rT);
+		fprintf(tracefp, "\tB=%016llo(%u) KV=%02o Z=%02o S=%05o R=%05o MSFF=%u SALF=%u\n",
+			cpu->rB, cpu->bBROF,
+			cpu->rKV,
+			cpu->rZ, cpu->rS,
+			cpu->rR,
+			cpu->bMSFF, cpu->bSALF);
+	}
+}
+
+/***********************************************************************
+* collect the NAME entries for a binary trace file header
+* the caller frees *psym
+***********************************************************************/
+static unsigned collect_symbols(BINTRACE_SYM **psym) {
+	MACHINE *m = machine;
+	BINTRACE_SYM *sym;
+	unsigned index, nsym = 0;
+
+	sym = (BINTRACE_SYM *)malloc(MAXNAME * sizeof *sym);
+	*psym = sym;
+	if (sym == NULL)
+		return 0;
+	for (index = 1; index < MAXNAME; index++) {
+		if (m->name[index][0] == 0)
+			continue;
+		sym[nsym].index = index;
+		sym[nsym].addr = (MAIN[index] & MASK_FLAG) ? MAIN[index] & MASK_ADDR : 0;
+		strncpy(sym[nsym].name, m->name[index], sizeof sym[nsym].name);
+		nsym++;
+	}
+	return nsym;
+}
+
+/***********************************************************************
+* start the binary trace, closed by machine_destroy
+***********************************************************************/
+int start_bintrace(const char *filename) {
+	BINTRACE_SYM *sym;
+	unsigned nsym = collect_symbols(&sym);
+	int res;
+
+	res = bintrace_open(machine->bintrace, filename, sym, nsym);
+	free(sym);
+	if (res < 0)
+		return -1;
+	machine->dobintrace = true;
+	return 0;
+}
+
+/***********************************************************************
+* write the flight recorder
+* called by the CPU thread between instructions
+***********************************************************************/
+void dump_flight(const char *why) {
+	BINTRACE_SYM *sym;
+	unsigned nsym;
+	char filename[40];
+	int n;
+
+	if (!machine->doflight)
+		return;
+	nsym = collect_symbols(&sym);
+	machine_file(filename, sizeof filename, FLIGHT_FILE, "bin");
+	n = flight_dump(machine->bintrace, filename, sym, nsym);
+	free(sym);
+	if (n >= 0)
+		printf("flight recorder (%s): %d instructions written to %s\n",
+			why, n, filename);
+}
+
+/***********************************************************************
+* CPU commands
+***********************************************************************/
+static int cpu_flight(const char *v, void *) {
+	MACHINE *m = machine;
+	unsigned len = strtoul(v, NULL, 10);
+
+	if (m->cpu_running) {
+		printf("$FLIGHT can only be set before the CPU runs\n");
+		return 2; // FATAL
+	}
+	if (flight_init(m->bintrace, len) < 0)
+		return 2; // FATAL
+	m->doflight = len > 0;
+	return 0; // OK
+}
+
+static int cpu_clock(const char *v, void *) {
+	MACHINE *m = machine;
+	char *end;
+	unsigned n = strtoul(v, &end, 10);
+
+	if (m->cpu_running) {
+		printf("$CLOCK can only be set before the CPU runs\n");
+		return 2; // FATAL
+	}
+	if (*v == 0 || *end != 0) {
+		printf("$CLOCK needs instructions per tick, 0 for the wall clock\n");
+		return 2; // FATAL
+	}
+	m->vclock_left = n;
+	m->vclock = n;
+	return 0; // OK
+}
+
+static int cpu_dump(const char *v, void *) {
+	// the CPU thread writes it
+	machine->flight_request = true;
+	return 0; // OK
+}
+
+static const command_t cpu_commands[] = {
+	{"CPU", NULL},
+	{"FLIGHT", cpu_flight},
+	{"CLOCK", cpu_clock},
+	{"DUMP", cpu_dump},
+	{NULL, NULL},
+};
+
+/***********************************************************************
+* execute up to count instructions, stops early when the CPU halts
+* or the process is asked to end
+* returns the number of instructions executed
+***********************************************************************/
+unsigned long long execute_slice(unsigned long long count) {
+	MACHINE *m = machine;
+	CPU *cpu = P[0];
+	unsigned long long done;
+
+	for (done = 0; done < count && !cpu->bHLTF && !term_request; done++) {
+		m->instr_count++;
+
+		run(cpu);
+		if (dotrcins)
+			sim_printregs(cpu);
+		if (m->dobintrace || m->doflight)
+			bintrace_regs(m->bintrace, cpu);
+		if (m->flight_request) {
+			m->flight_request = false;
+			dump_flight("request");
+		}
+		if (m->cpu_post_due)
+			cpu_post_poll();
+		if (m->snap_request)
+			snapshot_poll();
+		if (m->replay_due || m->instr_count == m->replay_next)
+			replay_poll();
+		if (m->vclock && --m->vclock_left == 0) {
+			m->vclock_left = m->vclock;
+			timer_tick();
+		}
+		if (m->telemetry_due)
+			telemetry_publish();
+	}
+	return done;
+}
+
+/***********************************************************************
+* command parser
+***********************************************************************/
+int command_parser(const command_t *table, const char *op) {
+	const char *delim;
+	const char *equals;
+	int wlen, res;
+	char buffer[80];
+	const command_t *tp;
+
+next:
+	// remove leading blanks
+	while (*op == ' ')
+		op++;
+	while (*op != 0) {
+		// partition options into words
+		delim = strchrnul(op, ' ');
+		equals = strchrnul(op, '=');
+		if (equals >= delim) {
+			// single command without assignment
+			wlen = delim - op;
+		} else {
+			// with assigment
+			wlen = equals - op;
+		}
+		// search table for command
+		for (tp = table; tp->cmd; tp++) {
+			if ((int)strlen(tp->cmd) == wlen && strncasecmp(tp->cmd, op, wlen) == 0) {
+				// found the command, prepare parameter
+				memset(buffer, 0, sizeof buffer);
+				if (delim > equals) {
+					if (delim - equals >= (int)sizeof buffer) {
+						printf("argument too long\n");
+						return 2; // FATAL
+					}
+					memcpy(buffer, equals+1, delim - (equals+1));
+				}
+				// execute command if it has a function
+				if (tp->func)
+					res = (tp->func)(buffer, tp->data);
+				else
+					res = 0;
+				if (res)
+					return res; // some error
+				op = delim;
+				goto next;
+			}
+		}
+		// no match
+		printf("unknown command\n");
+		return 2; // FATAL
+	}
+	return 0; // OK
+}
+
+/***********************************************************************
+* handle an option/command by passing it to the proper "unit"
+***********************************************************************/
+int handle_option(const char *option) {
+	if (strncasecmp(option, "spo", 3) == 0) {
+                return spo_init(option); /* console emulation options */
+	} else if (strncasecmp(option, "snap", 4) == 0) {
+                return snapshot_init(option); /* machine snapshots */
+	} else if (strncasecmp(option, "batch", 5) == 0) {
+                return batch_init(option); /* headless batch mode */
+	} else if (strncasecmp(option, "cpu", 3) == 0) {
+                return command_parser(cpu_commands, option); /* processor options */
+	} else if (strncasecmp(option, "cr", 2) == 0) {
+                return cr_init(option);  /* card reader emulation options */
+	} else if (strncasecmp(option, "cp", 2) == 0) {
+                return cp_init(option);  /* card punch emulation options */
+	} else if (strncasecmp(option, "mt", 2) == 0) {
+                return mt_init(option); /* tape emulation options */
+	} else if (strncasecmp(option, "dr", 2) == 0) {
+                return dr_init(option); /* magnetic drum emulation options */
+	} else if (strncasecmp(option, "dk", 2) == 0) {
+                return dk_init(option); /* disk file emulation options */
+	} else if (strncasecmp(option, "lp", 2) == 0) {
+                return lp_init(option); /* printer emulation options */
+	} else if (strncasecmp(option, "dcc", 3) == 0) {
+                return dcc_init(option); /* data communications emulation options */
+	} else if (strncasecmp(option, "io", 2) == 0) {
+                return io_init(option); /* central control options */
+	}
+	printf("unknown component\n");
+	return 1; // WARNING
+}
+
+/***********************************************************************
+* commands from other threads (SPO input, autoexec, batch script) are
+* carried out by the CPU thread between two instructions, so no unit
+* is reconfigured in the middle of an instruction or an I/O
+***********************************************************************/
+void cpu_post(int (*func)(const char *arg), const char *arg) {
+	MACHINE *m = machine;
+	struct post *p;
+
+	pthread_mutex_lock(&m->post_mutex);
+	if (m->post_wp - m->post_rp >= NPOST) {
+		pthread_mutex_unlock(&m->post_mutex);
+		printf("$COMMAND LOST\r\n");
+		return;
+	}
+	p = m->post + m->post_wp++ % NPOST;
+	p->func = func;
+	snprintf(p->arg, sizeof p->arg, "%s", arg);
+	m->cpu_post_due = true;
+	pthread_mutex_unlock(&m->post_mutex);
+}
+
+/***********************************************************************
+* carry out the posted commands, called by the CPU thread
+***********************************************************************/
+void cpu_post_poll(void) {
+	MACHINE *m = machine;
+	struct post p;
+
+	pthread_mutex_lock(&m->post_mutex);
+	while (m->post_rp != m->post_wp) {
+		p = m->post[m->post_rp++ % NPOST];
+		pthread_mutex_unlock(&m->post_mutex);
+		(*p.func)(p.arg);
+		pthread_mutex_lock(&m->post_mutex);
+	}
+	m->cpu_post_due = false;
+	pthread_mutex_unlock(&m->post_mutex);
+}
+
+/***********************************************************************
+* 60 Hz timer thread of a machine
+* sleeps to absolute times, so the ticks do not drift
+***********************************************************************/
+static void *timer_function(void *p) {
+	MACHINE *m = (MACHINE *)p;
+	struct timespec next;
+
+	machine_bind(m);
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (m->timer_running) {
+		next.tv_nsec += 16666667; // 16.666667ms ~ 60 Hz
+		if (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+			;
+		if (m->timer_running)
+			timer60hz();
+	}
+	return NULL;
+}
+
+/***********************************************************************
+* create a machine with cleared memory and processors and all units
+* in their initial state, and bind it to the calling thread
+* returns NULL when the shares or a unit cannot be set up
+***********************************************************************/
+MACHINE *machine_create(unsigned instance, BIT console) {
+	MACHINE *m;
+	CPU *cpu;
+
+	m = (MACHINE *)calloc(1, sizeof *m);
+	if (m == NULL) {
+		perror("machine");
+		return NULL;
+	}
+	m->console = console;
+	if (b5500_init_shares(m, instance, true) < 0) {
+		free(m);
+		return NULL;
+	}
+	machine_bind(m);
+
+        memset((void*)MAIN, 0, MAXMEM*sizeof(WORD48));
+
+	// P2
+        cpu = P[1];
+        memset((void*)cpu, 0, sizeof(CPU));
+        strcpy((char*)cpu->id, "P2");
+        cpu->acc.id = cpu->id;
+        cpu->isP1 = false;
+
+	// P1
+        cpu = P[0];
+        memset((void*)cpu, 0, sizeof(CPU));
+        strcpy((char*)cpu->id, "P1");
+        cpu->acc.id = cpu->id;
+        cpu->isP1 = true;
+
+	// clear CC
+	memset((void*)CC, 0, sizeof(*CC));
+
+	// clear telemetry, panels wait for the first snapshot
+	memset((void*)TM, 0, sizeof(*TM));
+	TM->rate = TELEMETRY_RATE;
+
+	// make sure P2 is not used
+	CC->P2BF = true;
+	CC->HP2F = true;
+
+	m->tracefp = stdout;
+	m->post = (struct post *)calloc(NPOST, sizeof *m->post);
+	pthread_mutex_init(&m->post_mutex, NULL);
+	m->bintrace = bintrace_create();
+	if (m->post == NULL || m->bintrace == NULL)
+		goto fail;
+
+	// flight recorder is on unless "CPU FLIGHT=0"
+	if (flight_init(m->bintrace, FLIGHT_LEN) == 0)
+		m->doflight = true;
+
+	// the units
+	if (replay_create() < 0 || batch_create() < 0 || io_create() < 0
+		|| spo_create() < 0 || cr_create() < 0 || cp_create() < 0
+		|| lp_create() < 0 || mt_create() < 0 || dr_create() < 0
+		|| dk_create() < 0 || dcc_create() < 0)
+		goto fail;
+	io_init("");
+	return m;
+
+fail:
+	machine_destroy(m);
+	return NULL;
+}
+
+/***********************************************************************
+* an option/command for one of the units of the machine
+* returns 0: OK, 1: WARNING, 2: FATAL
+***********************************************************************/
+int machine_configure(MACHINE *m, const char *option) {
+	machine_bind(m);
+	return handle_option(option);
+}
+
+/***********************************************************************
+* start the 60 Hz timer and the processor, from IPL or a snapshot
+***********************************************************************/
+int machine_start(MACHINE *m, const char *snapshot) {
+	ADDR15 addr = 020;
+
+	machine_bind(m);
+	m->timer_running = true;
+	if (pthread_create(&m->timer, 0, timer_function, m) != 0) {
+		perror("timer");
+		m->timer_running = false;
+		return -1;
+	}
+
+	if (snapshot) {
+		if (snapshot_load(snapshot) < 0)
+			return -1;
+	} else {
+		io_ipl(addr);
+		preset(P[0], addr);
+	}
+	m->cpu_running = true;
+	start(P[0]);
+	return 0;
+}
+
+/***********************************************************************
+* execute up to count instructions on the calling thread
+* returns the number of instructions executed
+***********************************************************************/
+unsigned long long machine_run(MACHINE *m, unsigned long long count) {
+	machine_bind(m);
+	return execute_slice(count);
+}
+
+/***********************************************************************
+* the processor has halted or the process is asked to end
+***********************************************************************/
+BIT machine_halted(MACHINE *m) {
+	return m->cpu[0]->bHLTF || term_request;
+}
+
+/***********************************************************************
+* end all threads of the machine, write out and close all units,
+* remove the shares and free everything
+***********************************************************************/
+void machine_destroy(MACHINE *m) {
+	if (m == NULL)
+		return;
+	machine_bind(m);
+	if (m->timer_running) {
+		m->timer_running = false;
+		pthread_join(m->timer, NULL);
+	}
+	// without its message queue the I/O thread ends
+	b5500_remove_shares(m);
+	io_term();
+	spo_term();
+	cr_term();
+	cp_term();
+	lp_term();
+	mt_term();
+	dr_term();
+	dk_term();
+	dcc_term();
+	bintrace_destroy(m->bintrace);
+	replay_term();
+	batch_term();
+	free(m->post);
+	pthread_mutex_destroy(&m->post_mutex);
+	if (m->tracefp && m->tracefp != stdout)
+		fclose(m->tracefp);
+	b5500_detach_shares(m);
+	machine = NULL;
+	free(m);
+}
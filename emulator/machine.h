@@ -0,0 +1,144 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* machine context
+*
+* One emulated B5500: the shared memory with main memory, processors,
+* central control and I/O control units, the state of the CPU thread
+* and the state of every unit. All threads of a machine (CPU, I/O,
+* units, timer) bind it first, from then on the code reaches it by
+* the thread local "machine" and MAIN, P, CC, IO and TM. So a process
+* can run any number of machines, and a slice of one machine can be
+* executed by any thread, e.g. from a pool of workers.
+*
+* Each machine needs its own instance number, its shares and message
+* queues are named by it, see IPCKEY. Only the first machine created
+* as the console reads the SPO from stdin.
+*
+* Usage:
+*	m = machine_create(instance, console);
+*	machine_configure(m, "DKA FILE=...");	// as many as needed
+*	machine_start(m, NULL);			// IPL, or snapshot file
+*	while (!machine_halted(m))
+*		machine_run(m, 100000);
+*	machine_destroy(m);
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#ifndef	_MACHINE_H_
+#define	_MACHINE_H_
+
+#include <stdio.h>
+#include <pthread.h>
+#include "telemetry.h"
+
+#define	MAXNAME		1000	// NAME entries from a listing
+
+/***********************************************************************
+* the machine
+***********************************************************************/
+struct machine {
+	unsigned	instance;	// see IPCKEY
+	BIT		console;	// SPO reads stdin
+
+	// shared memory and message queues, see init_shares.c
+	int		shm_main, shm_cpu[2], shm_cc, shm_ioc[4], shm_tele;
+	int		msg_cpu[2];	// messages to P1 and P2
+	int		msg_iocu;	// messages to IOCU(s)
+	volatile WORD48	*main;
+	CPU		*cpu[2];
+	volatile CENTRAL_CONTROL *cc;
+	IOCU		*iocu[4];
+	TELEMETRY_T	*tm;
+
+	// CPU thread
+	unsigned long long instr_count;	// instructions executed
+	unsigned	iar_count;	// instructions with IRQ pending
+	BIT		cpu_running;	// recorder size and clock are fixed
+	BIT		dobintrace;	// binary trace of instruction execution
+	BIT		doflight;	// flight recorder of instruction execution
+	volatile BIT	flight_request;	// dump flight recorder at next instruction
+	FILE		*tracefp;	// text trace of instruction execution
+	char		name[MAXNAME][29];	// NAME entries from the listing
+
+	// commands carried out by the CPU thread, see cpu_post
+	struct post	*post;
+	unsigned	post_rp, post_wp;
+	pthread_mutex_t	post_mutex;
+	volatile BIT	cpu_post_due;
+
+	// 60 Hz timer, virtual clock and telemetry
+	pthread_t	timer;
+	volatile BIT	timer_running;
+	unsigned	vclock;		// instructions per tick, 0 = wall clock
+	unsigned	vclock_left;
+	volatile BIT	telemetry_due;	// set by timer, CPU takes a snapshot
+	unsigned	telemetry_ticks;
+
+	// record and replay, see replay.h
+	int		replay_mode;
+	volatile BIT	replay_due;	// record: events are waiting
+	volatile unsigned long long replay_next;	// play: count of the next record
+	BIT		replay_capture;	// record: I/O stores are logged
+
+	// snapshots, see snapshot.h
+	volatile BIT	snap_request;
+	BIT		snap_save;
+	char		snap_file[80];
+
+	// state of the modules, see there
+	struct bintrace	*bintrace;
+	struct replay_state *replay;
+	struct batch_state *batch;
+	struct io_state	*io;
+	struct spo_state *spo;
+	struct cr_state	*cr;
+	struct cp_state	*cp;
+	struct lp_state	*lp;
+	struct mt_state	*mt;
+	struct dr_state	*dr;
+	struct dk_state	*dk;
+	struct dcc_state *dcc;
+	struct telnet_state *telnet;
+	struct itelex_state *itelex;
+};
+
+/***********************************************************************
+* make m the machine of the calling thread
+***********************************************************************/
+static inline void machine_bind(MACHINE *m) {
+	machine = m;
+	MAIN = m->main;
+	P[0] = m->cpu[0];
+	P[1] = m->cpu[1];
+	CC = m->cc;
+	for (int i = 0; i < 4; i++)
+		IO[i] = m->iocu[i];
+	TM = m->tm;
+}
+
+/***********************************************************************
+* the API
+* all but machine_run and machine_halted print their complaints
+***********************************************************************/
+extern MACHINE *machine_create(unsigned instance, BIT console);
+extern int machine_configure(MACHINE *m, const char *option);
+extern int machine_start(MACHINE *m, const char *snapshot);
+extern unsigned long long machine_run(MACHINE *m, unsigned long long count);
+extern BIT machine_halted(MACHINE *m);
+extern void machine_destroy(MACHINE *m);
+
+/***********************************************************************
+* helpers of the emulator main program
+***********************************************************************/
+extern void machine_file(char *buf, unsigned len, const char *base, const char *ext);
+extern int start_bintrace(const char *filename);
+
+#endif	/*_MACHINE_H_*/
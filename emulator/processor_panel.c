@@ -13,6 +13,9 @@
 *   from thin air.
 * 2017-09-30  R.Meyer
 *   overhaul of file names
+* 2026-10-19  agent
+*   telemetry snapshot, -n <instance>, only attaches to the shares
+*   of a running emulator
 ***********************************************************************/
 
 #include <stdio.h>
@@ -21,30 +24,71 @@
 #include <math.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
 #include "common.h"
+#include "telemetry.h"
+#include "machine.h"
 
 int main(int argc, char	*argv[])
 {
-	int i;
-	b5500_init_shares();
+	static TELEMETRY_DATA d;
+	static MACHINE m;
+	unsigned seq, last = 0, rate;
+	unsigned long long lastcount = 0;
+	struct timespec now, then = {0, 0};
+	double dt;
+	int i, opt;
+	unsigned instance = 0;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			instance = strtoul(optarg, NULL, 10);
+			if (instance < MAXINSTANCE)
+				break;
+			// fall through
+		default:
+			fprintf(stderr, "Usage: %s [-n <instance>]\n", argv[0]);
+			exit(2);
+		}
+	}
+	if (b5500_init_shares(&m, instance, false) < 0)
+		exit(2);
+	machine_bind(&m);
 
 	printf("\033[2J");
 	while (1) {
-		printf("\033[H");
-		for (i=0; i<2; i++) {
-			b5500_pdp_text2(P[i]);
+		rate = TM->rate;
+		seq = __atomic_load_n(&TM->seq, __ATOMIC_ACQUIRE);
+		if (seq != last && telemetry_read(&d) == 0) {
+			last = seq;
+			printf("\033[H");
+			for (i=0; i<2; i++) {
+				b5500_pdp_text2(&d.P[i]);
+				printf("\n");
+			}
+
+			b5500_ccdp_text2(&d.CC);
 			printf("\n");
-		}
 
-		b5500_ccdp_text2(CC);
-		printf("\n");
+			for (i=0; i<4; i++) {
+				b5500_iodp_text2(&d.IO[i]);
+				printf("\n");
+			}
 
-		for (i=0; i<4; i++) {
-			b5500_iodp_text2(IO[i]);
-			printf("\n");
+			// instruction rate since last display
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			dt = (now.tv_sec - then.tv_sec) + (now.tv_nsec - then.tv_nsec) / 1e9;
+			if (then.tv_sec > 0 && dt > 0)
+				printf("INSTR=%010llu  %.0f/s\033[K\n", d.instr_count,
+					(d.instr_count - lastcount) / dt);
+			then = now;
+			lastcount = d.instr_count;
+			fflush(stdout);
 		}
 
-		sleep(1);
+		// poll at the rate snapshots are taken
+		usleep(rate > 0 ? 1000000 / rate : 1000000);
 	}
 	return 0;
 }
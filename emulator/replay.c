@@ -0,0 +1,408 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* deterministic record and replay
+*
+* see replay.h
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "io.h"
+#include "replay.h"
+#include "machine.h"
+
+/***********************************************************************
+* state, the flags checked after each instruction are in the MACHINE
+***********************************************************************/
+struct replay_state {
+	FILE	*fp;
+
+	// recording: events posted by other threads, applied by the CPU thread
+	pthread_mutex_t post_mutex;
+	unsigned pend_ticks;
+	unsigned pend_irqs;
+	WORD48	pend_set, pend_clr;
+	unsigned flushticks;
+
+	// recording: words stored by the current I/O
+	WORD48	capbuf[REPLAY_MAXWORDS];
+	unsigned ncap;
+	BIT	overflow;
+
+	// replay: the next record, its data is not yet read
+	REPLAY_REC next;
+};
+#define	RP	(machine->replay)
+
+/***********************************************************************
+* set interrupt flags, bit n for vector 020+n
+***********************************************************************/
+static void irq_set(unsigned irqs) {
+	unsigned vector;
+
+	for (vector = 020; irqs != 0; vector++, irqs >>= 1) {
+		if ((irqs & 1) == 0)
+			continue;
+		switch (vector) {
+		case 024: CC->CCI05F = true; break;	// keyboard request
+		case 025: CC->CCI06F = true; break;	// printer 1 finished
+		case 026: CC->CCI07F = true; break;	// printer 2 finished
+		case 034: CC->CCI13F = true; break;	// inquiry request
+		default:
+			printf("replay: unexpected interrupt %03o\n", vector);
+		}
+	}
+}
+
+/***********************************************************************
+* write one record
+***********************************************************************/
+static void log_rec(unsigned type, unsigned arg, const void *data, unsigned len) {
+	REPLAY_REC r;
+
+	r.count = machine->instr_count;
+	r.type = type;
+	r.arg = arg;
+	r.len = len;
+	fwrite(&r, sizeof r, 1, RP->fp);
+	if (len)
+		fwrite(data, len, 1, RP->fp);
+}
+
+/***********************************************************************
+* stop replaying, the machine continues with the real devices
+***********************************************************************/
+static void replay_end(const char *why) {
+	printf("replay: %s at instruction %llu, continuing live\n", why, machine->instr_count);
+	machine->replay_mode = REPLAY_OFF;
+	machine->replay_next = 0;
+	fclose(RP->fp);
+	RP->fp = NULL;
+	io_restart();
+}
+
+/***********************************************************************
+* replay: read the header of the next record
+***********************************************************************/
+static BIT read_next(void) {
+	if (fread(&RP->next, sizeof RP->next, 1, RP->fp) != 1) {
+		replay_end("end of log");
+		return false;
+	}
+	machine->replay_next = RP->next.count;
+	return true;
+}
+
+/***********************************************************************
+* replay: read the data of the current record
+***********************************************************************/
+static BIT read_data(void *p, unsigned len) {
+	if (fread(p, len, 1, RP->fp) != 1) {
+		replay_end("truncated log");
+		return false;
+	}
+	return true;
+}
+
+/***********************************************************************
+* replay: apply a record that is not an I/O
+***********************************************************************/
+static BIT play_event(void) {
+	WORD48 rdy;
+	unsigned i;
+
+	switch (RP->next.type) {
+	case RP_TICK:
+		for (i = 0; i < RP->next.arg; i++)
+			timer_tick();
+		break;
+	case RP_IRQ:
+		irq_set(RP->next.arg);
+		break;
+	case RP_READY:
+		if (!read_data(&rdy, sizeof rdy))
+			return false;
+		CC->RDY = rdy;
+		break;
+	default:
+		replay_end("bad record");
+		return false;
+	}
+	return read_next();
+}
+
+/***********************************************************************
+* open the log
+***********************************************************************/
+int replay_open(const char *filename, int mode) {
+	REPLAY_HDR hdr;
+
+	RP->fp = fopen(filename, mode == REPLAY_RECORD ? "wb" : "rb");
+	if (RP->fp == NULL) {
+		perror(filename);
+		return -1;
+	}
+	setvbuf(RP->fp, NULL, _IOFBF, 65536);
+	if (mode == REPLAY_RECORD) {
+		hdr.magic = REPLAY_MAGIC;
+		hdr.version = REPLAY_VERSION;
+		fwrite(&hdr, sizeof hdr, 1, RP->fp);
+		printf("replay: recording to %s\n", filename);
+	} else {
+		if (fread(&hdr, sizeof hdr, 1, RP->fp) != 1 || hdr.magic != REPLAY_MAGIC
+			|| hdr.version != REPLAY_VERSION) {
+			printf("%s: not a replay log of this version\n", filename);
+			fclose(RP->fp);
+			return -1;
+		}
+		if (fread(&RP->next, sizeof RP->next, 1, RP->fp) != 1) {
+			printf("%s: empty replay log\n", filename);
+			fclose(RP->fp);
+			return -1;
+		}
+		machine->replay_next = RP->next.count;
+		printf("replay: playing %s\n", filename);
+	}
+	machine->replay_mode = mode;
+	return 0;
+}
+
+/***********************************************************************
+* state of a new machine
+***********************************************************************/
+int replay_create(void) {
+	RP = (struct replay_state *)calloc(1, sizeof *RP);
+	if (RP == NULL) {
+		perror("replay");
+		return -1;
+	}
+	pthread_mutex_init(&RP->post_mutex, NULL);
+	machine->replay_mode = REPLAY_OFF;
+	return 0;
+}
+
+/***********************************************************************
+* close the log when the machine ends
+***********************************************************************/
+void replay_term(void) {
+	if (RP == NULL)
+		return;
+	if (RP->fp)
+		fclose(RP->fp);
+	pthread_mutex_destroy(&RP->post_mutex);
+	free(RP);
+	RP = NULL;
+	machine->replay_mode = REPLAY_OFF;
+}
+
+/***********************************************************************
+* a device thread raises an interrupt
+* while recording the CPU thread sets it, a replay takes it from the log
+***********************************************************************/
+void replay_irq(unsigned vector) {
+	switch (machine->replay_mode) {
+	case REPLAY_OFF:
+		irq_set(1u << (vector - 020));
+		break;
+	case REPLAY_RECORD:
+		pthread_mutex_lock(&RP->post_mutex);
+		RP->pend_irqs |= 1u << (vector - 020);
+		machine->replay_due = true;
+		pthread_mutex_unlock(&RP->post_mutex);
+		break;
+	}
+}
+
+/***********************************************************************
+* a tick of the 60 Hz timer
+***********************************************************************/
+void replay_tick(void) {
+	if (machine->replay_mode != REPLAY_RECORD)
+		return;
+	pthread_mutex_lock(&RP->post_mutex);
+	RP->pend_ticks++;
+	machine->replay_due = true;
+	pthread_mutex_unlock(&RP->post_mutex);
+}
+
+/***********************************************************************
+* units in mask changed their ready status
+***********************************************************************/
+void replay_ready(WORD48 mask, BIT ready) {
+	if (machine->replay_mode != REPLAY_RECORD)
+		return;
+	pthread_mutex_lock(&RP->post_mutex);
+	if (ready) {
+		RP->pend_set |= mask;
+		RP->pend_clr &= ~mask;
+	} else {
+		RP->pend_clr |= mask;
+		RP->pend_set &= ~mask;
+	}
+	machine->replay_due = true;
+	pthread_mutex_unlock(&RP->post_mutex);
+}
+
+/***********************************************************************
+* apply and log the posted events, or apply the logged ones
+* called by the CPU thread between instructions
+***********************************************************************/
+void replay_poll(void) {
+	unsigned ticks, irqs, i;
+	WORD48 set, clr, rdy;
+
+	switch (machine->replay_mode) {
+	case REPLAY_RECORD:
+		pthread_mutex_lock(&RP->post_mutex);
+		ticks = RP->pend_ticks;
+		irqs = RP->pend_irqs;
+		set = RP->pend_set;
+		clr = RP->pend_clr;
+		RP->pend_ticks = RP->pend_irqs = 0;
+		RP->pend_set = RP->pend_clr = 0;
+		machine->replay_due = false;
+		pthread_mutex_unlock(&RP->post_mutex);
+
+		// same order as in play_event
+		if (set | clr) {
+			rdy = (CC->RDY | set) & ~clr;
+			CC->RDY = rdy;
+			log_rec(RP_READY, 0, &rdy, sizeof rdy);
+		}
+		if (irqs) {
+			irq_set(irqs);
+			log_rec(RP_IRQ, irqs, NULL, 0);
+		}
+		if (ticks) {
+			for (i = 0; i < ticks; i++)
+				timer_tick();
+			log_rec(RP_TICK, ticks, NULL, 0);
+			// about once a second, so little is lost when killed
+			RP->flushticks += ticks;
+			if (RP->flushticks >= 60) {
+				RP->flushticks = 0;
+				fflush(RP->fp);
+			}
+		}
+		break;
+	case REPLAY_PLAY:
+		while (RP->next.count == machine->instr_count && RP->next.type != RP_IO)
+			if (!play_event())
+				return;
+		// an I/O of this instruction should have been done by now
+		if (RP->next.count == machine->instr_count)
+			replay_end("missing IIO");
+		break;
+	}
+}
+
+/***********************************************************************
+* the ready mask is built from scratch (IPL or snapshot load)
+***********************************************************************/
+void replay_scan(WORD48 *rdy) {
+	switch (machine->replay_mode) {
+	case REPLAY_RECORD:
+		log_rec(RP_READY, 1, rdy, sizeof *rdy);
+		break;
+	case REPLAY_PLAY:
+		// events logged before the scan come first
+		while (RP->next.type != RP_READY || RP->next.arg != 1) {
+			if (RP->next.type == RP_IO) {
+				replay_end("missing scan");
+				return;
+			}
+			if (!play_event())
+				return;
+		}
+		if (read_data(rdy, sizeof *rdy))
+			read_next();
+		break;
+	}
+}
+
+/***********************************************************************
+* recording: an I/O stores a word
+***********************************************************************/
+void replay_word(ADDR15 addr, WORD48 w) {
+	if (RP->ncap < REPLAY_MAXWORDS)
+		RP->capbuf[RP->ncap++] = ((WORD48)(addr & MASKMEM) << 48) | (w & MASK_WORD48);
+	else
+		RP->overflow = true;
+}
+
+/***********************************************************************
+* recording: an I/O has completed
+***********************************************************************/
+void replay_record_io(int cu, WORD48 iocw, WORD48 result) {
+	REPLAY_REC r;
+
+	r.count = machine->instr_count;
+	r.type = RP_IO;
+	r.arg = cu;
+	r.len = 2 * sizeof(WORD48) + RP->ncap * sizeof(WORD48);
+	fwrite(&r, sizeof r, 1, RP->fp);
+	fwrite(&iocw, sizeof iocw, 1, RP->fp);
+	fwrite(&result, sizeof result, 1, RP->fp);
+	fwrite(RP->capbuf, sizeof *RP->capbuf, RP->ncap, RP->fp);
+	if (RP->overflow)
+		printf("replay: I/O stored more than %u words, the log is incomplete\n",
+			REPLAY_MAXWORDS);
+	RP->ncap = 0;
+	RP->overflow = false;
+}
+
+/***********************************************************************
+* replay: do an I/O from the log
+* returns false when the replay has ended, the device must do it
+***********************************************************************/
+BIT replay_play_io(IOCU *u, int cu, WORD48 iocw) {
+	WORD48 logged[2], buf[256];
+	unsigned n, i, chunk;
+
+	if (RP->next.type != RP_IO || RP->next.count != machine->instr_count || RP->next.arg != cu) {
+		replay_end("unexpected IIO");
+		return false;
+	}
+	if (RP->next.len < sizeof logged || !read_data(logged, sizeof logged))
+		return false;
+	if (logged[0] != iocw) {
+		replay_end("different IOCW");
+		return false;
+	}
+
+	// the words stored by the device
+	n = (RP->next.len - sizeof logged) / sizeof(WORD48);
+	u->words = n;
+	while (n > 0) {
+		chunk = n < 256 ? n : 256;
+		if (!read_data(buf, chunk * sizeof *buf))
+			return false;
+		for (i = 0; i < chunk; i++)
+			MAIN[(buf[i] >> 48) & MASKMEM] = buf[i] & MASK_WORD48;
+		n -= chunk;
+	}
+
+	// decompose the result as perform_io composes it
+	u->w = logged[1];
+	u->d_unit = (u->w & MASK_IODUNIT) >> SHFT_IODUNIT;
+	u->d_wc = (u->w & MASK_IODWCNT) >> SHFT_IODWCNT;
+	u->d_control = (u->w & MASK_IODCONTROL) >> SHFT_IODCONTROL;
+	u->d_result = (u->w & MASK_IODRESULT) >> SHFT_IODRESULT;
+	u->d_addr = (u->w & MASK_IODADDR) >> SHFT_IODADDR;
+	read_next();
+	return true;
+}
@@ -0,0 +1,100 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* deterministic record and replay
+*
+* Everything that reaches the CPU from outside is logged together with
+* the instruction count at which the CPU saw it:
+*   - ticks of the 60 Hz timer
+*   - interrupts raised by device threads (keyboard request, printer
+*     finished, datacom inquiry)
+*   - changes of the ready mask (card reader hopper, tapes, ...)
+*   - every I/O operation: its result descriptor and the words it
+*     stored into MAIN
+*
+* While recording or replaying, device threads do not touch central
+* control. They post their events, the CPU thread applies and logs them
+* between two instructions. I/O is done synchronously by the CPU thread
+* inside IIO, so it completes at a fixed instruction.
+*
+* A replay starts from the same IPL or the same snapshot (-r) as the
+* recording. It takes all the above from the log, the devices are not
+* used. Where the CPU does something else than in the recording, or
+* the log ends, the replay stops and the machine continues live.
+*
+* File layout:
+*   REPLAY_HDR
+*   records, each REPLAY_REC followed by len bytes of data
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#ifndef	_REPLAY_H_
+#define	_REPLAY_H_
+
+#define	REPLAY_MAGIC	0x50523542	// "B5RP"
+#define	REPLAY_VERSION	2
+#define	REPLAY_MAXWORDS	8192		// words stored by one I/O
+
+/***********************************************************************
+* modes
+***********************************************************************/
+#define	REPLAY_OFF	0
+#define	REPLAY_RECORD	1
+#define	REPLAY_PLAY	2
+
+/***********************************************************************
+* file layout
+***********************************************************************/
+typedef struct replay_hdr {
+	unsigned	magic;
+	unsigned	version;
+} REPLAY_HDR;
+
+// record types
+#define	RP_TICK		1	// arg: number of timer ticks
+#define	RP_IRQ		2	// arg: interrupt flags, bit n for vector 020+n
+#define	RP_READY	3	// arg: 1 from a full scan; data: the ready mask
+#define	RP_IO		4	// arg: I/O unit 1..4; data: IOCW, result
+				// descriptor, words stored (address in bits 48..62)
+
+typedef struct replay_rec {
+	unsigned long long count;	// instruction count
+	unsigned short	type;
+	unsigned short	arg;
+	unsigned	len;		// bytes of data following
+} REPLAY_REC;
+
+/***********************************************************************
+* start and end
+* the state checked by the CPU thread after each instruction,
+* replay_mode, replay_due, replay_next and replay_capture, is in the
+* MACHINE, see machine.h
+***********************************************************************/
+extern int replay_create(void);
+extern int replay_open(const char *filename, int mode);
+extern void replay_term(void);
+
+/***********************************************************************
+* called by device threads and the timer
+***********************************************************************/
+extern void replay_irq(unsigned vector);
+extern void replay_tick(void);
+extern void replay_ready(WORD48 mask, BIT ready);
+
+/***********************************************************************
+* called by the CPU thread
+***********************************************************************/
+extern void replay_poll(void);
+extern void replay_scan(WORD48 *rdy);
+extern void replay_word(ADDR15 addr, WORD48 w);
+extern void replay_record_io(int cu, WORD48 iocw, WORD48 result);
+extern BIT replay_play_io(IOCU *u, int cu, WORD48 iocw);
+
+#endif	/*_REPLAY_H_*/
@@ -0,0 +1,224 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* machine snapshot
+*
+* see snapshot.h
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "io.h"
+#include "snapshot.h"
+#include "machine.h"
+
+/***********************************************************************
+* file header, rejects snapshots of a different build
+***********************************************************************/
+typedef struct snap_hdr {
+	unsigned	magic;
+	unsigned	version;
+	unsigned	cpusize;
+	unsigned	ccsize;
+	unsigned	iocusize;
+} SNAP_HDR;
+
+/***********************************************************************
+* write or read len bytes
+***********************************************************************/
+void snap_data(SNAP_T *s, void *p, unsigned len) {
+	if (s->error || len == 0)
+		return;
+	if (s->save)
+		s->error = fwrite(p, len, 1, s->fp) != 1;
+	else
+		s->error = fread(p, len, 1, s->fp) != 1;
+}
+
+/***********************************************************************
+* write or check a section tag of 4 characters
+***********************************************************************/
+void snap_section(SNAP_T *s, const char *tag) {
+	char buf[4];
+
+	memcpy(buf, tag, sizeof buf);
+	snap_data(s, buf, sizeof buf);
+	if (!s->save && !s->error && memcmp(buf, tag, sizeof buf) != 0) {
+		printf("snapshot: expected section %.4s\n", tag);
+		s->error = true;
+	}
+}
+
+/***********************************************************************
+* the machine itself
+***********************************************************************/
+static void snap_machine(SNAP_T *s) {
+	SNAP_HDR hdr, want;
+	int i;
+
+	want.magic = SNAP_MAGIC;
+	want.version = SNAP_VERSION;
+	want.cpusize = sizeof(CPU);
+	want.ccsize = sizeof(CENTRAL_CONTROL);
+	want.iocusize = sizeof(IOCU);
+	hdr = want;
+	snap_data(s, &hdr, sizeof hdr);
+	if (!s->error && memcmp(&hdr, &want, sizeof hdr) != 0) {
+		printf("snapshot: not made by this version of the emulator\n");
+		s->error = true;
+	}
+
+	snap_section(s, "MAIN");
+	snap_data(s, (void *)MAIN, MAXMEM * sizeof(WORD48));
+	snap_section(s, "CPU ");
+	snap_data(s, P[0], sizeof *P[0]);
+	snap_data(s, P[1], sizeof *P[1]);
+	// the name pointers are only valid in the process that saved them
+	if (!s->save)
+		for (i = 0; i < 2; i++)
+			P[i]->acc.id = P[i]->id;
+	snap_data(s, &machine->instr_count, sizeof machine->instr_count);
+	snap_data(s, &machine->vclock, sizeof machine->vclock);
+	snap_data(s, &machine->vclock_left, sizeof machine->vclock_left);
+	snap_section(s, "CC  ");
+	snap_data(s, (void *)CC, sizeof *CC);
+	snap_section(s, "IOCU");
+	for (i = 0; i < 4; i++)
+		snap_data(s, IO[i], sizeof *IO[i]);
+
+	// devices
+	snap_section(s, "MT  ");
+	mt_snapshot(s);
+	snap_section(s, "CR  ");
+	cr_snapshot(s);
+	snap_section(s, "LP  ");
+	lp_snapshot(s);
+	snap_section(s, "DR  ");
+	dr_snapshot(s);
+	snap_section(s, "DK  ");
+	dk_snapshot(s);
+	snap_section(s, "DCC ");
+	dcc_snapshot(s);
+	snap_section(s, "END ");
+}
+
+/***********************************************************************
+* save the machine to a file
+***********************************************************************/
+int snapshot_save(const char *filename) {
+	SNAP_T s;
+	char tmp[200];
+
+	// written under a temporary name, an old snapshot survives errors
+	snprintf(tmp, sizeof tmp, "%s.tmp", filename);
+	s.fp = fopen(tmp, "wb");
+	if (s.fp == NULL) {
+		perror(tmp);
+		return -1;
+	}
+	s.save = true;
+	s.error = false;
+	snap_machine(&s);
+	if (fclose(s.fp) != 0)
+		s.error = true;
+	if (s.error || rename(tmp, filename) < 0) {
+		perror(filename);
+		unlink(tmp);
+		return -1;
+	}
+	printf("snapshot saved to %s\n", filename);
+	return 0;
+}
+
+/***********************************************************************
+* load the machine from a file
+* the devices must be configured with the same files as when saved
+***********************************************************************/
+int snapshot_load(const char *filename) {
+	SNAP_T s;
+
+	s.fp = fopen(filename, "rb");
+	if (s.fp == NULL) {
+		perror(filename);
+		return -1;
+	}
+	s.save = false;
+	s.error = false;
+	snap_machine(&s);
+	fclose(s.fp);
+	if (s.error) {
+		printf("snapshot %s could not be loaded, machine state is undefined\n", filename);
+		return -1;
+	}
+	io_restart();
+	printf("snapshot loaded from %s\n", filename);
+	return 0;
+}
+
+/***********************************************************************
+* no I/O unit is working on an I/O
+* a finished one with its interrupt pending is complete in CC and IOCU
+***********************************************************************/
+BIT snapshot_io_idle(void) {
+	return (!CC->AD1F || CC->CCI08F) && (!CC->AD2F || CC->CCI09F)
+		&& (!CC->AD3F || CC->CCI10F) && (!CC->AD4F || CC->CCI11F);
+}
+
+/***********************************************************************
+* called by the CPU thread between instructions when snap_request is set
+* waits for all I/O units to become idle
+***********************************************************************/
+void snapshot_poll(void) {
+	MACHINE *m = machine;
+
+	if (!snapshot_io_idle())
+		return;
+	m->snap_request = false;
+	if (m->snap_save)
+		snapshot_save(m->snap_file);
+	else if (snapshot_load(m->snap_file) < 0)
+		stop(P[0]);
+}
+
+/***********************************************************************
+* SPO commands
+***********************************************************************/
+static int snap_set(const char *v, void *data) {
+	MACHINE *m = machine;
+
+	if (m->snap_request) {
+		printf("$SNAP still busy\n");
+		return 1; // WARNING
+	}
+	if (v[0] == 0 || strlen(v) >= sizeof m->snap_file) {
+		printf("$SNAP needs a file name\n");
+		return 2; // FATAL
+	}
+	strcpy(m->snap_file, v);
+	m->snap_save = data != NULL;
+	m->snap_request = true;
+	return 0; // OK
+}
+
+static const command_t snap_commands[] = {
+	{"SNAP", NULL},
+	{"SAVE", snap_set, (void *)1},
+	{"LOAD", snap_set, NULL},
+	{NULL, NULL},
+};
+
+int snapshot_init(const char *option) {
+	return command_parser(snap_commands, option);
+}
@@ -0,0 +1,57 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* machine snapshot
+*
+* A snapshot holds MAIN, the processors, central control, the I/O
+* units, the instruction counter, the virtual clock and the state of
+* the devices. It is taken by the CPU thread between two instructions
+* while no I/O is in progress.
+*
+* Save and load use the same code: every part of the machine has one
+* function that hands its data to snap_data(), which writes or reads
+* depending on the direction. Sections are tagged so a mismatch is
+* found early.
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#ifndef	_SNAPSHOT_H_
+#define	_SNAPSHOT_H_
+
+#define	SNAP_MAGIC	0x4e533542	// "B5SN"
+#define	SNAP_VERSION	3
+
+typedef struct snap {
+	FILE	*fp;
+	BIT	save;		// true: write, false: read
+	BIT	error;		// an I/O error or mismatch happened
+} SNAP_T;
+
+/***********************************************************************
+* helpers for the parts
+***********************************************************************/
+extern void snap_data(SNAP_T *s, void *p, unsigned len);
+extern void snap_section(SNAP_T *s, const char *tag);
+
+/***********************************************************************
+* the whole machine
+***********************************************************************/
+extern int snapshot_save(const char *filename);
+extern int snapshot_load(const char *filename);
+extern BIT snapshot_io_idle(void);
+
+/***********************************************************************
+* SNAP SAVE=<file> and SNAP LOAD=<file>, done by the CPU thread
+* the request is kept in the MACHINE
+***********************************************************************/
+extern int snapshot_init(const char *option);
+extern void snapshot_poll(void);
+
+#endif	/*_SNAPSHOT_H_*/
@@ -0,0 +1,85 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* telemetry for the panels
+*
+* The emulator copies its state into a shared memory region of its
+* own, the panels copy it out. A sequence counter (seqlock) tells the
+* reader whether its copy is consistent: it is odd while the writer
+* is busy and changes with every snapshot. The writer never waits and
+* the panels never touch the live structures.
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#ifndef	_TELEMETRY_H_
+#define	_TELEMETRY_H_
+
+#include <string.h>
+
+#define	TELEMETRY_RATE		10	// default snapshots per second
+#define	TELEMETRY_MAXRATE	60	// limited by the 60 Hz timer
+
+/***********************************************************************
+* seqlock, one writer, any number of readers
+***********************************************************************/
+static inline void seqlock_write_begin(unsigned *seq) {
+	__atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+	// data stores must not become visible before the odd count
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seqlock_write_end(unsigned *seq) {
+	__atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+// copy len bytes from src, returns 0 if consistent, -1 if not (yet)
+static inline int seqlock_read(const unsigned *seq, void *dst, const void *src, unsigned len) {
+	unsigned s;
+	int tries;
+
+	for (tries = 0; tries < 100; tries++) {
+		s = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+		if (s == 0)
+			return -1;	// never written
+		if (s & 1)
+			continue;	// writer busy
+		memcpy(dst, src, len);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(seq, __ATOMIC_RELAXED) == s)
+			return 0;
+	}
+	return -1;
+}
+
+/***********************************************************************
+* processor, central control and I/O control units
+* taken by the CPU thread between two instructions
+***********************************************************************/
+typedef struct telemetry_data {
+	unsigned long long instr_count;	// instructions executed so far
+	CPU		P[2];
+	CENTRAL_CONTROL	CC;
+	IOCU		IO[4];
+} TELEMETRY_DATA;
+
+typedef struct telemetry {
+	unsigned	seq;		// seqlock
+	unsigned	rate;		// snapshots per second, 0 = off
+	TELEMETRY_DATA	data;
+} TELEMETRY_T;
+
+extern __thread TELEMETRY_T *TM;	// of the machine, see machine.h
+extern void telemetry_publish(void);
+
+static inline int telemetry_read(TELEMETRY_DATA *d) {
+	return seqlock_read(&TM->seq, d, &TM->data, sizeof *d);
+}
+
+#endif	/*_TELEMETRY_H_*/
@@ -16,6 +16,8 @@
 *   extracted from b5500emulator/dev_dcc.c
 * 2019-01-29  R.Meyer
 *   clear telnet structure "type" when new connection arrives
+* 2026-10-19  agent
+*   unsigned escape sequences, longer listen backlog, output ring
 ***********************************************************************/
 
 #include <stdio.h>
@@ -102,7 +104,7 @@ static void telnet_escape_interpret(TELNET_SESSION_T *t) {
 			break;
 		case TN_SUB:
 			t->subbuf[t->subidx] = 0;
-			strncpy(t->type, t->subbuf+3, TN_TYPE_BUFLEN);
+			strncpy(t->type, (char*)t->subbuf+3, TN_TYPE_BUFLEN);
 			t->type[TN_TYPE_BUFLEN-1] = 0;
 #if TN_VERBOSE
 			printf("+TERMINAL TYPE=%s\n", t->type);
@@ -138,10 +140,10 @@ static void telnet_escape_interpret(TELNET_SESSION_T *t) {
 * TELNET Escape Check
 ***********************************************************************/
 static int telnet_escape_check(TELNET_SESSION_T *t, char *buf, int len) {
-	char *p, *q;
+	unsigned char *p, *q;
 	int i;
-	// test each character
-	p = q = buf;
+	// test each character (unsigned, IAC is 255)
+	p = q = (unsigned char*)buf;
 	for (i=0; i<len; i++) {
 		// first detect IAC
 		if (*p == TN_IAC) {
@@ -189,13 +191,13 @@ static int telnet_escape_check(TELNET_SESSION_T *t, char *buf, int len) {
 			break;
 		case had_sub:
 			// assemble into subbuf - prevent buffer overflow
-			if (t->subidx < sizeof t->subbuf)
+			if (t->subidx < sizeof t->subbuf - 1)
 				t->subbuf[t->subidx++] = *p;
 			p++;
 			break;
 		} // switch
 	} // for
-	return q - buf;
+	return q - (unsigned char*)buf;
 }
 
 /***********************************************************************
@@ -222,6 +224,13 @@ int telnet_session_open(TELNET_SESSION_T *t, int sock) {
 ***********************************************************************/
 void telnet_session_close(TELNET_SESSION_T *t) {
 	int so = t->socket;
+	unsigned char *p;
+	unsigned len;
+
+	// last output, as far as it goes
+	if (so > 2 && t->out.buf && (len = ring_span(&t->out, &p)) > 0)
+		write(so, p, len);
+	ring_clear(&t->out);
 	t->socket = -1;		// prevent recursion
 	if (so > 2)		// prevent accidential closing of std files
 		close(so);
@@ -271,6 +280,16 @@ int telnet_session_read(TELNET_SESSION_T *t, char *buf, int len) {
 * Returns number of bytes written or -1 on non-recoverable error
 ***********************************************************************/
 int telnet_session_write(TELNET_SESSION_T *t, const char *buf, int len) {
+	if (t->socket > 2 && t->out.buf) {
+		// collect output, make room if needed
+		int cnt = ring_write_n(&t->out, buf, len);
+		if (cnt < len) {
+			if (telnet_session_flush(t) < 0)
+				return -1;
+			cnt += ring_write_n(&t->out, buf + cnt, len - cnt);
+		}
+		return cnt;
+	}
 	if (t->socket > 2) {	// prevent accidential use of std files
 		int cnt = write(t->socket, buf, len);
 		if (cnt < 0) {	// cnt < 0 : error occured
@@ -292,6 +311,32 @@ int telnet_session_write(TELNET_SESSION_T *t, const char *buf, int len) {
 	return -1;
 }
 
+/***********************************************************************
+* TELNET Session Flush
+* Returns number of bytes still waiting or -1 on non-recoverable error
+***********************************************************************/
+int telnet_session_flush(TELNET_SESSION_T *t) {
+	unsigned char *p;
+	unsigned len;
+	int cnt;
+
+	if (t->out.buf == NULL)
+		return 0;
+	while (t->socket > 2 && (len = ring_span(&t->out, &p)) > 0) {
+		cnt = write(t->socket, p, len);
+		if (cnt < 0) {
+			if (errno == EAGAIN)
+				break;	// recoverable, try again later
+			telnet_session_close(t);
+			return -1;
+		}
+		ring_skip(&t->out, cnt);
+		if ((unsigned)cnt < len)
+			break;
+	}
+	return ring_used(&t->out);
+}
+
 /***********************************************************************
 * TELNET Server Start
 ***********************************************************************/
@@ -325,7 +370,7 @@ int telnet_server_start(TELNET_SERVER_T *ts, unsigned port) {
 		return -1;
 	}
 	// start the listening
-	if (listen(ts->socket, 4)) {
+	if (listen(ts->socket, 16)) {
 		perror("telnet listen");
 		close(ts->socket);
 		ts->socket = -1;
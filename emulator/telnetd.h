@@ -26,11 +26,15 @@
 ************************************************************************
 * 2018-03-21  R.Meyer
 *   extracted from b5500emulator/dev_dcc.c
+* 2026-10-19  agent
+*   optional output ring buffer
 ***********************************************************************/
 
 #ifndef	_TELNETD_H_
 #define	_TELNETD_H_
 
+#include "circbuffer.h"
+
 #define TIMEOUT 1000
 
 // codes
@@ -65,13 +69,15 @@ typedef struct telnet_session {
 	// negotiation
 	int		lastchar;
 	enum escape	escape;
-	char		subbuf[20];
+	unsigned char	subbuf[20];
 	unsigned	subidx;
 	// negotiated terminal values
 	unsigned	success_mask;
 	int		is_fullduplex;
 	unsigned	cols, rows;
 	char		type[TN_TYPE_BUFLEN];
+	// output waiting for the socket (buf == NULL: write directly)
+	RING_T		out;
 } TELNET_SESSION_T;
 
 typedef struct telnet_server {
@@ -86,6 +92,7 @@ extern void telnet_session_close(TELNET_SESSION_T *t);
 extern void telnet_session_clear(TELNET_SESSION_T *t);
 extern int telnet_session_read(TELNET_SESSION_T *t, char *buf, int len);
 extern int telnet_session_write(TELNET_SESSION_T *t, const char *buf, int len);
+extern int telnet_session_flush(TELNET_SESSION_T *t);
 extern int telnet_server_start(TELNET_SERVER_T *ts, unsigned port);
 extern void telnet_server_stop(TELNET_SERVER_T *ts);
 extern int telnet_server_poll(TELNET_SERVER_T *ts, struct sockaddr_in *addr);
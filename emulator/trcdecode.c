@@ -0,0 +1,300 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* decoder for the binary instruction trace of emulator2 -E
+* and for the flight recorder dumps
+*
+* writes the same text the -e trace writes to instrace.txt
+*
+* usage: trcdecode [-s <first>] [-n <count>] <tracefile>
+*   -s	skip instructions with a smaller instruction count
+*   -n	stop after this many instructions
+*
+* Differences to the -e trace: the trace lines written from inside
+* single instructions (LLL) are not part of the binary trace, and
+* PRT names show the code address they had at trace start.
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "bintrace.h"
+
+/***********************************************************************
+* symbols, by PRT index and sorted by code address
+***********************************************************************/
+#define MAXNAME 1000
+static const BINTRACE_SYM *byindex[MAXNAME];
+static BINTRACE_SYM *sym;
+static unsigned nsym;
+
+static int symcmp(const void *a, const void *b) {
+	const BINTRACE_SYM *x = (const BINTRACE_SYM *)a;
+	const BINTRACE_SYM *y = (const BINTRACE_SYM *)b;
+
+	if (x->addr != y->addr)
+		return x->addr - y->addr;
+	return x->index - y->index;
+}
+
+/***********************************************************************
+* opcode lookup, [cwmf][syllable]
+***********************************************************************/
+static const INSTRUCTION *optab[2][010000];
+
+static void build_optab(void) {
+	const INSTRUCTION *ip;
+	unsigned cwmf, code;
+	BIT match;
+
+	// the first matching table entry wins, as in the linear search
+	for (cwmf = 0; cwmf < 2; cwmf++)
+	for (code = 0; code < 010000; code++)
+	for (ip = instruction_table; ip->name != 0; ip++) {
+		if (ip->cwmf != cwmf)
+			continue;
+		switch (ip->outtype) {
+		case OP_ASIS:
+		case OP_BRAS:
+		case OP_BRAW:	match = ip->code == code; break;
+		case OP_TOP4:	match = ip->code == (code & 0x0ff); break;
+		case OP_TOP6:	match = ip->code == (code & 0x03f); break;
+		case OP_TOP10:	match = ip->code == (code & 0x003); break;
+		default:	match = false;
+		}
+		if (match) {
+			optab[cwmf][code] = ip;
+			break;
+		}
+	}
+}
+
+/***********************************************************************
+* convert a relative address into a string
+***********************************************************************/
+static const char *relsym(unsigned offset, unsigned fflags) {
+	static char buf[48];
+	const BINTRACE_SYM *s;
+
+	if (fflags & BT_SALF) {
+		// subroutine level - check upper 3 bits of the 10 bit offset
+		switch ((offset >> 7) & 7) {
+		case 4:
+		case 5:
+			offset &= 0xff;
+			if (fflags & BT_Q12F)
+				sprintf(buf, "PARAMETERLOADING %u", offset);
+			else
+				sprintf(buf, "LOCAL %u", offset);
+			return buf;
+		case 6:
+			sprintf(buf, "CODE+%u", offset & 0x7f);
+			return buf;
+		case 7:
+			sprintf(buf, "PARAMETER %u", offset & 0x7f);
+			return buf;
+		default:
+			offset &= 0x1ff;
+		}
+	} else {
+		// program level - all 10 bits are offset
+		offset &= 0x3ff;
+	}
+	s = offset < MAXNAME ? byindex[offset] : NULL;
+	if (s && s->addr)
+		sprintf(buf, "%s=%05o", s->name, s->addr);
+	else if (s)
+		sprintf(buf, "%s", s->name);
+	else
+		sprintf(buf, "PRT[%03o]", offset);
+	return buf;
+}
+
+/***********************************************************************
+* best matching label for a code address
+***********************************************************************/
+static void codesym(unsigned long long count, unsigned c, unsigned l) {
+	int lo = 0, hi = nsym - 1, mid, best = -1;
+
+	// last symbol with 0 < addr <= c, the lowest index of equal ones
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (sym[mid].addr <= c) {
+			best = mid;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	while (best > 0 && sym[best-1].addr == sym[best].addr)
+		best--;
+	if (best >= 0 && sym[best].addr > 0)
+		printf("%08llu %s+%04o (%05o:%o) ",
+			count, sym[best].name,
+			((c - sym[best].addr) << 2) + l, c, l);
+	else
+		printf("%08llu (%05o:%o) ", count, c, l);
+}
+
+/***********************************************************************
+* disassemble one instruction
+***********************************************************************/
+static void printinstr(unsigned code, unsigned fflags) {
+	const INSTRUCTION *ip = optab[(fflags & BT_CWMF) ? 1 : 0][code & 07777];
+
+	if (ip == NULL) {
+		printf("unknown instruction %04o", code);
+		return;
+	}
+	switch (ip->outtype) {
+	case OP_TOP4:
+		printf("%-4.4s  %4u  %04o", ip->name, code >> 8, code);
+		break;
+	case OP_TOP6:
+		printf("%-4.4s  %02o    %04o", ip->name, code >> 6, code);
+		break;
+	case OP_TOP10:
+		printf("%-4.4s  %04o  %04o  (%s)", ip->name, code >> 2, code,
+			relsym(code >> 2, fflags));
+		break;
+	default:
+		printf("%-4.4s        %04o", ip->name, code);
+	}
+}
+
+/***********************************************************************
+* register printouts as in emulator2
+***********************************************************************/
+static char *word2string(WORD48 w) {
+	static char buf[33];
+	int i;
+
+	for (i=7; i>=0; i--) {
+		buf[3*i  ] = '0'+((w>>3) & 7);
+		buf[3*i+1] = '0'+((w   ) & 7);
+		buf[3*i+2] = ' ';
+		buf[24+i] = translatetable_bic2ascii[w&077];
+		w>>=6;
+	}
+	buf[32]=0;
+	return buf;
+}
+
+static char *lcw2string(WORD48 w) {
+	static char buf[64];
+
+	if (w & MASK_CREG) {
+		sprintf(buf, "Loop(%05llo:%llo Rpt=%03llo Prev=%05llo)",
+			(w & MASK_CREG) >> SHFT_CREG,
+			(w & MASK_LREG) >> SHFT_LREG,
+			(w & MASK_LCWrpt) >> SHFT_LCWrpt,
+			(w & MASK_FREG) >> SHFT_FREG);
+		buf[32]=0;
+	} else {
+		buf[0]=0;
+	}
+	return buf;
+}
+
+static void printregs(const BINTRACE_REC *r) {
+	unsigned f = r->flags;
+
+	if (f & BT_CWMF) {
+		printf("\tSI(M:GH)=%05o:%02o A=%s (%u) Y=%02o\n",
+			r->m, r->gh, word2string(r->a), (f & BT_AROF) != 0, r->y);
+		printf("\tDI(S:KV)=%05o:%02o B=%s (%u) Z=%02o\n",
+			r->s, r->kv, word2string(r->b), (f & BT_BROF) != 0, r->z);
+		printf("\tR=%05o N=%d F=%05o TFFF=%u SALF=%u NCSF=%u T=%04o\n",
+			r->r, r->n, r->f,
+			(f & BT_Q12F) != 0, (f & BT_SALF) != 0, (f & BT_NCSF) != 0, r->t);
+		printf("\tX=__%014llo %s\n", r->x, lcw2string(r->x));
+	} else {
+		printf("\tA=%016llo(%u) GH=%02o Y=%02o M=%05o F=%05o N=%d NCSF=%u T=%04o\n",
+			r->a, (f & BT_AROF) != 0, r->gh, r->y, r->m, r->f,
+			r->n, (f & BT_NCSF) != 0, r->t);
+		printf("\tB=%016llo(%u) KV=%02o Z=%02o S=%05o R=%05o MSFF=%u SALF=%u\n",
+			r->b, (f & BT_BROF) != 0, r->kv, r->z, r->s, r->r,
+			(f & BT_Q12F) != 0, (f & BT_SALF) != 0);
+	}
+}
+
+/***********************************************************************
+* main
+***********************************************************************/
+int main(int argc, char *argv[]) {
+	FILE *fp;
+	BINTRACE_HDR hdr;
+	BINTRACE_REC rec;
+	unsigned long long first = 0, count = 0, done = 0;
+	unsigned i;
+	int opt, res;
+
+	while ((opt = getopt(argc, argv, "s:n:")) != -1) {
+		switch (opt) {
+		case 's':
+			first = strtoull(optarg, NULL, 10);
+			break;
+		case 'n':
+			count = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-s <first>] [-n <count>] <tracefile>\n", argv[0]);
+			exit(2);
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "Usage: %s [-s <first>] [-n <count>] <tracefile>\n", argv[0]);
+		exit(2);
+	}
+	fp = fopen(argv[optind], "rb");
+	if (fp == NULL) {
+		perror(argv[optind]);
+		exit(2);
+	}
+	if (fread(&hdr, sizeof hdr, 1, fp) != 1 || hdr.magic != BINTRACE_MAGIC
+		|| hdr.version != BINTRACE_VERSION || hdr.recsize != sizeof rec) {
+		fprintf(stderr, "%s: not a binary trace of this version\n", argv[optind]);
+		exit(2);
+	}
+	nsym = hdr.nsym;
+	sym = (BINTRACE_SYM *)calloc(nsym + 1, sizeof *sym);
+	if (sym == NULL || fread(sym, sizeof *sym, nsym, fp) != nsym) {
+		fprintf(stderr, "%s: bad symbol table\n", argv[optind]);
+		exit(2);
+	}
+	qsort(sym, nsym, sizeof *sym, symcmp);
+	for (i = 0; i < nsym; i++) {
+		sym[i].name[sizeof sym[i].name - 1] = 0;
+		if (sym[i].index < MAXNAME)
+			byindex[sym[i].index] = &sym[i];
+	}
+	build_optab();
+
+	memset(&rec, 0, sizeof rec);
+	while ((res = bintrace_decode(fp, &rec)) > 0) {
+		if (rec.count < first)
+			continue;
+		printf("\n");
+		codesym(rec.count, rec.c, rec.l);
+		printinstr(rec.ft, rec.fflags);
+		printf("\n");
+		printregs(&rec);
+		if (count && ++done >= count)
+			break;
+	}
+	if (res < 0)
+		fprintf(stderr, "%s: truncated\n", argv[optind]);
+	fclose(fp);
+	return 0;
+}
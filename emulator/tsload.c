@@ -0,0 +1,625 @@
+/***********************************************************************
+* b5500emulator
+************************************************************************
+* Copyright (c) 2026, agent
+* Licensed under the MIT License,
+*       see LICENSE
+************************************************************************
+* time sharing load generator
+*
+* Opens a number of concurrent TELNET sessions to the DCC TELNET
+* servers (port 23: B9352 with ANSI emulation, port 8023: TELETYPE),
+* answers the negotiation the emulator expects (TERMTYPE, WINDOWSIZE,
+* ECHO) and replays a script on each session.
+*
+* Script lines:
+*	>text		send text followed by CR
+*	<text		wait until text appears in the output received
+*			since the last send, the time from the send to here
+*			is one response time sample
+*	=ms		pause (think time)
+*	#...		comment
+*
+* Each repetition of the script uses a new connection.
+*
+* At the end throughput and response time percentiles and a
+* histogram (log2 of microseconds) are printed.
+*
+************************************************************************
+* 2026-10-19  agent
+*   from thin air.
+***********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "telnetd.h"
+
+/***********************************************************************
+* defines
+***********************************************************************/
+#define	MAXSESS	256	// maximum number of sessions
+#define	MAXSTEPS 1000	// maximum number of script lines
+#define	LINELEN	200	// length of a script line
+#define	WINLEN	1024	// output remembered for matching
+#define	BUFLEN	512	// length of TCP input buffer
+#define	NHIST	32	// histogram buckets (log2 of microseconds)
+#define	SUBLEN	20	// TELNET sub negotiation buffer
+
+#define	ESC	0x1b
+#define	CR	0x0d
+
+/***********************************************************************
+* the script
+***********************************************************************/
+enum stepcode {
+	st_send=0,	// send a line
+	st_expect,	// wait for output
+	st_pause};	// think time
+
+typedef struct step {
+	enum stepcode	code;
+	int		ms;		// pause time
+	char		text[LINELEN];	// line to send or to wait for
+} STEP_T;
+
+static STEP_T script[MAXSTEPS];
+static int nsteps;
+
+/***********************************************************************
+* the sessions
+***********************************************************************/
+typedef struct session {
+	int		sock;
+	int		step;		// current script line
+	int		loop;		// current repetition
+	int		done;		// finished or failed
+	// TELNET escape state
+	int		lastiac;
+	enum escape	escape;
+	unsigned char	sub[SUBLEN];
+	unsigned	subidx;
+	int		ansiesc;	// in ANSI escape sequence
+	// output since last send
+	char		win[WINLEN];
+	unsigned	winlen;
+	// timing
+	struct timespec	sent;		// last line sent
+	struct timespec	until;		// end of pause or wait
+	int		measuring;	// response time pending
+} SESSION_T;
+
+static SESSION_T sess[MAXSESS];
+static int epollfd;
+
+/***********************************************************************
+* settings
+***********************************************************************/
+static const char *server = "127.0.0.1";
+static unsigned port = 8023;
+static int nsess = 1;
+static int loops = 1;
+static int ramp = 100;		// ms between session starts
+static int waitmax = 30000;	// ms to wait for expected output
+static const char *termtype = "ANSI";
+static unsigned cols = 80, rows = 25;
+static int verbose = 0;
+
+/***********************************************************************
+* statistics
+***********************************************************************/
+static unsigned *sample;	// response times in microseconds
+static unsigned nsample, maxsample;
+static unsigned hist[NHIST];
+static unsigned timeouts, failures;
+static unsigned long long bytesin, bytesout;
+
+/***********************************************************************
+* time helpers
+***********************************************************************/
+static long long usec(const struct timespec *a, const struct timespec *b) {
+	return (b->tv_sec - a->tv_sec) * 1000000LL + (b->tv_nsec - a->tv_nsec) / 1000;
+}
+
+static void later(struct timespec *t, const struct timespec *now, int ms) {
+	t->tv_sec = now->tv_sec + ms / 1000;
+	t->tv_nsec = now->tv_nsec + (ms % 1000) * 1000000L;
+	if (t->tv_nsec >= 1000000000L) {
+		t->tv_nsec -= 1000000000L;
+		t->tv_sec++;
+	}
+}
+
+static int reached(const struct timespec *t, const struct timespec *now) {
+	return usec(t, now) >= 0;
+}
+
+/***********************************************************************
+* record a response time
+***********************************************************************/
+static void record(unsigned us) {
+	unsigned b = 0;
+
+	if (nsample >= maxsample) {
+		maxsample = maxsample ? maxsample * 2 : 1024;
+		sample = (unsigned*)realloc(sample, maxsample * sizeof *sample);
+		if (sample == NULL) {
+			perror("tsload samples");
+			exit(2);
+		}
+	}
+	sample[nsample++] = us;
+	while (us > 1 && b < NHIST-1) {
+		us >>= 1;
+		b++;
+	}
+	hist[b]++;
+}
+
+/***********************************************************************
+* read the script
+***********************************************************************/
+static int script_read(const char *name) {
+	FILE *fp;
+	char buf[LINELEN+2];
+	char *p;
+	STEP_T *s;
+
+	fp = fopen(name, "r");
+	if (fp == NULL) {
+		perror(name);
+		return 1;
+	}
+	while (fgets(buf, sizeof buf, fp) != NULL) {
+		p = strchr(buf, '\n');
+		if (p)
+			*p = 0;
+		p = strchr(buf, '\r');
+		if (p)
+			*p = 0;
+		if (buf[0] == 0 || buf[0] == '#')
+			continue;
+		if (nsteps >= MAXSTEPS) {
+			fprintf(stderr, "%s: more than %d lines\n", name, MAXSTEPS);
+			break;
+		}
+		s = script + nsteps;
+		switch (buf[0]) {
+		case '>': s->code = st_send; break;
+		case '<': s->code = st_expect; break;
+		case '=': s->code = st_pause; s->ms = atoi(buf+1); break;
+		default:
+			fprintf(stderr, "%s: unknown line '%s'\n", name, buf);
+			continue;
+		}
+		strncpy(s->text, buf+1, LINELEN-1);
+		nsteps++;
+	}
+	fclose(fp);
+	return nsteps == 0;
+}
+
+/***********************************************************************
+* Socket Write (all or nothing)
+***********************************************************************/
+static int sess_write(SESSION_T *s, const void *buf, int len) {
+	int cnt = write(s->sock, buf, len);
+
+	if (cnt != len) {
+		if (verbose)
+			perror("tsload write");
+		return -1;
+	}
+	bytesout += cnt;
+	return 0;
+}
+
+/***********************************************************************
+* Session Close
+***********************************************************************/
+static void sess_close(SESSION_T *s, int failed) {
+	if (s->sock > 2)
+		close(s->sock);
+	s->sock = -1;
+	s->done = 1;
+	if (failed)
+		failures++;
+}
+
+/***********************************************************************
+* answer TELNET commands and sub negotiations
+***********************************************************************/
+static void telnet_answer(SESSION_T *s) {
+	unsigned char buf[40];
+	unsigned char *p = buf;
+	unsigned char cmd = s->sub[0], opt = s->sub[1];
+
+	if (cmd == TN_DO) {
+		*p++ = TN_IAC;
+		if (opt == TN_TERMTYPE) {
+			*p++ = TN_WILL; *p++ = opt;
+		} else if (opt == TN_WINDOWSIZE) {
+			*p++ = TN_WILL; *p++ = opt;
+			*p++ = TN_IAC; *p++ = TN_SUB; *p++ = opt;
+			*p++ = cols >> 8; *p++ = cols;
+			*p++ = rows >> 8; *p++ = rows;
+			*p++ = TN_IAC; *p++ = TN_END;
+		} else {
+			*p++ = TN_WONT; *p++ = opt;
+		}
+	} else if (cmd == TN_WILL) {
+		*p++ = TN_IAC;
+		*p++ = opt == TN_ECHO ? TN_DO : TN_DONT;
+		*p++ = opt;
+	} else if (cmd == TN_SUB && opt == TN_TERMTYPE && s->subidx > 2 && s->sub[2] == 1) {
+		// SEND - answer with IS
+		*p++ = TN_IAC; *p++ = TN_SUB; *p++ = opt; *p++ = 0;
+		p += sprintf((char*)p, "%s", termtype);
+		*p++ = TN_IAC; *p++ = TN_END;
+	}
+	if (p > buf && sess_write(s, buf, p-buf) < 0)
+		sess_close(s, 1);
+}
+
+/***********************************************************************
+* handle received data
+* TELNET escapes are answered, ANSI escapes and controls are dropped,
+* printable characters are remembered for matching
+***********************************************************************/
+static void sess_input(SESSION_T *s, unsigned char *buf, int len) {
+	int i;
+	unsigned char ch;
+
+	for (i=0; i<len; i++) {
+		ch = buf[i];
+		if (ch == TN_IAC && !s->lastiac) {
+			s->lastiac = 1;
+			continue;
+		}
+		if (s->lastiac) {
+			s->lastiac = 0;
+			if (ch == TN_IAC) {
+				// double IAC is data
+			} else {
+				if (ch == TN_WILL || ch == TN_WONT || ch == TN_DO || ch == TN_DONT)
+					s->escape = had_cmd;
+				else if (ch == TN_SUB)
+					s->escape = had_sub;
+				else {
+					if (ch == TN_END)
+						telnet_answer(s);
+					s->escape = none;
+				}
+				s->sub[0] = ch;
+				s->subidx = 1;
+				continue;
+			}
+		}
+		if (s->escape == had_cmd) {
+			s->sub[1] = ch;
+			s->subidx = 2;
+			s->escape = none;
+			telnet_answer(s);
+			continue;
+		}
+		if (s->escape == had_sub) {
+			if (s->subidx < SUBLEN)
+				s->sub[s->subidx++] = ch;
+			continue;
+		}
+		// plain data
+		if (ch == ESC) {
+			s->ansiesc = 1;
+			continue;
+		}
+		if (s->ansiesc) {
+			// sequence ends with a final character
+			if (ch != '[' && ch >= 0x40 && ch <= 0x7e)
+				s->ansiesc = 0;
+			continue;
+		}
+		if (verbose > 1)
+			putchar(ch);
+		if (ch < 0x20 && ch != CR)
+			continue;
+		if (ch == CR)
+			ch = ' ';
+		if (s->winlen >= WINLEN-1) {
+			// keep the newer half
+			memmove(s->win, s->win + WINLEN/2, s->winlen - WINLEN/2);
+			s->winlen -= WINLEN/2;
+		}
+		s->win[s->winlen++] = ch;
+		s->win[s->winlen] = 0;
+	}
+}
+
+/***********************************************************************
+* Session Open
+* each repetition of the script is a new connection
+***********************************************************************/
+static int sess_open(SESSION_T *s, int index) {
+	struct sockaddr_in addr;
+	struct epoll_event ev;
+	int one = 1, loop = s->loop;
+
+	memset(s, 0, sizeof *s);
+	s->loop = loop;
+	s->sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (s->sock < 0) {
+		perror("tsload socket");
+		return -1;
+	}
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, server, &addr.sin_addr) <= 0) {
+		fprintf(stderr, "tsload: %s is not a numeric address\n", server);
+		exit(2);
+	}
+	if (connect(s->sock, (struct sockaddr*)&addr, sizeof addr) < 0) {
+		perror("tsload connect");
+		sess_close(s, 1);
+		return -1;
+	}
+	setsockopt(s->sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+	fcntl(s->sock, F_SETFL, O_NONBLOCK);
+	ev.events = EPOLLIN;
+	ev.data.u32 = index;
+	epoll_ctl(epollfd, EPOLL_CTL_ADD, s->sock, &ev);
+	return 0;
+}
+
+/***********************************************************************
+* prepare a script line
+***********************************************************************/
+static void step_enter(SESSION_T *s, const struct timespec *now) {
+	if (s->step >= nsteps) {
+		// script done, next repetition on a new connection
+		sess_close(s, 0);
+		if (++s->loop >= loops || sess_open(s, s - sess) < 0)
+			return;
+	}
+	switch (script[s->step].code) {
+	case st_pause:
+		later(&s->until, now, script[s->step].ms);
+		break;
+	case st_expect:
+		later(&s->until, now, waitmax);
+		break;
+	default:
+		break;
+	}
+}
+
+/***********************************************************************
+* run the script of a session as far as possible
+***********************************************************************/
+static void sess_run(SESSION_T *s, const struct timespec *now) {
+	STEP_T *st;
+	char buf[LINELEN+2];
+	int len;
+
+	while (!s->done) {
+		st = script + s->step;
+		switch (st->code) {
+		case st_send:
+			len = sprintf(buf, "%s\r", st->text);
+			if (sess_write(s, buf, len) < 0) {
+				sess_close(s, 1);
+				return;
+			}
+			s->sent = *now;
+			s->measuring = 1;
+			s->winlen = 0;
+			s->win[0] = 0;
+			break;
+		case st_expect:
+			if (strstr(s->win, st->text)) {
+				if (s->measuring)
+					record(usec(&s->sent, now));
+				s->measuring = 0;
+				s->winlen = 0;
+				s->win[0] = 0;
+			} else if (reached(&s->until, now)) {
+				if (verbose)
+					fprintf(stderr, "session %d: no '%s'\n", (int)(s - sess), st->text);
+				timeouts++;
+				s->measuring = 0;
+			} else {
+				return;
+			}
+			break;
+		case st_pause:
+			if (!reached(&s->until, now))
+				return;
+			break;
+		}
+		s->step++;
+		step_enter(s, now);
+	}
+}
+
+/***********************************************************************
+* percentile from sorted samples
+***********************************************************************/
+static int compare(const void *a, const void *b) {
+	unsigned x = *(const unsigned*)a, y = *(const unsigned*)b;
+	return x < y ? -1 : x > y;
+}
+
+static double pct(double p) {
+	unsigned i;
+
+	if (nsample == 0)
+		return 0;
+	i = (unsigned)(p * (nsample - 1) + 0.5);
+	return sample[i] / 1000.0;
+}
+
+/***********************************************************************
+* print the results
+***********************************************************************/
+static void report(double secs) {
+	unsigned i, max = 0;
+	unsigned long long sum = 0;
+	int width;
+
+	qsort(sample, nsample, sizeof *sample, compare);
+	for (i=0; i<nsample; i++)
+		sum += sample[i];
+	printf("sessions %d, repetitions %d, %.1f seconds\n", nsess, loops, secs);
+	printf("responses %u (%.1f/s), timeouts %u, failed sessions %u\n",
+		nsample, secs > 0 ? nsample / secs : 0.0, timeouts, failures);
+	printf("bytes in %llu (%.0f/s), out %llu (%.0f/s)\n",
+		bytesin, secs > 0 ? bytesin / secs : 0.0,
+		bytesout, secs > 0 ? bytesout / secs : 0.0);
+	if (nsample == 0)
+		return;
+	printf("response ms: min %.3f p50 %.3f p90 %.3f p99 %.3f max %.3f avg %.3f\n",
+		pct(0), pct(0.5), pct(0.9), pct(0.99), pct(1),
+		sum / 1000.0 / nsample);
+
+	for (i=0; i<NHIST; i++)
+		if (hist[i] > max)
+			max = hist[i];
+	for (i=0; i<NHIST; i++) {
+		if (hist[i] == 0)
+			continue;
+		width = (int)((hist[i] * 50ULL + max - 1) / max);
+		printf("%10u us %8u %.*s\n", 1u << i, hist[i], width,
+			"##################################################");
+	}
+}
+
+/***********************************************************************
+* main
+***********************************************************************/
+int main(int argc, char *argv[]) {
+	struct epoll_event ev[16];
+	struct timespec start, now, next;
+	unsigned char buf[BUFLEN];
+	int opt, n, i, cnt, started = 0, active;
+	SESSION_T *s;
+
+	while ((opt = getopt(argc, argv, "s:p:n:r:d:w:t:g:v")) != -1) {
+		switch (opt) {
+		case 's':
+			server = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'n':
+			nsess = atoi(optarg);
+			if (nsess < 1 || nsess > MAXSESS) {
+				fprintf(stderr, "1 to %d sessions\n", MAXSESS);
+				exit(2);
+			}
+			break;
+		case 'r':
+			loops = atoi(optarg);
+			break;
+		case 'd':
+			ramp = atoi(optarg);
+			break;
+		case 'w':
+			waitmax = atoi(optarg);
+			break;
+		case 't':
+			termtype = optarg;
+			break;
+		case 'g':
+			sscanf(optarg, "%ux%u", &cols, &rows);
+			break;
+		case 'v':
+			verbose++;
+			break;
+		default: /* '?' */
+			fprintf(stderr,
+				"Usage: %s [options] <script>\n"
+				"\t-s\t<server>\tnumeric address (127.0.0.1)\n"
+				"\t-p\t<port>\t\t23 = B9352, 8023 = TELETYPE (8023)\n"
+				"\t-n\t<sessions>\tconcurrent sessions (1)\n"
+				"\t-r\t<count>\t\tscript repetitions per session (1)\n"
+				"\t-d\t<ms>\t\tdelay between session starts (100)\n"
+				"\t-w\t<ms>\t\tmaximum wait for expected output (30000)\n"
+				"\t-t\t<type>\t\tterminal type (ANSI)\n"
+				"\t-g\t<cols>x<rows>\twindow size (80x25)\n"
+				"\t-v\t\t\tverbose, twice shows output\n"
+				, argv[0]);
+			exit(2);
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "%s: script missing\n", argv[0]);
+		exit(2);
+	}
+	if (script_read(argv[optind]))
+		exit(2);
+
+	epollfd = epoll_create1(0);
+	if (epollfd < 0) {
+		perror("tsload epoll");
+		exit(2);
+	}
+	for (i=0; i<nsess; i++)
+		sess[i].done = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	next = start;
+loop:
+	n = epoll_wait(epollfd, ev, 16, 10);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i=0; i<n; i++) {
+		s = sess + ev[i].data.u32;
+		cnt = read(s->sock, buf, sizeof buf);
+		if (cnt <= 0) {
+			if (cnt < 0 && errno == EAGAIN)
+				continue;
+			if (verbose)
+				fprintf(stderr, "session %u closed by peer\n", ev[i].data.u32);
+			sess_close(s, 1);
+			continue;
+		}
+		bytesin += cnt;
+		sess_input(s, buf, cnt);
+	}
+
+	// start the next session
+	if (started < nsess && reached(&next, &now)) {
+		s = sess + started;
+		if (sess_open(s, started) == 0)
+			step_enter(s, &now);
+		started++;
+		later(&next, &now, ramp);
+	}
+
+	// advance all scripts
+	active = 0;
+	for (i=0; i<started; i++) {
+		s = sess + i;
+		sess_run(s, &now);
+		if (!s->done)
+			active++;
+	}
+	if (active > 0 || started < nsess)
+		goto loop;
+
+	report(usec(&start, &now) / 1e6);
+	return failures > 0;
+}
+